@@ -110,6 +110,7 @@
 #include "ruleset.h"
 #include "parserif.h"
 #include "statsobj.h"
+#include "msgtrace.h"
 
 #pragma GCC diagnostic ignored "-Wswitch-enum"
 
@@ -1387,6 +1388,13 @@ processBatchMain(void *__restrict__ const pVoid,
 	}
 
 	iRet = actionCommit(pAction, pWti);
+
+	if(msgtraceSampleRate) {
+		for(i = 0 ; i < batchNumMsgs(pBatch) ; ++i) {
+			if(batchIsValidElem(pBatch, i))
+				msgtraceActEvt(pBatch->pElem[i].pMsg, pAction->iActionNbr, MSGTRACE_ACT_DONE);
+		}
+	}
 	RETiRet;
 }
 
@@ -1505,9 +1513,11 @@ doSubmitToActionQ(action_t * const pAction, wti_t * const pWti, msg_t *pMsg)
 	}
 
 	STATSCOUNTER_INC(pAction->ctrProcessed, pAction->mutCtrProcessed);
+	msgtraceActEvt(pMsg, pAction->iActionNbr, MSGTRACE_ACT_ENQ);
 	if(pAction->pQueue->qType == QUEUETYPE_DIRECT) {
 		ttNow.year = 0;
 		iRet = processMsgMain(pAction, pWti, pMsg, &ttNow);
+		msgtraceActEvt(pMsg, pAction->iActionNbr, MSGTRACE_ACT_DONE);
 	} else {/* in this case, we do single submits to the queue. 
 		 * TODO: optimize this, we may do at least a multi-submit!
 		 */
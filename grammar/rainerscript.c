@@ -50,6 +50,7 @@
 #include "ruleset.h"
 #include "msg.h"
 #include "wti.h"
+#include "ratelimit.h"
 #include "unicode-helper.h"
 
 #pragma GCC diagnostic ignored "-Wswitch-enum"
@@ -1868,6 +1869,19 @@ doFuncCall(struct cnffunc *__restrict__ const func, struct var *__restrict__ con
 		if(bMustFree) free(str);
 		varFreeMembers(&r[1]);
 		break;
+	case CNFFUNC_RATELIMIT:
+		ret->datatype = 'N';
+		if(func->funcdata == NULL) {
+			ret->d.n = 1;
+			break;
+		}
+		cnfexprEval(func->expr[0], &r[0], usrptr);
+		str = (char*) var2CString(&r[0], &bMustFree);
+		ret->d.n = ratelimitKeyCheck(func->funcdata, (uchar*)str,
+				((msg_t*)usrptr)->ttGenTime);
+		if(bMustFree) free(str);
+		varFreeMembers(&r[0]);
+		break;
 	default:
 		if(Debug) {
 			char *fname = es_str2cstr(func->fname, NULL);
@@ -2517,6 +2531,10 @@ cnffuncDestruct(struct cnffunc *func)
 			if(func->funcdata != NULL)
 				regexp.regfree(func->funcdata);
 			break;
+		case CNFFUNC_RATELIMIT:
+			if(func->funcdata != NULL)
+				ratelimitDestruct(func->funcdata);
+			break;
 		default:break;
 	}
 	if(func->destructable_funcdata) {
@@ -3920,6 +3938,12 @@ funcName2ID(es_str_t *fname, unsigned short nParams)
 			"but is %d.");
 	} else if(FUNC_NAME("random")) {
 		GENERATE_FUNC("random", 1, CNFFUNC_RANDOM);
+	} else if(FUNC_NAME("ratelimit")) {
+		GENERATE_FUNC_WITH_NARG_RANGE("ratelimit", 3, 4, CNFFUNC_RATELIMIT,
+			"number of parameters for %s() must either be "
+			"three (key, interval, burst) or "
+			"four (key, interval, burst, dyn_stats_bucket) "
+			"but is %d.");
 	} else {
 		return CNFFUNC_INVALID;
 	}
@@ -4095,6 +4119,57 @@ finalize_it:
 	RETiRet;
 }
 
+/* ratelimit(key, interval, burst[, bucket]) keeps a keyed ratelimiter
+ * as its function data. interval, burst and bucket must be constants.
+ */
+static rsRetVal
+initFunc_ratelimit(struct cnffunc *func)
+{
+	ratelimit_t *ratelimit = NULL;
+	uchar *bucket = NULL;
+	long long interval, burst;
+	DEFiRet;
+
+	func->destructable_funcdata = 0;
+	func->funcdata = NULL;
+
+	if(func->expr[1]->nodetype != 'N' || func->expr[2]->nodetype != 'N') {
+		parser_errmsg("ratelimit(): interval and burst (param 2 and 3) must be constant numbers");
+		FINALIZE;
+	}
+	interval = ((struct cnfnumval*) func->expr[1])->val;
+	burst = ((struct cnfnumval*) func->expr[2])->val;
+	if(interval < 1 || interval > 65535 || burst < 1 || burst > 65535) {
+		parser_errmsg("ratelimit(): interval and burst must be in the range 1..65535");
+		FINALIZE;
+	}
+
+	if(func->nParams == 4) {
+		if(func->expr[3]->nodetype != 'S') {
+			parser_errmsg("ratelimit(): dyn_stats bucket name (param 4) must be a constant string");
+			FINALIZE;
+		}
+		CHKmalloc(bucket = (uchar*)es_str2cstr(((struct cnfstringval*) func->expr[3])->estr, NULL));
+		if(dynstats_findBucket(bucket) == NULL) {
+			parser_errmsg("ratelimit(): dyn-stats bucket '%s' not found - ignored", bucket);
+			free(bucket);
+			bucket = NULL;
+		}
+	}
+
+	CHKiRet(ratelimitNew(&ratelimit, "ratelimit()", NULL));
+	ratelimitSetLinuxLike(ratelimit, (unsigned short) interval, (unsigned short) burst);
+	CHKiRet(ratelimitSetKeyed(ratelimit, NULL, 0, bucket));
+	func->funcdata = ratelimit;
+	ratelimit = NULL;
+
+finalize_it:
+	if(ratelimit != NULL)
+		ratelimitDestruct(ratelimit);
+	free(bucket);
+	RETiRet;
+}
+
 struct cnffunc *
 cnffuncNew(es_str_t *fname, struct cnffparamlst* paramlst)
 {
@@ -4142,6 +4217,9 @@ cnffuncNew(es_str_t *fname, struct cnffparamlst* paramlst)
 			case CNFFUNC_DYN_INC:
 				initFunc_dyn_stats(func);
 				break;
+			case CNFFUNC_RATELIMIT:
+				initFunc_ratelimit(func);
+				break;
 			default:break;
 		}
 	}
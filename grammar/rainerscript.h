@@ -288,7 +288,8 @@ enum cnffuncid {
 	CNFFUNC_REPLACE,
 	CNFFUNC_WRAP,
 	CNFFUNC_RANDOM,
-	CNFFUNC_DYN_INC
+	CNFFUNC_DYN_INC,
+	CNFFUNC_RATELIMIT
 };
 
 struct cnffunc {
@@ -0,0 +1,895 @@
+/* imafpacket.c
+ * This is an input module for syslog over UDP which receives datagrams
+ * via a Linux AF_PACKET socket with a TPACKET_V3 memory-mapped ring
+ * buffer instead of a regular UDP socket. The kernel fills complete
+ * blocks of packets into the ring, which we then process in one go,
+ * without a system call per datagram (or batch of datagrams).
+ *
+ * Only datagrams destined to the configured port are delivered into
+ * the ring, this is done via a socket filter. IP and UDP headers are
+ * parsed here. Note that IP fragments are NOT reassembled (and thus
+ * dropped by the filter) and IPv6 extension headers are not supported.
+ * Also note that, as we capture packets, no UDP socket is bound to the
+ * port - so the kernel will usually send ICMP port unreachable messages
+ * to the senders, unless a (dummy) listener exists or ICMP is filtered.
+ *
+ * NOTE: read comments in module-template.h to understand how this file
+ *       works!
+ *
+ * This file is part of rsyslog.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <linux/if_packet.h>
+#include <linux/if_ether.h>
+#include <linux/filter.h>
+#if HAVE_SYS_PRCTL_H
+#  include <sys/prctl.h>
+#endif
+#include "rsyslog.h"
+#include "dirty.h"
+#include "net.h"
+#include "module-template.h"
+#include "srUtils.h"
+#include "errmsg.h"
+#include "glbl.h"
+#include "msg.h"
+#include "datetime.h"
+#include "prop.h"
+#include "ruleset.h"
+#include "statsobj.h"
+#include "ratelimit.h"
+#include "unicode-helper.h"
+
+MODULE_TYPE_INPUT
+MODULE_TYPE_NOKEEP
+MODULE_CNFNAME("imafpacket")
+
+/* defines */
+#define BLOCK_SIZE_DFLT (1024 * 1024)	/* size of a ring block */
+#define BLOCK_COUNT_DFLT 64		/* number of blocks in ring */
+#define BLOCK_TIMEOUT_DFLT 10		/* ms after which the kernel hands over a non-full block */
+#define FRAME_SIZE 2048			/* only needed for the ring setup, V3 does not use frames */
+
+/* Module static data */
+DEF_IMOD_STATIC_DATA
+DEFobjCurrIf(errmsg)
+DEFobjCurrIf(glbl)
+DEFobjCurrIf(net)
+DEFobjCurrIf(datetime)
+DEFobjCurrIf(prop)
+DEFobjCurrIf(ruleset)
+DEFobjCurrIf(statsobj)
+
+
+static struct lstn_s {
+	struct lstn_s *next;
+	int sock;		/* AF_PACKET socket */
+	uchar *ring;		/* mmap()ed ring buffer */
+	size_t lenRing;
+	unsigned blockSize;
+	unsigned blockCount;
+	unsigned currBlock;	/* next block to be processed */
+	ruleset_t *pRuleset;	/* bound ruleset */
+	prop_t *pInputName;
+	statsobj_t *stats;	/* listener stats */
+	ratelimit_t *ratelimiter;
+	uchar *dfltTZ;
+	STATSCOUNTER_DEF(ctrSubmit, mutCtrSubmit)
+	STATSCOUNTER_DEF(ctrBlocks, mutCtrBlocks)
+	STATSCOUNTER_DEF(ctrTruncated, mutCtrTruncated)
+	STATSCOUNTER_DEF(ctrKernelDrops, mutCtrKernelDrops)
+} *lcnfRoot = NULL, *lcnfLast = NULL;
+
+
+static int bDoACLCheck;			/* are ACL checks neeed? Cached once immediately before listener startup */
+static int iMaxLine;			/* maximum UDP message size supported */
+static time_t ttLastDiscard = 0;	/* timestamp when a message from a non-permitted sender was last discarded */
+static time_t lastPktTsSec;		/* second of the last packet timestamp converted ... */
+static struct syslogTime lastPktTs;	/* ... and its conversion result */
+
+struct instanceConf_s {
+	uchar *pszInterface;		/* interface to capture on, NULL means all */
+	int port;			/* UDP destination port to capture */
+	uchar *pszBindRuleset;		/* name of ruleset to bind to */
+	uchar *inputname;
+	ruleset_t *pBindRuleset;	/* ruleset to bind listener to (use system default if unspecified) */
+	uchar *dfltTZ;
+	int ratelimitInterval;
+	int ratelimitBurst;
+	uchar *ratelimitKey;		/* if set, ratelimit per key instead of per listener */
+	int ratelimitMaxKeys;
+	uchar *ratelimitKeyStats;	/* dyn_stats bucket for per-key drop counts */
+	struct instanceConf_s *next;
+};
+
+struct modConfData_s {
+	rsconf_t *pConf;		/* our overall config object */
+	instanceConf_t *root, *tail;
+	int blockSize;			/* size of a single ring block */
+	int blockCount;			/* number of blocks per ring */
+	int blockTimeout;		/* block retire timeout in ms */
+};
+static modConfData_t *loadModConf = NULL;/* modConf ptr to use for the current load process */
+static modConfData_t *runModConf = NULL;/* modConf ptr to use for the current load process */
+
+/* module-global parameters */
+static struct cnfparamdescr modpdescr[] = {
+	{ "block.size", eCmdHdlrSize, 0 },
+	{ "block.count", eCmdHdlrPositiveInt, 0 },
+	{ "block.timeout", eCmdHdlrPositiveInt, 0 }
+};
+static struct cnfparamblk modpblk =
+	{ CNFPARAMBLK_VERSION,
+	  sizeof(modpdescr)/sizeof(struct cnfparamdescr),
+	  modpdescr
+	};
+
+/* input instance parameters */
+static struct cnfparamdescr inppdescr[] = {
+	{ "port", eCmdHdlrPositiveInt, CNFPARAM_REQUIRED },
+	{ "interface", eCmdHdlrGetWord, 0 },
+	{ "defaulttz", eCmdHdlrString, 0 },
+	{ "name", eCmdHdlrGetWord, 0 },
+	{ "ratelimit.interval", eCmdHdlrInt, 0 },
+	{ "ratelimit.burst", eCmdHdlrInt, 0 },
+	{ "ratelimit.key", eCmdHdlrString, 0 },
+	{ "ratelimit.maxkeys", eCmdHdlrPositiveInt, 0 },
+	{ "ratelimit.keystats", eCmdHdlrString, 0 },
+	{ "ruleset", eCmdHdlrString, 0 }
+};
+static struct cnfparamblk inppblk =
+	{ CNFPARAMBLK_VERSION,
+	  sizeof(inppdescr)/sizeof(struct cnfparamdescr),
+	  inppdescr
+	};
+
+#include "im-helper.h" /* must be included AFTER the type definitions! */
+
+/* create input instance, set default parameters, and
+ * add it to the list of instances.
+ */
+static rsRetVal
+createInstance(instanceConf_t **pinst)
+{
+	instanceConf_t *inst;
+	DEFiRet;
+	CHKmalloc(inst = MALLOC(sizeof(instanceConf_t)));
+	inst->next = NULL;
+	inst->pBindRuleset = NULL;
+
+	inst->port = 0;
+	inst->pszInterface = NULL;
+	inst->pszBindRuleset = NULL;
+	inst->inputname = NULL;
+	inst->ratelimitBurst = 10000; /* arbitrary high limit */
+	inst->ratelimitInterval = 0; /* off */
+	inst->ratelimitKey = NULL;
+	inst->ratelimitMaxKeys = RATELIMIT_DFLT_MAXKEYS;
+	inst->ratelimitKeyStats = NULL;
+	inst->dfltTZ = NULL;
+
+	/* node created, let's add to config */
+	if(loadModConf->tail == NULL) {
+		loadModConf->tail = loadModConf->root = inst;
+	} else {
+		loadModConf->tail->next = inst;
+		loadModConf->tail = inst;
+	}
+
+	*pinst = inst;
+finalize_it:
+	RETiRet;
+}
+
+
+/* attach a socket filter which only lets pass UDP datagrams to the
+ * given port. Filter code starts at the network header, as we use a
+ * SOCK_DGRAM packet socket. Outgoing packets are dropped, as we would
+ * otherwise see everything twice on the loopback interface.
+ */
+static rsRetVal
+setPortFilter(const int sock, const int port)
+{
+	struct sock_filter code[] = {
+		/*  0 */ BPF_STMT(BPF_LD|BPF_W|BPF_ABS, SKF_AD_OFF + SKF_AD_PKTTYPE),
+		/*  1 */ BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, PACKET_OUTGOING, 16, 0),
+		/*  2 */ BPF_STMT(BPF_LD|BPF_B|BPF_ABS, 0),
+		/*  3 */ BPF_STMT(BPF_ALU|BPF_AND|BPF_K, 0xf0),
+		/*  4 */ BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, 0x40, 0, 7),
+		/* IPv4: UDP, no fragment, destination port */
+		/*  5 */ BPF_STMT(BPF_LD|BPF_B|BPF_ABS, 9),
+		/*  6 */ BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, IPPROTO_UDP, 0, 11),
+		/*  7 */ BPF_STMT(BPF_LD|BPF_H|BPF_ABS, 6),
+		/*  8 */ BPF_JUMP(BPF_JMP|BPF_JSET|BPF_K, 0x3fff, 9, 0),
+		/*  9 */ BPF_STMT(BPF_LDX|BPF_B|BPF_MSH, 0),
+		/* 10 */ BPF_STMT(BPF_LD|BPF_H|BPF_IND, 2),
+		/* 11 */ BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, port, 5, 6),
+		/* IPv6: next header must be UDP, destination port */
+		/* 12 */ BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, 0x60, 0, 5),
+		/* 13 */ BPF_STMT(BPF_LD|BPF_B|BPF_ABS, 6),
+		/* 14 */ BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, IPPROTO_UDP, 0, 3),
+		/* 15 */ BPF_STMT(BPF_LD|BPF_H|BPF_ABS, 42),
+		/* 16 */ BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, port, 0, 1),
+		/* 17 */ BPF_STMT(BPF_RET|BPF_K, 0xffffffff),
+		/* 18 */ BPF_STMT(BPF_RET|BPF_K, 0)
+	};
+	struct sock_fprog prog;
+	DEFiRet;
+
+	prog.len = sizeof(code) / sizeof(struct sock_filter);
+	prog.filter = code;
+	if(setsockopt(sock, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) != 0) {
+		errmsg.LogError(errno, RS_RET_ERR, "imafpacket: could not attach port filter");
+		ABORT_FINALIZE(RS_RET_ERR);
+	}
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* create the packet socket and its ring buffer. The socket is created
+ * without a protocol, so that it does not receive anything before it is
+ * completely set up and finally bound.
+ */
+static rsRetVal
+openRing(struct lstn_s *const lstn, instanceConf_t *const inst)
+{
+	int version = TPACKET_V3;
+	struct tpacket_req3 req;
+	struct sockaddr_ll sll;
+	void *ring;
+	DEFiRet;
+
+	lstn->sock = socket(AF_PACKET, SOCK_DGRAM, 0);
+	if(lstn->sock < 0) {
+		errmsg.LogError(errno, RS_RET_ERR, "imafpacket: could not create packet socket "
+				"(CAP_NET_RAW is required)");
+		ABORT_FINALIZE(RS_RET_ERR);
+	}
+	if(setsockopt(lstn->sock, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) != 0) {
+		errmsg.LogError(errno, RS_RET_ERR, "imafpacket: TPACKET_V3 not supported by kernel");
+		ABORT_FINALIZE(RS_RET_ERR);
+	}
+	CHKiRet(setPortFilter(lstn->sock, inst->port));
+
+	lstn->blockSize = runModConf->blockSize;
+	lstn->blockCount = runModConf->blockCount;
+	memset(&req, 0, sizeof(req));
+	req.tp_block_size = lstn->blockSize;
+	req.tp_block_nr = lstn->blockCount;
+	req.tp_frame_size = FRAME_SIZE;
+	req.tp_frame_nr = (lstn->blockSize / FRAME_SIZE) * lstn->blockCount;
+	req.tp_retire_blk_tov = runModConf->blockTimeout;
+	if(setsockopt(lstn->sock, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) != 0) {
+		errmsg.LogError(errno, RS_RET_ERR, "imafpacket: could not set up ring buffer "
+				"with %u blocks of %u bytes", lstn->blockCount, lstn->blockSize);
+		ABORT_FINALIZE(RS_RET_ERR);
+	}
+	lstn->lenRing = (size_t) lstn->blockSize * lstn->blockCount;
+	ring = mmap(NULL, lstn->lenRing, PROT_READ | PROT_WRITE, MAP_SHARED, lstn->sock, 0);
+	if(ring == MAP_FAILED) {
+		errmsg.LogError(errno, RS_RET_ERR, "imafpacket: could not mmap() ring buffer");
+		ABORT_FINALIZE(RS_RET_ERR);
+	}
+	lstn->ring = ring;
+	lstn->currBlock = 0;
+
+	memset(&sll, 0, sizeof(sll));
+	sll.sll_family = AF_PACKET;
+	sll.sll_protocol = htons(ETH_P_ALL);
+	if(inst->pszInterface != NULL) {
+		sll.sll_ifindex = if_nametoindex((char*) inst->pszInterface);
+		if(sll.sll_ifindex == 0) {
+			errmsg.LogError(errno, RS_RET_ERR, "imafpacket: unknown interface '%s'",
+					inst->pszInterface);
+			ABORT_FINALIZE(RS_RET_ERR);
+		}
+	}
+	if(bind(lstn->sock, (struct sockaddr*) &sll, sizeof(sll)) != 0) {
+		errmsg.LogError(errno, RS_RET_ERR, "imafpacket: could not bind packet socket");
+		ABORT_FINALIZE(RS_RET_ERR);
+	}
+
+finalize_it:
+	if(iRet != RS_RET_OK) {
+		if(lstn->ring != NULL) {
+			munmap(lstn->ring, lstn->lenRing);
+			lstn->ring = NULL;
+		}
+		if(lstn->sock != -1) {
+			close(lstn->sock);
+			lstn->sock = -1;
+		}
+	}
+	RETiRet;
+}
+
+
+/* This function is called when a new listener shall be added. It takes
+ * the instance config description, sets up the ring and, if that
+ * succeeds, adds it to the list of existing listeners.
+ */
+static rsRetVal
+addListner(instanceConf_t *inst)
+{
+	struct lstn_s *newlcnfinfo = NULL;
+	uchar dispname[64];
+	uchar *inputname;
+	DEFiRet;
+
+	DBGPRINTF("imafpacket: trying to capture UDP port %d on %s\n", inst->port,
+		  inst->pszInterface == NULL ? "all interfaces" : (char*) inst->pszInterface);
+
+	CHKmalloc(newlcnfinfo = (struct lstn_s*) calloc(1, sizeof(struct lstn_s)));
+	newlcnfinfo->sock = -1;
+	CHKiRet(openRing(newlcnfinfo, inst));
+	newlcnfinfo->pRuleset = inst->pBindRuleset;
+	newlcnfinfo->dfltTZ = inst->dfltTZ;
+	inputname = (inst->inputname == NULL) ? (uchar*)"imafpacket" : inst->inputname;
+	snprintf((char*)dispname, sizeof(dispname), "%s(%s:%d)", inputname,
+		 inst->pszInterface == NULL ? "*" : (char*) inst->pszInterface, inst->port);
+	dispname[sizeof(dispname)-1] = '\0'; /* just to be on the save side... */
+	CHKiRet(ratelimitNew(&newlcnfinfo->ratelimiter, (char*)dispname, NULL));
+	ratelimitSetLinuxLike(newlcnfinfo->ratelimiter, inst->ratelimitInterval, inst->ratelimitBurst);
+	if(inst->ratelimitKey != NULL) {
+		CHKiRet(ratelimitSetKeyed(newlcnfinfo->ratelimiter, inst->ratelimitKey,
+			inst->ratelimitMaxKeys, inst->ratelimitKeyStats));
+	}
+	CHKiRet(prop.Construct(&newlcnfinfo->pInputName));
+	CHKiRet(prop.SetString(newlcnfinfo->pInputName, inputname, ustrlen(inputname)));
+	CHKiRet(prop.ConstructFinalize(newlcnfinfo->pInputName));
+	/* support statistics gathering */
+	CHKiRet(statsobj.Construct(&(newlcnfinfo->stats)));
+	CHKiRet(statsobj.SetName(newlcnfinfo->stats, dispname));
+	CHKiRet(statsobj.SetOrigin(newlcnfinfo->stats, (uchar*)"imafpacket"));
+	STATSCOUNTER_INIT(newlcnfinfo->ctrSubmit, newlcnfinfo->mutCtrSubmit);
+	CHKiRet(statsobj.AddCounter(newlcnfinfo->stats, UCHAR_CONSTANT("submitted"),
+		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &(newlcnfinfo->ctrSubmit)));
+	STATSCOUNTER_INIT(newlcnfinfo->ctrBlocks, newlcnfinfo->mutCtrBlocks);
+	CHKiRet(statsobj.AddCounter(newlcnfinfo->stats, UCHAR_CONSTANT("blocks"),
+		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &(newlcnfinfo->ctrBlocks)));
+	STATSCOUNTER_INIT(newlcnfinfo->ctrTruncated, newlcnfinfo->mutCtrTruncated);
+	CHKiRet(statsobj.AddCounter(newlcnfinfo->stats, UCHAR_CONSTANT("truncated"),
+		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &(newlcnfinfo->ctrTruncated)));
+	STATSCOUNTER_INIT(newlcnfinfo->ctrKernelDrops, newlcnfinfo->mutCtrKernelDrops);
+	CHKiRet(statsobj.AddCounter(newlcnfinfo->stats, UCHAR_CONSTANT("kernel.drops"),
+		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &(newlcnfinfo->ctrKernelDrops)));
+	CHKiRet(statsobj.ConstructFinalize(newlcnfinfo->stats));
+
+	if(lcnfRoot == NULL)
+		lcnfRoot = newlcnfinfo;
+	if(lcnfLast == NULL)
+		lcnfLast = newlcnfinfo;
+	else {
+		lcnfLast->next = newlcnfinfo;
+		lcnfLast = newlcnfinfo;
+	}
+
+finalize_it:
+	if(iRet != RS_RET_OK && newlcnfinfo != NULL) {
+		if(newlcnfinfo->ratelimiter != NULL)
+			ratelimitDestruct(newlcnfinfo->ratelimiter);
+		if(newlcnfinfo->pInputName != NULL)
+			prop.Destruct(&newlcnfinfo->pInputName);
+		if(newlcnfinfo->stats != NULL)
+			statsobj.Destruct(&newlcnfinfo->stats);
+		if(newlcnfinfo->ring != NULL)
+			munmap(newlcnfinfo->ring, newlcnfinfo->lenRing);
+		if(newlcnfinfo->sock != -1)
+			close(newlcnfinfo->sock);
+		free(newlcnfinfo);
+	}
+	RETiRet;
+}
+
+
+static inline void
+std_checkRuleset_genErrMsg(__attribute__((unused)) modConfData_t *modConf, instanceConf_t *inst)
+{
+	errmsg.LogError(0, NO_ERRCODE, "imafpacket: ruleset '%s' for %s:%d not found - "
+			"using default ruleset instead", inst->pszBindRuleset,
+			inst->pszInterface == NULL ? "*" : (char*) inst->pszInterface,
+			inst->port);
+}
+
+
+/* convert the kernel capture timestamp. As with imudp kernel timestamps,
+ * we do the full conversion only once per second.
+ */
+static inline void
+pktTime2syslogTime(const struct tpacket3_hdr *const hdr, struct syslogTime *const stTime,
+	time_t *const ttGenTime)
+{
+	struct timeval tv;
+
+	if(hdr->tp_sec != lastPktTsSec) {
+		tv.tv_sec = hdr->tp_sec;
+		tv.tv_usec = hdr->tp_nsec / 1000;
+		datetime.timeval2syslogTime(&tv, &lastPktTs, TIME_IN_LOCALTIME);
+		lastPktTsSec = hdr->tp_sec;
+	}
+	*stTime = lastPktTs;
+	stTime->secfrac = hdr->tp_nsec / 1000;
+	*ttGenTime = hdr->tp_sec;
+}
+
+
+/* check if the sender is permitted. The result is cached for consecutive
+ * datagrams from the same sender. We use the UDP ACL, just like imudp.
+ */
+static inline int
+isPermitted(struct sockaddr_storage *const frominet, struct sockaddr_storage *const frominetPrev,
+	int *const pbIsPermitted)
+{
+	if(!bDoACLCheck)
+		return 1;
+	if(net.CmpHost(frominet, frominetPrev, sizeof(struct sockaddr_storage)) != 0) {
+		memcpy(frominetPrev, frominet, sizeof(struct sockaddr_storage));
+		*pbIsPermitted = net.isAllowedSender2((uchar*)"UDP", (struct sockaddr *)frominet, "", 0);
+		if(*pbIsPermitted == 0) {
+			DBGPRINTF("msg is not from an allowed sender\n");
+			if(glbl.GetOption_DisallowWarning) {
+				time_t tt;
+				datetime.GetTime(&tt);
+				if(tt > ttLastDiscard + 60) {
+					ttLastDiscard = tt;
+					errmsg.LogError(0, NO_ERRCODE,
+					"UDP message from disallowed sender discarded");
+				}
+			}
+		}
+	}
+	return *pbIsPermitted;
+}
+
+
+/* process a single captured packet. The socket filter already made sure
+ * it is a UDP datagram for our port, but we still need to check the
+ * lengths, as the capture may be truncated (if larger than the block).
+ */
+static inline rsRetVal
+processPacket(struct lstn_s *const lstn, const struct tpacket3_hdr *const hdr,
+	struct sockaddr_storage *const frominetPrev, int *const pbIsPermitted, multi_submit_t *const multiSub)
+{
+	const uchar *const pkt = (const uchar*) hdr + hdr->tp_net;
+	const uchar *udp;
+	unsigned len;
+	unsigned lenUDP;
+	struct sockaddr_storage frominet;
+	struct sockaddr_in *const sin = (struct sockaddr_in*) &frominet;
+	struct sockaddr_in6 *const sin6 = (struct sockaddr_in6*) &frominet;
+	struct syslogTime stTime;
+	time_t ttGenTime;
+	msg_t *pMsg = NULL;
+	int bPermitted;
+	DEFiRet;
+
+	len = hdr->tp_snaplen - (hdr->tp_net - hdr->tp_mac);
+	memset(&frominet, 0, sizeof(frominet));
+	if(len >= 20 && (pkt[0] >> 4) == 4) {
+		udp = pkt + (pkt[0] & 0x0f) * 4;
+		sin->sin_family = AF_INET;
+		memcpy(&sin->sin_addr, pkt + 12, 4);
+	} else if(len >= 40 && (pkt[0] >> 4) == 6) {
+		udp = pkt + 40;
+		sin6->sin6_family = AF_INET6;
+		memcpy(&sin6->sin6_addr, pkt + 8, 16);
+	} else {
+		FINALIZE; /* can not happen due to filter, but be on the safe side */
+	}
+	if(udp + 8 > pkt + len) {
+		STATSCOUNTER_INC(lstn->ctrTruncated, lstn->mutCtrTruncated);
+		FINALIZE;
+	}
+	/* ports are stored in network byte order in both header and sockaddr */
+	if(sin->sin_family == AF_INET)
+		memcpy(&sin->sin_port, udp, 2);
+	else
+		memcpy(&sin6->sin6_port, udp, 2);
+	lenUDP = (udp[4] << 8) | udp[5];
+	if(lenUDP < 8)
+		FINALIZE;
+	lenUDP -= 8;
+	if(udp + 8 + lenUDP > pkt + len) {
+		STATSCOUNTER_INC(lstn->ctrTruncated, lstn->mutCtrTruncated);
+		lenUDP = pkt + len - (udp + 8);
+	}
+	if(lenUDP == 0)
+		FINALIZE;
+	if(lenUDP > (unsigned) iMaxLine)
+		lenUDP = iMaxLine;
+
+	bPermitted = isPermitted(&frominet, frominetPrev, pbIsPermitted);
+	DBGPRINTF("imafpacket: packet len %u, acl:%d, msg:%.*s\n", lenUDP, bPermitted,
+		  (int) lenUDP, udp + 8);
+	if(bPermitted == 0)
+		FINALIZE;
+
+	pktTime2syslogTime(hdr, &stTime, &ttGenTime);
+	CHKiRet(msgConstructWithTime(&pMsg, &stTime, ttGenTime));
+	MsgSetRawMsg(pMsg, (char*) udp + 8, lenUDP);
+	MsgSetInputName(pMsg, lstn->pInputName);
+	MsgSetRuleset(pMsg, lstn->pRuleset);
+	MsgSetFlowControlType(pMsg, eFLOWCTL_NO_DELAY);
+	if(lstn->dfltTZ != NULL)
+		MsgSetDfltTZ(pMsg, (char*) lstn->dfltTZ);
+	pMsg->msgFlags  = NEEDS_PARSING | PARSE_HOSTNAME | NEEDS_DNSRESOL;
+	if(bPermitted == 2)
+		pMsg->msgFlags  |= NEEDS_ACLCHK_U; /* request ACL check after resolution */
+	CHKiRet(msgSetFromSockinfo(pMsg, &frominet));
+	CHKiRet(ratelimitAddMsg(lstn->ratelimiter, multiSub, pMsg));
+	STATSCOUNTER_INC(lstn->ctrSubmit, lstn->mutCtrSubmit);
+
+finalize_it:
+	if(iRet != RS_RET_OK) {
+		if(pMsg != NULL) {
+			msgDestruct(&pMsg);
+		}
+	}
+	RETiRet;
+}
+
+
+/* process all blocks that the kernel has handed over to us. All messages
+ * of a block are submitted as one batch, after which the block is
+ * returned to the kernel (messages hold a copy of the data).
+ */
+static void
+processRing(struct lstn_s *const lstn, struct sockaddr_storage *const frominetPrev, int *const pbIsPermitted)
+{
+	struct tpacket_block_desc *pbd;
+	struct tpacket3_hdr *hdr;
+	struct tpacket_stats_v3 pktStats;
+	socklen_t lenStats;
+	msg_t *pMsgs[CONF_NUM_MULTISUB];
+	multi_submit_t multiSub;
+	unsigned i;
+
+	multiSub.ppMsgs = pMsgs;
+	multiSub.maxElem = CONF_NUM_MULTISUB;
+	multiSub.nElem = 0;
+	while(1) {
+		pbd = (struct tpacket_block_desc*) (lstn->ring + (size_t) lstn->currBlock * lstn->blockSize);
+		if((pbd->hdr.bh1.block_status & TP_STATUS_USER) == 0)
+			break;
+		__sync_synchronize(); /* block content must not be read before status */
+		hdr = (struct tpacket3_hdr*) ((uchar*) pbd + pbd->hdr.bh1.offset_to_first_pkt);
+		for(i = 0 ; i < pbd->hdr.bh1.num_pkts ; ++i) {
+			processPacket(lstn, hdr, frominetPrev, pbIsPermitted, &multiSub);
+			hdr = (struct tpacket3_hdr*) ((uchar*) hdr + hdr->tp_next_offset);
+		}
+		multiSubmitFlush(&multiSub);
+		__sync_synchronize();
+		pbd->hdr.bh1.block_status = TP_STATUS_KERNEL;
+		lstn->currBlock = (lstn->currBlock + 1) % lstn->blockCount;
+		STATSCOUNTER_INC(lstn->ctrBlocks, lstn->mutCtrBlocks);
+	}
+
+	/* note: reading the statistics resets them inside the kernel */
+	lenStats = sizeof(pktStats);
+	if(getsockopt(lstn->sock, SOL_PACKET, PACKET_STATISTICS, &pktStats, &lenStats) == 0
+	   && pktStats.tp_drops > 0) {
+		STATSCOUNTER_ADD(lstn->ctrKernelDrops, lstn->mutCtrKernelDrops, pktStats.tp_drops);
+	}
+}
+
+
+/* This function is called to gather input. We have a single thread
+ * which waits on all rings; a ring becomes readable as soon as the
+ * kernel has handed over a block (full or retired by timeout).
+ */
+BEGINrunInput
+	struct pollfd *fds = NULL;
+	struct lstn_s *lstn;
+	struct sockaddr_storage frominetPrev;
+	int bIsPermitted;
+	int nLstn;
+	int i;
+CODESTARTrunInput
+	/* start "name caching" algo by making sure the previous system indicator
+	 * is invalidated.
+	 */
+	bIsPermitted = 0;
+	memset(&frominetPrev, 0, sizeof(frominetPrev));
+	lastPktTsSec = 0;
+
+	nLstn = 0;
+	for(lstn = lcnfRoot ; lstn != NULL ; lstn = lstn->next)
+		++nLstn;
+	CHKmalloc(fds = calloc(nLstn, sizeof(struct pollfd)));
+	i = 0;
+	for(lstn = lcnfRoot ; lstn != NULL ; lstn = lstn->next) {
+		fds[i].fd = lstn->sock;
+		fds[i].events = POLLIN | POLLERR;
+		++i;
+	}
+
+	while(pThrd->bShallStop != RSTRUE) {
+		/* blocks may already be waiting, e.g. filled before we started */
+		for(lstn = lcnfRoot ; lstn != NULL ; lstn = lstn->next)
+			processRing(lstn, &frominetPrev, &bIsPermitted);
+		if(pThrd->bShallStop == RSTRUE)
+			break;
+		if(poll(fds, nLstn, -1) < 0 && errno != EINTR) {
+			errmsg.LogError(errno, NO_ERRCODE, "imafpacket: poll() failed");
+			ABORT_FINALIZE(RS_RET_IO_ERROR);
+		}
+	}
+
+finalize_it:
+	free(fds);
+ENDrunInput
+
+
+BEGINnewInpInst
+	struct cnfparamvals *pvals;
+	instanceConf_t *inst;
+	int i;
+CODESTARTnewInpInst
+	DBGPRINTF("newInpInst (imafpacket)\n");
+
+	if((pvals = nvlstGetParams(lst, &inppblk, NULL)) == NULL) {
+		ABORT_FINALIZE(RS_RET_MISSING_CNFPARAMS);
+	}
+	if(Debug) {
+		dbgprintf("input param blk in imafpacket:\n");
+		cnfparamsPrint(&inppblk, pvals);
+	}
+
+	CHKiRet(createInstance(&inst));
+	for(i = 0 ; i < inppblk.nParams ; ++i) {
+		if(!pvals[i].bUsed)
+			continue;
+		if(!strcmp(inppblk.descr[i].name, "port")) {
+			inst->port = (int) pvals[i].val.d.n;
+		} else if(!strcmp(inppblk.descr[i].name, "interface")) {
+			inst->pszInterface = (uchar*)es_str2cstr(pvals[i].val.d.estr, NULL);
+		} else if(!strcmp(inppblk.descr[i].name, "name")) {
+			inst->inputname = (uchar*)es_str2cstr(pvals[i].val.d.estr, NULL);
+		} else if(!strcmp(inppblk.descr[i].name, "defaulttz")) {
+			inst->dfltTZ = (uchar*)es_str2cstr(pvals[i].val.d.estr, NULL);
+		} else if(!strcmp(inppblk.descr[i].name, "ruleset")) {
+			inst->pszBindRuleset = (uchar*)es_str2cstr(pvals[i].val.d.estr, NULL);
+		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.burst")) {
+			inst->ratelimitBurst = (int) pvals[i].val.d.n;
+		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.interval")) {
+			inst->ratelimitInterval = (int) pvals[i].val.d.n;
+		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.key")) {
+			inst->ratelimitKey = (uchar*)es_str2cstr(pvals[i].val.d.estr, NULL);
+		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.maxkeys")) {
+			inst->ratelimitMaxKeys = (int) pvals[i].val.d.n;
+		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.keystats")) {
+			inst->ratelimitKeyStats = (uchar*)es_str2cstr(pvals[i].val.d.estr, NULL);
+		} else {
+			dbgprintf("imafpacket: program error, non-handled "
+			  "param '%s'\n", inppblk.descr[i].name);
+		}
+	}
+	if(inst->port > 65535) {
+		errmsg.LogError(0, RS_RET_INVALID_PARAMS, "imafpacket: invalid port %d", inst->port);
+		ABORT_FINALIZE(RS_RET_INVALID_PARAMS);
+	}
+
+finalize_it:
+CODE_STD_FINALIZERnewInpInst
+	cnfparamvalsDestruct(pvals, &inppblk);
+ENDnewInpInst
+
+
+BEGINbeginCnfLoad
+CODESTARTbeginCnfLoad
+	loadModConf = pModConf;
+	pModConf->pConf = pConf;
+	/* init our settings */
+	loadModConf->blockSize = BLOCK_SIZE_DFLT;
+	loadModConf->blockCount = BLOCK_COUNT_DFLT;
+	loadModConf->blockTimeout = BLOCK_TIMEOUT_DFLT;
+ENDbeginCnfLoad
+
+
+BEGINsetModCnf
+	struct cnfparamvals *pvals = NULL;
+	int i;
+CODESTARTsetModCnf
+	pvals = nvlstGetParams(lst, &modpblk, NULL);
+	if(pvals == NULL) {
+		errmsg.LogError(0, RS_RET_MISSING_CNFPARAMS, "imafpacket: error processing module "
+				"config parameters [module(...)]");
+		ABORT_FINALIZE(RS_RET_MISSING_CNFPARAMS);
+	}
+
+	if(Debug) {
+		dbgprintf("module (global) param blk for imafpacket:\n");
+		cnfparamsPrint(&modpblk, pvals);
+	}
+
+	for(i = 0 ; i < modpblk.nParams ; ++i) {
+		if(!pvals[i].bUsed)
+			continue;
+		if(!strcmp(modpblk.descr[i].name, "block.size")) {
+			loadModConf->blockSize = (int) pvals[i].val.d.n;
+		} else if(!strcmp(modpblk.descr[i].name, "block.count")) {
+			loadModConf->blockCount = (int) pvals[i].val.d.n;
+		} else if(!strcmp(modpblk.descr[i].name, "block.timeout")) {
+			loadModConf->blockTimeout = (int) pvals[i].val.d.n;
+		} else {
+			dbgprintf("imafpacket: program error, non-handled "
+			  "param '%s' in beginCnfLoad\n", modpblk.descr[i].name);
+		}
+	}
+finalize_it:
+	if(pvals != NULL)
+		cnfparamvalsDestruct(pvals, &modpblk);
+ENDsetModCnf
+
+
+BEGINendCnfLoad
+CODESTARTendCnfLoad
+	loadModConf = NULL; /* done loading */
+ENDendCnfLoad
+
+
+BEGINcheckCnf
+	instanceConf_t *inst;
+	long pageSize;
+CODESTARTcheckCnf
+	/* the kernel requires the block size to be a multiple of the page size */
+	pageSize = sysconf(_SC_PAGESIZE);
+	if(pModConf->blockSize < pageSize || pModConf->blockSize % pageSize != 0) {
+		pModConf->blockSize = ((pModConf->blockSize + pageSize - 1) / pageSize) * pageSize;
+		errmsg.LogError(0, RS_RET_INVALID_PARAMS, "imafpacket: block.size must be a "
+				"multiple of the page size, using %d instead", pModConf->blockSize);
+	}
+	for(inst = pModConf->root ; inst != NULL ; inst = inst->next) {
+		std_checkRuleset(pModConf, inst);
+		ratelimitCheckKeyCnf("imafpacket", &inst->ratelimitKey, &inst->ratelimitKeyStats);
+	}
+	if(pModConf->root == NULL) {
+		errmsg.LogError(0, RS_RET_NO_LISTNERS , "imafpacket: module loaded, but "
+				"no listeners defined - no input will be gathered");
+		iRet = RS_RET_NO_LISTNERS;
+	}
+ENDcheckCnf
+
+
+BEGINactivateCnfPrePrivDrop
+	instanceConf_t *inst;
+CODESTARTactivateCnfPrePrivDrop
+	runModConf = pModConf;
+	for(inst = runModConf->root ; inst != NULL ; inst = inst->next) {
+		addListner(inst);
+	}
+	/* if we could not set up any listeners, there is no point in running... */
+	if(lcnfRoot == NULL) {
+		errmsg.LogError(0, NO_ERRCODE, "imafpacket: no listeners could be started, "
+				"input not activated.\n");
+		ABORT_FINALIZE(RS_RET_NO_RUN);
+	}
+
+finalize_it:
+ENDactivateCnfPrePrivDrop
+
+
+BEGINactivateCnf
+CODESTARTactivateCnf
+	iMaxLine = glbl.GetMaxLine();
+ENDactivateCnf
+
+
+BEGINfreeCnf
+	instanceConf_t *inst, *del;
+CODESTARTfreeCnf
+	for(inst = pModConf->root ; inst != NULL ; ) {
+		free(inst->pszInterface);
+		free(inst->pszBindRuleset);
+		free(inst->inputname);
+		free(inst->dfltTZ);
+		free(inst->ratelimitKey);
+		free(inst->ratelimitKeyStats);
+		del = inst;
+		inst = inst->next;
+		free(del);
+	}
+ENDfreeCnf
+
+
+/* initialize and return if will run or not */
+BEGINwillRun
+CODESTARTwillRun
+	net.HasRestrictions(UCHAR_CONSTANT("UDP"), &bDoACLCheck); /* UDP */
+ENDwillRun
+
+
+BEGINafterRun
+	struct lstn_s *lstn, *lstnDel;
+CODESTARTafterRun
+	/* do cleanup here. Note that the UDP ACL is owned by imudp, so we
+	 * do not clear it.
+	 */
+	for(lstn = lcnfRoot ; lstn != NULL ; ) {
+		statsobj.Destruct(&(lstn->stats));
+		ratelimitDestruct(lstn->ratelimiter);
+		munmap(lstn->ring, lstn->lenRing);
+		close(lstn->sock);
+		prop.Destruct(&lstn->pInputName);
+		lstnDel = lstn;
+		lstn = lstn->next;
+		free(lstnDel);
+	}
+	lcnfRoot = lcnfLast = NULL;
+ENDafterRun
+
+
+BEGINmodExit
+CODESTARTmodExit
+	/* release what we no longer need */
+	objRelease(errmsg, CORE_COMPONENT);
+	objRelease(glbl, CORE_COMPONENT);
+	objRelease(statsobj, CORE_COMPONENT);
+	objRelease(datetime, CORE_COMPONENT);
+	objRelease(prop, CORE_COMPONENT);
+	objRelease(ruleset, CORE_COMPONENT);
+	objRelease(net, LM_NET_FILENAME);
+ENDmodExit
+
+
+BEGINisCompatibleWithFeature
+CODESTARTisCompatibleWithFeature
+	if(eFeat == sFEATURENonCancelInputTermination)
+		iRet = RS_RET_OK;
+ENDisCompatibleWithFeature
+
+
+BEGINqueryEtryPt
+CODESTARTqueryEtryPt
+CODEqueryEtryPt_STD_IMOD_QUERIES
+CODEqueryEtryPt_STD_CONF2_QUERIES
+CODEqueryEtryPt_STD_CONF2_setModCnf_QUERIES
+CODEqueryEtryPt_STD_CONF2_PREPRIVDROP_QUERIES
+CODEqueryEtryPt_STD_CONF2_IMOD_QUERIES
+CODEqueryEtryPt_IsCompatibleWithFeature_IF_OMOD_QUERIES
+ENDqueryEtryPt
+
+
+BEGINmodInit()
+CODESTARTmodInit
+	*ipIFVersProvided = CURR_MOD_IF_VERSION; /* we only support the current interface specification */
+CODEmodInit_QueryRegCFSLineHdlr
+	CHKiRet(objUse(errmsg, CORE_COMPONENT));
+	CHKiRet(objUse(glbl, CORE_COMPONENT));
+	CHKiRet(objUse(statsobj, CORE_COMPONENT));
+	CHKiRet(objUse(datetime, CORE_COMPONENT));
+	CHKiRet(objUse(prop, CORE_COMPONENT));
+	CHKiRet(objUse(ruleset, CORE_COMPONENT));
+	CHKiRet(objUse(net, LM_NET_FILENAME));
+	DBGPRINTF("imafpacket: version %s initializing\n", VERSION);
+ENDmodInit
+/* vim:set ai:
+ */
@@ -35,6 +35,8 @@
 #include <unistd.h>
 #include <glob.h>
 #include <fnmatch.h>
+#include <poll.h>
+#include <time.h>
 #ifdef HAVE_SYS_INOTIFY_H
 #include <sys/inotify.h>
 #endif
@@ -56,6 +58,8 @@
 #include "stringbuf.h"
 #include "ruleset.h"
 #include "ratelimit.h"
+#include "hashtable.h"
+#include "hashtable_itr.h"
 
 #include <regex.h> // TODO: fix via own module
 
@@ -84,6 +88,7 @@ static int bLegacyCnfModGlobalsPermitted;/* are legacy module-global config para
 #define INIT_WDMAP_TAB_SIZE 1 /* default wdMap table size - is extended as needed, use 2^x value */
 
 #define ADD_METADATA_UNSPECIFIED -1
+#define DFLT_StateJournalFlushInterval 1000 /* ms */
 
 /* this structure is used in pure polling mode as well one of the support
  * structures for inotify.
@@ -114,12 +119,18 @@ typedef struct lstn_s {
 	uchar *prevLineSegment;	/* previous line segment (in regex mode) */
 	sbool escapeLF;	/* escape LF inside the MSG content? */
 	sbool reopenOnTruncate;
+	sbool decompress;	/* transparently read gzip-compressed files? */
 	sbool addMetadata;
 	sbool addCeeTag;
 	sbool freshStartTail; /* read from tail of file on fresh start? */
 	ruleset_t *pRuleset;	/* ruleset to bind listener to (use system default if unspecified) */
 	ratelimit_t *ratelimiter;
 	multi_submit_t multiSub;
+	/* worker pool support, protected by wrkrPool.mut */
+	struct lstn_s *nextRun;	/* next listener in run queue */
+	sbool bQueued;	/* is listener in run queue? */
+	sbool bBusy;	/* is listener currently being processed by a worker? */
+	sbool bRerun;	/* new data was signalled while being processed */
 } lstn_t;
 
 static struct configSettings_s {
@@ -152,6 +163,7 @@ struct instanceConf_s {
 	uchar *startRegex;
 	sbool escapeLF;
 	sbool reopenOnTruncate;
+	sbool decompress;
 	sbool addCeeTag;
 	sbool addMetadata;
 	sbool freshStartTail;
@@ -178,6 +190,10 @@ struct modConfData_s {
 	lstn_t *pRootLstn;
 	lstn_t *pTailLstn;
 	uint8_t opMode;
+	int nWrkr;	/* number of worker threads, 0 - process files on input thread */
+	uchar *pszStateJournal;	/* name of state journal, NULL - use one state file per file */
+	int iStateJournalFlushInterval;	/* max ms state records are held before being written */
+	sbool bStateJournalFsync;	/* fsync() journal after each write? */
 	sbool configSetViaV2Method;
 };
 static modConfData_t *loadModConf = NULL;/* modConf ptr to use for the current load process */
@@ -247,10 +263,56 @@ static int ino_fd;	/* fd for inotify calls */
 
 static prop_t *pInputName = NULL;	/* there is only one global inputName for all messages generated by this input */
 
+/* support for the worker pool. If workerThreads is set, files are no longer
+ * processed on the input thread itself. Instead, the input thread (inotify or
+ * polling) just schedules listeners which (may) have new data, and the workers
+ * process them. A listener is processed by only one worker at a time, so the
+ * order of messages from a single file is preserved. If a worker stops because
+ * maxLinesAtOnce was reached, the listener is put at the end of the run queue,
+ * so a single large file can not starve the others.
+ */
+static struct {
+	int nWrkr;
+	pthread_t *tids;
+	pthread_mutex_t mut;
+	pthread_cond_t workAvail;
+	pthread_cond_t lstnIdle;
+	lstn_t *pRunRoot;	/* run queue */
+	lstn_t *pRunTail;
+	int nBusy;	/* number of listeners currently being processed */
+	sbool bStop;
+	sbool bHadFileData;	/* did any file have data since last WaitIdle()? */
+} wrkrPool;
+
+/* support for the state journal. If configured, the state of all files is
+ * kept in a single, append-only journal instead of one state file per
+ * monitored file. Each record is a single line of JSON and describes the
+ * complete state of one file, so the most recent record per file wins.
+ * Records are collected in memory and written with a single write() call
+ * at most every flushInterval ms. We also keep the most recent record of each
+ * file in memory, so that we can compact the journal by writing a fresh copy
+ * and atomically renaming it over the old one. A record torn by a crash is
+ * simply ignored on recovery; the file is then re-read from the previous
+ * state, so data may be duplicated but not lost.
+ */
+static struct {
+	uchar *pszName;	/* full path name, NULL if journal is not used */
+	int fd;
+	struct hashtable *ht;	/* state file name -> most recent record */
+	cstr_t *pending;	/* records not yet written */
+	unsigned nRecords;	/* number of records in journal file (for compaction) */
+	long long lastFlush;	/* ms, monotonic */
+	pthread_mutex_t mut;
+} stateJournal;
+
 /* module-global parameters */
 static struct cnfparamdescr modpdescr[] = {
 	{ "pollinginterval", eCmdHdlrPositiveInt, 0 },
-	{ "mode", eCmdHdlrGetWord, 0 }
+	{ "mode", eCmdHdlrGetWord, 0 },
+	{ "workerthreads", eCmdHdlrNonNegInt, 0 },
+	{ "statejournal", eCmdHdlrGetWord, 0 },
+	{ "statejournal.fsync", eCmdHdlrBinary, 0 },
+	{ "statejournal.flushinterval", eCmdHdlrNonNegInt, 0 }
 };
 static struct cnfparamblk modpblk =
 	{ CNFPARAMBLK_VERSION,
@@ -278,7 +340,8 @@ static struct cnfparamdescr inppdescr[] = {
 	{ "addmetadata", eCmdHdlrBinary, 0 },
 	{ "addceetag", eCmdHdlrBinary, 0 },
 	{ "statefile", eCmdHdlrString, CNFPARAM_DEPRECATED },
-	{ "freshstarttail", eCmdHdlrBinary, 0}
+	{ "freshstarttail", eCmdHdlrBinary, 0},
+	{ "decompress", eCmdHdlrBinary, 0 }
 };
 static struct cnfparamblk inppblk =
 	{ CNFPARAMBLK_VERSION,
@@ -449,16 +512,18 @@ getStateFileName(lstn_t *const __restrict__ pLstn,
 }
 
 
-/* enqueue the read file line as a message. The provided string is
- * not freed - thuis must be done by the caller.
+/* enqueue the read file line as a message. The line is a view
+ * (not necessarily '\0'-terminated) and is not freed - this must
+ * be done by the caller, if needed at all.
  */
 static rsRetVal enqLine(lstn_t *const __restrict__ pLstn,
-                        cstr_t *const __restrict__ cstrLine)
+                        const uchar *const __restrict__ pLine,
+                        const size_t lenLine)
 {
 	DEFiRet;
 	msg_t *pMsg;
 
-	if(rsCStrLen(cstrLine) == 0) {
+	if(lenLine == 0) {
 		/* we do not process empty lines */
 		FINALIZE;
 	}
@@ -467,17 +532,18 @@ static rsRetVal enqLine(lstn_t *const __restrict__ pLstn,
 	MsgSetFlowControlType(pMsg, eFLOWCTL_FULL_DELAY);
 	MsgSetInputName(pMsg, pInputName);
 	if (pLstn->addCeeTag) {
-		size_t msgLen = cstrLen(cstrLine);
 		const char *const ceeToken = "@cee:";
-		size_t ceeMsgSize = msgLen + strlen(ceeToken) +1;
+		const size_t lenToken = strlen(ceeToken);
+		size_t ceeMsgSize = lenLine + lenToken +1;
 		char *ceeMsg;
 		CHKmalloc(ceeMsg = MALLOC(ceeMsgSize));
-		strcpy(ceeMsg, ceeToken);
-		strcat(ceeMsg, (char*)rsCStrGetSzStrNoNULL(cstrLine));
+		memcpy(ceeMsg, ceeToken, lenToken);
+		memcpy(ceeMsg + lenToken, pLine, lenLine);
+		ceeMsg[ceeMsgSize-1] = '\0';
 		MsgSetRawMsg(pMsg, ceeMsg, ceeMsgSize);
 		free(ceeMsg);
 	} else {
-		MsgSetRawMsg(pMsg, (char*)rsCStrGetSzStrNoNULL(cstrLine), cstrLen(cstrLine));
+		MsgSetRawMsg(pMsg, (const char*)pLine, lenLine);
 	}
 	MsgSetMSGoffs(pMsg, 0);	/* we do not have a header... */
 	MsgSetHOSTNAME(pMsg, glbl.GetLocalHostName(), ustrlen(glbl.GetLocalHostName()));
@@ -492,6 +558,356 @@ finalize_it:
 }
 
 
+/* ---------------------------- state journal ---------------------------- */
+
+static long long
+journalNow(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (long long) t.tv_sec * 1000 + t.tv_nsec / 1000000;
+}
+
+
+/* remember rec (a journal line, including LF) as the most recent record for
+ * the state file name key. If rec is NULL, the entry is removed. Must be
+ * called with the mutex locked.
+ */
+static rsRetVal
+journalSetEntry(const char *const key, const char *const rec)
+{
+	char *k = NULL;
+	char *v = NULL;
+	DEFiRet;
+
+	free(hashtable_remove(stateJournal.ht, (void*) key));
+	if(rec == NULL)
+		FINALIZE;
+	CHKmalloc(k = strdup(key));
+	CHKmalloc(v = strdup(rec));
+	if(!hashtable_insert(stateJournal.ht, k, v))
+		ABORT_FINALIZE(RS_RET_OUT_OF_MEMORY);
+	k = v = NULL; /* now owned by hashtable */
+
+finalize_it:
+	free(k);
+	free(v);
+	RETiRet;
+}
+
+
+/* write a complete buffer, retrying on partial writes */
+static rsRetVal
+journalWrite(const int fd, const uchar *buf, size_t len)
+{
+	ssize_t r;
+	DEFiRet;
+
+	while(len > 0) {
+		r = write(fd, buf, len);
+		if(r == -1) {
+			if(errno == EINTR)
+				continue;
+			ABORT_FINALIZE(RS_RET_IO_ERROR);
+		}
+		buf += r;
+		len -= r;
+	}
+finalize_it:
+	RETiRet;
+}
+
+
+/* compact the journal: write the most recent record of each file to a new
+ * journal and atomically replace the old one. This is always fsync()ed, as
+ * otherwise we could end up with an empty journal after a crash.
+ * Must be called with the mutex locked.
+ */
+static rsRetVal
+journalCompact(void)
+{
+	char tmpName[MAXFNAME];
+	struct hashtable_itr *itr = NULL;
+	const char *rec;
+	int fd = -1;
+	DEFiRet;
+
+	snprintf(tmpName, sizeof(tmpName), "%s.tmp", stateJournal.pszName);
+	fd = open(tmpName, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_NOCTTY, 0600);
+	if(fd == -1)
+		ABORT_FINALIZE(RS_RET_IO_ERROR);
+	if(hashtable_count(stateJournal.ht) > 0) {
+		CHKmalloc(itr = hashtable_iterator(stateJournal.ht));
+		do {
+			rec = hashtable_iterator_value(itr);
+			CHKiRet(journalWrite(fd, (const uchar*) rec, strlen(rec)));
+		} while(hashtable_iterator_advance(itr));
+	}
+	if(fsync(fd) != 0 || rename(tmpName, (char*) stateJournal.pszName) != 0)
+		ABORT_FINALIZE(RS_RET_IO_ERROR);
+	if(stateJournal.fd != -1)
+		close(stateJournal.fd);
+	stateJournal.fd = fd;
+	fd = -1;
+	if(lseek(stateJournal.fd, 0, SEEK_END) == -1)
+		ABORT_FINALIZE(RS_RET_IO_ERROR);
+	stateJournal.nRecords = hashtable_count(stateJournal.ht);
+	DBGPRINTF("imfile: state journal compacted, %u records\n", stateJournal.nRecords);
+
+finalize_it:
+	free(itr);
+	if(fd != -1) {
+		close(fd);
+		unlink(tmpName);
+	}
+	if(iRet != RS_RET_OK) {
+		errmsg.LogError(errno, iRet, "imfile: could not compact state journal '%s'",
+			stateJournal.pszName);
+	}
+	RETiRet;
+}
+
+
+/* write pending records to the journal. If bForce is not set, this is only
+ * done if flushInterval has expired since the last write.
+ */
+static void
+journalFlush(const int bForce)
+{
+	rsRetVal localRet;
+	unsigned nLive;
+
+	if(stateJournal.pszName == NULL)
+		return;
+	pthread_mutex_lock(&stateJournal.mut);
+	if(cstrLen(stateJournal.pending) == 0)
+		goto done;
+	if(!bForce && journalNow() - stateJournal.lastFlush < runModConf->iStateJournalFlushInterval)
+		goto done;
+	localRet = journalWrite(stateJournal.fd, rsCStrGetSzStrNoNULL(stateJournal.pending),
+		cstrLen(stateJournal.pending));
+	if(localRet == RS_RET_OK && runModConf->bStateJournalFsync && fsync(stateJournal.fd) != 0)
+		localRet = RS_RET_IO_ERROR;
+	if(localRet != RS_RET_OK) {
+		errmsg.LogError(errno, localRet, "imfile: error writing state journal '%s' - data "
+			"may be repeated on next startup", stateJournal.pszName);
+	}
+	rsCStrTruncate(stateJournal.pending, cstrLen(stateJournal.pending));
+	stateJournal.lastFlush = journalNow();
+	/* compact when the journal is mostly obsolete records */
+	nLive = hashtable_count(stateJournal.ht);
+	if(stateJournal.nRecords > 2 * nLive + 1024)
+		journalCompact();
+done:
+	pthread_mutex_unlock(&stateJournal.mut);
+}
+
+
+/* add a record to the journal. If pStrm is NULL, a record is added that
+ * deletes the state of the file.
+ */
+static rsRetVal
+journalAddRecord(const uchar *const statefn, strm_t *const pStrm)
+{
+	struct json_object *json = NULL;
+	const char *rec;
+	cstr_t *line = NULL;
+	DEFiRet;
+
+	CHKmalloc(json = json_object_new_object());
+	json_object_object_add(json, "f", json_object_new_string((const char*) statefn));
+	if(pStrm == NULL) {
+		json_object_object_add(json, "del", json_object_new_int(1));
+	} else {
+		json_object_object_add(json, "inode", json_object_new_int64(pStrm->inode));
+		json_object_object_add(json, "offs", json_object_new_int64(pStrm->iCurrOffs));
+		json_object_object_add(json, "prevnl", json_object_new_int(pStrm->bPrevWasNL));
+		if(pStrm->prevLineSegment != NULL)
+			json_object_object_add(json, "prevline", json_object_new_string(
+				(char*) rsCStrGetSzStrNoNULL(pStrm->prevLineSegment)));
+		if(pStrm->prevMsgSegment != NULL)
+			json_object_object_add(json, "prevmsg", json_object_new_string(
+				(char*) rsCStrGetSzStrNoNULL(pStrm->prevMsgSegment)));
+	}
+	rec = json_object_to_json_string_ext(json, JSON_C_TO_STRING_PLAIN);
+	CHKiRet(rsCStrConstructFromszStr(&line, (const uchar*) rec));
+	CHKiRet(cstrAppendChar(line, '\n'));
+	cstrFinalize(line);
+
+	pthread_mutex_lock(&stateJournal.mut);
+	iRet = rsCStrAppendStrWithLen(stateJournal.pending, rsCStrGetSzStrNoNULL(line), cstrLen(line));
+	if(iRet == RS_RET_OK) {
+		++stateJournal.nRecords;
+		iRet = journalSetEntry((const char*) statefn,
+			(pStrm == NULL) ? NULL : (const char*) rsCStrGetSzStrNoNULL(line));
+	}
+	pthread_mutex_unlock(&stateJournal.mut);
+
+finalize_it:
+	if(json != NULL)
+		json_object_put(json);
+	if(line != NULL)
+		cstrDestruct(&line);
+	RETiRet;
+}
+
+
+/* obtain an int64 value from a journal record, 0 if not present */
+static int64
+journalGetInt(struct json_object *const json, const char *const name)
+{
+	struct json_object *val;
+	if(!json_object_object_get_ex(json, name, &val))
+		return 0;
+	return json_object_get_int64(val);
+}
+
+
+/* open a listener's stream based on its state journal record. Returns
+ * RS_RET_NOT_FOUND if there is no state for this file in the journal.
+ */
+static rsRetVal
+journalLoadState(lstn_t *const pLstn, const uchar *const statefn)
+{
+	char *rec = NULL;
+	struct json_object *json = NULL;
+	struct json_object *val;
+	strm_t *pStrm;
+	DEFiRet;
+
+	pthread_mutex_lock(&stateJournal.mut);
+	rec = hashtable_search(stateJournal.ht, (void*) statefn);
+	if(rec != NULL)
+		rec = strdup(rec);
+	pthread_mutex_unlock(&stateJournal.mut);
+	if(rec == NULL)
+		ABORT_FINALIZE(RS_RET_NOT_FOUND);
+	if((json = json_tokener_parse(rec)) == NULL)
+		ABORT_FINALIZE(RS_RET_NOT_FOUND);
+
+	CHKiRet(strm.Construct(&pLstn->pStrm));
+	pStrm = pLstn->pStrm;
+	CHKiRet(strm.SettOperationsMode(pStrm, STREAMMODE_READ));
+	CHKiRet(strm.SetsType(pStrm, STREAMTYPE_FILE_MONITOR));
+	CHKiRet(strm.SetFName(pStrm, pLstn->pszFileName, strlen((char*) pLstn->pszFileName)));
+	CHKiRet(strm.SetbReopenOnTruncate(pStrm, pLstn->reopenOnTruncate));
+	CHKiRet(strm.SetbDecompress(pStrm, pLstn->decompress));
+	CHKiRet(strm.ConstructFinalize(pStrm));
+	pStrm->inode = (ino_t) journalGetInt(json, "inode");
+	pStrm->iCurrOffs = journalGetInt(json, "offs");
+	pStrm->bPrevWasNL = (sbool) journalGetInt(json, "prevnl");
+	if(json_object_object_get_ex(json, "prevline", &val))
+		CHKiRet(rsCStrConstructFromszStr(&pStrm->prevLineSegment,
+			(const uchar*) json_object_get_string(val)));
+	if(json_object_object_get_ex(json, "prevmsg", &val))
+		CHKiRet(rsCStrConstructFromszStr(&pStrm->prevMsgSegment,
+			(const uchar*) json_object_get_string(val)));
+	DBGPRINTF("imfile: state for '%s' obtained from journal, offset %lld\n",
+		pLstn->pszFileName, (long long) pStrm->iCurrOffs);
+
+	strm.CheckFileChange(pStrm);
+	CHKiRet(strm.SeekCurrOffs(pStrm));
+
+finalize_it:
+	if(json != NULL)
+		json_object_put(json);
+	free(rec);
+	RETiRet;
+}
+
+
+/* open the state journal and recover the state from it. Records that can
+ * not be parsed (most probably torn by a crash) are ignored. After recovery,
+ * we compact, so the journal is always small when we start.
+ */
+static rsRetVal
+journalOpen(void)
+{
+	FILE *fp = NULL;
+	char *line = NULL;
+	size_t lenLine = 0;
+	ssize_t r;
+	struct json_object *json;
+	struct json_object *val;
+	unsigned nRead = 0;
+	DEFiRet;
+
+	stateJournal.fd = -1;
+	stateJournal.pszName = NULL;
+	if(runModConf->pszStateJournal == NULL)
+		FINALIZE;
+
+	if(asprintf((char**) &stateJournal.pszName, "%s/%s", (char*) glbl.GetWorkDir(),
+		(char*) runModConf->pszStateJournal) == -1) {
+		stateJournal.pszName = NULL;
+		ABORT_FINALIZE(RS_RET_OUT_OF_MEMORY);
+	}
+	CHKmalloc(stateJournal.ht = create_hashtable(100, hash_from_string, key_equals_string, NULL));
+	CHKiRet(cstrConstruct(&stateJournal.pending));
+	stateJournal.nRecords = 0;
+	stateJournal.lastFlush = journalNow();
+
+	if((fp = fopen((char*) stateJournal.pszName, "r")) != NULL) {
+		while((r = getline(&line, &lenLine, fp)) != -1) {
+			if(r == 0 || line[r-1] != '\n')
+				continue; /* incomplete record */
+			if((json = json_tokener_parse(line)) == NULL)
+				continue;
+			if(json_object_object_get_ex(json, "f", &val)) {
+				++nRead;
+				journalSetEntry(json_object_get_string(val),
+					json_object_object_get_ex(json, "del", &val) ? NULL : line);
+			}
+			json_object_put(json);
+		}
+		fclose(fp);
+	}
+	DBGPRINTF("imfile: state journal '%s': read %u records, state for %u files\n",
+		stateJournal.pszName, nRead, hashtable_count(stateJournal.ht));
+	CHKiRet(journalCompact());
+
+finalize_it:
+	free(line);
+	if(iRet != RS_RET_OK && stateJournal.pszName != NULL) {
+		errmsg.LogError(0, iRet, "imfile: could not open state journal '%s' - "
+			"using one state file per monitored file", stateJournal.pszName);
+		free(stateJournal.pszName);
+		stateJournal.pszName = NULL;
+		if(stateJournal.fd != -1) {
+			close(stateJournal.fd);
+			stateJournal.fd = -1;
+		}
+		if(stateJournal.ht != NULL) {
+			hashtable_destroy(stateJournal.ht, 1);
+			stateJournal.ht = NULL;
+		}
+		if(stateJournal.pending != NULL)
+			cstrDestruct(&stateJournal.pending);
+	}
+	RETiRet;
+}
+
+
+/* write outstanding records and close the journal */
+static void
+journalClose(void)
+{
+	if(stateJournal.pszName == NULL)
+		return;
+	journalFlush(1);
+	pthread_mutex_lock(&stateJournal.mut);
+	if(stateJournal.fd != -1)
+		close(stateJournal.fd);
+	stateJournal.fd = -1;
+	hashtable_destroy(stateJournal.ht, 1);
+	stateJournal.ht = NULL;
+	cstrDestruct(&stateJournal.pending);
+	free(stateJournal.pszName);
+	stateJournal.pszName = NULL;
+	pthread_mutex_unlock(&stateJournal.mut);
+}
+
+
 /* try to open a file. This involves checking if there is a status file and,
  * if so, reading it in. Processing continues from the last know location.
  */
@@ -509,6 +925,15 @@ openFile(lstn_t *pLstn)
 	uchar *const statefn = getStateFileName(pLstn, statefile, sizeof(statefile));
 	DBGPRINTF("imfile: trying to open state for '%s', state file '%s'\n",
 		  pLstn->pszFileName, statefn);
+	if(stateJournal.pszName != NULL) {
+		/* if the journal does not know the file, we fall back to the
+		 * state file, which permits migration to the journal.
+		 */
+		iRet = journalLoadState(pLstn, statefn);
+		if(iRet != RS_RET_NOT_FOUND)
+			FINALIZE;
+		iRet = RS_RET_OK;
+	}
 	/* Construct file name */
 	lenSFNam = snprintf((char*)pszSFNam, sizeof(pszSFNam), "%s/%s",
 			     (char*) glbl.GetWorkDir(), (char*)statefn);
@@ -539,6 +964,7 @@ openFile(lstn_t *pLstn)
 	/* read back in the object */
 	CHKiRet(obj.Deserialize(&pLstn->pStrm, (uchar*) "strm", psSF, NULL, pLstn));
 	CHKiRet(strm.SetbReopenOnTruncate(pLstn->pStrm, pLstn->reopenOnTruncate));
+	CHKiRet(strm.SetbDecompress(pLstn->pStrm, pLstn->decompress));
 	DBGPRINTF("imfile: deserialized state file, state file base name '%s', "
 		  "configured base name '%s'\n", pLstn->pStrm->pszFName,
 		  pLstn->pszFileName);
@@ -570,15 +996,16 @@ finalize_it:
 		CHKiRet(strm.SettOperationsMode(pLstn->pStrm, STREAMMODE_READ));
 		CHKiRet(strm.SetsType(pLstn->pStrm, STREAMTYPE_FILE_MONITOR));
 		CHKiRet(strm.SetFName(pLstn->pStrm, pLstn->pszFileName, strlen((char*) pLstn->pszFileName)));
+		CHKiRet(strm.SetbDecompress(pLstn->pStrm, pLstn->decompress));
 		CHKiRet(strm.ConstructFinalize(pLstn->pStrm));
 
 		/* If state file not exist, this is a fresh start. seek to file end
-		 * when freshStartTail is on.
+		 * when freshStartTail is on. For compressed files, the end is not
+		 * the file size, so we let the stream class find it.
 		 */
 		if(pLstn->freshStartTail && isFreshStart){
 			if(stat((char*) pLstn->pszFileName, &stat_buf) != -1) {
-				pLstn->pStrm->iCurrOffs = stat_buf.st_size;
-				CHKiRet(strm.SeekCurrOffs(pLstn->pStrm));
+				CHKiRet(strm.SeekEnd(pLstn->pStrm));
 			}
 		}
 	}
@@ -606,6 +1033,8 @@ static rsRetVal
 pollFile(lstn_t *pLstn, int *pbHadFileData)
 {
 	cstr_t *pCStr = NULL;
+	uchar *pLine;
+	size_t lenLine;
 	DEFiRet;
 
 	/* Note: we must do pthread_cleanup_push() immediately, because the POXIS macros
@@ -621,16 +1050,24 @@ pollFile(lstn_t *pLstn, int *pbHadFileData)
 	while(glbl.GetGlobalInputTermState() == 0) {
 		if(pLstn->maxLinesAtOnce != 0 && nProcessed >= pLstn->maxLinesAtOnce)
 			break;
-		if(pLstn->startRegex == NULL) {
-			CHKiRet(strm.ReadLine(pLstn->pStrm, &pCStr, pLstn->readMode, pLstn->escapeLF, pLstn->trimLineOverBytes));
-		} else {
+		if(pLstn->startRegex != NULL) {
 			CHKiRet(strmReadMultiLine(pLstn->pStrm, &pCStr, &pLstn->end_preg, pLstn->escapeLF));
+		} else if(pLstn->readMode == 0) {
+			/* block-based reader, line is a view into the stream buffer */
+			CHKiRet(strm.ReadLineView(pLstn->pStrm, &pLine, &lenLine, pLstn->trimLineOverBytes));
+		} else {
+			CHKiRet(strm.ReadLine(pLstn->pStrm, &pCStr, pLstn->readMode, pLstn->escapeLF, pLstn->trimLineOverBytes));
 		}
 		++nProcessed;
 		if(pbHadFileData != NULL)
 			*pbHadFileData = 1; /* this is just a flag, so set it and forget it */
-		CHKiRet(enqLine(pLstn, pCStr)); /* process line */
-		rsCStrDestruct(&pCStr); /* discard string (must be done by us!) */
+		if(pCStr != NULL) {
+			pLine = rsCStrGetSzStrNoNULL(pCStr);
+			lenLine = cstrLen(pCStr);
+		}
+		CHKiRet(enqLine(pLstn, pLine, lenLine)); /* process line */
+		if(pCStr != NULL)
+			rsCStrDestruct(&pCStr); /* discard string (must be done by us!) */
 		if(pLstn->iPersistStateInterval > 0 && pLstn->nRecords++ >= pLstn->iPersistStateInterval) {
 			persistStrmState(pLstn);
 			pLstn->nRecords = 0;
@@ -639,6 +1076,7 @@ pollFile(lstn_t *pLstn, int *pbHadFileData)
 
 finalize_it:
 	multiSubmitFlush(&pLstn->multiSub);
+	journalFlush(0);
 	pthread_cleanup_pop(0);
 
 	if(pCStr != NULL) {
@@ -650,6 +1088,194 @@ finalize_it:
 #pragma GCC diagnostic warning "-Wempty-body"
 
 
+/* add listener to the end of the run queue. wrkrPool.mut must be held. */
+static void
+wrkrPoolEnqueue(lstn_t *const pLstn)
+{
+	pLstn->nextRun = NULL;
+	if(wrkrPool.pRunTail == NULL)
+		wrkrPool.pRunRoot = pLstn;
+	else
+		wrkrPool.pRunTail->nextRun = pLstn;
+	wrkrPool.pRunTail = pLstn;
+	pLstn->bQueued = 1;
+	pthread_cond_signal(&wrkrPool.workAvail);
+}
+
+
+/* schedule a listener for processing by the worker pool. If it is
+ * currently being processed, we just record that it must be run again
+ * when the current run is done - we may otherwise miss data.
+ */
+static void
+wrkrPoolSchedule(lstn_t *const pLstn)
+{
+	pthread_mutex_lock(&wrkrPool.mut);
+	if(pLstn->bBusy)
+		pLstn->bRerun = 1;
+	else if(!pLstn->bQueued)
+		wrkrPoolEnqueue(pLstn);
+	pthread_mutex_unlock(&wrkrPool.mut);
+}
+
+
+/* process a file, either directly or via the worker pool (if configured) */
+static void
+schedulePollFile(lstn_t *const pLstn)
+{
+	if(wrkrPool.nWrkr == 0)
+		pollFile(pLstn, NULL);
+	else
+		wrkrPoolSchedule(pLstn);
+}
+
+
+/* make sure that a listener is no longer in use by the pool. This must
+ * be called before a listener is deleted. If it is currently being
+ * processed, we wait until this is done. Only then we unlink it from the
+ * run queue, as the worker re-queues it when it has more data.
+ */
+static void
+wrkrPoolRemoveLstn(lstn_t *const pLstn)
+{
+	lstn_t *pPrev;
+
+	if(wrkrPool.nWrkr == 0)
+		return;
+	pthread_mutex_lock(&wrkrPool.mut);
+	while(pLstn->bBusy)
+		pthread_cond_wait(&wrkrPool.lstnIdle, &wrkrPool.mut);
+	if(pLstn->bQueued) {
+		if(wrkrPool.pRunRoot == pLstn) {
+			pPrev = NULL;
+			wrkrPool.pRunRoot = pLstn->nextRun;
+		} else {
+			for(pPrev = wrkrPool.pRunRoot ; pPrev->nextRun != pLstn ; pPrev = pPrev->nextRun)
+				/* just search */;
+			pPrev->nextRun = pLstn->nextRun;
+		}
+		if(wrkrPool.pRunTail == pLstn)
+			wrkrPool.pRunTail = pPrev;
+		pLstn->bQueued = 0;
+	}
+	pLstn->bRerun = 0;
+	pthread_mutex_unlock(&wrkrPool.mut);
+}
+
+
+/* wait until all scheduled listeners have been processed. Used in polling
+ * mode, where we need to know if some file had data in the last round.
+ */
+static void
+wrkrPoolWaitIdle(int *const pbHadFileData)
+{
+	pthread_mutex_lock(&wrkrPool.mut);
+	while(wrkrPool.pRunRoot != NULL || wrkrPool.nBusy > 0)
+		pthread_cond_wait(&wrkrPool.lstnIdle, &wrkrPool.mut);
+	if(wrkrPool.bHadFileData)
+		*pbHadFileData = 1;
+	wrkrPool.bHadFileData = 0;
+	pthread_mutex_unlock(&wrkrPool.mut);
+}
+
+
+/* the worker thread: take the next listener from the run queue and process
+ * it. pollFile() returns RS_RET_OK (and not EOF) if it stopped because
+ * maxLinesAtOnce was reached, so there is more data and we re-queue it.
+ */
+static void *
+wrkrPoolWrkr(void __attribute__((unused)) *arg)
+{
+	lstn_t *pLstn;
+	int bHadFileData;
+	rsRetVal localRet;
+
+	pthread_mutex_lock(&wrkrPool.mut);
+	while(!wrkrPool.bStop) {
+		if(wrkrPool.pRunRoot == NULL) {
+			pthread_cond_wait(&wrkrPool.workAvail, &wrkrPool.mut);
+			continue;
+		}
+		pLstn = wrkrPool.pRunRoot;
+		wrkrPool.pRunRoot = pLstn->nextRun;
+		if(wrkrPool.pRunRoot == NULL)
+			wrkrPool.pRunTail = NULL;
+		pLstn->bQueued = 0;
+		pLstn->bBusy = 1;
+		pLstn->bRerun = 0;
+		++wrkrPool.nBusy;
+		pthread_mutex_unlock(&wrkrPool.mut);
+
+		bHadFileData = 0;
+		localRet = pollFile(pLstn, &bHadFileData);
+
+		pthread_mutex_lock(&wrkrPool.mut);
+		pLstn->bBusy = 0;
+		--wrkrPool.nBusy;
+		if(bHadFileData)
+			wrkrPool.bHadFileData = 1;
+		if((localRet == RS_RET_OK || pLstn->bRerun) && glbl.GetGlobalInputTermState() == 0)
+			wrkrPoolEnqueue(pLstn);
+		pLstn->bRerun = 0;
+		pthread_cond_broadcast(&wrkrPool.lstnIdle);
+	}
+	pthread_mutex_unlock(&wrkrPool.mut);
+	return NULL;
+}
+
+
+/* start the worker pool, if configured. If we can not create all threads,
+ * we continue with what we have; without any, files are processed on the
+ * input thread.
+ */
+static void
+wrkrPoolStart(void)
+{
+	int i;
+
+	wrkrPool.nWrkr = 0;
+	wrkrPool.pRunRoot = NULL;
+	wrkrPool.pRunTail = NULL;
+	wrkrPool.nBusy = 0;
+	wrkrPool.bStop = 0;
+	wrkrPool.bHadFileData = 0;
+	if(runModConf->nWrkr == 0)
+		return;
+	if((wrkrPool.tids = calloc(runModConf->nWrkr, sizeof(pthread_t))) == NULL)
+		return;
+	for(i = 0 ; i < runModConf->nWrkr ; ++i) {
+		if(pthread_create(&wrkrPool.tids[wrkrPool.nWrkr], NULL, wrkrPoolWrkr, NULL) == 0) {
+			++wrkrPool.nWrkr;
+		} else {
+			errmsg.LogError(0, NO_ERRCODE, "imfile: could not create worker thread %d, "
+					"continuing with %d workers", i, wrkrPool.nWrkr);
+			break;
+		}
+	}
+	DBGPRINTF("imfile: started %d worker threads\n", wrkrPool.nWrkr);
+}
+
+
+static void
+wrkrPoolStop(void)
+{
+	int i;
+
+	if(wrkrPool.nWrkr == 0)
+		goto done;
+	pthread_mutex_lock(&wrkrPool.mut);
+	wrkrPool.bStop = 1;
+	pthread_cond_broadcast(&wrkrPool.workAvail);
+	pthread_mutex_unlock(&wrkrPool.mut);
+	for(i = 0 ; i < wrkrPool.nWrkr ; ++i)
+		pthread_join(wrkrPool.tids[i], NULL);
+	wrkrPool.nWrkr = 0;
+done:
+	free(wrkrPool.tids);
+	wrkrPool.tids = NULL;
+}
+
+
 /* create input instance, set default parameters, and
  * add it to the list of instances.
  */
@@ -677,6 +1303,7 @@ createInstance(instanceConf_t **pinst)
 	inst->bRMStateOnDel = 1;
 	inst->escapeLF = 1;
 	inst->reopenOnTruncate = 0;
+	inst->decompress = 0;
 	inst->addMetadata = ADD_METADATA_UNSPECIFIED;
 	inst->addCeeTag = 0;
 	inst->freshStartTail = 0;
@@ -808,7 +1435,7 @@ addInstance(void __attribute__((unused)) *pVal, uchar *pNewVal)
 	inst->iSeverity = cs.iSeverity;
 	inst->iFacility = cs.iFacility;
 	if(cs.maxLinesAtOnce) {
-		if(loadModConf->opMode == OPMODE_INOTIFY) {
+		if(loadModConf->opMode == OPMODE_INOTIFY && loadModConf->nWrkr == 0) {
 			errmsg.LogError(0, RS_RET_PARAM_NOT_PERMITTED,
 				"parameter \"maxLinesAtOnce\" not "
 				"permited in inotify mode - ignored");
@@ -857,6 +1484,10 @@ lstnAdd(lstn_t **newLstn)
 	}
 	runModConf->pTailLstn = pLstn;
 	pLstn->next = NULL;
+	pLstn->nextRun = NULL;
+	pLstn->bQueued = 0;
+	pLstn->bBusy = 0;
+	pLstn->bRerun = 0;
 	*newLstn = pLstn;
 
 finalize_it:
@@ -934,6 +1565,7 @@ lstnDup(lstn_t **ppExisting, uchar *const __restrict__ newname)
 	pThis->hasWildcard = existing->hasWildcard;
 	pThis->escapeLF = existing->escapeLF;
 	pThis->reopenOnTruncate = existing->reopenOnTruncate;
+	pThis->decompress = existing->decompress;
 	pThis->addMetadata = existing->addMetadata;
 	pThis->addCeeTag = existing->addCeeTag;
 	pThis->freshStartTail = existing->freshStartTail;
@@ -1003,6 +1635,7 @@ addListner(instanceConf_t *inst)
 	pThis->bRMStateOnDel = inst->bRMStateOnDel;
 	pThis->escapeLF = inst->escapeLF;
 	pThis->reopenOnTruncate = inst->reopenOnTruncate;
+	pThis->decompress = inst->decompress;
 	pThis->addMetadata = (inst->addMetadata == ADD_METADATA_UNSPECIFIED) ?
 			       hasWildcard : inst->addMetadata;
 	pThis->addCeeTag = inst->addCeeTag;
@@ -1069,8 +1702,11 @@ CODESTARTnewInpInst
 			inst->escapeLF = (sbool) pvals[i].val.d.n;
 		} else if(!strcmp(inppblk.descr[i].name, "reopenontruncate")) {
 			inst->reopenOnTruncate = (sbool) pvals[i].val.d.n;
+		} else if(!strcmp(inppblk.descr[i].name, "decompress")) {
+			inst->decompress = (sbool) pvals[i].val.d.n;
 		} else if(!strcmp(inppblk.descr[i].name, "maxlinesatonce")) {
 			if(   loadModConf->opMode == OPMODE_INOTIFY
+			   && loadModConf->nWrkr == 0
 			   && pvals[i].val.d.n > 0) {
 				errmsg.LogError(0, RS_RET_PARAM_NOT_PERMITTED,
 					"parameter \"maxLinesAtOnce\" not "
@@ -1108,6 +1744,10 @@ CODESTARTbeginCnfLoad
 	/* init our settings */
 	loadModConf->opMode = OPMODE_POLLING;
 	loadModConf->iPollInterval = DFLT_PollInterval;
+	loadModConf->nWrkr = 0;
+	loadModConf->pszStateJournal = NULL;
+	loadModConf->iStateJournalFlushInterval = DFLT_StateJournalFlushInterval;
+	loadModConf->bStateJournalFsync = 0;
 	loadModConf->configSetViaV2Method = 0;
 	bLegacyCnfModGlobalsPermitted = 1;
 	/* init legacy config vars */
@@ -1157,6 +1797,14 @@ CODESTARTsetModCnf
 					"mode '%s'", cstr);
 				free(cstr);
 			}
+		} else if(!strcmp(modpblk.descr[i].name, "workerthreads")) {
+			loadModConf->nWrkr = (int) pvals[i].val.d.n;
+		} else if(!strcmp(modpblk.descr[i].name, "statejournal")) {
+			loadModConf->pszStateJournal = (uchar*)es_str2cstr(pvals[i].val.d.estr, NULL);
+		} else if(!strcmp(modpblk.descr[i].name, "statejournal.fsync")) {
+			loadModConf->bStateJournalFsync = (sbool) pvals[i].val.d.n;
+		} else if(!strcmp(modpblk.descr[i].name, "statejournal.flushinterval")) {
+			loadModConf->iStateJournalFlushInterval = (int) pvals[i].val.d.n;
 		} else {
 			DBGPRINTF("imfile: program error, non-handled "
 			  "param '%s' in beginCnfLoad\n", modpblk.descr[i].name);
@@ -1181,9 +1829,10 @@ CODESTARTendCnfLoad
 		/* persist module-specific settings from legacy config system */
 		loadModConf->iPollInterval = cs.iPollInterval;
 	}
-	DBGPRINTF("imfile: opmode is %d, polling interval is %d\n",
+	DBGPRINTF("imfile: opmode is %d, polling interval is %d, %d worker threads\n",
 		  loadModConf->opMode,
-		  loadModConf->iPollInterval);
+		  loadModConf->iPollInterval,
+		  loadModConf->nWrkr);
 
 	loadModConf = NULL; /* done loading */
 	/* free legacy config vars */
@@ -1235,6 +1884,7 @@ ENDactivateCnf
 BEGINfreeCnf
 	instanceConf_t *inst, *del;
 CODESTARTfreeCnf
+	free(pModConf->pszStateJournal);
 	for(inst = pModConf->root ; inst != NULL ; ) {
 		free(inst->pszBindRuleset);
 		free(inst->pszFileName);
@@ -1279,8 +1929,13 @@ doPolling(void)
 			for(pLstn = runModConf->pRootLstn ; pLstn != NULL ; pLstn = pLstn->next) {
 				if(glbl.GetGlobalInputTermState() == 1)
 					break; /* terminate input! */
-				pollFile(pLstn, &bHadFileData);
+				if(wrkrPool.nWrkr == 0)
+					pollFile(pLstn, &bHadFileData);
+				else
+					wrkrPoolSchedule(pLstn);
 			}
+			if(wrkrPool.nWrkr > 0)
+				wrkrPoolWaitIdle(&bHadFileData);
 		} while(bHadFileData == 1 && glbl.GetGlobalInputTermState() == 0);
 		  /* warning: do...while()! */
 
@@ -1289,6 +1944,7 @@ doPolling(void)
 		 * of 0 seconds. It doesn't hurt any other valid scenario. So do not remove.
 		 * rgerhards, 2008-02-14
 		 */
+		journalFlush(1);
 		if(glbl.GetGlobalInputTermState() == 0)
 			srSleep(runModConf->iPollInterval, 10);
 	}
@@ -1559,7 +2215,7 @@ startLstnFile(lstn_t *const __restrict__ pLstn)
 	}
 	DBGPRINTF("imfile: watch %d added for file %s\n", wd, pLstn->pszFileName);
 	dirsAddFile(pLstn, ACTIVE_FILE);
-	pollFile(pLstn, NULL);
+	schedulePollFile(pLstn);
 done:	return;
 }
 
@@ -1705,20 +2361,33 @@ in_removeFile(const int dirIdx,
 	          pLstn->pszFileName, dirIdx);
 	if(pLstn->bRMStateOnDel) {
 		statefn = getStateFileName(pLstn, statefile, sizeof(statefile));
+		if(statefn != statefile) {
+			/* name is owned by pLstn, which we delete below */
+			snprintf((char*)statefile, sizeof(statefile), "%s", (char*)statefn);
+			statefn = statefile;
+		}
 		snprintf((char*)toDel, sizeof(toDel), "%s/%s",
 				     glbl.GetWorkDir(), (char*)statefn);
 		bDoRMState = 1;
 	} else {
 		bDoRMState = 0;
+		statefn = NULL;
 	}
+	wrkrPoolRemoveLstn(pLstn); /* must no longer be used by workers */
 	pollFile(pLstn, NULL); /* one final try to gather data */
 	/*	delete listener data */
 	DBGPRINTF("imfile: DELETING listener data for '%s' - '%s'\n", pLstn->pszBaseName, pLstn->pszFileName);
 	lstnDel(pLstn);
 	fileTableDelFile(&dirs[dirIdx].active, pLstn);
+	if(bDoRMState && stateJournal.pszName != NULL) {
+		journalAddRecord(statefn, NULL);
+	}
 	if(bDoRMState) {
+		/* the state file does not exist if the state was never persisted
+		 * or is kept in the journal, which is fine.
+		 */
 		DBGPRINTF("imfile: unlinking '%s'\n", toDel);
-		if(unlink((char*)toDel) != 0) {
+		if(unlink((char*)toDel) != 0 && errno != ENOENT) {
 			char errStr[1024];
 			rs_strerror_r(errno, errStr, sizeof(errStr));
 			errmsg.LogError(0, RS_RET_ERR, "imfile: could not remove state "
@@ -1793,7 +2462,7 @@ static void
 in_handleFileEvent(struct inotify_event *ev, const wd_map_t *const etry)
 {
 	if(ev->mask & IN_MODIFY) {
-		pollFile(etry->pLstn, NULL);
+		schedulePollFile(etry->pLstn);
 	} else {
 		DBGPRINTF("imfile: got non-expected inotify event:\n");
 		in_dbg_showEv(ev);
@@ -1872,6 +2541,14 @@ do_inotify(void)
 	in_setupInitialWatches();
 
 	while(glbl.GetGlobalInputTermState() == 0) {
+		if(stateJournal.pszName != NULL) {
+			/* do not keep state records pending for too long if idle */
+			struct pollfd pfd = { .fd = ino_fd, .events = POLLIN, .revents = 0 };
+			if(poll(&pfd, 1, runModConf->iStateJournalFlushInterval) == 0) {
+				journalFlush(1);
+				continue;
+			}
+		}
 		rd = read(ino_fd, iobuf, sizeof(iobuf));
 		if(rd < 0 && Debug) {
 			char errStr[1024];
@@ -1912,10 +2589,13 @@ BEGINrunInput
 CODESTARTrunInput
 	DBGPRINTF("imfile: working in %s mode\n",
 		 (runModConf->opMode == OPMODE_POLLING) ? "polling" : "inotify");
+	journalOpen();
+	wrkrPoolStart();
 	if(runModConf->opMode == OPMODE_POLLING)
 		iRet = doPolling();
 	else
 		iRet = do_inotify();
+	wrkrPoolStop();
 
 	DBGPRINTF("imfile: terminating upon request of rsyslog core\n");
 ENDrunInput
@@ -1952,6 +2632,12 @@ persistStrmState(lstn_t *pLstn)
 	uchar statefile[MAXFNAME];
 
 	uchar *const statefn = getStateFileName(pLstn, statefile, sizeof(statefile));
+	if(stateJournal.pszName != NULL) {
+		DBGPRINTF("imfile: persisting state for '%s' to journal, key '%s'\n",
+			  pLstn->pszFileName, statefn);
+		CHKiRet(journalAddRecord(statefn, pLstn->pStrm));
+		FINALIZE;
+	}
 	DBGPRINTF("imfile: persisting state for '%s' to file '%s'\n",
 		  pLstn->pszFileName, statefn);
 	CHKiRet(strm.Construct(&psSF));
@@ -1992,6 +2678,7 @@ CODESTARTafterRun
 		/* Note: lstnDel() reasociates root! */
 		lstnDel(runModConf->pRootLstn);
 	}
+	journalClose();
 
 	if(pInputName != NULL)
 		prop.Destruct(&pInputName);
@@ -2018,6 +2705,10 @@ CODESTARTmodExit
 	objRelease(errmsg, CORE_COMPONENT);
 	objRelease(prop, CORE_COMPONENT);
 	objRelease(ruleset, CORE_COMPONENT);
+	pthread_mutex_destroy(&wrkrPool.mut);
+	pthread_cond_destroy(&wrkrPool.workAvail);
+	pthread_cond_destroy(&wrkrPool.lstnIdle);
+	pthread_mutex_destroy(&stateJournal.mut);
 #if HAVE_INOTIFY_INIT
 	/* we use these vars only in inotify mode */
 	if(dirs != NULL) {
@@ -2095,6 +2786,10 @@ CODEmodInit_QueryRegCFSLineHdlr
 	CHKiRet(objUse(strm, CORE_COMPONENT));
 	CHKiRet(objUse(ruleset, CORE_COMPONENT));
 	CHKiRet(objUse(prop, CORE_COMPONENT));
+	pthread_mutex_init(&wrkrPool.mut, NULL);
+	pthread_cond_init(&wrkrPool.workAvail, NULL);
+	pthread_cond_init(&wrkrPool.lstnIdle, NULL);
+	pthread_mutex_init(&stateJournal.mut, NULL);
 
 	DBGPRINTF("imfile: version %s initializing\n", VERSION);
 	CHKiRet(omsdRegCFSLineHdlr((uchar *)"inputfilename", 0, eCmdHdlrGetWord,
@@ -76,6 +76,10 @@ static struct configSettings_s {
 	int iDfltSeverity;
 	int iDfltFacility;
 	int bUseJnlPID;
+	int batchSize;		/* max nbr of entries read before submitting them */
+	char **fields;		/* if set, only these fields are exported */
+	int nFields;
+	char *journalFile;	/* read from this journal file instead of system journal */
 } cs;
 
 static rsRetVal facilityHdlr(uchar **pp, void *pVal);
@@ -90,6 +94,9 @@ static struct cnfparamdescr modpdescr[] = {
 	{ "defaultseverity", eCmdHdlrSeverity, 0 },
 	{ "defaultfacility", eCmdHdlrString, 0 },
 	{ "usepidfromsystem", eCmdHdlrBinary, 0 },
+	{ "batchsize", eCmdHdlrPositiveInt, 0 },
+	{ "fields", eCmdHdlrArray, 0 },
+	{ "file", eCmdHdlrGetWord, 0 },
 };
 static struct cnfparamblk modpblk =
 	{ CNFPARAMBLK_VERSION,
@@ -98,6 +105,7 @@ static struct cnfparamblk modpblk =
 	};
 
 #define DFLT_persiststateinterval 10
+#define DFLT_batchsize 32
 #define DFLT_SEVERITY pri2sev(LOG_NOTICE)
 #define DFLT_FACILITY pri2fac(LOG_USER)
 
@@ -170,10 +178,12 @@ finalize_it:
 
 /* enqueue the the journal message into the message queue.
  * The provided msg string is not freed - thus must be done
- * by the caller.
+ * by the caller. The message is added to the current batch, which
+ * is submitted by the caller.
  */
 static rsRetVal
-enqMsg(uchar *msg, uchar *pszTag, int iFacility, int iSeverity, struct timeval *tp, struct json_object *json, int sharedJsonProperties)
+enqMsg(uchar *msg, uchar *pszTag, int iFacility, int iSeverity, struct timeval *tp, struct json_object *json,
+	int sharedJsonProperties, multi_submit_t *const pMultiSub)
 {
 	struct syslogTime st;
 	msg_t *pMsg;
@@ -207,7 +217,35 @@ enqMsg(uchar *msg, uchar *pszTag, int iFacility, int iSeverity, struct timeval *
 		msgAddJSON(pMsg, (uchar*)"!", json, 0, sharedJsonProperties);
 	}
 
-	CHKiRet(ratelimitAddMsg(ratelimiter, NULL, pMsg));
+	CHKiRet(ratelimitAddMsg(ratelimiter, pMultiSub, pMsg));
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* add only the configured fields to the json object. This saves us from
+ * enumerating and copying all fields of each entry, which is costly at
+ * high journald rates.
+ */
+static rsRetVal
+addWhitelistedFields(struct json_object *json)
+{
+	const void *get;
+	size_t l;
+	size_t prefixlen;
+	char *data;
+	int i;
+	DEFiRet;
+
+	for(i = 0 ; i < cs.nFields ; ++i) {
+		if(sd_journal_get_data(j, cs.fields[i], &get, &l) < 0)
+			continue; /* field not present in this entry */
+		prefixlen = strlen(cs.fields[i]) + 1; /* name + '=' */
+		CHKiRet(sanitizeValue(((const char *)get) + prefixlen, l - prefixlen, &data));
+		json_object_object_add(json, cs.fields[i], json_object_new_string(data));
+		free(data);
+	}
 
 finalize_it:
 	RETiRet;
@@ -218,7 +256,7 @@ finalize_it:
  * record of printk buffer.
  */
 static rsRetVal
-readjournal(void)
+readjournal(multi_submit_t *const pMultiSub)
 {
 	DEFiRet;
 
@@ -318,38 +356,42 @@ readjournal(void)
 
 	json = json_object_new_object();
 
-	SD_JOURNAL_FOREACH_DATA(j, get, l) {
-		char *data;
-		char *name;
-
-		/* locate equal sign, this is always present */
-		equal_sign = memchr(get, '=', l);
+	if(cs.nFields > 0) {
+		CHKiRet(addWhitelistedFields(json));
+	} else {
+		SD_JOURNAL_FOREACH_DATA(j, get, l) {
+			char *data;
+			char *name;
+
+			/* locate equal sign, this is always present */
+			equal_sign = memchr(get, '=', l);
+
+			/* ... but we know better than to trust the specs */
+			if (equal_sign == NULL) {
+				errmsg.LogError(0, RS_RET_ERR, "SD_JOURNAL_FOREACH_DATA()"
+					"returned a malformed field (has no '='): '%s'", (char*)get);
+				continue; /* skip the entry */
+			}
 
-		/* ... but we know better than to trust the specs */
-		if (equal_sign == NULL) {
-			errmsg.LogError(0, RS_RET_ERR, "SD_JOURNAL_FOREACH_DATA()"
-				"returned a malformed field (has no '='): '%s'", (char*)get);
-			continue; /* skip the entry */
-		}
+			/* get length of journal data prefix */
+			prefixlen = ((char *)equal_sign - (char *)get);
 
-		/* get length of journal data prefix */
-		prefixlen = ((char *)equal_sign - (char *)get);
+			name = strndup(get, prefixlen);
+			CHKmalloc(name);
 
-		name = strndup(get, prefixlen);
-		CHKmalloc(name);
+			prefixlen++; /* remove '=' */
 
-		prefixlen++; /* remove '=' */
+			CHKiRet_Hdlr(sanitizeValue(((const char *)get) + prefixlen, l - prefixlen, &data)) {
+				free (name);
+				FINALIZE;
+			}
 
-		CHKiRet_Hdlr(sanitizeValue(((const char *)get) + prefixlen, l - prefixlen, &data)) {
+			/* and save them to json object */
+			jval = json_object_new_string((char *)data);
+			json_object_object_add(json, name, jval);
+			free (data);
 			free (name);
-			FINALIZE;
 		}
-
-		/* and save them to json object */
-		jval = json_object_new_string((char *)data);
-		json_object_object_add(json, name, jval);
-		free (data);
-		free (name);
 	}
 
 	/* calculate timestamp */
@@ -359,7 +401,7 @@ readjournal(void)
 	}
 
 	/* submit message */
-	enqMsg((uchar *)message, (uchar *) sys_iden_help, facility, severity, &tv, json, 0);
+	enqMsg((uchar *)message, (uchar *) sys_iden_help, facility, severity, &tv, json, 0, pMultiSub);
 
 finalize_it:
 	if (sys_iden_help != NULL)
@@ -533,9 +575,36 @@ finalize_it:
 	RETiRet;
 }
 
+/* submit the current batch and persist our position, if due. We persist
+ * only at batch boundaries, so that the state file is not written more
+ * often than once per batch.
+ */
+static rsRetVal
+submitBatch(multi_submit_t *const pMultiSub, int *const pCount)
+{
+	DEFiRet;
+
+	CHKiRet(multiSubmitFlush(pMultiSub));
+	if (cs.stateFile && *pCount >= cs.iPersistStateInterval) {
+		*pCount = 0;
+		persistJournalState();
+	}
+
+finalize_it:
+	RETiRet;
+}
+
+
 BEGINrunInput
 	int count = 0;
+	int nBatch = 0;
+	msg_t *pMsgs[CONF_NUM_MULTISUB];
+	multi_submit_t multiSub;
 CODESTARTrunInput
+	multiSub.ppMsgs = pMsgs;
+	multiSub.maxElem = CONF_NUM_MULTISUB;
+	multiSub.nElem = 0;
+
 	CHKiRet(ratelimitNew(&ratelimiter, "imjournal", NULL));
 	dbgprintf("imjournal: ratelimiting burst %d, interval %d\n", cs.ratelimitBurst,
 		  cs.ratelimitInterval);
@@ -576,23 +645,26 @@ CODESTARTrunInput
 		}
 
 		if (r == 0) {
-			/* No new messages, wait for activity. */
+			/* No new messages, submit what we have and wait for activity. */
+			if (nBatch > 0) {
+				nBatch = 0;
+				CHKiRet(submitBatch(&multiSub, &count));
+			}
 			CHKiRet(pollJournal());
 			continue;
 		}
 
-		CHKiRet(readjournal());
-		if (cs.stateFile) { /* can't persist without a state file */
-			/* TODO: This could use some finer metric. */
-			count++;
-			if (count == cs.iPersistStateInterval) {
-				count = 0;
-				persistJournalState();
-			}
+		CHKiRet(readjournal(&multiSub));
+		count++;
+		if (++nBatch >= cs.batchSize) {
+			nBatch = 0;
+			CHKiRet(submitBatch(&multiSub, &count));
 		}
 	}
 
 finalize_it:
+	/* the cursor is persisted in afterRun, so we must not lose the batch */
+	multiSubmitFlush(&multiSub);
 ENDrunInput
 
 
@@ -607,6 +679,10 @@ CODESTARTbeginCnfLoad
 	cs.iDfltSeverity = DFLT_SEVERITY;
 	cs.iDfltFacility = DFLT_FACILITY;
 	cs.bUseJnlPID = 0;
+	cs.batchSize = DFLT_batchsize;
+	cs.fields = NULL;
+	cs.nFields = 0;
+	cs.journalFile = NULL;
 ENDbeginCnfLoad
 
 
@@ -626,15 +702,33 @@ ENDactivateCnf
 
 
 BEGINfreeCnf
+	int i;
 CODESTARTfreeCnf
 	free(cs.stateFile);
+	for(i = 0 ; i < cs.nFields ; ++i)
+		free(cs.fields[i]);
+	free(cs.fields);
+	free(cs.journalFile);
 ENDfreeCnf
 
 /* open journal */
 BEGINwillRun
 CODESTARTwillRun
 	int ret;
-	ret = sd_journal_open(&j, SD_JOURNAL_LOCAL_ONLY);
+	if (cs.journalFile != NULL) {
+#		ifdef HAVE_SD_JOURNAL_OPEN_FILES
+		const char *paths[2];
+		paths[0] = cs.journalFile;
+		paths[1] = NULL;
+		ret = sd_journal_open_files(&j, paths, 0);
+#		else
+		errmsg.LogError(0, RS_RET_NOT_IMPLEMENTED, "imjournal: parameter 'file' "
+			"is not supported by this version of libsystemd");
+		ret = -ENOSYS;
+#		endif
+	} else {
+		ret = sd_journal_open(&j, SD_JOURNAL_LOCAL_ONLY);
+	}
 	if (ret < 0) {
 		iRet = RS_RET_IO_ERROR;
 	}
@@ -710,6 +804,18 @@ CODESTARTsetModCnf
 			free(fac);
 		} else if (!strcmp(modpblk.descr[i].name, "usepidfromsystem")) {
 			cs.bUseJnlPID = (int) pvals[i].val.d.n;
+		} else if (!strcmp(modpblk.descr[i].name, "batchsize")) {
+			cs.batchSize = (int) pvals[i].val.d.n;
+		} else if (!strcmp(modpblk.descr[i].name, "fields")) {
+			struct cnfarray *const ar = pvals[i].val.d.ar;
+			int k;
+			CHKmalloc(cs.fields = calloc(ar->nmemb, sizeof(char*)));
+			for (k = 0 ; k < ar->nmemb ; ++k) {
+				CHKmalloc(cs.fields[k] = es_str2cstr(ar->arr[k], NULL));
+				cs.nFields = k + 1;
+			}
+		} else if (!strcmp(modpblk.descr[i].name, "file")) {
+			cs.journalFile = (char *)es_str2cstr(pvals[i].val.d.estr, NULL);
 		} else {
 			dbgprintf("imjournal: program error, non-handled "
 				"param '%s' in beginCnfLoad\n", modpblk.descr[i].name);
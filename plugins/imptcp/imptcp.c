@@ -53,6 +53,7 @@
 #include <sys/queue.h>
 #include <netinet/tcp.h>
 #include <stdint.h>
+#include <signal.h>
 #include <zlib.h>
 #if HAVE_FCNTL_H
 #include <fcntl.h>
@@ -98,6 +99,12 @@ static void * wrkr(void *myself);
 #define DFLT_wrkrMax 2
 #define DFLT_inlineDispatchThreshold 1
 
+/* the epoll loops are woken up by SIGTTIN on termination. To guard against
+ * the signal arriving just before we enter epoll_wait(), we do not block
+ * forever but re-check the termination state periodically.
+ */
+#define EVTLOOP_TIMEOUT 1000 /* ms */
+
 #define COMPRESS_NEVER 0
 #define COMPRESS_SINGLE_MSG 1	/* old, single-message compression */
 /* all other settings are for stream-compression */
@@ -139,6 +146,9 @@ struct instanceConf_s {
 	sbool bUnlink;
 	int ratelimitInterval;
 	int ratelimitBurst;
+	uchar *ratelimitKey;		/* if set, ratelimit per key instead of per listener */
+	int ratelimitMaxKeys;
+	uchar *ratelimitKeyStats;	/* dyn_stats bucket for per-key drop counts */
 	struct instanceConf_s *next;
 };
 
@@ -148,6 +158,7 @@ struct modConfData_s {
 	instanceConf_t *root, *tail;
 	int wrkrMax;
 	int bProcessOnPoller;
+	int nEvtLoops;			/* number of independent event loops, 0 - classic poller/worker mode */
 	sbool configSetViaV2Method;
 };
 
@@ -157,7 +168,8 @@ static modConfData_t *runModConf = NULL;/* modConf ptr to use for the current lo
 /* module-global parameters */
 static struct cnfparamdescr modpdescr[] = {
 	{ "threads", eCmdHdlrPositiveInt, 0 },
-	{ "processOnPoller", eCmdHdlrBinary, 0 }
+	{ "processOnPoller", eCmdHdlrBinary, 0 },
+	{ "eventLoops", eCmdHdlrPositiveInt, 0 }
 };
 static struct cnfparamblk modpblk =
 	{ CNFPARAMBLK_VERSION,
@@ -184,7 +196,10 @@ static struct cnfparamdescr inppdescr[] = {
 	{ "keepalive.interval", eCmdHdlrInt, 0 },
 	{ "addtlframedelimiter", eCmdHdlrInt, 0 },
 	{ "ratelimit.interval", eCmdHdlrInt, 0 },
-	{ "ratelimit.burst", eCmdHdlrInt, 0 }
+	{ "ratelimit.burst", eCmdHdlrInt, 0 },
+	{ "ratelimit.key", eCmdHdlrString, 0 },
+	{ "ratelimit.maxkeys", eCmdHdlrPositiveInt, 0 },
+	{ "ratelimit.keystats", eCmdHdlrString, 0 }
 };
 static struct cnfparamblk inppblk =
 	{ CNFPARAMBLK_VERSION,
@@ -254,7 +269,8 @@ struct ptcpsess_s {
 	} inputState;		/* our current state */
 	int iOctetsRemain;	/* Number of Octets remaining in message */
 	TCPFRAMINGMODE eFraming;
-	uchar *pMsg;		/* message (fragment) received */
+	uchar *pMsg;		/* message (fragment) received, points into pChunk */
+	msgChunk_t *pChunk;	/* receive chunk, handed over to messages without copying */
 	prop_t *peerName;	/* host name we received messages from */
 	prop_t *peerIP;
 //--- END from tcps_sess.h
@@ -286,6 +302,22 @@ static struct wrkrInfo_s {
 } *wrkrInfo;
 static int wrkrRunning;
 
+/* The event loops. In classic mode, there is only one, serviced by the
+ * poller (runInput) thread, which hands work over to the worker pool. In
+ * event loop mode, each loop has its own thread, epoll set, (SO_REUSEPORT)
+ * listen sockets and thus sessions. Everything is processed on the loop
+ * thread, so a session never moves between threads.
+ */
+typedef struct evtLoop_s {
+	pthread_t tid;
+	int id;
+	int epollfd;
+	sbool bThrdStarted;		/* do we have a thread (loops other than the first)? */
+	long long unsigned numCalled;	/* how many events were processed */
+} evtLoop_t;
+static evtLoop_t *evtLoops = NULL;
+static int nEvtLoops;		/* number of entries in evtLoops */
+
 
 /* type of object stored in epoll descriptor */
 typedef enum {
@@ -300,6 +332,7 @@ struct epolld_s {
 	epolld_type_t typ;
 	void *ptr;
 	int sock;
+	int epollfd;		/* epoll set this descriptor belongs to */
 	struct epoll_event ev;
 };
 
@@ -321,25 +354,25 @@ typedef struct io_q_s {
 /* global data */
 pthread_attr_t wrkrThrdAttr;	/* Attribute for session threads; read only after startup */
 static ptcpsrv_t *pSrvRoot = NULL;
-static int epollfd = -1;			/* (sole) descriptor for epoll */
 static int iMaxLine; /* maximum size of a single message */
 static io_q_t io_q;
 
 /* forward definitions */
 static rsRetVal resetConfigVariables(uchar __attribute__((unused)) *pp, void __attribute__((unused)) *pVal);
-static rsRetVal addLstn(ptcpsrv_t *pSrv, int sock, int isIPv6);
+static rsRetVal addLstn(ptcpsrv_t *pSrv, evtLoop_t *pLoop, int sock, int isIPv6);
 
 
 /* some simple constructors/destructors */
 static void
 destructSess(ptcpsess_t *pSess)
 {
-	free(pSess->pMsg);
+	msgChunkRelease(pSess->pChunk);
 	free(pSess->epd);
 	prop.Destruct(&pSess->peerName);
 	prop.Destruct(&pSess->peerIP);
 	/* TODO: make these inits compile-time switch depending: */
 	pSess->pMsg = NULL;
+	pSess->pChunk = NULL;
 	pSess->epd = NULL;
 	free(pSess);
 }
@@ -368,7 +401,7 @@ destructSrv(ptcpsrv_t *pSrv)
  * so far was to keep everything related close togehter. -- rgerhards, 2010-08-10
  */
 
-static rsRetVal startupUXSrv(ptcpsrv_t *pSrv) {
+static rsRetVal startupUXSrv(ptcpsrv_t *pSrv, evtLoop_t *pLoop) {
 	DEFiRet;
 	int sock;
 	int sockflags;
@@ -411,7 +444,7 @@ static rsRetVal startupUXSrv(ptcpsrv_t *pSrv) {
 		ABORT_FINALIZE(RS_RET_ERR_CRE_AFUX);
 	}
 
-	CHKiRet(addLstn(pSrv, sock, 0));
+	CHKiRet(addLstn(pSrv, pLoop, sock, 0));
 
 finalize_it:
 	if (iRet != RS_RET_OK) {
@@ -426,9 +459,12 @@ finalize_it:
 /* Start up a server. That means all of its listeners are created.
  * Does NOT yet accept/process any incoming data (but binds ports). Hint: this
  * code is to be executed before dropping privileges.
+ * The listeners are added to the given event loop. If bReusePort is set,
+ * the sockets are bound with SO_REUSEPORT, so that each event loop can have
+ * its own listeners for the same address and port.
  */
 static rsRetVal
-startupSrv(ptcpsrv_t *pSrv)
+startupSrv(ptcpsrv_t *pSrv, evtLoop_t *pLoop, const int bReusePort)
 {
 	DEFiRet;
 	int error, maxs, on = 1;
@@ -440,7 +476,7 @@ startupSrv(ptcpsrv_t *pSrv)
 	int isIPv6 = 0;
 
 	if (pSrv->bUnixSocket) {
-		return startupUXSrv(pSrv);
+		return startupUXSrv(pSrv, pLoop);
 	}
 
 	lstnIP = pSrv->lstnIP == NULL ? UCHAR_CONSTANT("") : pSrv->lstnIP;
@@ -497,6 +533,15 @@ startupSrv(ptcpsrv_t *pSrv)
 			continue;
 		}
 
+#ifdef SO_REUSEPORT
+		if(bReusePort && setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, (char *) &on, sizeof(on)) < 0 ) {
+			errmsg.LogError(errno, NO_ERRCODE, "imptcp: error setting SO_REUSEPORT");
+			close(sock);
+			sock = -1;
+			continue;
+		}
+#endif
+
 		/* We use non-blocking IO! */
 		if((sockflags = fcntl(sock, F_GETFL)) != -1) {
 			sockflags |= O_NONBLOCK;
@@ -553,7 +598,7 @@ startupSrv(ptcpsrv_t *pSrv)
 		/* if we reach this point, we were able to obtain a valid socket, so we can
 		 * create our listener object. -- rgerhards, 2010-08-10
 		 */
-		CHKiRet(addLstn(pSrv, sock, isIPv6));
+		CHKiRet(addLstn(pSrv, pLoop, sock, isIPv6));
 		++numSocks;
 	}
 
@@ -811,7 +856,7 @@ doSubmitMsg(ptcpsess_t *pThis, struct syslogTime *stTime, time_t ttGenTime, mult
 
 	/* we now create our own message object and submit it to the queue */
 	CHKiRet(msgConstructWithTime(&pMsg, stTime, ttGenTime));
-	MsgSetRawMsg(pMsg, (char*)pThis->pMsg, pThis->iMsg);
+	MsgSetRawMsgFromChunk(pMsg, &pThis->pChunk, &pThis->pMsg, pThis->iMsg, iMaxLine + 1);
 	MsgSetInputName(pMsg, pSrv->pInputName);
 	MsgSetFlowControlType(pMsg, eFLOWCTL_LIGHT_DELAY);
 	if(pSrv->dfltTZ != NULL)
@@ -873,7 +918,12 @@ processDataRcvd(ptcpsess_t *const __restrict__ pThis,
 
 	if(pThis->inputState == eInOctetCnt) {
 		if(isdigit(c)) {
-			pThis->iOctetsRemain = pThis->iOctetsRemain * 10 + c - '0';
+			/* stop accumulating before the count overflows (it would become
+			 * negative and break the block copy below); such a frame is
+			 * truncated to iMaxLine anyway.
+			 */
+			if(pThis->iOctetsRemain <= 200000000)
+				pThis->iOctetsRemain = pThis->iOctetsRemain * 10 + c - '0';
 		} else { /* done with the octet count, so this must be the SP terminator */
 			DBGPRINTF("TCP Message with octet-counter, size %d.\n", pThis->iOctetsRemain);
 			if(c != ' ') {
@@ -959,6 +1009,71 @@ finalize_it:
 }
 
 
+/* process a block of octet-stuffed (delimiter-terminated) frame data.
+ * This is the fast path for the by far most common framing: instead of
+ * passing each byte through the state machine, we search the delimiter
+ * with memchr() (which is vectorized in all relevant libcs) and copy the
+ * frame content in one go. Large frames are split at iMaxLine, exactly
+ * as processDataRcvd() would do. If the frame is not yet complete, its
+ * content is kept in the session buffer and the state is not changed.
+ * On return, *buff points to the first unprocessed byte.
+ */
+static rsRetVal
+processOctetStuffedBlock(ptcpsess_t *const __restrict__ pThis,
+	char **buff,
+	char *const pEnd,
+	struct syslogTime *stTime,
+	const time_t ttGenTime,
+	multi_submit_t *pMultiSub,
+	unsigned *const __restrict__ pnMsgs)
+{
+	char *pData = *buff;
+	char *pDelim;
+	char *pAddtlDelim;
+	char *pFrameEnd;
+	int lenCopy;
+	const int iAddtlFrameDelim = pThis->pLstn->pSrv->iAddtlFrameDelim;
+	DEFiRet;
+
+	pDelim = memchr(pData, '\n', pEnd - pData);
+	if(iAddtlFrameDelim != TCPSRV_NO_ADDTL_DELIMITER) {
+		pAddtlDelim = memchr(pData, iAddtlFrameDelim, ((pDelim == NULL) ? pEnd : pDelim) - pData);
+		if(pAddtlDelim != NULL)
+			pDelim = pAddtlDelim;
+	}
+	pFrameEnd = (pDelim == NULL) ? pEnd : pDelim;
+
+	while(pData < pFrameEnd) {
+		if(pThis->iMsg >= iMaxLine) {
+			DBGPRINTF("error: message received is larger than max msg size, we split it\n");
+			doSubmitMsg(pThis, stTime, ttGenTime, pMultiSub);
+			++(*pnMsgs);
+		}
+		lenCopy = pFrameEnd - pData;
+		if(lenCopy > iMaxLine - pThis->iMsg)
+			lenCopy = iMaxLine - pThis->iMsg;
+		memcpy(pThis->pMsg + pThis->iMsg, pData, lenCopy);
+		pThis->iMsg += lenCopy;
+		pData += lenCopy;
+	}
+
+	if(pDelim != NULL) {
+		if(pThis->iMsg >= iMaxLine) {
+			/* the state machine would split here as well, resulting in an empty frame */
+			doSubmitMsg(pThis, stTime, ttGenTime, pMultiSub);
+			++(*pnMsgs);
+		}
+		doSubmitMsg(pThis, stTime, ttGenTime, pMultiSub);
+		++(*pnMsgs);
+		pThis->inputState = eAtStrtFram;
+		++pData; /* skip delimiter */
+	}
+
+	*buff = pData;
+	RETiRet;
+}
+
+
 /* Processes the data received via a TCP session. If there
  * is no other way to handle it, data is discarded.
  * Input parameter data is the data received, iLen is its
@@ -992,13 +1107,24 @@ DataRcvdUncompressed(ptcpsess_t *pThis, char *pData, size_t iLen, struct syslogT
 	multiSub.ppMsgs = pMsgs;
 	multiSub.maxElem = CONF_NUM_MULTISUB;
 	multiSub.nElem = 0;
+	if(pThis->iMsg == 0) /* no partial message, so we may be able to recycle the chunk */
+		msgChunkRewind(pThis->pChunk, &pThis->pMsg);
 
 	 /* We now copy the message to the session buffer. */
 	pEnd = pData + iLen; /* this is one off, which is intensional */
 
+	/* Frame headers (and octet counts) go through the state machine byte by
+	 * byte. Frame content is processed as a block: octet-counted content is
+	 * copied in one go by processDataRcvd(), octet-stuffed content is handled
+	 * by processOctetStuffedBlock().
+	 */
 	while(pData < pEnd) {
-		CHKiRet(processDataRcvd(pThis, &pData, pEnd - pData, stTime, ttGenTime, &multiSub, &nMsgs));
-		pData++;
+		if(pThis->inputState == eInMsg && pThis->eFraming == TCP_FRAMING_OCTET_STUFFING) {
+			CHKiRet(processOctetStuffedBlock(pThis, &pData, pEnd, stTime, ttGenTime, &multiSub, &nMsgs));
+		} else {
+			CHKiRet(processDataRcvd(pThis, &pData, pEnd - pData, stTime, ttGenTime, &multiSub, &nMsgs));
+			pData++;
+		}
 	}
 
 	iRet = multiSubmitFlush(&multiSub);
@@ -1094,9 +1220,13 @@ initConfigSettings(void)
 
 
 /* add socket to the epoll set
+ * In classic mode, the socket is armed one-shot, so that only a single
+ * worker processes it at a time (it is re-armed after processing). In event
+ * loop mode, only the loop thread ever processes it, so we use plain
+ * level-triggered mode and save the re-arm.
  */
 static rsRetVal
-addEPollSock(epolld_type_t typ, void *ptr, int sock, epolld_t **pEpd)
+addEPollSock(epolld_type_t typ, void *ptr, int sock, int epollfd, epolld_t **pEpd)
 {
 	DEFiRet;
 	epolld_t *epd = NULL;
@@ -1105,8 +1235,9 @@ addEPollSock(epolld_type_t typ, void *ptr, int sock, epolld_t **pEpd)
 	epd->typ = typ;
 	epd->ptr = ptr;
 	epd->sock = sock;
+	epd->epollfd = epollfd;
 	*pEpd = epd;
-	epd->ev.events = EPOLLIN|EPOLLET|EPOLLONESHOT;
+	epd->ev.events = (runModConf->nEvtLoops > 0) ? EPOLLIN : EPOLLIN|EPOLLET|EPOLLONESHOT;
 	epd->ev.data.ptr = (void*) epd;
 
 	if(epoll_ctl(epollfd, EPOLL_CTL_ADD, sock, &(epd->ev)) != 0) {
@@ -1141,9 +1272,9 @@ removeEPollSock(int sock, epolld_t *epd)
 {
 	DEFiRet;
 
-	DBGPRINTF("imptcp: removing socket %d from epoll[%d] set\n", sock, epollfd);
+	DBGPRINTF("imptcp: removing socket %d from epoll[%d] set\n", sock, epd->epollfd);
 
-	if(epoll_ctl(epollfd, EPOLL_CTL_DEL, sock, &(epd->ev)) != 0) {
+	if(epoll_ctl(epd->epollfd, EPOLL_CTL_DEL, sock, &(epd->ev)) != 0) {
 		char errStr[1024];
 		int eno = errno;
 		errmsg.LogError(0, RS_RET_EPOLL_CTL_FAILED, "os error (%d) during epoll DEL: %s",
@@ -1159,7 +1290,7 @@ finalize_it:
 /* add a listener to the server 
  */
 static rsRetVal
-addLstn(ptcpsrv_t *pSrv, int sock, int isIPv6)
+addLstn(ptcpsrv_t *pSrv, evtLoop_t *pLoop, int sock, int isIPv6)
 {
 	DEFiRet;
 	ptcplstn_t *pLstn = NULL;
@@ -1178,9 +1309,16 @@ addLstn(ptcpsrv_t *pSrv, int sock, int isIPv6)
 		inputname = pSrv->pszInputName;
 	}
 	CHKiRet(statsobj.Construct(&(pLstn->stats)));
-	snprintf((char*)statname, sizeof(statname), "%s(%s/%s/%s)", inputname,
-		(pSrv->lstnIP == NULL) ? "*" : (char*)pSrv->lstnIP, pSrv->port,
-		isIPv6 ? "IPv6" : "IPv4");
+	if(runModConf->nEvtLoops > 1) {
+		/* each loop has its own listener for this address */
+		snprintf((char*)statname, sizeof(statname), "%s(%s/%s/%s/loop%d)", inputname,
+			(pSrv->lstnIP == NULL) ? "*" : (char*)pSrv->lstnIP, pSrv->port,
+			isIPv6 ? "IPv6" : "IPv4", pLoop->id);
+	} else {
+		snprintf((char*)statname, sizeof(statname), "%s(%s/%s/%s)", inputname,
+			(pSrv->lstnIP == NULL) ? "*" : (char*)pSrv->lstnIP, pSrv->port,
+			isIPv6 ? "IPv6" : "IPv4");
+	}
 	statname[sizeof(statname)-1] = '\0'; /* just to be on the save side... */
 	CHKiRet(statsobj.SetName(pLstn->stats, statname));
 	CHKiRet(statsobj.SetOrigin(pLstn->stats, (uchar*)"imptcp"));
@@ -1197,7 +1335,7 @@ addLstn(ptcpsrv_t *pSrv, int sock, int isIPv6)
 		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &(pLstn->rcvdDecompressed)));
 	CHKiRet(statsobj.ConstructFinalize(pLstn->stats));
 
-	CHKiRet(addEPollSock(epolld_lstn, pLstn, sock, &pLstn->epd));
+	CHKiRet(addEPollSock(epolld_lstn, pLstn, sock, pLoop->epollfd, &pLstn->epd));
 
 	/* add to start of server's listener list */
 	pLstn->prev = NULL;
@@ -1229,7 +1367,9 @@ addSess(ptcplstn_t *pLstn, int sock, prop_t *peerName, prop_t *peerIP)
 	ptcpsrv_t *pSrv = pLstn->pSrv;
 
 	CHKmalloc(pSess = malloc(sizeof(ptcpsess_t)));
-	CHKmalloc(pSess->pMsg = malloc(iMaxLine));
+	pSess->pChunk = NULL;
+	CHKiRet(msgChunkConstruct(&pSess->pChunk, iMaxLine + 1 + MSGCHUNK_DFLT_SIZE));
+	pSess->pMsg = pSess->pChunk->buf;
 	pSess->pLstn = pLstn;
 	pSess->sock = sock;
 	pSess->bSuppOctetFram = pLstn->bSuppOctetFram;
@@ -1251,13 +1391,14 @@ addSess(ptcplstn_t *pLstn, int sock, prop_t *peerName, prop_t *peerIP)
 	pSrv->pSess = pSess;
 	pthread_mutex_unlock(&pSrv->mutSessLst);
 
-	CHKiRet(addEPollSock(epolld_sess, pSess, sock, &pSess->epd));
+	/* sessions stay on the event loop of the listener they were accepted on */
+	CHKiRet(addEPollSock(epolld_sess, pSess, sock, pLstn->epd->epollfd, &pSess->epd));
 
 finalize_it:
 	if(iRet != RS_RET_OK) {
 		if(pSess != NULL) {
-			if(pSess->pMsg != NULL)
-				free(pSess->pMsg);
+			if(pSess->pChunk != NULL)
+				msgChunkRelease(pSess->pChunk);
 			free(pSess);
 		}
 	}
@@ -1372,6 +1513,9 @@ createInstance(instanceConf_t **pinst)
 	inst->pBindRuleset = NULL;
 	inst->ratelimitBurst = 10000; /* arbitrary high limit */
 	inst->ratelimitInterval = 0; /* off */
+	inst->ratelimitKey = NULL;
+	inst->ratelimitMaxKeys = RATELIMIT_DFLT_MAXKEYS;
+	inst->ratelimitKeyStats = NULL;
 	inst->compressionMode = COMPRESS_SINGLE_MSG;
 
 	/* node created, let's add to config */
@@ -1482,6 +1626,10 @@ addListner(modConfData_t __attribute__((unused)) *modConf, instanceConf_t *inst)
 	CHKiRet(ratelimitNew(&pSrv->ratelimiter, "imptcp", (char*) pSrv->port));
 	ratelimitSetLinuxLike(pSrv->ratelimiter, inst->ratelimitInterval, inst->ratelimitBurst);
 	ratelimitSetThreadSafe(pSrv->ratelimiter);
+	if(inst->ratelimitKey != NULL) {
+		CHKiRet(ratelimitSetKeyed(pSrv->ratelimiter, inst->ratelimitKey,
+			inst->ratelimitMaxKeys, inst->ratelimitKeyStats));
+	}
 	/* add to linked list */
 	pSrv->pNext = pSrvRoot;
 	pSrvRoot = pSrv;
@@ -1542,6 +1690,44 @@ stopWorkerPool(void)
 
 
 
+/* start up a server on all event loops. In event loop mode, each loop
+ * receives its own set of SO_REUSEPORT listeners, so that the kernel
+ * distributes the incoming connections among the loops. Unix sockets
+ * can not be shared that way and are always serviced by the first loop.
+ * We consider the server started if at least one loop has listeners.
+ */
+static rsRetVal
+startupSrvOnLoops(ptcpsrv_t *pSrv)
+{
+	DEFiRet;
+	rsRetVal localRet;
+	int nOK;
+	int i;
+
+	if(runModConf->nEvtLoops == 0 || pSrv->bUnixSocket) {
+		iRet = startupSrv(pSrv, &evtLoops[0], 0);
+		FINALIZE;
+	}
+
+	nOK = 0;
+	for(i = 0 ; i < nEvtLoops ; ++i) {
+		localRet = startupSrv(pSrv, &evtLoops[i], 1);
+		if(localRet == RS_RET_OK)
+			++nOK;
+		else
+			iRet = localRet;
+	}
+	if(nOK > 0 && nOK < nEvtLoops) {
+		errmsg.LogError(0, iRet, "imptcp: could only create listeners for %d out of %d "
+				"event loops on port %s", nOK, nEvtLoops, pSrv->port);
+		iRet = RS_RET_OK;
+	}
+
+finalize_it:
+	RETiRet;
+}
+
+
 /* start up all listeners 
  * This is a one-time stop once the module is set to start.
  */
@@ -1559,7 +1745,7 @@ startupServers(void)
 	pSrv = pSrvRoot;
 	while(pSrv != NULL) {
 		DBGPRINTF("imptcp: starting up server for port %s, name '%s'\n", pSrv->port, pSrv->pszInputName);
-		localRet = startupSrv(pSrv);
+		localRet = startupSrvOnLoops(pSrv);
 		if(localRet == RS_RET_OK)
 			iOK++;
 		else
@@ -1683,8 +1869,8 @@ processWorkItem(epolld_t *epd)
 						"error: invalid epolld_type_t %d after epoll", epd->typ);
 		break;
 	}
-	if (continue_polling == 1) {
-		epoll_ctl(epollfd, EPOLL_CTL_MOD, epd->sock, &(epd->ev));
+	if (continue_polling == 1 && (epd->ev.events & EPOLLONESHOT)) {
+		epoll_ctl(epd->epollfd, EPOLL_CTL_MOD, epd->sock, &(epd->ev));
 	}
 }
 
@@ -1792,6 +1978,35 @@ processWorkSet(int nEvents, struct epoll_event events[])
 }
 
 
+/* run a single event loop (event loop mode). All events are processed
+ * on the calling thread, there is no handoff to the worker pool.
+ */
+static void
+runEvtLoop(evtLoop_t *const pLoop)
+{
+	int nEvents;
+	int iEvt;
+	struct epoll_event events[128];
+
+	DBGPRINTF("imptcp: event loop %d starting\n", pLoop->id);
+	while(glbl.GetGlobalInputTermState() == 0) {
+		nEvents = epoll_wait(pLoop->epollfd, events, sizeof(events)/sizeof(struct epoll_event),
+			EVTLOOP_TIMEOUT);
+		for(iEvt = 0 ; (iEvt < nEvents) && (glbl.GetGlobalInputTermState() == 0) ; ++iEvt) {
+			processWorkItem((epolld_t*)events[iEvt].data.ptr);
+			++pLoop->numCalled;
+		}
+	}
+}
+
+static void *
+evtLoopThrd(void *myself)
+{
+	runEvtLoop((evtLoop_t*) myself);
+	return NULL;
+}
+
+
 /* worker to process incoming requests
  */
 static void *
@@ -1902,6 +2117,12 @@ CODESTARTnewInpInst
 			inst->ratelimitBurst = (int) pvals[i].val.d.n;
 		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.interval")) {
 			inst->ratelimitInterval = (int) pvals[i].val.d.n;
+		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.key")) {
+			inst->ratelimitKey = (uchar*)es_str2cstr(pvals[i].val.d.estr, NULL);
+		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.maxkeys")) {
+			inst->ratelimitMaxKeys = (int) pvals[i].val.d.n;
+		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.keystats")) {
+			inst->ratelimitKeyStats = (uchar*)es_str2cstr(pvals[i].val.d.estr, NULL);
 		} else {
 			dbgprintf("imptcp: program error, non-handled "
 			  "param '%s'\n", inppblk.descr[i].name);
@@ -1927,6 +2148,7 @@ CODESTARTbeginCnfLoad
 	/* init our settings */
 	loadModConf->wrkrMax = DFLT_wrkrMax;
 	loadModConf->bProcessOnPoller = 1;
+	loadModConf->nEvtLoops = 0;
 	loadModConf->configSetViaV2Method = 0;
 	bLegacyCnfModGlobalsPermitted = 1;
 	/* init legacy config vars */
@@ -1957,6 +2179,13 @@ CODESTARTsetModCnf
 			loadModConf->wrkrMax = (int) pvals[i].val.d.n;
 		} else if(!strcmp(modpblk.descr[i].name, "processOnPoller")) {
 			loadModConf->bProcessOnPoller = (int) pvals[i].val.d.n;
+		} else if(!strcmp(modpblk.descr[i].name, "eventLoops")) {
+#			ifdef SO_REUSEPORT
+			loadModConf->nEvtLoops = (int) pvals[i].val.d.n;
+#			else
+			errmsg.LogError(0, RS_RET_PARAM_ERROR, "imptcp: eventLoops is not supported "
+					"on this platform (no SO_REUSEPORT) - ignored");
+#			endif
 		} else {
 			dbgprintf("imptcp: program error, non-handled "
 			  "param '%s' in beginCnfLoad\n", modpblk.descr[i].name);
@@ -2004,12 +2233,42 @@ BEGINcheckCnf
 CODESTARTcheckCnf
 	for(inst = pModConf->root ; inst != NULL ; inst = inst->next) {
 		std_checkRuleset(pModConf, inst);
+		ratelimitCheckKeyCnf("imptcp", &inst->ratelimitKey, &inst->ratelimitKeyStats);
 	}
 ENDcheckCnf
 
 
+/* create the epoll set for an event loop */
+static rsRetVal
+createEvtLoopEPoll(evtLoop_t *const pLoop)
+{
+	DEFiRet;
+#	if defined(EPOLL_CLOEXEC) && defined(HAVE_EPOLL_CREATE1)
+	DBGPRINTF("imptcp uses epoll_create1()\n");
+	pLoop->epollfd = epoll_create1(EPOLL_CLOEXEC);
+	if(pLoop->epollfd < 0 && errno == ENOSYS)
+#	endif
+	{
+		DBGPRINTF("imptcp uses epoll_create()\n");
+		/* reading the docs, the number of epoll events passed to
+		 * epoll_create() seems not to be used at all in kernels. So
+		 * we just provide "a" number, happens to be 10.
+		 */
+		pLoop->epollfd = epoll_create(10);
+	}
+
+	if(pLoop->epollfd < 0) {
+		errmsg.LogError(0, RS_RET_EPOLL_CR_FAILED, "error: epoll_create() failed");
+		ABORT_FINALIZE(RS_RET_NO_RUN);
+	}
+finalize_it:
+	RETiRet;
+}
+
+
 BEGINactivateCnfPrePrivDrop
 	instanceConf_t *inst;
+	int i;
 CODESTARTactivateCnfPrePrivDrop
 	iMaxLine = glbl.GetMaxLine(); /* get maximum size we currently support */
 	DBGPRINTF("imptcp: config params iMaxLine %d\n", iMaxLine);
@@ -2023,23 +2282,15 @@ CODESTARTactivateCnfPrePrivDrop
 		ABORT_FINALIZE(RS_RET_NO_RUN);
 	}
 
-#	if defined(EPOLL_CLOEXEC) && defined(HAVE_EPOLL_CREATE1)
-	DBGPRINTF("imptcp uses epoll_create1()\n");
-	epollfd = epoll_create1(EPOLL_CLOEXEC);
-	if(epollfd < 0 && errno == ENOSYS)
-#	endif
-	{
-		DBGPRINTF("imptcp uses epoll_create()\n");
-		/* reading the docs, the number of epoll events passed to
-		 * epoll_create() seems not to be used at all in kernels. So
-		 * we just provide "a" number, happens to be 10.
-		 */
-		epollfd = epoll_create(10);
+	/* classic mode uses a single "loop" shared by poller and workers */
+	nEvtLoops = (runModConf->nEvtLoops == 0) ? 1 : runModConf->nEvtLoops;
+	CHKmalloc(evtLoops = calloc(nEvtLoops, sizeof(evtLoop_t)));
+	for(i = 0 ; i < nEvtLoops ; ++i) {
+		evtLoops[i].id = i;
+		evtLoops[i].epollfd = -1;
 	}
-
-	if(epollfd < 0) {
-		errmsg.LogError(0, RS_RET_EPOLL_CR_FAILED, "error: epoll_create() failed");
-		ABORT_FINALIZE(RS_RET_NO_RUN);
+	for(i = 0 ; i < nEvtLoops ; ++i) {
+		CHKiRet(createEvtLoopEPoll(&evtLoops[i]));
 	}
 
 	/* start up servers, but do not yet read input data */
@@ -2065,6 +2316,8 @@ CODESTARTfreeCnf
 		free(inst->pszBindRuleset);
 		free(inst->pszInputName);
 		free(inst->dfltTZ);
+		free(inst->ratelimitKey);
+		free(inst->ratelimitKeyStats);
 		del = inst;
 		inst = inst->next;
 		free(del);
@@ -2073,22 +2326,50 @@ ENDfreeCnf
 
 
 /* This function is called to gather input.
+ * In event loop mode, we start one thread per additional loop and run
+ * the first loop on our own thread.
  */
 BEGINrunInput
 	int nEvents;
 	struct epoll_event events[128];
+	int i;
 CODESTARTrunInput
+	if(runModConf->nEvtLoops > 0) {
+		DBGPRINTF("imptcp: now beginning to process input data on %d event loops\n", nEvtLoops);
+		for(i = 1 ; i < nEvtLoops ; ++i) {
+			if(pthread_create(&evtLoops[i].tid, &wrkrThrdAttr, evtLoopThrd, &evtLoops[i]) == 0) {
+				evtLoops[i].bThrdStarted = 1;
+			} else {
+				errmsg.LogError(0, RS_RET_ERR, "imptcp: could not start thread for "
+						"event loop %d - its connections will not be served", i);
+			}
+		}
+		runEvtLoop(&evtLoops[0]);
+		for(i = 1 ; i < nEvtLoops ; ++i) {
+			if(evtLoops[i].bThrdStarted)
+				pthread_kill(evtLoops[i].tid, SIGTTIN);
+		}
+		for(i = 0 ; i < nEvtLoops ; ++i) {
+			if(evtLoops[i].bThrdStarted)
+				pthread_join(evtLoops[i].tid, NULL);
+			DBGPRINTF("imptcp: info: event loop %d processed %llu events\n", i, evtLoops[i].numCalled);
+		}
+		FINALIZE;
+	}
+
 	initIoQ();
 	startWorkerPool();
 	DBGPRINTF("imptcp: now beginning to process input data\n");
 	while(glbl.GetGlobalInputTermState() == 0) {
 		DBGPRINTF("imptcp going on epoll_wait\n");
-		nEvents = epoll_wait(epollfd, events, sizeof(events)/sizeof(struct epoll_event), -1);
+		nEvents = epoll_wait(evtLoops[0].epollfd, events, sizeof(events)/sizeof(struct epoll_event),
+			EVTLOOP_TIMEOUT);
 		DBGPRINTF("imptcp: epoll returned %d events\n", nEvents);
 		processWorkSet(nEvents, events);
 	}
 	DBGPRINTF("imptcp: successfully terminated\n");
 	/* we stop the worker pool in AfterRun, in case we get cancelled for some reason (old Interface) */
+finalize_it:
 ENDrunInput
 
 
@@ -2140,9 +2421,12 @@ shutdownSrv(ptcpsrv_t *pSrv)
 
 BEGINafterRun
 	ptcpsrv_t *pSrv, *srvDel;
+	int i;
 CODESTARTafterRun
-	stopWorkerPool();
-	destroyIoQ();
+	if(runModConf->nEvtLoops == 0) {
+		stopWorkerPool();
+		destroyIoQ();
+	}
 
 	/* we need to close everything that is still open */
 	pSrv = pSrvRoot;
@@ -2153,7 +2437,11 @@ CODESTARTafterRun
 		destructSrv(srvDel);
 	}
 
-	close(epollfd);
+	for(i = 0 ; i < nEvtLoops ; ++i) {
+		close(evtLoops[i].epollfd);
+	}
+	free(evtLoops);
+	evtLoops = NULL;
 ENDafterRun
 
 
@@ -0,0 +1,668 @@
+/* imshmring.c
+ * This is an input module for local high-rate producers. Each input
+ * instance creates a shared memory ring buffer (a file, usually on
+ * /dev/shm) into which producers write their messages with the help of
+ * libshmring (runtime/libshmring.[ch]). Writing a message does not
+ * require any system call, and neither does reading it as long as data
+ * is flowing. Only if the ring runs empty, we wait on a futex.
+ *
+ * Every ring is serviced by its own thread, the first one by the input
+ * thread itself. Records are consumed in batches and the space is handed
+ * back to the producers once per batch. If a producer finds the ring full,
+ * it may wait for space or drop the record. Dropped records are added to
+ * a drop counter inside the ring by the producer (shmringAddDrops()),
+ * which we report via impstats. So it is recommended to use one ring per
+ * producer, as this also gives per-producer drop counts.
+ *
+ * Records are regular syslog messages, just like the ones sent to the
+ * system log socket, and go through the regular parser chain.
+ *
+ * NOTE: read comments in module-template.h to understand how this file
+ *       works!
+ *
+ * This file is part of rsyslog.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include "rsyslog.h"
+#include "dirty.h"
+#include "module-template.h"
+#include "srUtils.h"
+#include "errmsg.h"
+#include "glbl.h"
+#include "msg.h"
+#include "datetime.h"
+#include "prop.h"
+#include "ruleset.h"
+#include "statsobj.h"
+#include "ratelimit.h"
+#include "unicode-helper.h"
+#include "libshmring.h"
+
+MODULE_TYPE_INPUT
+MODULE_TYPE_NOKEEP
+MODULE_CNFNAME("imshmring")
+
+/* defines */
+#define RING_SIZE_DFLT (4 * 1024 * 1024)
+#define BATCH_SIZE_DFLT 256	/* max records processed before space is released */
+#define WAIT_TIMEOUT 1000	/* ms, guards against missed termination signals */
+
+/* Module static data */
+DEF_IMOD_STATIC_DATA
+DEFobjCurrIf(errmsg)
+DEFobjCurrIf(glbl)
+DEFobjCurrIf(datetime)
+DEFobjCurrIf(prop)
+DEFobjCurrIf(ruleset)
+DEFobjCurrIf(statsobj)
+
+
+static struct lstn_s {
+	struct lstn_s *next;
+	shmring_t *pRing;
+	uchar *pszRing;		/* ring file name, for error messages */
+	ruleset_t *pRuleset;	/* bound ruleset */
+	prop_t *pInputName;
+	int bParseHost;
+	uint64_t lastDrops;	/* producer drop count at last check */
+	pthread_t tid;
+	int bThrdStarted;
+	statsobj_t *stats;	/* listener stats */
+	ratelimit_t *ratelimiter;
+	STATSCOUNTER_DEF(ctrSubmit, mutCtrSubmit)
+	STATSCOUNTER_DEF(ctrDropped, mutCtrDropped)
+	STATSCOUNTER_DEF(ctrWakeups, mutCtrWakeups)
+	STATSCOUNTER_DEF(ctrCorrupt, mutCtrCorrupt)
+} *lcnfRoot = NULL, *lcnfLast = NULL;
+
+
+static int iMaxLine;			/* maximum message size supported */
+static prop_t *pLocalHostIP = NULL;
+static thrdInfo_t *pInputThrd = NULL;	/* our input thread, needed by the ring threads */
+
+struct instanceConf_s {
+	uchar *pszRing;			/* name of ring file */
+	int64 ringSize;
+	int fCreateMode;
+	uid_t fileUID;
+	gid_t fileGID;
+	uchar *pszBindRuleset;		/* name of ruleset to bind to */
+	uchar *inputname;
+	ruleset_t *pBindRuleset;	/* ruleset to bind listener to (use system default if unspecified) */
+	int bParseHost;
+	int ratelimitInterval;
+	int ratelimitBurst;
+	struct instanceConf_s *next;
+};
+
+struct modConfData_s {
+	rsconf_t *pConf;		/* our overall config object */
+	instanceConf_t *root, *tail;
+	int batchSize;			/* max records per batch */
+};
+static modConfData_t *loadModConf = NULL;/* modConf ptr to use for the current load process */
+static modConfData_t *runModConf = NULL;/* modConf ptr to use for the current load process */
+
+/* module-global parameters */
+static struct cnfparamdescr modpdescr[] = {
+	{ "batchsize", eCmdHdlrPositiveInt, 0 }
+};
+static struct cnfparamblk modpblk =
+	{ CNFPARAMBLK_VERSION,
+	  sizeof(modpdescr)/sizeof(struct cnfparamdescr),
+	  modpdescr
+	};
+
+/* input instance parameters */
+static struct cnfparamdescr inppdescr[] = {
+	{ "ring", eCmdHdlrGetWord, CNFPARAM_REQUIRED },
+	{ "size", eCmdHdlrSize, 0 },
+	{ "filecreatemode", eCmdHdlrFileCreateMode, 0 },
+	{ "fileowner", eCmdHdlrUID, 0 },
+	{ "filegroup", eCmdHdlrGID, 0 },
+	{ "parsehostname", eCmdHdlrBinary, 0 },
+	{ "name", eCmdHdlrGetWord, 0 },
+	{ "ratelimit.interval", eCmdHdlrInt, 0 },
+	{ "ratelimit.burst", eCmdHdlrInt, 0 },
+	{ "ruleset", eCmdHdlrString, 0 }
+};
+static struct cnfparamblk inppblk =
+	{ CNFPARAMBLK_VERSION,
+	  sizeof(inppdescr)/sizeof(struct cnfparamdescr),
+	  inppdescr
+	};
+
+#include "im-helper.h" /* must be included AFTER the type definitions! */
+
+/* create input instance, set default parameters, and
+ * add it to the list of instances.
+ */
+static rsRetVal
+createInstance(instanceConf_t **pinst)
+{
+	instanceConf_t *inst;
+	DEFiRet;
+	CHKmalloc(inst = MALLOC(sizeof(instanceConf_t)));
+	inst->next = NULL;
+	inst->pBindRuleset = NULL;
+
+	inst->pszRing = NULL;
+	inst->ringSize = RING_SIZE_DFLT;
+	inst->fCreateMode = 0600;
+	inst->fileUID = -1;
+	inst->fileGID = -1;
+	inst->pszBindRuleset = NULL;
+	inst->inputname = NULL;
+	inst->bParseHost = 0;
+	inst->ratelimitBurst = 10000; /* arbitrary high limit */
+	inst->ratelimitInterval = 0; /* off */
+
+	/* node created, let's add to config */
+	if(loadModConf->tail == NULL) {
+		loadModConf->tail = loadModConf->root = inst;
+	} else {
+		loadModConf->tail->next = inst;
+		loadModConf->tail = inst;
+	}
+
+	*pinst = inst;
+finalize_it:
+	RETiRet;
+}
+
+
+/* create (or re-use) the ring file */
+static rsRetVal
+openRing(struct lstn_s *const lstn, instanceConf_t *const inst)
+{
+	int r;
+	DEFiRet;
+
+	r = shmringCreate(&lstn->pRing, (char*) inst->pszRing, inst->ringSize, inst->fCreateMode);
+	if(r != SHMRING_OK) {
+		errmsg.LogError((r == SHMRING_ERR_IO) ? errno : 0, RS_RET_ERR, "imshmring: could not "
+				"create ring '%s' of size %lld (error %d)", inst->pszRing,
+				(long long) inst->ringSize, r);
+		ABORT_FINALIZE(RS_RET_ERR);
+	}
+	if(   (inst->fileUID != (uid_t) -1 || inst->fileGID != (gid_t) -1)
+	   && fchown(lstn->pRing->fd, inst->fileUID, inst->fileGID) != 0) {
+		errmsg.LogError(errno, RS_RET_ERR, "imshmring: could not set owner of ring '%s', "
+				"producers may not be able to access it", inst->pszRing);
+	}
+	DBGPRINTF("imshmring: ring '%s' ready, size %llu, max record length %zu\n", inst->pszRing,
+		  (unsigned long long) lstn->pRing->size, shmringMaxRecLen(lstn->pRing));
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* This function is called when a new listener shall be added. It takes
+ * the instance config description, sets up the ring and, if that
+ * succeeds, adds it to the list of existing listeners.
+ */
+static rsRetVal
+addListner(instanceConf_t *inst)
+{
+	struct lstn_s *newlcnfinfo = NULL;
+	uchar dispname[256];
+	uchar *inputname;
+	DEFiRet;
+
+	CHKmalloc(newlcnfinfo = (struct lstn_s*) calloc(1, sizeof(struct lstn_s)));
+	CHKiRet(openRing(newlcnfinfo, inst));
+	newlcnfinfo->lastDrops = shmringGetDrops(newlcnfinfo->pRing);
+	CHKmalloc(newlcnfinfo->pszRing = ustrdup(inst->pszRing));
+	newlcnfinfo->pRuleset = inst->pBindRuleset;
+	newlcnfinfo->bParseHost = inst->bParseHost;
+	inputname = (inst->inputname == NULL) ? (uchar*)"imshmring" : inst->inputname;
+	snprintf((char*)dispname, sizeof(dispname), "%s(%s)", inputname, inst->pszRing);
+	dispname[sizeof(dispname)-1] = '\0'; /* just to be on the save side... */
+	CHKiRet(ratelimitNew(&newlcnfinfo->ratelimiter, (char*)dispname, NULL));
+	ratelimitSetLinuxLike(newlcnfinfo->ratelimiter, inst->ratelimitInterval, inst->ratelimitBurst);
+	CHKiRet(prop.Construct(&newlcnfinfo->pInputName));
+	CHKiRet(prop.SetString(newlcnfinfo->pInputName, inputname, ustrlen(inputname)));
+	CHKiRet(prop.ConstructFinalize(newlcnfinfo->pInputName));
+	/* support statistics gathering */
+	CHKiRet(statsobj.Construct(&(newlcnfinfo->stats)));
+	CHKiRet(statsobj.SetName(newlcnfinfo->stats, dispname));
+	CHKiRet(statsobj.SetOrigin(newlcnfinfo->stats, (uchar*)"imshmring"));
+	STATSCOUNTER_INIT(newlcnfinfo->ctrSubmit, newlcnfinfo->mutCtrSubmit);
+	CHKiRet(statsobj.AddCounter(newlcnfinfo->stats, UCHAR_CONSTANT("submitted"),
+		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &(newlcnfinfo->ctrSubmit)));
+	STATSCOUNTER_INIT(newlcnfinfo->ctrDropped, newlcnfinfo->mutCtrDropped);
+	CHKiRet(statsobj.AddCounter(newlcnfinfo->stats, UCHAR_CONSTANT("producer.drops"),
+		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &(newlcnfinfo->ctrDropped)));
+	STATSCOUNTER_INIT(newlcnfinfo->ctrWakeups, newlcnfinfo->mutCtrWakeups);
+	CHKiRet(statsobj.AddCounter(newlcnfinfo->stats, UCHAR_CONSTANT("wakeups"),
+		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &(newlcnfinfo->ctrWakeups)));
+	STATSCOUNTER_INIT(newlcnfinfo->ctrCorrupt, newlcnfinfo->mutCtrCorrupt);
+	CHKiRet(statsobj.AddCounter(newlcnfinfo->stats, UCHAR_CONSTANT("corrupt"),
+		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &(newlcnfinfo->ctrCorrupt)));
+	CHKiRet(statsobj.ConstructFinalize(newlcnfinfo->stats));
+
+	if(lcnfRoot == NULL)
+		lcnfRoot = newlcnfinfo;
+	if(lcnfLast == NULL)
+		lcnfLast = newlcnfinfo;
+	else {
+		lcnfLast->next = newlcnfinfo;
+		lcnfLast = newlcnfinfo;
+	}
+
+finalize_it:
+	if(iRet != RS_RET_OK && newlcnfinfo != NULL) {
+		if(newlcnfinfo->ratelimiter != NULL)
+			ratelimitDestruct(newlcnfinfo->ratelimiter);
+		if(newlcnfinfo->pInputName != NULL)
+			prop.Destruct(&newlcnfinfo->pInputName);
+		if(newlcnfinfo->stats != NULL)
+			statsobj.Destruct(&newlcnfinfo->stats);
+		shmringClose(newlcnfinfo->pRing);
+		free(newlcnfinfo->pszRing);
+		free(newlcnfinfo);
+	}
+	RETiRet;
+}
+
+
+static inline void
+std_checkRuleset_genErrMsg(__attribute__((unused)) modConfData_t *modConf, instanceConf_t *inst)
+{
+	errmsg.LogError(0, NO_ERRCODE, "imshmring: ruleset '%s' for ring %s not found - "
+			"using default ruleset instead", inst->pszBindRuleset, inst->pszRing);
+}
+
+
+/* submit a single record. The message receives a copy of the data, so
+ * the ring space can be released after the batch has been submitted.
+ */
+static inline rsRetVal
+submitRec(struct lstn_s *const lstn, const void *const data, size_t len,
+	struct syslogTime *const stTime, const time_t ttGenTime, multi_submit_t *const multiSub)
+{
+	msg_t *pMsg = NULL;
+	DEFiRet;
+
+	if(len == 0)
+		FINALIZE;
+	if(len > (size_t) iMaxLine)
+		len = iMaxLine;
+	CHKiRet(msgConstructWithTime(&pMsg, stTime, ttGenTime));
+	MsgSetRawMsg(pMsg, data, len);
+	MsgSetInputName(pMsg, lstn->pInputName);
+	MsgSetRuleset(pMsg, lstn->pRuleset);
+	/* there is no backpressure: if we are delayed, the ring fills up and
+	 * producers wait or drop records (reported as producer.drops)
+	 */
+	MsgSetFlowControlType(pMsg, eFLOWCTL_LIGHT_DELAY);
+	pMsg->msgFlags  = NEEDS_PARSING;
+	if(lstn->bParseHost)
+		pMsg->msgFlags  |= PARSE_HOSTNAME;
+	MsgSetRcvFrom(pMsg, glbl.GetLocalHostNameProp());
+	CHKiRet(MsgSetRcvFromIP(pMsg, pLocalHostIP));
+	CHKiRet(ratelimitAddMsg(lstn->ratelimiter, multiSub, pMsg));
+	STATSCOUNTER_INC(lstn->ctrSubmit, lstn->mutCtrSubmit);
+
+finalize_it:
+	if(iRet != RS_RET_OK) {
+		if(pMsg != NULL) {
+			msgDestruct(&pMsg);
+		}
+	}
+	RETiRet;
+}
+
+
+/* process one batch of records. Returns the number of records
+ * processed, so 0 means the ring is empty.
+ */
+static int
+processRing(struct lstn_s *const lstn)
+{
+	msg_t *pMsgs[CONF_NUM_MULTISUB];
+	multi_submit_t multiSub;
+	struct syslogTime stTime;
+	time_t ttGenTime;
+	const void *data;
+	size_t len;
+	uint64_t drops;
+	int nRecs = 0;
+	int r = 0;
+
+	multiSub.ppMsgs = pMsgs;
+	multiSub.maxElem = CONF_NUM_MULTISUB;
+	multiSub.nElem = 0;
+	datetime.getCurrTime(&stTime, &ttGenTime, TIME_IN_LOCALTIME);
+	while(nRecs < runModConf->batchSize && (r = shmringPeek(lstn->pRing, &data, &len)) == 1) {
+		submitRec(lstn, data, len, &stTime, ttGenTime, &multiSub);
+		shmringAdvance(lstn->pRing);
+		++nRecs;
+	}
+	multiSubmitFlush(&multiSub);
+	shmringRelease(lstn->pRing);
+
+	if(r == SHMRING_ERR_CORRUPT) {
+		errmsg.LogError(0, RS_RET_ERR, "imshmring: ring '%s' contains an invalid record, "
+				"probably a faulty producer - discarding ring content", lstn->pszRing);
+		STATSCOUNTER_INC(lstn->ctrCorrupt, lstn->mutCtrCorrupt);
+		shmringResync(lstn->pRing);
+	}
+
+	drops = shmringGetDrops(lstn->pRing);
+	if(drops != lstn->lastDrops) {
+		STATSCOUNTER_ADD(lstn->ctrDropped, lstn->mutCtrDropped, drops - lstn->lastDrops);
+		lstn->lastDrops = drops;
+	}
+	return nRecs;
+}
+
+
+/* service a ring until the input shall terminate. We only wait
+ * if the ring was found empty.
+ */
+static void
+ringLoop(struct lstn_s *const lstn)
+{
+	while(glbl.GetGlobalInputTermState() == 0 && pInputThrd->bShallStop != RSTRUE) {
+		if(processRing(lstn) > 0)
+			continue;
+		if(shmringWait(lstn->pRing, WAIT_TIMEOUT))
+			STATSCOUNTER_INC(lstn->ctrWakeups, lstn->mutCtrWakeups);
+	}
+}
+
+
+/* thread startup wrapper for rings other than the first */
+static void *
+ringThrd(void *arg)
+{
+	struct lstn_s *const lstn = (struct lstn_s*) arg;
+
+	dbgSetThrdName((uchar*)"imshmring");
+	ringLoop(lstn);
+	return NULL;
+}
+
+
+/* This function is called to gather input. The first ring is serviced by
+ * our own thread, all others by threads of their own.
+ */
+BEGINrunInput
+	pthread_attr_t thrdAttr;
+	struct lstn_s *lstn;
+CODESTARTrunInput
+	pInputThrd = pThrd;
+	pthread_attr_init(&thrdAttr);
+	pthread_attr_setstacksize(&thrdAttr, 4096*1024);
+	for(lstn = lcnfRoot->next ; lstn != NULL ; lstn = lstn->next) {
+		if(pthread_create(&lstn->tid, &thrdAttr, ringThrd, lstn) == 0) {
+			lstn->bThrdStarted = 1;
+		} else {
+			errmsg.LogError(errno, NO_ERRCODE, "imshmring: could not create thread for "
+					"ring '%s', it will not be serviced", lstn->pszRing);
+		}
+	}
+	pthread_attr_destroy(&thrdAttr);
+
+	ringLoop(lcnfRoot);
+
+	for(lstn = lcnfRoot->next ; lstn != NULL ; lstn = lstn->next) {
+		if(lstn->bThrdStarted)
+			pthread_kill(lstn->tid, SIGTTIN);
+	}
+	for(lstn = lcnfRoot->next ; lstn != NULL ; lstn = lstn->next) {
+		if(lstn->bThrdStarted) {
+			pthread_join(lstn->tid, NULL);
+			lstn->bThrdStarted = 0;
+		}
+	}
+ENDrunInput
+
+
+BEGINnewInpInst
+	struct cnfparamvals *pvals;
+	instanceConf_t *inst;
+	int i;
+CODESTARTnewInpInst
+	DBGPRINTF("newInpInst (imshmring)\n");
+
+	if((pvals = nvlstGetParams(lst, &inppblk, NULL)) == NULL) {
+		ABORT_FINALIZE(RS_RET_MISSING_CNFPARAMS);
+	}
+	if(Debug) {
+		dbgprintf("input param blk in imshmring:\n");
+		cnfparamsPrint(&inppblk, pvals);
+	}
+
+	CHKiRet(createInstance(&inst));
+	for(i = 0 ; i < inppblk.nParams ; ++i) {
+		if(!pvals[i].bUsed)
+			continue;
+		if(!strcmp(inppblk.descr[i].name, "ring")) {
+			inst->pszRing = (uchar*)es_str2cstr(pvals[i].val.d.estr, NULL);
+		} else if(!strcmp(inppblk.descr[i].name, "size")) {
+			inst->ringSize = pvals[i].val.d.n;
+		} else if(!strcmp(inppblk.descr[i].name, "filecreatemode")) {
+			inst->fCreateMode = (int) pvals[i].val.d.n;
+		} else if(!strcmp(inppblk.descr[i].name, "fileowner")) {
+			inst->fileUID = (uid_t) pvals[i].val.d.n;
+		} else if(!strcmp(inppblk.descr[i].name, "filegroup")) {
+			inst->fileGID = (gid_t) pvals[i].val.d.n;
+		} else if(!strcmp(inppblk.descr[i].name, "parsehostname")) {
+			inst->bParseHost = (int) pvals[i].val.d.n;
+		} else if(!strcmp(inppblk.descr[i].name, "name")) {
+			inst->inputname = (uchar*)es_str2cstr(pvals[i].val.d.estr, NULL);
+		} else if(!strcmp(inppblk.descr[i].name, "ruleset")) {
+			inst->pszBindRuleset = (uchar*)es_str2cstr(pvals[i].val.d.estr, NULL);
+		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.burst")) {
+			inst->ratelimitBurst = (int) pvals[i].val.d.n;
+		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.interval")) {
+			inst->ratelimitInterval = (int) pvals[i].val.d.n;
+		} else {
+			dbgprintf("imshmring: program error, non-handled "
+			  "param '%s'\n", inppblk.descr[i].name);
+		}
+	}
+
+finalize_it:
+CODE_STD_FINALIZERnewInpInst
+	cnfparamvalsDestruct(pvals, &inppblk);
+ENDnewInpInst
+
+
+BEGINbeginCnfLoad
+CODESTARTbeginCnfLoad
+	loadModConf = pModConf;
+	pModConf->pConf = pConf;
+	/* init our settings */
+	loadModConf->batchSize = BATCH_SIZE_DFLT;
+ENDbeginCnfLoad
+
+
+BEGINsetModCnf
+	struct cnfparamvals *pvals = NULL;
+	int i;
+CODESTARTsetModCnf
+	pvals = nvlstGetParams(lst, &modpblk, NULL);
+	if(pvals == NULL) {
+		errmsg.LogError(0, RS_RET_MISSING_CNFPARAMS, "imshmring: error processing module "
+				"config parameters [module(...)]");
+		ABORT_FINALIZE(RS_RET_MISSING_CNFPARAMS);
+	}
+
+	if(Debug) {
+		dbgprintf("module (global) param blk for imshmring:\n");
+		cnfparamsPrint(&modpblk, pvals);
+	}
+
+	for(i = 0 ; i < modpblk.nParams ; ++i) {
+		if(!pvals[i].bUsed)
+			continue;
+		if(!strcmp(modpblk.descr[i].name, "batchsize")) {
+			loadModConf->batchSize = (int) pvals[i].val.d.n;
+		} else {
+			dbgprintf("imshmring: program error, non-handled "
+			  "param '%s' in beginCnfLoad\n", modpblk.descr[i].name);
+		}
+	}
+finalize_it:
+	if(pvals != NULL)
+		cnfparamvalsDestruct(pvals, &modpblk);
+ENDsetModCnf
+
+
+BEGINendCnfLoad
+CODESTARTendCnfLoad
+	loadModConf = NULL; /* done loading */
+ENDendCnfLoad
+
+
+BEGINcheckCnf
+	instanceConf_t *inst;
+CODESTARTcheckCnf
+	for(inst = pModConf->root ; inst != NULL ; inst = inst->next) {
+		std_checkRuleset(pModConf, inst);
+	}
+	if(pModConf->root == NULL) {
+		errmsg.LogError(0, RS_RET_NO_LISTNERS , "imshmring: module loaded, but "
+				"no rings defined - no input will be gathered");
+		iRet = RS_RET_NO_LISTNERS;
+	}
+ENDcheckCnf
+
+
+/* rings are created before dropping privileges, so that they can be
+ * placed in directories not accessible to the unprivileged user.
+ */
+BEGINactivateCnfPrePrivDrop
+	instanceConf_t *inst;
+CODESTARTactivateCnfPrePrivDrop
+	runModConf = pModConf;
+	for(inst = runModConf->root ; inst != NULL ; inst = inst->next) {
+		addListner(inst);
+	}
+	/* if we could not set up any rings, there is no point in running... */
+	if(lcnfRoot == NULL) {
+		errmsg.LogError(0, NO_ERRCODE, "imshmring: no rings could be created, "
+				"input not activated.\n");
+		ABORT_FINALIZE(RS_RET_NO_RUN);
+	}
+
+finalize_it:
+ENDactivateCnfPrePrivDrop
+
+
+BEGINactivateCnf
+CODESTARTactivateCnf
+	iMaxLine = glbl.GetMaxLine();
+ENDactivateCnf
+
+
+BEGINfreeCnf
+	instanceConf_t *inst, *del;
+CODESTARTfreeCnf
+	for(inst = pModConf->root ; inst != NULL ; ) {
+		free(inst->pszRing);
+		free(inst->pszBindRuleset);
+		free(inst->inputname);
+		del = inst;
+		inst = inst->next;
+		free(del);
+	}
+ENDfreeCnf
+
+
+/* initialize and return if will run or not */
+BEGINwillRun
+CODESTARTwillRun
+	pLocalHostIP = glbl.GetLocalHostIP();
+ENDwillRun
+
+
+BEGINafterRun
+	struct lstn_s *lstn, *lstnDel;
+CODESTARTafterRun
+	/* note: the ring files are NOT removed, so producers may continue
+	 * to write into them while we are restarted.
+	 */
+	for(lstn = lcnfRoot ; lstn != NULL ; ) {
+		statsobj.Destruct(&(lstn->stats));
+		ratelimitDestruct(lstn->ratelimiter);
+		shmringClose(lstn->pRing);
+		prop.Destruct(&lstn->pInputName);
+		free(lstn->pszRing);
+		lstnDel = lstn;
+		lstn = lstn->next;
+		free(lstnDel);
+	}
+	lcnfRoot = lcnfLast = NULL;
+ENDafterRun
+
+
+BEGINmodExit
+CODESTARTmodExit
+	/* release what we no longer need */
+	objRelease(errmsg, CORE_COMPONENT);
+	objRelease(glbl, CORE_COMPONENT);
+	objRelease(statsobj, CORE_COMPONENT);
+	objRelease(datetime, CORE_COMPONENT);
+	objRelease(prop, CORE_COMPONENT);
+	objRelease(ruleset, CORE_COMPONENT);
+ENDmodExit
+
+
+BEGINisCompatibleWithFeature
+CODESTARTisCompatibleWithFeature
+	if(eFeat == sFEATURENonCancelInputTermination)
+		iRet = RS_RET_OK;
+ENDisCompatibleWithFeature
+
+
+BEGINqueryEtryPt
+CODESTARTqueryEtryPt
+CODEqueryEtryPt_STD_IMOD_QUERIES
+CODEqueryEtryPt_STD_CONF2_QUERIES
+CODEqueryEtryPt_STD_CONF2_setModCnf_QUERIES
+CODEqueryEtryPt_STD_CONF2_PREPRIVDROP_QUERIES
+CODEqueryEtryPt_STD_CONF2_IMOD_QUERIES
+CODEqueryEtryPt_IsCompatibleWithFeature_IF_OMOD_QUERIES
+ENDqueryEtryPt
+
+
+BEGINmodInit()
+CODESTARTmodInit
+	*ipIFVersProvided = CURR_MOD_IF_VERSION; /* we only support the current interface specification */
+CODEmodInit_QueryRegCFSLineHdlr
+	CHKiRet(objUse(errmsg, CORE_COMPONENT));
+	CHKiRet(objUse(glbl, CORE_COMPONENT));
+	CHKiRet(objUse(statsobj, CORE_COMPONENT));
+	CHKiRet(objUse(datetime, CORE_COMPONENT));
+	CHKiRet(objUse(prop, CORE_COMPONENT));
+	CHKiRet(objUse(ruleset, CORE_COMPONENT));
+	DBGPRINTF("imshmring: version %s initializing\n", VERSION);
+ENDmodInit
+/* vim:set ai:
+ */
@@ -61,6 +61,7 @@
 #include "errmsg.h"
 #include "tcpsrv.h"
 #include "ruleset.h"
+#include "ratelimit.h"
 #include "rainerscript.h"
 #include "net.h" /* for permittedPeers, may be removed when this is removed */
 
@@ -115,6 +116,9 @@ struct instanceConf_s {
 	sbool bSPFramingFix;
 	int ratelimitInterval;
 	int ratelimitBurst;
+	uchar *ratelimitKey;		/* if set, ratelimit per key instead of per listener */
+	int ratelimitMaxKeys;
+	uchar *ratelimitKeyStats;	/* dyn_stats bucket for per-key drop counts */
 	int bSuppOctetFram;
 	struct instanceConf_s *next;
 };
@@ -125,6 +129,8 @@ struct modConfData_s {
 	instanceConf_t *root, *tail;
 	int iTCPSessMax; /* max number of sessions */
 	int iTCPLstnMax; /* max number of sessions */
+	int iWrkrThreads; /* number of worker threads (event loops) */
+	int iHandshakeThreads; /* number of TLS handshake threads, 0 - do handshakes on workers */
 	int iStrmDrvrMode; /* mode for stream driver, driver-dependent (0 mostly means plain tcp) */
 	int iAddtlFrameDelim; /* addtl frame delimiter, e.g. for netscreen, default none */
 	int bSuppOctetFram;
@@ -154,6 +160,8 @@ static struct cnfparamdescr modpdescr[] = {
 	{ "maxsessions", eCmdHdlrPositiveInt, 0 },
 	{ "maxlistners", eCmdHdlrPositiveInt, 0 },
 	{ "maxlisteners", eCmdHdlrPositiveInt, 0 },
+	{ "workerthreads", eCmdHdlrPositiveInt, 0 },
+	{ "streamdriver.handshakethreads", eCmdHdlrNonNegInt, 0 },
 	{ "streamdriver.mode", eCmdHdlrPositiveInt, 0 },
 	{ "streamdriver.authmode", eCmdHdlrString, 0 },
 	{ "streamdriver.name", eCmdHdlrString, 0 },
@@ -179,7 +187,10 @@ static struct cnfparamdescr inppdescr[] = {
 	{ "supportoctetcountedframing", eCmdHdlrBinary, 0 },
 	{ "ratelimit.interval", eCmdHdlrInt, 0 },
 	{ "framingfix.cisco.asa", eCmdHdlrBinary, 0 },
-	{ "ratelimit.burst", eCmdHdlrInt, 0 }
+	{ "ratelimit.burst", eCmdHdlrInt, 0 },
+	{ "ratelimit.key", eCmdHdlrString, 0 },
+	{ "ratelimit.maxkeys", eCmdHdlrPositiveInt, 0 },
+	{ "ratelimit.keystats", eCmdHdlrString, 0 }
 };
 static struct cnfparamblk inppblk =
 	{ CNFPARAMBLK_VERSION,
@@ -280,6 +291,9 @@ createInstance(instanceConf_t **pinst)
 	inst->bSPFramingFix = 0;
 	inst->ratelimitInterval = 0;
 	inst->ratelimitBurst = 10000;
+	inst->ratelimitKey = NULL;
+	inst->ratelimitMaxKeys = RATELIMIT_DFLT_MAXKEYS;
+	inst->ratelimitKeyStats = NULL;
 
 	/* node created, let's add to config */
 	if(loadModConf->tail == NULL) {
@@ -353,6 +367,8 @@ addListner(modConfData_t *modConf, instanceConf_t *inst)
 		CHKiRet(tcpsrv.SetKeepAliveTime(pOurTcpsrv, modConf->iKeepAliveTime));
 		CHKiRet(tcpsrv.SetSessMax(pOurTcpsrv, modConf->iTCPSessMax));
 		CHKiRet(tcpsrv.SetLstnMax(pOurTcpsrv, modConf->iTCPLstnMax));
+		CHKiRet(tcpsrv.SetNumWrkr(pOurTcpsrv, modConf->iWrkrThreads));
+		CHKiRet(tcpsrv.SetNumHandshakeWrkr(pOurTcpsrv, modConf->iHandshakeThreads));
 		CHKiRet(tcpsrv.SetDrvrMode(pOurTcpsrv, modConf->iStrmDrvrMode));
 		CHKiRet(tcpsrv.SetUseFlowControl(pOurTcpsrv, modConf->bUseFlowControl));
 		CHKiRet(tcpsrv.SetAddtlFrameDelim(pOurTcpsrv, modConf->iAddtlFrameDelim));
@@ -379,6 +395,8 @@ addListner(modConfData_t *modConf, instanceConf_t *inst)
 	CHKiRet(tcpsrv.SetDfltTZ(pOurTcpsrv, (inst->dfltTZ == NULL) ? (uchar*)"" : inst->dfltTZ));
 	CHKiRet(tcpsrv.SetbSPFramingFix(pOurTcpsrv, inst->bSPFramingFix));
 	CHKiRet(tcpsrv.SetLinuxLikeRatelimiters(pOurTcpsrv, inst->ratelimitInterval, inst->ratelimitBurst));
+	CHKiRet(tcpsrv.SetKeyedRatelimiter(pOurTcpsrv, inst->ratelimitKey, inst->ratelimitMaxKeys,
+		inst->ratelimitKeyStats));
 	tcpsrv.configureTCPListen(pOurTcpsrv, inst->pszBindPort, inst->bSuppOctetFram, inst->pszBindAddr);
 
 finalize_it:
@@ -431,6 +449,12 @@ CODESTARTnewInpInst
 			inst->ratelimitBurst = (int) pvals[i].val.d.n;
 		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.interval")) {
 			inst->ratelimitInterval = (int) pvals[i].val.d.n;
+		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.key")) {
+			inst->ratelimitKey = (uchar*)es_str2cstr(pvals[i].val.d.estr, NULL);
+		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.maxkeys")) {
+			inst->ratelimitMaxKeys = (int) pvals[i].val.d.n;
+		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.keystats")) {
+			inst->ratelimitKeyStats = (uchar*)es_str2cstr(pvals[i].val.d.estr, NULL);
 		} else {
 			dbgprintf("imtcp: program error, non-handled "
 			  "param '%s'\n", inppblk.descr[i].name);
@@ -449,6 +473,8 @@ CODESTARTbeginCnfLoad
 	/* init our settings */
 	loadModConf->iTCPSessMax = 200;
 	loadModConf->iTCPLstnMax = 20;
+	loadModConf->iWrkrThreads = TCPSRV_DFLT_NUM_WRKR;
+	loadModConf->iHandshakeThreads = 0;
 	loadModConf->bSuppOctetFram = 1;
 	loadModConf->iStrmDrvrMode = 0;
 	loadModConf->bUseFlowControl = 1;
@@ -504,6 +530,10 @@ CODESTARTsetModCnf
 		} else if(!strcmp(modpblk.descr[i].name, "maxlisteners") ||
 			  !strcmp(modpblk.descr[i].name, "maxlistners")) { /* keep old name for a while */
 			loadModConf->iTCPLstnMax = (int) pvals[i].val.d.n;
+		} else if(!strcmp(modpblk.descr[i].name, "workerthreads")) {
+			loadModConf->iWrkrThreads = (int) pvals[i].val.d.n;
+		} else if(!strcmp(modpblk.descr[i].name, "streamdriver.handshakethreads")) {
+			loadModConf->iHandshakeThreads = (int) pvals[i].val.d.n;
 		} else if(!strcmp(modpblk.descr[i].name, "keepalive")) {
 			loadModConf->bKeepAlive = (int) pvals[i].val.d.n;
 		} else if(!strcmp(modpblk.descr[i].name, "keepalive.probes")) {
@@ -582,6 +612,7 @@ BEGINcheckCnf
 CODESTARTcheckCnf
 	for(inst = pModConf->root ; inst != NULL ; inst = inst->next) {
 		std_checkRuleset(pModConf, inst);
+		ratelimitCheckKeyCnf("imtcp", &inst->ratelimitKey, &inst->ratelimitKeyStats);
 		if(inst->bSuppOctetFram == FRAMING_UNSET)
 			inst->bSuppOctetFram = pModConf->bSuppOctetFram;
 	}
@@ -634,6 +665,8 @@ CODESTARTfreeCnf
 		free(inst->pszBindAddr);
 		free(inst->pszInputName);
 		free(inst->dfltTZ);
+		free(inst->ratelimitKey);
+		free(inst->ratelimitKeyStats);
 		del = inst;
 		inst = inst->next;
 		free(del);
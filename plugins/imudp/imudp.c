@@ -32,6 +32,8 @@
 #include <unistd.h>
 #include <netdb.h>
 #include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
 #include <pthread.h>
 #include <signal.h>
 #if HAVE_SYS_EPOLL_H
@@ -40,6 +42,9 @@
 #ifdef HAVE_SCHED_H
 #	include <sched.h>
 #endif
+#ifdef HAVE_LINUX_FILTER_H
+#	include <linux/filter.h>
+#endif
 #include "rsyslog.h"
 #include "dirty.h"
 #include "net.h"
@@ -63,6 +68,12 @@ MODULE_CNFNAME("imudp")
 
 /* defines */
 #define MAX_WRKR_THREADS 32
+#ifndef CPU_SETSIZE
+#	define CPU_SETSIZE 1024	/* only used to limit cpuaffinity if we cannot pin */
+#endif
+#define GRO_RCVBUF_SIZE 65536	/* receive buffer per datagram if GRO is enabled */
+/* control message space per datagram: GRO segment size plus kernel timestamp */
+#define RCV_CMSG_LEN (CMSG_SPACE(sizeof(int)) + CMSG_SPACE(sizeof(struct timespec)))
 
 /* Module static data */
 DEF_IMOD_STATIC_DATA
@@ -78,6 +89,7 @@ DEFobjCurrIf(statsobj)
 static struct lstn_s {
 	struct lstn_s *next;
 	int sock;		/* socket */
+	int *wrkrSocks;		/* SO_REUSEPORT sockets, one per worker; NULL if sock is shared */
 	ruleset_t *pRuleset;	/* bound ruleset */
 	prop_t *pInputName;
 	statsobj_t *stats;	/* listener stats */
@@ -90,6 +102,7 @@ static struct lstn_s {
 static int bLegacyCnfModGlobalsPermitted;/* are legacy module-global config parameters permitted? */
 static int bDoACLCheck;			/* are ACL checks neeed? Cached once immediately before listener startup */
 static int iMaxLine;			/* maximum UDP message size supported */
+static int lenRcvBufEntry;		/* size of receive buffer per datagram */
 static time_t ttLastDiscard = 0;	/* timestamp when a message from a non-permitted sender was last discarded
 					 * This shall prevent remote DoS when the "discard on disallowed sender"
 					 * message is configured to be logged on occurance of such a case.
@@ -115,6 +128,9 @@ struct instanceConf_s {
 	uchar *dfltTZ;
 	int ratelimitInterval;
 	int ratelimitBurst;
+	uchar *ratelimitKey;		/* if set, ratelimit per key instead of per listener */
+	int ratelimitMaxKeys;
+	uchar *ratelimitKeyStats;	/* dyn_stats bucket for per-key drop counts */
 	int rcvbuf;			/* 0 means: do not set, keep OS default */
 	/*  0 means:  IP_FREEBIND is disabled
 	1 means:  IP_FREEBIND enabled + warning disabled
@@ -135,11 +151,15 @@ static struct wrkrInfo_s {
 	STATSCOUNTER_DEF(ctrCall_recvmmsg, mutCtrCall_recvmmsg)
 	STATSCOUNTER_DEF(ctrCall_recvmsg, mutCtrCall_recvmsg)
 	STATSCOUNTER_DEF(ctrMsgsRcvd, mutCtrMsgsRcvd)
+	STATSCOUNTER_DEF(ctrGRODatagrams, mutCtrGRODatagrams)
 	uchar *pRcvBuf;		/* receive buffer (for a single packet) */
 #	ifdef HAVE_RECVMMSG
 	struct sockaddr_storage *frominet;
 	struct mmsghdr *recvmsg_mmh;
 	struct iovec *recvmsg_iov;
+	uchar *pCmsgBuf;	/* control message buffers, NULL if not needed */
+	time_t lastKernTsSec;	/* second of the last kernel timestamp converted ... */
+	struct syslogTime lastKernTs; /* ... and its conversion result */
 #	endif
 } wrkrInfo[MAX_WRKR_THREADS];
 
@@ -152,6 +172,11 @@ struct modConfData_s {
 	int iTimeRequery;		/* how often is time to be queried inside tight recv loop? 0=always */
 	int batchSize;			/* max nbr of input batch --> also recvmmsg() max count */
 	int8_t wrkrMax;			/* max nbr of worker threads */
+	int *cpuAffinity;		/* CPUs to pin worker threads to (round-robin), NULL - do not pin */
+	int nCpuAffinity;		/* number of entries in cpuAffinity */
+	sbool bReusePort;		/* one SO_REUSEPORT socket per worker and listener? */
+	sbool bGRO;			/* enable UDP_GRO (receive coalesced datagrams)? */
+	sbool bKernelTimestamp;		/* use kernel receive timestamps (SO_TIMESTAMPNS)? */
 	sbool configSetViaV2Method;
 };
 static modConfData_t *loadModConf = NULL;/* modConf ptr to use for the current load process */
@@ -163,7 +188,11 @@ static struct cnfparamdescr modpdescr[] = {
 	{ "schedulingpriority", eCmdHdlrInt, 0 },
 	{ "batchsize", eCmdHdlrInt, 0 },
 	{ "threads", eCmdHdlrPositiveInt, 0 },
-	{ "timerequery", eCmdHdlrInt, 0 }
+	{ "timerequery", eCmdHdlrInt, 0 },
+	{ "reuseport", eCmdHdlrBinary, 0 },
+	{ "cpuaffinity", eCmdHdlrString, 0 },
+	{ "gro", eCmdHdlrBinary, 0 },
+	{ "kerneltimestamp", eCmdHdlrBinary, 0 }
 };
 static struct cnfparamblk modpblk =
 	{ CNFPARAMBLK_VERSION,
@@ -182,6 +211,9 @@ static struct cnfparamdescr inppdescr[] = {
 	{ "address", eCmdHdlrString, 0 },
 	{ "ratelimit.interval", eCmdHdlrInt, 0 },
 	{ "ratelimit.burst", eCmdHdlrInt, 0 },
+	{ "ratelimit.key", eCmdHdlrString, 0 },
+	{ "ratelimit.maxkeys", eCmdHdlrPositiveInt, 0 },
+	{ "ratelimit.keystats", eCmdHdlrString, 0 },
 	{ "rcvbufsize", eCmdHdlrSize, 0 },
 	{ "ipfreebind", eCmdHdlrInt, 0 },
 	{ "ruleset", eCmdHdlrString, 0 }
@@ -213,6 +245,9 @@ createInstance(instanceConf_t **pinst)
 	inst->bAppendPortToInpname = 0;
 	inst->ratelimitBurst = 10000; /* arbitrary high limit */
 	inst->ratelimitInterval = 0; /* off */
+	inst->ratelimitKey = NULL;
+	inst->ratelimitMaxKeys = RATELIMIT_DFLT_MAXKEYS;
+	inst->ratelimitKeyStats = NULL;
 	inst->rcvbuf = 0;
 	inst->ipfreebind = IPFREEBIND_ENABLED_WITH_LOG;
 	inst->dfltTZ = NULL;
@@ -264,13 +299,105 @@ finalize_it:
  * the instance config description, tries to bind the socket and, if that
  * succeeds, adds it to the list of existing listen sockets.
  */
+/* return the CPU worker thread wrkrId shall run on. Must only be called
+ * if CPU affinity is configured.
+ */
+static inline int
+wrkrCPU(const int wrkrId)
+{
+	return runModConf->cpuAffinity[wrkrId % runModConf->nCpuAffinity];
+}
+
+
+/* return the socket a worker shall read for a given listener */
+static inline int
+lstnSock(const struct lstn_s *const lstn, const struct wrkrInfo_s *const pWrkr)
+{
+	return (lstn->wrkrSocks == NULL) ? lstn->sock : lstn->wrkrSocks[pWrkr->id];
+}
+
+
+/* If worker threads are pinned to CPUs, make the kernel deliver packets to
+ * the socket of the worker that runs on the CPU which processed the packet.
+ * We do this via a classic BPF program attached to the reuseport group,
+ * which maps the current CPU to the worker (socket) index. Sockets are
+ * indexed in the order they were bound, which is the worker id. If there
+ * is no match (a CPU without a worker), CPU mod #workers is used.
+ * In addition, SO_INCOMING_CPU is set, which newer kernels use for the
+ * same purpose if no BPF program is attached. Failure is not fatal; in
+ * that case the kernel simply hashes over the sockets.
+ */
+static void
+setReusePortSteering(struct lstn_s *const lstn)
+{
+	int i;
+	int cpu;
+#	if defined(SO_ATTACH_REUSEPORT_CBPF) && defined(HAVE_LINUX_FILTER_H)
+	struct sock_filter code[2 * MAX_WRKR_THREADS + 3];
+	struct sock_fprog prog;
+	int n = 0;
+
+	code[n++] = (struct sock_filter) BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_CPU);
+	for(i = 0 ; i < runModConf->wrkrMax ; ++i) {
+		code[n++] = (struct sock_filter) BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, wrkrCPU(i), 0, 1);
+		code[n++] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, i);
+	}
+	code[n++] = (struct sock_filter) BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, runModConf->wrkrMax);
+	code[n++] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_A, 0);
+	prog.len = n;
+	prog.filter = code;
+	if(setsockopt(lstn->wrkrSocks[0], SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) < 0) {
+		errmsg.LogError(errno, NO_ERRCODE, "imudp: could not attach reuseport "
+			"steering program, kernel will hash over sockets");
+	}
+#	endif
+	for(i = 0 ; i < runModConf->wrkrMax ; ++i) {
+		cpu = wrkrCPU(i);
+#		ifdef SO_INCOMING_CPU
+		if(setsockopt(lstn->wrkrSocks[i], SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu)) < 0) {
+			DBGPRINTF("imudp: could not set SO_INCOMING_CPU %d on socket %d\n",
+				  cpu, lstn->wrkrSocks[i]);
+		}
+#		endif
+		DBGPRINTF("imudp: worker %d uses socket %d on cpu %d\n", i, lstn->wrkrSocks[i], cpu);
+	}
+}
+
+
+/* set socket options that affect reception, as requested by the module config */
+static void
+setRcvSockOpts(const int sock)
+{
+	int on = 1;
+	if(runModConf->bGRO) {
+#		ifdef UDP_GRO
+		if(setsockopt(sock, IPPROTO_UDP, UDP_GRO, &on, sizeof(on)) < 0) {
+			errmsg.LogError(errno, NO_ERRCODE, "imudp: could not enable UDP_GRO "
+					"on socket %d - ignoring", sock);
+		}
+#		endif
+	}
+	if(runModConf->bKernelTimestamp) {
+#		ifdef SO_TIMESTAMPNS
+		if(setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) < 0) {
+			errmsg.LogError(errno, NO_ERRCODE, "imudp: could not enable SO_TIMESTAMPNS "
+					"on socket %d - using system time", sock);
+		}
+#		endif
+	}
+}
+
+
 static inline rsRetVal
 addListner(instanceConf_t *inst)
 {
 	DEFiRet;
 	uchar *bindAddr;
 	int *newSocks;
+	int *reuseSocks[MAX_WRKR_THREADS];
+	int bReusePort;
 	int iSrc;
+	int w;
 	struct lstn_s *newlcnfinfo;
 	uchar *bindName;
 	uchar *port;
@@ -291,7 +418,33 @@ addListner(instanceConf_t *inst)
 
 	DBGPRINTF("Trying to open syslog UDP ports at %s:%s.\n", bindName, inst->pszBindPort);
 
-	newSocks = net.create_udp_socket(bindAddr, port, 1, inst->rcvbuf, inst->ipfreebind);
+	/* in reuseport mode, we open one full set of sockets for each worker. Each
+	 * worker then only reads from its own sockets, so that the workers do not
+	 * contend on a single socket receive queue.
+	 */
+	bReusePort = runModConf->bReusePort && runModConf->wrkrMax > 1;
+	newSocks = net.create_udp_socket(bindAddr, port, 1, inst->rcvbuf, inst->ipfreebind, bReusePort);
+	for(w = 1 ; w < runModConf->wrkrMax ; ++w)
+		reuseSocks[w] = NULL;
+	if(newSocks != NULL && bReusePort) {
+		for(w = 1 ; w < runModConf->wrkrMax ; ++w) {
+			reuseSocks[w] = net.create_udp_socket(bindAddr, port, 1, inst->rcvbuf,
+							      inst->ipfreebind, 1);
+			if(reuseSocks[w] == NULL || reuseSocks[w][0] != newSocks[0]) {
+				errmsg.LogError(0, NO_ERRCODE, "imudp: could not open %d SO_REUSEPORT "
+					"sockets for %s:%s, using a single shared socket instead",
+					runModConf->wrkrMax, bindName, port);
+				for(w = 1 ; w < runModConf->wrkrMax ; ++w) {
+					if(reuseSocks[w] != NULL) {
+						net.closeUDPListenSockets(reuseSocks[w]);
+						reuseSocks[w] = NULL;
+					}
+				}
+				bReusePort = 0;
+				break;
+			}
+		}
+	}
 	if(newSocks != NULL) {
 		/* we now need to add the new sockets to the existing set */
 		/* ready to copy */
@@ -299,6 +452,17 @@ addListner(instanceConf_t *inst)
 			CHKmalloc(newlcnfinfo = (struct lstn_s*) calloc(1, sizeof(struct lstn_s)));
 			newlcnfinfo->next = NULL;
 			newlcnfinfo->sock = newSocks[iSrc];
+			setRcvSockOpts(newSocks[iSrc]);
+			if(bReusePort) {
+				CHKmalloc(newlcnfinfo->wrkrSocks = malloc(runModConf->wrkrMax * sizeof(int)));
+				newlcnfinfo->wrkrSocks[0] = newSocks[iSrc];
+				for(w = 1 ; w < runModConf->wrkrMax ; ++w) {
+					newlcnfinfo->wrkrSocks[w] = reuseSocks[w][iSrc];
+					setRcvSockOpts(reuseSocks[w][iSrc]);
+				}
+				if(runModConf->nCpuAffinity > 0)
+					setReusePortSteering(newlcnfinfo);
+			}
 			newlcnfinfo->pRuleset = inst->pBindRuleset;
 			newlcnfinfo->dfltTZ = inst->dfltTZ;
 			if(inst->inputname == NULL) {
@@ -321,6 +485,10 @@ addListner(instanceConf_t *inst)
 			CHKiRet(prop.ConstructFinalize(newlcnfinfo->pInputName));
 			ratelimitSetLinuxLike(newlcnfinfo->ratelimiter, inst->ratelimitInterval,
 					      inst->ratelimitBurst);
+			if(inst->ratelimitKey != NULL) {
+				CHKiRet(ratelimitSetKeyed(newlcnfinfo->ratelimiter, inst->ratelimitKey,
+					inst->ratelimitMaxKeys, inst->ratelimitKeyStats));
+			}
 			/* support statistics gathering */
 			CHKiRet(statsobj.Construct(&(newlcnfinfo->stats)));
 			CHKiRet(statsobj.SetName(newlcnfinfo->stats, dispname));
@@ -352,16 +520,23 @@ finalize_it:
 				prop.Destruct(&newlcnfinfo->pInputName);
 			if(newlcnfinfo->stats != NULL)
 				statsobj.Destruct(&newlcnfinfo->stats);
+			free(newlcnfinfo->wrkrSocks);
 			free(newlcnfinfo);
 		}
 		/* close the rest of the open sockets as there's
 		   nowhere to put them */
 		for(; iSrc <= newSocks[0]; iSrc++) {
 			close(newSocks[iSrc]);
+			if(bReusePort) {
+				for(w = 1 ; w < runModConf->wrkrMax ; ++w)
+					close(reuseSocks[w][iSrc]);
+			}
 		}
 	}
 
 	free(newSocks);
+	for(w = 1 ; w < runModConf->wrkrMax ; ++w)
+		free(reuseSocks[w]); /* sockets are now owned by the listeners */
 	RETiRet;
 }
 
@@ -460,6 +635,85 @@ finalize_it:
  * an appropriate version is compiled (as such we need to maintain both!).
  */
 #ifdef HAVE_RECVMMSG
+/* convert a kernel receive timestamp. Most datagrams of a busy socket were
+ * received within the same second, so we only do the (costly) full conversion
+ * once per second and just update the fractional part otherwise.
+ */
+static inline void
+kernelTime2syslogTime(struct wrkrInfo_s *const pWrkr, const struct timespec *const ts,
+	struct syslogTime *const stTime, time_t *const ttGenTime)
+{
+	struct timeval tv;
+
+	if(ts->tv_sec != pWrkr->lastKernTsSec) {
+		tv.tv_sec = ts->tv_sec;
+		tv.tv_usec = ts->tv_nsec / 1000;
+		datetime.timeval2syslogTime(&tv, &pWrkr->lastKernTs, TIME_IN_LOCALTIME);
+		pWrkr->lastKernTsSec = ts->tv_sec;
+	}
+	*stTime = pWrkr->lastKernTs;
+	stTime->secfrac = ts->tv_nsec / 1000;
+	*ttGenTime = ts->tv_sec;
+}
+
+
+/* process a single datagram received via recvmmsg(). If UDP_GRO is active,
+ * the datagram may consist of multiple coalesced segments of gso_size bytes
+ * each (the last one may be shorter), each of which is a message.
+ */
+static inline void
+processDatagram(struct wrkrInfo_s *const pWrkr, struct lstn_s *const lstn,
+	struct sockaddr_storage *frominetPrev, int *pbIsPermitted, struct mmsghdr *const mmh,
+	struct syslogTime *stTime, time_t ttGenTime, struct sockaddr_storage *frominet,
+	multi_submit_t *multiSub)
+{
+	struct cmsghdr *cmsg;
+	struct timespec ts;
+	struct syslogTime pktTime;
+	int bHaveTs = 0;
+	int gsoSize = 0;
+	uchar *buf = mmh->msg_hdr.msg_iov->iov_base;
+	ssize_t len = mmh->msg_len;
+	ssize_t lenSeg;
+
+	if(pWrkr->pCmsgBuf != NULL) {
+		for(cmsg = CMSG_FIRSTHDR(&mmh->msg_hdr) ; cmsg != NULL ; cmsg = CMSG_NXTHDR(&mmh->msg_hdr, cmsg)) {
+#			ifdef UDP_GRO
+			if(cmsg->cmsg_level == IPPROTO_UDP && cmsg->cmsg_type == UDP_GRO)
+				memcpy(&gsoSize, CMSG_DATA(cmsg), sizeof(gsoSize));
+#			endif
+#			ifdef SCM_TIMESTAMPNS
+			if(cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+				memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+				bHaveTs = 1;
+			}
+#			endif
+		}
+	}
+
+	if(runModConf->bKernelTimestamp) {
+		if(bHaveTs)
+			kernelTime2syslogTime(pWrkr, &ts, &pktTime, &ttGenTime);
+		else
+			datetime.getCurrTime(&pktTime, &ttGenTime, TIME_IN_LOCALTIME);
+		stTime = &pktTime;
+	}
+
+	if(gsoSize <= 0 || gsoSize >= len)
+		gsoSize = len;
+	else
+		++pWrkr->ctrGRODatagrams;
+	do {
+		lenSeg = (len > gsoSize) ? gsoSize : len;
+		processPacket(lstn, frominetPrev, pbIsPermitted, buf, (lenSeg > iMaxLine) ? iMaxLine : lenSeg,
+			      stTime, ttGenTime, frominet, mmh->msg_hdr.msg_namelen, multiSub);
+		++pWrkr->ctrMsgsRcvd;
+		buf += lenSeg;
+		len -= lenSeg;
+	} while(len > 0);
+}
+
+
 static inline rsRetVal
 processSocket(struct wrkrInfo_s *pWrkr, struct lstn_s *lstn, struct sockaddr_storage *frominetPrev, int *pbIsPermitted)
 {
@@ -472,6 +726,7 @@ processSocket(struct wrkrInfo_s *pWrkr, struct lstn_s *lstn, struct sockaddr_sto
 	char errStr[1024];
 	msg_t *pMsgs[CONF_NUM_MULTISUB];
 	multi_submit_t multiSub;
+	const int sock = lstnSock(lstn, pWrkr);
 	int nelem;
 	int i;
 
@@ -485,20 +740,24 @@ processSocket(struct wrkrInfo_s *pWrkr, struct lstn_s *lstn, struct sockaddr_sto
 		memset(pWrkr->recvmsg_iov, 0, runModConf->batchSize * sizeof(struct iovec));
 		memset(pWrkr->recvmsg_mmh, 0, runModConf->batchSize * sizeof(struct mmsghdr));
 		for(i = 0 ; i < runModConf->batchSize ; ++i) {
-			pWrkr->recvmsg_iov[i].iov_base = pWrkr->pRcvBuf+(i*(iMaxLine+1));
-			pWrkr->recvmsg_iov[i].iov_len = iMaxLine;
+			pWrkr->recvmsg_iov[i].iov_base = pWrkr->pRcvBuf+(i*lenRcvBufEntry);
+			pWrkr->recvmsg_iov[i].iov_len = lenRcvBufEntry - 1;
 			pWrkr->recvmsg_mmh[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage); 
 			pWrkr->recvmsg_mmh[i].msg_hdr.msg_name = &(pWrkr->frominet[i]);
 			pWrkr->recvmsg_mmh[i].msg_hdr.msg_iov = &(pWrkr->recvmsg_iov[i]);
 			pWrkr->recvmsg_mmh[i].msg_hdr.msg_iovlen = 1;
+			if(pWrkr->pCmsgBuf != NULL) {
+				pWrkr->recvmsg_mmh[i].msg_hdr.msg_control = pWrkr->pCmsgBuf + i * RCV_CMSG_LEN;
+				pWrkr->recvmsg_mmh[i].msg_hdr.msg_controllen = RCV_CMSG_LEN;
+			}
 		}
-		nelem = recvmmsg(lstn->sock, pWrkr->recvmsg_mmh, runModConf->batchSize, 0, NULL);
+		nelem = recvmmsg(sock, pWrkr->recvmsg_mmh, runModConf->batchSize, 0, NULL);
 		STATSCOUNTER_INC(pWrkr->ctrCall_recvmmsg, pWrkr->mutCtrCall_recvmmsg);
 		DBGPRINTF("imudp: recvmmsg returned %d\n", nelem);
 		if(nelem < 0 && errno == ENOSYS) {
 			/* be careful: some versions of valgrind do not support recvmmsg()! */
 			DBGPRINTF("imudp: error ENOSYS on call to recvmmsg() - fall back to recvmsg\n");
-			nelem = recvmsg(lstn->sock, &(pWrkr->recvmsg_mmh[0].msg_hdr), 0);
+			nelem = recvmsg(sock, &(pWrkr->recvmsg_mmh[0].msg_hdr), 0);
 			STATSCOUNTER_INC(pWrkr->ctrCall_recvmsg, pWrkr->mutCtrCall_recvmsg);
 			if(nelem >= 0) {
 				pWrkr->recvmsg_mmh[0].msg_len = nelem;
@@ -514,15 +773,15 @@ processSocket(struct wrkrInfo_s *pWrkr, struct lstn_s *lstn, struct sockaddr_sto
 			ABORT_FINALIZE(RS_RET_ERR); // this most often is NOT an error, state is not checked by caller!
 		}
 
-		if((runModConf->iTimeRequery == 0) || (iNbrTimeUsed++ % runModConf->iTimeRequery) == 0) {
+		/* with kernel timestamps, the time is taken per datagram */
+		if(!runModConf->bKernelTimestamp
+		   && ((runModConf->iTimeRequery == 0) || (iNbrTimeUsed++ % runModConf->iTimeRequery) == 0)) {
 			datetime.getCurrTime(&stTime, &ttGenTime, TIME_IN_LOCALTIME);
 		}
 
-		pWrkr->ctrMsgsRcvd += nelem;
 		for(i = 0 ; i < nelem ; ++i) {
-			processPacket(lstn, frominetPrev, pbIsPermitted, pWrkr->recvmsg_mmh[i].msg_hdr.msg_iov->iov_base,
-				      pWrkr->recvmsg_mmh[i].msg_len, &stTime, ttGenTime, &(pWrkr->frominet[i]),
-				      pWrkr->recvmsg_mmh[i].msg_hdr.msg_namelen, &multiSub);
+			processDatagram(pWrkr, lstn, frominetPrev, pbIsPermitted, &(pWrkr->recvmsg_mmh[i]),
+				        &stTime, ttGenTime, &(pWrkr->frominet[i]), &multiSub);
 		}
 	}
 
@@ -558,6 +817,7 @@ processSocket(struct wrkrInfo_s *pWrkr, struct lstn_s *lstn, struct sockaddr_sto
 	char errStr[1024];
 	struct msghdr mh;
 	struct iovec iov[1];
+	const int sock = lstnSock(lstn, pWrkr);
 	DEFiRet;
 
 	multiSub.ppMsgs = pMsgs;
@@ -575,7 +835,7 @@ processSocket(struct wrkrInfo_s *pWrkr, struct lstn_s *lstn, struct sockaddr_sto
 		mh.msg_namelen = sizeof(struct sockaddr_storage); 
 		mh.msg_iov = iov;
 		mh.msg_iovlen = 1;
-		lenRcvBuf = recvmsg(lstn->sock, &mh, 0);
+		lenRcvBuf = recvmsg(sock, &mh, 0);
 		STATSCOUNTER_INC(pWrkr->ctrCall_recvmsg, pWrkr->mutCtrCall_recvmsg);
 		if(lenRcvBuf < 0) {
 			if(errno != EINTR && errno != EAGAIN) {
@@ -784,13 +1044,13 @@ static rsRetVal rcvMainLoop(struct wrkrInfo_s *const __restrict__ pWrkr)
 	 */
 	i = 0;
 	for(lstn = lcnfRoot ; lstn != NULL ; lstn = lstn->next) {
-		if(lstn->sock != -1) {
+		if(lstnSock(lstn, pWrkr) != -1) {
 			udpEPollEvt[i].events = EPOLLIN | EPOLLET;
 			udpEPollEvt[i].data.ptr = lstn;
-			if(epoll_ctl(efd, EPOLL_CTL_ADD,  lstn->sock, &(udpEPollEvt[i])) < 0) {
+			if(epoll_ctl(efd, EPOLL_CTL_ADD,  lstnSock(lstn, pWrkr), &(udpEPollEvt[i])) < 0) {
 				rs_strerror_r(errno, errStr, sizeof(errStr));
 				errmsg.LogError(errno, NO_ERRCODE, "epoll_ctrl failed on fd %d with %s\n",
-					lstn->sock, errStr);
+					lstnSock(lstn, pWrkr), errStr);
 			}
 		}
 		i++;
@@ -937,6 +1197,12 @@ createListner(es_str_t *port, struct cnfparamvals *pvals)
 			inst->ratelimitBurst = (int) pvals[i].val.d.n;
 		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.interval")) {
 			inst->ratelimitInterval = (int) pvals[i].val.d.n;
+		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.key")) {
+			inst->ratelimitKey = (uchar*)es_str2cstr(pvals[i].val.d.estr, NULL);
+		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.maxkeys")) {
+			inst->ratelimitMaxKeys = (int) pvals[i].val.d.n;
+		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.keystats")) {
+			inst->ratelimitKeyStats = (uchar*)es_str2cstr(pvals[i].val.d.estr, NULL);
 		} else if(!strcmp(inppblk.descr[i].name, "rcvbufsize")) {
 			inst->rcvbuf = (int) pvals[i].val.d.n;
 		} else if(!strcmp(inppblk.descr[i].name, "ipfreebind")) {
@@ -989,6 +1255,11 @@ CODESTARTbeginCnfLoad
 	loadModConf->iTimeRequery = TIME_REQUERY_DFLT;
 	loadModConf->iSchedPrio = SCHED_PRIO_UNSET;
 	loadModConf->pszSchedPolicy = NULL;
+	loadModConf->bReusePort = 0;
+	loadModConf->bGRO = 0;
+	loadModConf->bKernelTimestamp = 0;
+	loadModConf->cpuAffinity = NULL;
+	loadModConf->nCpuAffinity = 0;
 	bLegacyCnfModGlobalsPermitted = 1;
 	/* init legacy config vars */
 	cs.pszBindRuleset = NULL;
@@ -999,10 +1270,55 @@ CODESTARTbeginCnfLoad
 ENDbeginCnfLoad
 
 
+/* parse a list of CPUs like "0,2,4-7" into the module config */
+static rsRetVal
+parseCPUList(const char *const list, modConfData_t *const modConf)
+{
+	const char *p = list;
+	char *end;
+	long first, last, cpu;
+	int *cpus = NULL;
+	int nCpus = 0;
+	DEFiRet;
+
+	CHKmalloc(cpus = malloc(CPU_SETSIZE * sizeof(int)));
+	while(*p != '\0') {
+		first = strtol(p, &end, 10);
+		if(end == p || first < 0 || first >= CPU_SETSIZE)
+			ABORT_FINALIZE(RS_RET_PARAM_ERROR);
+		last = first;
+		if(*end == '-') {
+			p = end + 1;
+			last = strtol(p, &end, 10);
+			if(end == p || last < first || last >= CPU_SETSIZE)
+				ABORT_FINALIZE(RS_RET_PARAM_ERROR);
+		}
+		for(cpu = first ; cpu <= last && nCpus < CPU_SETSIZE ; ++cpu)
+			cpus[nCpus++] = (int) cpu;
+		if(*end == ',')
+			++end;
+		else if(*end != '\0')
+			ABORT_FINALIZE(RS_RET_PARAM_ERROR);
+		p = end;
+	}
+	if(nCpus == 0)
+		ABORT_FINALIZE(RS_RET_PARAM_ERROR);
+	free(modConf->cpuAffinity);
+	modConf->cpuAffinity = cpus;
+	modConf->nCpuAffinity = nCpus;
+	cpus = NULL;
+
+finalize_it:
+	free(cpus);
+	RETiRet;
+}
+
+
 BEGINsetModCnf
 	struct cnfparamvals *pvals = NULL;
 	int i;
 	int wrkrMax;
+	char *cstr;
 CODESTARTsetModCnf
 	pvals = nvlstGetParams(lst, &modpblk, NULL);
 	if(pvals == NULL) {
@@ -1037,6 +1353,34 @@ CODESTARTsetModCnf
 			} else {
 				loadModConf->wrkrMax = wrkrMax;
 			}
+		} else if(!strcmp(modpblk.descr[i].name, "reuseport")) {
+#			if defined(SO_REUSEPORT) && (defined(HAVE_EPOLL_CREATE1) || defined(HAVE_EPOLL_CREATE))
+			loadModConf->bReusePort = (sbool) pvals[i].val.d.n;
+#			else
+			errmsg.LogError(0, RS_RET_PARAM_ERROR, "imudp: reuseport is not supported "
+					"on this platform - ignored");
+#			endif
+		} else if(!strcmp(modpblk.descr[i].name, "gro")) {
+#			if defined(UDP_GRO) && defined(HAVE_RECVMMSG)
+			loadModConf->bGRO = (sbool) pvals[i].val.d.n;
+#			else
+			errmsg.LogError(0, RS_RET_PARAM_ERROR, "imudp: gro is not supported "
+					"on this platform - ignored");
+#			endif
+		} else if(!strcmp(modpblk.descr[i].name, "kerneltimestamp")) {
+#			if defined(SO_TIMESTAMPNS) && defined(HAVE_RECVMMSG)
+			loadModConf->bKernelTimestamp = (sbool) pvals[i].val.d.n;
+#			else
+			errmsg.LogError(0, RS_RET_PARAM_ERROR, "imudp: kerneltimestamp is not "
+					"supported on this platform - ignored");
+#			endif
+		} else if(!strcmp(modpblk.descr[i].name, "cpuaffinity")) {
+			cstr = es_str2cstr(pvals[i].val.d.estr, NULL);
+			if(parseCPUList(cstr, loadModConf) != RS_RET_OK) {
+				errmsg.LogError(0, RS_RET_PARAM_ERROR, "imudp: invalid cpuaffinity "
+						"'%s' - ignored", cstr);
+			}
+			free(cstr);
 		} else {
 			dbgprintf("imudp: program error, non-handled "
 			  "param '%s' in beginCnfLoad\n", modpblk.descr[i].name);
@@ -1080,6 +1424,7 @@ CODESTARTcheckCnf
 	checkSchedParam(pModConf); /* this can not cause fatal errors */
 	for(inst = pModConf->root ; inst != NULL ; inst = inst->next) {
 		std_checkRuleset(pModConf, inst);
+		ratelimitCheckKeyCnf("imudp", &inst->ratelimitKey, &inst->ratelimitKeyStats);
 	}
 	if(pModConf->root == NULL) {
 		errmsg.LogError(0, RS_RET_NO_LISTNERS , "imudp: module loaded, but "
@@ -1113,9 +1458,14 @@ BEGINactivateCnf
 CODESTARTactivateCnf
 	/* caching various settings */
 	iMaxLine = glbl.GetMaxLine();
-	lenRcvBuf = iMaxLine + 1;
+	lenRcvBufEntry = iMaxLine + 1;
 #	ifdef HAVE_RECVMMSG
-	lenRcvBuf *= runModConf->batchSize;
+	/* a GRO datagram may contain up to 64k of coalesced messages */
+	if(runModConf->bGRO && lenRcvBufEntry < GRO_RCVBUF_SIZE)
+		lenRcvBufEntry = GRO_RCVBUF_SIZE;
+	lenRcvBuf = lenRcvBufEntry * runModConf->batchSize;
+#	else
+	lenRcvBuf = lenRcvBufEntry;
 #	endif
 	DBGPRINTF("imudp: config params iMaxLine %d, lenRcvBuf %d\n", iMaxLine, lenRcvBuf);
 	for(i = 0 ; i < runModConf->wrkrMax ; ++i) {
@@ -1123,6 +1473,11 @@ CODESTARTactivateCnf
 		CHKmalloc(wrkrInfo[i].recvmsg_iov = MALLOC(runModConf->batchSize * sizeof(struct iovec)));
 		CHKmalloc(wrkrInfo[i].recvmsg_mmh = MALLOC(runModConf->batchSize * sizeof(struct mmsghdr)));
 		CHKmalloc(wrkrInfo[i].frominet = MALLOC(runModConf->batchSize * sizeof(struct sockaddr_storage)));
+		wrkrInfo[i].pCmsgBuf = NULL;
+		if(runModConf->bGRO || runModConf->bKernelTimestamp) {
+			CHKmalloc(wrkrInfo[i].pCmsgBuf = MALLOC(runModConf->batchSize * RCV_CMSG_LEN));
+		}
+		wrkrInfo[i].lastKernTsSec = 0;
 #		endif
 		CHKmalloc(wrkrInfo[i].pRcvBuf = MALLOC(lenRcvBuf));
 		wrkrInfo[i].id = i;
@@ -1134,11 +1489,14 @@ ENDactivateCnf
 BEGINfreeCnf
 	instanceConf_t *inst, *del;
 CODESTARTfreeCnf
+	free(pModConf->cpuAffinity);
 	for(inst = pModConf->root ; inst != NULL ; ) {
 		free(inst->pszBindPort);
 		free(inst->pszBindAddr);
 		free(inst->inputname);
 		free(inst->dfltTZ);
+		free(inst->ratelimitKey);
+		free(inst->ratelimitKeyStats);
 		del = inst;
 		inst = inst->next;
 		free(del);
@@ -1146,6 +1504,30 @@ CODESTARTfreeCnf
 ENDfreeCnf
 
 
+/* pin the current (worker) thread to its configured CPU */
+static void
+setCPUAffinity(struct wrkrInfo_s *const pWrkr)
+{
+#	ifdef HAVE_PTHREAD_SETAFFINITY_NP
+	cpu_set_t cpuset;
+	int err;
+
+	CPU_ZERO(&cpuset);
+	CPU_SET(wrkrCPU(pWrkr->id), &cpuset);
+	err = pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+	if(err != 0) {
+		errmsg.LogError(err, NO_ERRCODE, "imudp: could not pin worker %d to cpu %d - ignoring",
+				pWrkr->id, wrkrCPU(pWrkr->id));
+	} else {
+		DBGPRINTF("imudp: worker %d pinned to cpu %d\n", pWrkr->id, wrkrCPU(pWrkr->id));
+	}
+#	else
+	errmsg.LogError(0, NO_ERRCODE, "imudp: cpuaffinity set, but pthread_setaffinity_np() "
+			"not available - ignored");
+#	endif
+}
+
+
 static void *
 wrkr(void *myself)
 {
@@ -1173,6 +1555,8 @@ wrkr(void *myself)
 	 * privileges within the same instance.
 	 */
 	setSchedParams(runModConf);
+	if(runModConf->nCpuAffinity > 0)
+		setCPUAffinity(pWrkr);
 
 	/* support statistics gathering */
 	statsobj.Construct(&(pWrkr->stats));
@@ -1187,6 +1571,11 @@ wrkr(void *myself)
 	STATSCOUNTER_INIT(pWrkr->ctrMsgsRcvd, pWrkr->mutCtrMsgsRcvd);
 	statsobj.AddCounter(pWrkr->stats, UCHAR_CONSTANT("msgs.received"),
 		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &(pWrkr->ctrMsgsRcvd));
+	if(runModConf->bGRO) {
+		STATSCOUNTER_INIT(pWrkr->ctrGRODatagrams, pWrkr->mutCtrGRODatagrams);
+		statsobj.AddCounter(pWrkr->stats, UCHAR_CONSTANT("gro.datagrams"),
+			ctrType_IntCtr, CTR_FLAG_RESETTABLE, &(pWrkr->ctrGRODatagrams));
+	}
 	statsobj.ConstructFinalize(pWrkr->stats);
 
 	rcvMainLoop(pWrkr);
@@ -1242,7 +1631,13 @@ CODESTARTafterRun
 	for(lstn = lcnfRoot ; lstn != NULL ; ) {
 		statsobj.Destruct(&(lstn->stats));
 		ratelimitDestruct(lstn->ratelimiter);
-		close(lstn->sock);
+		if(lstn->wrkrSocks == NULL) {
+			close(lstn->sock);
+		} else {
+			for(i = 0 ; i < runModConf->wrkrMax ; ++i)
+				close(lstn->wrkrSocks[i]);
+			free(lstn->wrkrSocks);
+		}
 		prop.Destruct(&lstn->pInputName);
 		lstnDel = lstn;
 		lstn = lstn->next;
@@ -1254,6 +1649,7 @@ CODESTARTafterRun
 		free(wrkrInfo[i].recvmsg_iov);
 		free(wrkrInfo[i].recvmsg_mmh);
 		free(wrkrInfo[i].frominet);
+		free(wrkrInfo[i].pCmsgBuf);
 #		endif
 		free(wrkrInfo[i].pRcvBuf);
 	}
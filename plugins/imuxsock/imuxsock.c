@@ -34,6 +34,8 @@
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/un.h>
@@ -93,6 +95,15 @@ struct ucred { int pid; uid_t uid; gid_t gid; };
 #define SUN_LEN(su) \
    (sizeof(*(su)) - sizeof((su)->sun_path) + strlen((su)->sun_path))
 #endif
+
+/* space for ancillary data of a single message (credentials and timestamp) */
+#define RCV_CMSG_LEN (CMSG_SPACE(sizeof(struct ucred)) + CMSG_SPACE(sizeof(struct timeval)))
+#define BATCH_SIZE_DFLT 32	/* max nbr of msgs pulled by a single recvmmsg() call */
+/* receive loops other than the first are woken up by SIGTTIN on termination. To
+ * guard against the signal arriving just before select(), they do not block
+ * forever but re-check the termination state periodically.
+ */
+#define RCVLOOP_TIMEOUT 1000 /* ms */
 /* Module static data */
 DEF_IMOD_STATIC_DATA
 DEFobjCurrIf(errmsg)
@@ -152,10 +163,33 @@ typedef struct lstn_s {
 	sbool bUseSysTimeStamp;	/* use timestamp from system (instead of from message) */
 	sbool bUnlink;		/* unlink&re-create socket at start and end of processing */
 	sbool bUseSpecialParser;/* use "canned" log socket parser instead of parser chain? */
+	int rcvbuf;		/* SO_RCVBUF size to request, 0 - keep OS default */
+	int iRcvLoop;		/* receive loop servicing this listener */
 	ruleset_t *pRuleset;
 } lstn_t;
 static lstn_t *listeners;
 
+/* A receive loop services a subset of the listeners. Loop 0 runs on the
+ * input thread itself, all others on their own threads. Each listener is
+ * serviced by exactly one loop, so its rate-limiting hashtable does not
+ * need to be guarded.
+ */
+typedef struct rcvLoop_s {
+	int id;
+	pthread_t tid;
+	sbool bThrdStarted;
+	thrdInfo_t *pThrd;
+	uchar *pRcvBuf;		/* batchSize buffers, each iMaxLine+1 bytes */
+	int lenRcvBufEntry;
+	char *pCmsgBuf;		/* batchSize ancillary data buffers */
+#	ifdef HAVE_RECVMMSG
+	struct mmsghdr *mmh;
+	struct iovec *iov;
+#	endif
+} rcvLoop_t;
+static rcvLoop_t *rcvLoops = NULL;
+static int nRcvLoops = 0;
+
 static prop_t *pLocalHostIP = NULL;	/* there is only one global IP for all internally-generated messages */
 static prop_t *pInputName = NULL;	/* our inputName currently is always "imudp", and this will hold it */
 static int startIndexUxLocalSockets; /* process fd from that index on (used to
@@ -213,6 +247,7 @@ struct instanceConf_s {
 	sbool bUnlink;
 	sbool bUseSpecialParser;
 	sbool bParseHost;
+	int rcvbuf;			/* SO_RCVBUF size, 0 - OS default */
 	uchar *pszBindRuleset;		/* name of ruleset to bind to */
 	ruleset_t *pBindRuleset;	/* ruleset to bind listener to (use system default if unspecified) */
 	struct instanceConf_s *next;
@@ -229,6 +264,9 @@ struct modConfData_s {
 	int bParseTrusted;
 	int bUseSpecialParser;
 	int bParseHost;
+	int rcvbufSysSock;		/* SO_RCVBUF size for system socket, 0 - OS default */
+	int batchSize;			/* max nbr of msgs per recvmmsg() call */
+	int nRcvLoops;			/* number of receive loops (threads) */
 	sbool bIgnoreTimestamp;		/* ignore timestamps present in the incoming message? */
 	sbool bUseFlowCtl;		/* use flow control or not (if yes, only LIGHT is used! */
 	sbool bOmitLocalLogging;
@@ -257,7 +295,10 @@ static struct cnfparamdescr modpdescr[] = {
 	{ "syssock.usepidfromsystem", eCmdHdlrBinary, 0 },
 	{ "syssock.ratelimit.interval", eCmdHdlrInt, 0 },
 	{ "syssock.ratelimit.burst", eCmdHdlrInt, 0 },
-	{ "syssock.ratelimit.severity", eCmdHdlrInt, 0 }
+	{ "syssock.ratelimit.severity", eCmdHdlrInt, 0 },
+	{ "syssock.rcvbufsize", eCmdHdlrSize, 0 },
+	{ "batchsize", eCmdHdlrPositiveInt, 0 },
+	{ "threads", eCmdHdlrPositiveInt, 0 }
 };
 static struct cnfparamblk modpblk =
 	{ CNFPARAMBLK_VERSION,
@@ -283,7 +324,8 @@ static struct cnfparamdescr inppdescr[] = {
 	{ "ruleset", eCmdHdlrString, 0 },
 	{ "ratelimit.interval", eCmdHdlrInt, 0 },
 	{ "ratelimit.burst", eCmdHdlrInt, 0 },
-	{ "ratelimit.severity", eCmdHdlrInt, 0 }
+	{ "ratelimit.severity", eCmdHdlrInt, 0 },
+	{ "rcvbufsize", eCmdHdlrSize, 0 }
 };
 static struct cnfparamblk inppblk =
 	{ CNFPARAMBLK_VERSION,
@@ -323,6 +365,7 @@ createInstance(instanceConf_t **pinst)
 	inst->bParseTrusted = 0;
 	inst->bDiscardOwnMsgs = 1;
 	inst->bUnlink = 1;
+	inst->rcvbuf = 0;
 	inst->next = NULL;
 
 	/* node created, let's add to config */
@@ -431,6 +474,7 @@ addListner(instanceConf_t *inst)
 	listeners[nfd].bWritePid = inst->bWritePid;
 	listeners[nfd].bUseSysTimeStamp = inst->bUseSysTimeStamp;
 	listeners[nfd].bUseSpecialParser = inst->bUseSpecialParser;
+	listeners[nfd].rcvbuf = inst->rcvbuf;
 	listeners[nfd].pRuleset = inst->pBindRuleset;
 	CHKiRet(ratelimitNew(&listeners[nfd].dflt_ratelimiter, "imuxsock", NULL));
 	ratelimitSetLinuxLike(listeners[nfd].dflt_ratelimiter,
@@ -508,6 +552,37 @@ finalize_it:
 }
 
 
+/* set the socket receive buffer size, if configured. A larger buffer helps
+ * to survive bursts while the receive loop is busy processing the previous
+ * batch. We try SO_RCVBUFFORCE first, which permits to go beyond the
+ * system-wide maximum when we have the necessary privileges.
+ */
+static void
+setRcvBuf(lstn_t *pLstn)
+{
+	int actrcvbuf;
+	socklen_t optlen;
+
+	if(pLstn->rcvbuf == 0)
+		return;
+#	if defined(SO_RCVBUFFORCE)
+	if(setsockopt(pLstn->fd, SOL_SOCKET, SO_RCVBUFFORCE, &pLstn->rcvbuf, sizeof(pLstn->rcvbuf)) < 0)
+#	endif
+	{
+		/* some platforms silently cap the value, so we check below */
+		setsockopt(pLstn->fd, SOL_SOCKET, SO_RCVBUF, &pLstn->rcvbuf, sizeof(pLstn->rcvbuf));
+	}
+	optlen = sizeof(actrcvbuf);
+	if(getsockopt(pLstn->fd, SOL_SOCKET, SO_RCVBUF, &actrcvbuf, &optlen) == 0) {
+		DBGPRINTF("imuxsock: socket '%s' rcvbuf size now %d\n", pLstn->sockName, actrcvbuf);
+		if(actrcvbuf/2 != pLstn->rcvbuf) {
+			errmsg.LogError(0, NO_ERRCODE, "imuxsock: cannot set rcvbuf size %d for "
+				"socket '%s', value now is %d", pLstn->rcvbuf, pLstn->sockName, actrcvbuf/2);
+		}
+	}
+}
+
+
 static inline rsRetVal
 openLogSocket(lstn_t *pLstn)
 {
@@ -547,6 +622,7 @@ openLogSocket(lstn_t *pLstn)
 	if (pLstn->fd == -1) {
 		CHKiRet(createLogSocket(pLstn));
 	}
+	setRcvBuf(pLstn);
 
 #	if HAVE_SCM_CREDENTIALS
 	if(pLstn->bUseCreds) {
@@ -762,7 +838,8 @@ copyescaped(uchar *dstbuf, uchar *inbuf, int inlen)
  * can also mangle it if necessary.
  */
 static inline rsRetVal
-SubmitMsg(uchar *pRcv, int lenRcv, lstn_t *pLstn, struct ucred *cred, struct timeval *ts)
+SubmitMsg(uchar *pRcv, int lenRcv, lstn_t *pLstn, struct ucred *cred, struct timeval *ts,
+	multi_submit_t *const pMultiSub)
 {
 	msg_t *pMsg = NULL;
 	int lenMsg;
@@ -973,7 +1050,7 @@ SubmitMsg(uchar *pRcv, int lenRcv, lstn_t *pLstn, struct ucred *cred, struct tim
 	MsgSetRcvFrom(pMsg, pLstn->hostName == NULL ? glbl.GetLocalHostNameProp() : pLstn->hostName);
 	CHKiRet(MsgSetRcvFromIP(pMsg, pLocalHostIP));
 	MsgSetRuleset(pMsg, pLstn->pRuleset);
-	ratelimitAddMsg(ratelimiter, NULL, pMsg);
+	ratelimitAddMsg(ratelimiter, pMultiSub, pMsg);
 	STATSCOUNTER_INC(ctrSubmit, mutCtrSubmit);
 finalize_it:
 	if(iRet != RS_RET_OK) {
@@ -984,100 +1061,140 @@ finalize_it:
 }
 
 
+/* pull credentials and system timestamp from the ancillary data of a single
+ * received message. This needs to be done per message, as a batch usually
+ * contains messages from many different processes.
+ */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wcast-align" /* TODO: how can we fix these warnings? */
+/* Problem with the warnings: they seem to stem back from the way the API is structured */
+static void
+getMsgCreds(lstn_t *const pLstn, struct msghdr *const msgh, struct ucred **const cred, struct timeval **const ts)
+{
+	*cred = NULL;
+	*ts = NULL;
+#	if defined(HAVE_SCM_CREDENTIALS) || defined(HAVE_SO_TIMESTAMP)
+	if(pLstn->bUseCreds) {
+		struct cmsghdr *cm;
+		for(cm = CMSG_FIRSTHDR(msgh); cm; cm = CMSG_NXTHDR(msgh, cm)) {
+#			if HAVE_SCM_CREDENTIALS
+			if(   pLstn->bUseCreds
+			   && cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_CREDENTIALS) {
+				*cred = (struct ucred*) CMSG_DATA(cm);
+			}
+#			endif /* HAVE_SCM_CREDENTIALS */
+#			if HAVE_SO_TIMESTAMP
+			if(   pLstn->bUseSysTimeStamp 
+			   && cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SO_TIMESTAMP) {
+				*ts = (struct timeval *)CMSG_DATA(cm);
+			}
+#			endif /* HAVE_SO_TIMESTAMP */
+		}
+	}
+#	endif /* defined(HAVE_SCM_CREDENTIALS) || defined(HAVE_SO_TIMESTAMP) */
+}
+#pragma GCC diagnostic pop
+
+
 /* This function receives data from a socket indicated to be ready
  * to receive and submits the message received for processing.
  * rgerhards, 2007-12-20
  * Interface changed so that this function is passed the array index
  * of the socket which is to be processed. This eases access to the
  * growing number of properties. -- rgerhards, 2008-08-01
+ * If recvmmsg() is available, we now pull up to batchSize messages with
+ * a single call and submit them as one batch. The socket is not drained
+ * completely, so that a busy socket does not starve the others serviced
+ * by the same receive loop.
  */
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wcast-align" /* TODO: how can we fix these warnings? */
-/* Problem with the warnings: they seem to stem back from the way the API is structured */
-static rsRetVal readSocket(lstn_t *pLstn)
+static rsRetVal readSocket(rcvLoop_t *const pLoop, lstn_t *const pLstn)
 {
 	DEFiRet;
-	int iRcvd;
-	int iMaxLine;
-	struct msghdr msgh;
-	struct iovec msgiov;
+	int nelem;
 	struct ucred *cred;
 	struct timeval *ts;
-	uchar bufRcv[4096+1];
-	uchar *pRcv = NULL; /* receive buffer */
-#	if HAVE_SCM_CREDENTIALS
-	char aux[128];
+	msg_t *pMsgs[CONF_NUM_MULTISUB];
+	multi_submit_t multiSub;
+#	ifdef HAVE_RECVMMSG
+	int i;
+#	else
+	struct msghdr msgh;
+	struct iovec msgiov;
 #	endif
 
 	assert(pLstn->fd >= 0);
 
-	iMaxLine = glbl.GetMaxLine();
-
-	/* we optimize performance: if iMaxLine is below 4K (which it is in almost all
-	 * cases, we use a fixed buffer on the stack. Only if it is higher, heap memory
-	 * is used. We could use alloca() to achive a similar aspect, but there are so
-	 * many issues with alloca() that I do not want to take that route.
-	 * rgerhards, 2008-09-02
-	 */
-	if((size_t) iMaxLine < sizeof(bufRcv) - 1) {
-		pRcv = bufRcv;
-	} else {
-		CHKmalloc(pRcv = (uchar*) MALLOC(iMaxLine + 1));
+	multiSub.ppMsgs = pMsgs;
+	multiSub.maxElem = CONF_NUM_MULTISUB;
+	multiSub.nElem = 0;
+
+#	ifdef HAVE_RECVMMSG
+	memset(pLoop->mmh, 0, runModConf->batchSize * sizeof(struct mmsghdr));
+	for(i = 0 ; i < runModConf->batchSize ; ++i) {
+		pLoop->iov[i].iov_base = (char*) pLoop->pRcvBuf + i * pLoop->lenRcvBufEntry;
+		pLoop->iov[i].iov_len = pLoop->lenRcvBufEntry - 1;
+		pLoop->mmh[i].msg_hdr.msg_iov = &(pLoop->iov[i]);
+		pLoop->mmh[i].msg_hdr.msg_iovlen = 1;
+		if(pLstn->bUseCreds) {
+			pLoop->mmh[i].msg_hdr.msg_control = pLoop->pCmsgBuf + i * RCV_CMSG_LEN;
+			pLoop->mmh[i].msg_hdr.msg_controllen = RCV_CMSG_LEN;
+		}
 	}
-
+	nelem = recvmmsg(pLstn->fd, pLoop->mmh, runModConf->batchSize, MSG_DONTWAIT, NULL);
+	if(nelem < 0 && errno == ENOSYS) {
+		/* be careful: some versions of valgrind do not support recvmmsg()! */
+		DBGPRINTF("imuxsock: error ENOSYS on call to recvmmsg() - fall back to recvmsg\n");
+		nelem = recvmsg(pLstn->fd, &(pLoop->mmh[0].msg_hdr), MSG_DONTWAIT);
+		if(nelem >= 0) {
+			pLoop->mmh[0].msg_len = nelem;
+			nelem = 1;
+		}
+	}
+#	else /* #ifdef HAVE_RECVMMSG */
 	memset(&msgh, 0, sizeof(msgh));
 	memset(&msgiov, 0, sizeof(msgiov));
-#	if HAVE_SCM_CREDENTIALS
 	if(pLstn->bUseCreds) {
-		memset(&aux, 0, sizeof(aux));
-		msgh.msg_control = aux;
-		msgh.msg_controllen = sizeof(aux);
+		msgh.msg_control = pLoop->pCmsgBuf;
+		msgh.msg_controllen = RCV_CMSG_LEN;
 	}
-#	endif
-	msgiov.iov_base = (char*)pRcv;
-	msgiov.iov_len = iMaxLine;
+	msgiov.iov_base = (char*)pLoop->pRcvBuf;
+	msgiov.iov_len = pLoop->lenRcvBufEntry - 1;
 	msgh.msg_iov = &msgiov;
 	msgh.msg_iovlen = 1;
-	iRcvd = recvmsg(pLstn->fd, &msgh, MSG_DONTWAIT);
+	nelem = recvmsg(pLstn->fd, &msgh, MSG_DONTWAIT);
+#	endif /* #ifdef HAVE_RECVMMSG */
  
-	DBGPRINTF("Message from UNIX socket: #%d\n", pLstn->fd);
-	if(iRcvd > 0) {
-		cred = NULL;
-		ts = NULL;
-#		if defined(HAVE_SCM_CREDENTIALS) || defined(HAVE_SO_TIMESTAMP)
-		if(pLstn->bUseCreds) {
-			struct cmsghdr *cm;
-			for(cm = CMSG_FIRSTHDR(&msgh); cm; cm = CMSG_NXTHDR(&msgh, cm)) {
-#				if HAVE_SCM_CREDENTIALS
-				if(   pLstn->bUseCreds
-				   && cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_CREDENTIALS) {
-					cred = (struct ucred*) CMSG_DATA(cm);
-				}
-#				endif /* HAVE_SCM_CREDENTIALS */
-#				if HAVE_SO_TIMESTAMP
-				if(   pLstn->bUseSysTimeStamp 
-				   && cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SO_TIMESTAMP) {
-					ts = (struct timeval *)CMSG_DATA(cm);
-				}
-#				endif /* HAVE_SO_TIMESTAMP */
-			}
+	DBGPRINTF("Message from UNIX socket: #%d, result %d\n", pLstn->fd, nelem);
+	if(nelem < 0) {
+		if(errno != EINTR && errno != EAGAIN) {
+			char errStr[1024];
+			rs_strerror_r(errno, errStr, sizeof(errStr));
+			DBGPRINTF("UNIX socket error: %d = %s.\n", errno, errStr);
+			errmsg.LogError(errno, NO_ERRCODE, "imuxsock: recvfrom UNIX");
 		}
-#		endif /* defined(HAVE_SCM_CREDENTIALS) || defined(HAVE_SO_TIMESTAMP) */
-		CHKiRet(SubmitMsg(pRcv, iRcvd, pLstn, cred, ts));
-	} else if(iRcvd < 0 && errno != EINTR && errno != EAGAIN) {
-		char errStr[1024];
-		rs_strerror_r(errno, errStr, sizeof(errStr));
-		DBGPRINTF("UNIX socket error: %d = %s.\n", errno, errStr);
-		errmsg.LogError(errno, NO_ERRCODE, "imuxsock: recvfrom UNIX");
+		FINALIZE;
 	}
 
-finalize_it:
-	if(pRcv != NULL && (size_t) iMaxLine >= sizeof(bufRcv) - 1)
-		free(pRcv);
+#	ifdef HAVE_RECVMMSG
+	for(i = 0 ; i < nelem ; ++i) {
+		if(pLoop->mmh[i].msg_len == 0)
+			continue;
+		getMsgCreds(pLstn, &(pLoop->mmh[i].msg_hdr), &cred, &ts);
+		/* errors affect only the single message, so we carry on with the batch */
+		SubmitMsg(pLoop->pRcvBuf + i * pLoop->lenRcvBufEntry, pLoop->mmh[i].msg_len,
+			  pLstn, cred, ts, &multiSub);
+	}
+#	else /* #ifdef HAVE_RECVMMSG */
+	if(nelem > 0) {
+		getMsgCreds(pLstn, &msgh, &cred, &ts);
+		SubmitMsg(pLoop->pRcvBuf, nelem, pLstn, cred, ts, &multiSub);
+	}
+#	endif /* #ifdef HAVE_RECVMMSG */
 
+finalize_it:
+	multiSubmitFlush(&multiSub);
 	RETiRet;
 }
-#pragma GCC diagnostic pop
 
 
 /* activate current listeners */
@@ -1127,6 +1244,7 @@ activateListeners(void)
 		listeners[0].bDiscardOwnMsgs = runModConf->bDiscardOwnMsgs;
 		listeners[0].bUnlink = runModConf->bUnlink;
 		listeners[0].bUseSysTimeStamp = runModConf->bUseSysTimeStamp;
+		listeners[0].rcvbuf = runModConf->rcvbufSysSock;
 		listeners[0].flags = runModConf->bIgnoreTimestamp ? IGNDATE : NOFLAG;
 		listeners[0].flowCtl = runModConf->bUseFlowCtl ? eFLOWCTL_LIGHT_DELAY : eFLOWCTL_NO_DELAY;
 		CHKiRet(ratelimitNew(&listeners[0].dflt_ratelimiter, "imuxsock", NULL));
@@ -1183,6 +1301,9 @@ CODESTARTbeginCnfLoad
 	pModConf->ratelimitIntervalSysSock = DFLT_ratelimitInterval;
 	pModConf->ratelimitBurstSysSock = DFLT_ratelimitBurst;
 	pModConf->ratelimitSeveritySysSock = DFLT_ratelimitSeverity;
+	pModConf->rcvbufSysSock = 0;
+	pModConf->batchSize = BATCH_SIZE_DFLT;
+	pModConf->nRcvLoops = 1;
 	bLegacyCnfModGlobalsPermitted = 1;
 	/* reset legacy config vars */
 	resetConfigVariables(NULL, NULL);
@@ -1238,6 +1359,12 @@ CODESTARTsetModCnf
 			loadModConf->ratelimitBurstSysSock = (int) pvals[i].val.d.n;
 		} else if(!strcmp(modpblk.descr[i].name, "syssock.ratelimit.severity")) {
 			loadModConf->ratelimitSeveritySysSock = (int) pvals[i].val.d.n;
+		} else if(!strcmp(modpblk.descr[i].name, "syssock.rcvbufsize")) {
+			loadModConf->rcvbufSysSock = (int) pvals[i].val.d.n;
+		} else if(!strcmp(modpblk.descr[i].name, "batchsize")) {
+			loadModConf->batchSize = (int) pvals[i].val.d.n;
+		} else if(!strcmp(modpblk.descr[i].name, "threads")) {
+			loadModConf->nRcvLoops = (int) pvals[i].val.d.n;
 		} else {
 			dbgprintf("imuxsock: program error, non-handled "
 			  "param '%s' in beginCnfLoad\n", modpblk.descr[i].name);
@@ -1312,6 +1439,8 @@ CODESTARTnewInpInst
 			inst->ratelimitBurst = (int) pvals[i].val.d.n;
 		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.severity")) {
 			inst->ratelimitSeverity = (int) pvals[i].val.d.n;
+		} else if(!strcmp(inppblk.descr[i].name, "rcvbufsize")) {
+			inst->rcvbuf = (int) pvals[i].val.d.n;
 		} else {
 			dbgprintf("imuxsock: program error, non-handled "
 			  "param '%s'\n", inppblk.descr[i].name);
@@ -1426,25 +1555,102 @@ CODESTARTfreeCnf
 ENDfreeCnf
 
 
-/* This function is called to gather input. */
-BEGINrunInput
+/* assign listeners to receive loops and allocate the loops' buffers. The
+ * system log socket is always serviced by loop 0 (the input thread). If
+ * there are multiple loops, it stays alone there and the additional
+ * sockets are spread over the other loops, so that heavy logging to
+ * e.g. container sockets does not slow down /dev/log.
+ */
+static rsRetVal
+setupRcvLoops(thrdInfo_t *const pThrd)
+{
+	int nActive;
+	int iFirst;
+	int i;
+	DEFiRet;
+
+	nActive = 0;
+	for(i = startIndexUxLocalSockets ; i < nfd ; ++i) {
+		if(listeners[i].fd != -1)
+			++nActive;
+	}
+	nRcvLoops = runModConf->nRcvLoops;
+	if(nRcvLoops > nActive)
+		nRcvLoops = nActive;
+	if(nRcvLoops < 1)
+		nRcvLoops = 1;
+	iFirst = (startIndexUxLocalSockets == 0 && nRcvLoops > 1) ? 1 : 0;
+	nActive = 0;
+	for(i = startIndexUxLocalSockets ; i < nfd ; ++i) {
+		if(i == 0) {
+			listeners[i].iRcvLoop = 0;
+		} else {
+			listeners[i].iRcvLoop = (listeners[i].fd == -1) ? 0
+				: iFirst + nActive++ % (nRcvLoops - iFirst);
+		}
+		DBGPRINTF("imuxsock: socket '%s' serviced by receive loop %d\n",
+			  listeners[i].sockName, listeners[i].iRcvLoop);
+	}
+
+	CHKmalloc(rcvLoops = calloc(nRcvLoops, sizeof(rcvLoop_t)));
+	for(i = 0 ; i < nRcvLoops ; ++i) {
+		rcvLoops[i].id = i;
+		rcvLoops[i].pThrd = pThrd;
+		rcvLoops[i].lenRcvBufEntry = glbl.GetMaxLine() + 1;
+		CHKmalloc(rcvLoops[i].pRcvBuf = MALLOC(runModConf->batchSize * rcvLoops[i].lenRcvBufEntry));
+		CHKmalloc(rcvLoops[i].pCmsgBuf = MALLOC(runModConf->batchSize * RCV_CMSG_LEN));
+#		ifdef HAVE_RECVMMSG
+		CHKmalloc(rcvLoops[i].mmh = MALLOC(runModConf->batchSize * sizeof(struct mmsghdr)));
+		CHKmalloc(rcvLoops[i].iov = MALLOC(runModConf->batchSize * sizeof(struct iovec)));
+#		endif
+	}
+
+finalize_it:
+	RETiRet;
+}
+
+
+static void
+freeRcvLoops(void)
+{
+	int i;
+
+	if(rcvLoops == NULL)
+		return;
+	for(i = 0 ; i < nRcvLoops ; ++i) {
+		free(rcvLoops[i].pRcvBuf);
+		free(rcvLoops[i].pCmsgBuf);
+#		ifdef HAVE_RECVMMSG
+		free(rcvLoops[i].mmh);
+		free(rcvLoops[i].iov);
+#		endif
+	}
+	free(rcvLoops);
+	rcvLoops = NULL;
+	nRcvLoops = 0;
+}
+
+
+/* the receive loop: wait for data on the listeners assigned to this loop
+ * and process it. Terminates when the input shall shut down.
+ */
+static rsRetVal
+rcvMainLoop(rcvLoop_t *const pLoop)
+{
 	int maxfds;
 	int nfds;
 	int i;
 	int fd;
+	struct timeval tv;
 #ifdef USE_UNLIMITED_SELECT
         fd_set  *pReadfds = malloc(glbl.GetFdSetSize());
 #else
         fd_set  readfds;
         fd_set *pReadfds = &readfds;
 #endif
+	DEFiRet;
 
-CODESTARTrunInput
 	CHKmalloc(pReadfds);
-	if(startIndexUxLocalSockets == 1 && nfd == 1) {
-		/* No sockets were configured, no reason to run. */
-		ABORT_FINALIZE(RS_RET_OK);
-	}
 	/* this is an endless loop - it is terminated when the thread is
 	 * signalled to do so. This, however, is handled by the framework,
 	 * right into the sleep below.
@@ -1460,7 +1666,7 @@ CODESTARTrunInput
 	        FD_ZERO (pReadfds);
 		/* Copy master connections */
 		for (i = startIndexUxLocalSockets; i < nfd; i++) {
-			if (listeners[i].fd!= -1) {
+			if (listeners[i].fd!= -1 && listeners[i].iRcvLoop == pLoop->id) {
 				FD_SET(listeners[i].fd, pReadfds);
 				if(listeners[i].fd > maxfds)
 					maxfds=listeners[i].fd;
@@ -1468,7 +1674,8 @@ CODESTARTrunInput
 		}
 
 		if(Debug) {
-			dbgprintf("--------imuxsock calling select, active file descriptors (max %d): ", maxfds);
+			dbgprintf("--------imuxsock loop %d calling select, active file descriptors (max %d): ",
+				  pLoop->id, maxfds);
 			for (nfds= 0; nfds <= maxfds; ++nfds)
 				if ( FD_ISSET(nfds, pReadfds) )
 					dbgprintf("%d ", nfds);
@@ -1476,15 +1683,21 @@ CODESTARTrunInput
 		}
 
 		/* wait for io to become ready */
-		nfds = select(maxfds+1, (fd_set *) pReadfds, NULL, NULL, NULL);
-		if(glbl.GetGlobalInputTermState() == 1)
+		if(pLoop->id == 0) {
+			nfds = select(maxfds+1, (fd_set *) pReadfds, NULL, NULL, NULL);
+		} else {
+			tv.tv_sec = RCVLOOP_TIMEOUT / 1000;
+			tv.tv_usec = (RCVLOOP_TIMEOUT % 1000) * 1000;
+			nfds = select(maxfds+1, (fd_set *) pReadfds, NULL, NULL, &tv);
+		}
+		if(glbl.GetGlobalInputTermState() == 1 || pLoop->pThrd->bShallStop == RSTRUE)
 			break; /* terminate input! */
 
 		for (i = startIndexUxLocalSockets ; i < nfd && nfds > 0; i++) {
 			if(glbl.GetGlobalInputTermState() == 1)
 				ABORT_FINALIZE(RS_RET_FORCE_TERM); /* terminate input! */
 			if ((fd = listeners[i].fd) != -1 && FD_ISSET(fd, pReadfds)) {
-				readSocket(&(listeners[i]));
+				readSocket(pLoop, &(listeners[i]));
 				--nfds; /* indicate we have processed one */
 			}
 		}
@@ -1492,6 +1705,62 @@ CODESTARTrunInput
 
 finalize_it:
 	freeFdSet(pReadfds);
+	RETiRet;
+}
+
+
+/* thread startup wrapper for receive loops other than the first */
+static void *
+rcvLoopThrd(void *arg)
+{
+	rcvLoop_t *const pLoop = (rcvLoop_t*) arg;
+
+	dbgSetThrdName((uchar*)"imuxsock rcv");
+
+	rcvMainLoop(pLoop);
+	return NULL;
+}
+
+
+/* This function is called to gather input.
+ * It starts the additional receive loops (if any) and runs the first one
+ * on our own thread.
+ */
+BEGINrunInput
+	pthread_attr_t thrdAttr;
+	int i;
+CODESTARTrunInput
+	if(startIndexUxLocalSockets == 1 && nfd == 1) {
+		/* No sockets were configured, no reason to run. */
+		ABORT_FINALIZE(RS_RET_OK);
+	}
+	CHKiRet(setupRcvLoops(pThrd));
+
+	pthread_attr_init(&thrdAttr);
+	pthread_attr_setstacksize(&thrdAttr, 4096*1024);
+	for(i = 1 ; i < nRcvLoops ; ++i) {
+		if(pthread_create(&rcvLoops[i].tid, &thrdAttr, rcvLoopThrd, &(rcvLoops[i])) == 0) {
+			rcvLoops[i].bThrdStarted = 1;
+		} else {
+			errmsg.LogError(errno, NO_ERRCODE, "imuxsock: could not create thread for "
+					"receive loop %d, its sockets will not be serviced", i);
+		}
+	}
+	pthread_attr_destroy(&thrdAttr);
+
+	iRet = rcvMainLoop(&(rcvLoops[0]));
+
+	for(i = 1 ; i < nRcvLoops ; ++i) {
+		if(rcvLoops[i].bThrdStarted)
+			pthread_kill(rcvLoops[i].tid, SIGTTIN);
+	}
+	for(i = 1 ; i < nRcvLoops ; ++i) {
+		if(rcvLoops[i].bThrdStarted)
+			pthread_join(rcvLoops[i].tid, NULL);
+	}
+
+finalize_it:
+	freeRcvLoops();
 ENDrunInput
 
 
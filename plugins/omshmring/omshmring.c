@@ -0,0 +1,418 @@
+/* omshmring.c
+ * This is an output module which writes template output into a shared
+ * memory ring buffer (a file, usually on /dev/shm), from which local
+ * consumers read it with the help of libshmring (runtime/libshmring.[ch]).
+ * Compared to forwarding via TCP or a pipe, this saves the per-message
+ * system calls and socket overhead on both sides.
+ *
+ * We use the transactional interface: all messages of a batch are written
+ * with a single ring reservation and a single consumer wakeup. What
+ * happens if the consumer falls behind and the ring is full is
+ * configurable via the "full" parameter:
+ * - block: wait until the consumer has made room (default)
+ * - drop: discard the messages that do not fit; they are counted inside
+ *         the ring, so that the consumer knows about them
+ * - suspend: suspend the action, so that the regular retry and action
+ *         queue processing applies. Note that if a batch could only be
+ *         written partially, we block for the rest of it, as a retry
+ *         would otherwise duplicate the part already written.
+ *
+ * The ring is created on first use and not removed when rsyslog
+ * terminates, so consumers may stay attached over a restart.
+ *
+ * NOTE: read comments in module-template.h to understand how this file
+ *       works!
+ *
+ * This file is part of rsyslog.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "config.h"
+#include "rsyslog.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "conf.h"
+#include "syslogd-types.h"
+#include "srUtils.h"
+#include "template.h"
+#include "module-template.h"
+#include "errmsg.h"
+#include "statsobj.h"
+#include "unicode-helper.h"
+#include "libshmring.h"
+
+MODULE_TYPE_OUTPUT
+MODULE_TYPE_NOKEEP
+MODULE_CNFNAME("omshmring")
+
+/* internal structures */
+DEF_OMOD_STATIC_DATA
+DEFobjCurrIf(errmsg)
+DEFobjCurrIf(statsobj)
+
+#define RING_SIZE_DFLT (4 * 1024 * 1024)
+#define WAIT_TIMEOUT 1000	/* ms, wait slice when blocking on a full ring */
+
+typedef enum {
+	FULL_BLOCK = 0,
+	FULL_DROP = 1,
+	FULL_SUSPEND = 2
+} fullAction_t;
+
+typedef struct _instanceData {
+	uchar *pszRing;		/* ring file name */
+	uchar *tplName;		/* name of assigned template */
+	int64 ringSize;
+	int fCreateMode;
+	uid_t fileUID;
+	gid_t fileGID;
+	fullAction_t fullAction;
+	shmring_t *pRing;	/* NULL if not yet created */
+	pthread_mutex_t mutRing;	/* guards ring creation */
+	statsobj_t *stats;
+	STATSCOUNTER_DEF(ctrSubmit, mutCtrSubmit)
+	STATSCOUNTER_DEF(ctrDropped, mutCtrDropped)
+	STATSCOUNTER_DEF(ctrBlocked, mutCtrBlocked)
+	STATSCOUNTER_DEF(ctrSuspended, mutCtrSuspended)
+} instanceData;
+
+typedef struct wrkrInstanceData {
+	instanceData *pData;
+	struct shmringBuf_s *recs;	/* records of current batch */
+	unsigned maxRecs;		/* size of recs array */
+} wrkrInstanceData_t;
+
+
+/* tables for interfacing with the v6 config system */
+/* action (instance) parameters */
+static struct cnfparamdescr actpdescr[] = {
+	{ "ring", eCmdHdlrGetWord, CNFPARAM_REQUIRED },
+	{ "size", eCmdHdlrSize, 0 },
+	{ "full", eCmdHdlrGetWord, 0 },
+	{ "filecreatemode", eCmdHdlrFileCreateMode, 0 },
+	{ "fileowner", eCmdHdlrUID, 0 },
+	{ "filegroup", eCmdHdlrGID, 0 },
+	{ "template", eCmdHdlrGetWord, 0 }
+};
+static struct cnfparamblk actpblk =
+	{ CNFPARAMBLK_VERSION,
+	  sizeof(actpdescr)/sizeof(struct cnfparamdescr),
+	  actpdescr
+	};
+
+
+BEGINcreateInstance
+CODESTARTcreateInstance
+	pData->pRing = NULL;
+	pData->stats = NULL;
+	pthread_mutex_init(&pData->mutRing, NULL);
+ENDcreateInstance
+
+
+BEGINcreateWrkrInstance
+CODESTARTcreateWrkrInstance
+	pWrkrData->recs = NULL;
+	pWrkrData->maxRecs = 0;
+ENDcreateWrkrInstance
+
+
+BEGINisCompatibleWithFeature
+CODESTARTisCompatibleWithFeature
+	if(eFeat == sFEATURERepeatedMsgReduction)
+		iRet = RS_RET_OK;
+ENDisCompatibleWithFeature
+
+
+BEGINfreeInstance
+CODESTARTfreeInstance
+	/* the ring file is intentionally kept, see file header */
+	shmringClose(pData->pRing);
+	if(pData->stats != NULL)
+		statsobj.Destruct(&pData->stats);
+	free(pData->pszRing);
+	free(pData->tplName);
+	pthread_mutex_destroy(&pData->mutRing);
+ENDfreeInstance
+
+
+BEGINfreeWrkrInstance
+CODESTARTfreeWrkrInstance
+	free(pWrkrData->recs);
+ENDfreeWrkrInstance
+
+
+BEGINdbgPrintInstInfo
+CODESTARTdbgPrintInstInfo
+	dbgprintf("omshmring\n");
+	dbgprintf("\tring='%s'\n", pData->pszRing);
+	dbgprintf("\tsize=%lld\n", (long long) pData->ringSize);
+	dbgprintf("\tfull=%d\n", pData->fullAction);
+	dbgprintf("\ttemplate='%s'\n", pData->tplName);
+ENDdbgPrintInstInfo
+
+
+/* create the ring, if not already done. This is done on first use,
+ * so that no ring is created e.g. during a config check.
+ */
+static rsRetVal
+ensureRing(instanceData *const pData)
+{
+	shmring_t *pRing;
+	int r;
+	DEFiRet;
+
+	pthread_mutex_lock(&pData->mutRing);
+	if(pData->pRing != NULL)
+		FINALIZE;
+	r = shmringCreate(&pRing, (char*) pData->pszRing, pData->ringSize, pData->fCreateMode);
+	if(r != SHMRING_OK) {
+		errmsg.LogError((r == SHMRING_ERR_IO) ? errno : 0, RS_RET_SUSPENDED, "omshmring: could "
+				"not create ring '%s' of size %lld (error %d)", pData->pszRing,
+				(long long) pData->ringSize, r);
+		ABORT_FINALIZE(RS_RET_SUSPENDED);
+	}
+	if(   (pData->fileUID != (uid_t) -1 || pData->fileGID != (gid_t) -1)
+	   && fchown(pRing->fd, pData->fileUID, pData->fileGID) != 0) {
+		errmsg.LogError(errno, RS_RET_ERR, "omshmring: could not set owner of ring '%s', "
+				"consumers may not be able to access it", pData->pszRing);
+	}
+	DBGPRINTF("omshmring: ring '%s' ready, size %llu, max record length %zu\n", pData->pszRing,
+		  (unsigned long long) pRing->size, shmringMaxRecLen(pRing));
+	pData->pRing = pRing;
+
+finalize_it:
+	pthread_mutex_unlock(&pData->mutRing);
+	RETiRet;
+}
+
+
+BEGINtryResume
+CODESTARTtryResume
+	CHKiRet(ensureRing(pWrkrData->pData));
+	if(   pWrkrData->pData->fullAction == FULL_SUSPEND
+	   && !shmringWaitSpace(pWrkrData->pData->pRing, 0, 0)) {
+		ABORT_FINALIZE(RS_RET_SUSPENDED);
+	}
+finalize_it:
+ENDtryResume
+
+
+BEGINbeginTransaction
+CODESTARTbeginTransaction
+	/* we have nothing to do to begin a transaction */
+ENDbeginTransaction
+
+
+/* write the whole batch into the ring. Records too large for the ring
+ * are truncated.
+ */
+BEGINcommitTransaction
+	instanceData *const pData = pWrkrData->pData;
+	struct shmringBuf_s *recs;
+	size_t maxLen;
+	unsigned nWritten = 0;
+	unsigned i;
+	int r;
+CODESTARTcommitTransaction
+	CHKiRet(ensureRing(pData));
+	if(nParams > pWrkrData->maxRecs) {
+		CHKmalloc(recs = realloc(pWrkrData->recs, nParams * sizeof(struct shmringBuf_s)));
+		pWrkrData->recs = recs;
+		pWrkrData->maxRecs = nParams;
+	}
+	recs = pWrkrData->recs;
+	maxLen = shmringMaxRecLen(pData->pRing);
+	for(i = 0 ; i < nParams ; ++i) {
+		recs[i].data = actParam(pParams, 1, i, 0).param;
+		recs[i].len = actParam(pParams, 1, i, 0).lenStr;
+		if(recs[i].len > maxLen) {
+			DBGPRINTF("omshmring: record of %zu bytes truncated to %zu\n", recs[i].len, maxLen);
+			recs[i].len = maxLen;
+		}
+	}
+
+	while(1) {
+		r = shmringWriteBatch(pData->pRing, recs + nWritten, nParams - nWritten);
+		if(r < 0) /* can not happen, as we truncated the records */
+			ABORT_FINALIZE(RS_RET_ERR);
+		nWritten += r;
+		if(nWritten == nParams)
+			break;
+		if(pData->fullAction == FULL_DROP) {
+			shmringAddDrops(pData->pRing, nParams - nWritten);
+			STATSCOUNTER_ADD(pData->ctrDropped, pData->mutCtrDropped, nParams - nWritten);
+			break;
+		}
+		if(pData->fullAction == FULL_SUSPEND && nWritten == 0) {
+			STATSCOUNTER_INC(pData->ctrSuspended, pData->mutCtrSuspended);
+			ABORT_FINALIZE(RS_RET_SUSPENDED);
+		}
+		STATSCOUNTER_INC(pData->ctrBlocked, pData->mutCtrBlocked);
+		while(!shmringWaitSpace(pData->pRing, recs[nWritten].len, WAIT_TIMEOUT)) {
+			/* the futex wait is no cancellation point, but we must
+			 * permit the action to be cancelled on shutdown.
+			 */
+			pthread_testcancel();
+		}
+	}
+
+finalize_it:
+	if(nWritten > 0)
+		STATSCOUNTER_ADD(pData->ctrSubmit, pData->mutCtrSubmit, nWritten);
+ENDcommitTransaction
+
+
+static inline void
+setInstParamDefaults(instanceData *pData)
+{
+	pData->pszRing = NULL;
+	pData->tplName = NULL;
+	pData->ringSize = RING_SIZE_DFLT;
+	pData->fCreateMode = 0600;
+	pData->fileUID = -1;
+	pData->fileGID = -1;
+	pData->fullAction = FULL_BLOCK;
+}
+
+
+static rsRetVal
+setupInstStatsCtrs(instanceData *const pData)
+{
+	uchar ctrName[512];
+	DEFiRet;
+
+	snprintf((char*)ctrName, sizeof(ctrName), "omshmring(%s)", pData->pszRing);
+	ctrName[sizeof(ctrName)-1] = '\0'; /* be on the save side */
+	CHKiRet(statsobj.Construct(&(pData->stats)));
+	CHKiRet(statsobj.SetName(pData->stats, ctrName));
+	CHKiRet(statsobj.SetOrigin(pData->stats, (uchar*)"omshmring"));
+	STATSCOUNTER_INIT(pData->ctrSubmit, pData->mutCtrSubmit);
+	CHKiRet(statsobj.AddCounter(pData->stats, UCHAR_CONSTANT("submitted"),
+		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &(pData->ctrSubmit)));
+	STATSCOUNTER_INIT(pData->ctrDropped, pData->mutCtrDropped);
+	CHKiRet(statsobj.AddCounter(pData->stats, UCHAR_CONSTANT("dropped"),
+		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &(pData->ctrDropped)));
+	STATSCOUNTER_INIT(pData->ctrBlocked, pData->mutCtrBlocked);
+	CHKiRet(statsobj.AddCounter(pData->stats, UCHAR_CONSTANT("blocked"),
+		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &(pData->ctrBlocked)));
+	STATSCOUNTER_INIT(pData->ctrSuspended, pData->mutCtrSuspended);
+	CHKiRet(statsobj.AddCounter(pData->stats, UCHAR_CONSTANT("suspended"),
+		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &(pData->ctrSuspended)));
+	CHKiRet(statsobj.ConstructFinalize(pData->stats));
+
+finalize_it:
+	RETiRet;
+}
+
+
+BEGINnewActInst
+	struct cnfparamvals *pvals;
+	char *cstr;
+	int i;
+CODESTARTnewActInst
+	if((pvals = nvlstGetParams(lst, &actpblk, NULL)) == NULL) {
+		ABORT_FINALIZE(RS_RET_MISSING_CNFPARAMS);
+	}
+
+	CHKiRet(createInstance(&pData));
+	setInstParamDefaults(pData);
+
+	CODE_STD_STRING_REQUESTnewActInst(1)
+	for(i = 0 ; i < actpblk.nParams ; ++i) {
+		if(!pvals[i].bUsed)
+			continue;
+		if(!strcmp(actpblk.descr[i].name, "ring")) {
+			pData->pszRing = (uchar*)es_str2cstr(pvals[i].val.d.estr, NULL);
+		} else if(!strcmp(actpblk.descr[i].name, "size")) {
+			pData->ringSize = pvals[i].val.d.n;
+		} else if(!strcmp(actpblk.descr[i].name, "full")) {
+			cstr = es_str2cstr(pvals[i].val.d.estr, NULL);
+			if(!strcasecmp(cstr, "block")) {
+				pData->fullAction = FULL_BLOCK;
+			} else if(!strcasecmp(cstr, "drop")) {
+				pData->fullAction = FULL_DROP;
+			} else if(!strcasecmp(cstr, "suspend")) {
+				pData->fullAction = FULL_SUSPEND;
+			} else {
+				errmsg.LogError(0, RS_RET_INVALID_PARAMS, "omshmring: invalid value '%s' "
+					"for parameter 'full', must be one of block, drop, suspend", cstr);
+				free(cstr);
+				ABORT_FINALIZE(RS_RET_INVALID_PARAMS);
+			}
+			free(cstr);
+		} else if(!strcmp(actpblk.descr[i].name, "filecreatemode")) {
+			pData->fCreateMode = (int) pvals[i].val.d.n;
+		} else if(!strcmp(actpblk.descr[i].name, "fileowner")) {
+			pData->fileUID = (uid_t) pvals[i].val.d.n;
+		} else if(!strcmp(actpblk.descr[i].name, "filegroup")) {
+			pData->fileGID = (gid_t) pvals[i].val.d.n;
+		} else if(!strcmp(actpblk.descr[i].name, "template")) {
+			pData->tplName = (uchar*)es_str2cstr(pvals[i].val.d.estr, NULL);
+		} else {
+			dbgprintf("omshmring: program error, non-handled "
+			  "param '%s'\n", actpblk.descr[i].name);
+		}
+	}
+
+	CHKiRet(OMSRsetEntry(*ppOMSR, 0, ustrdup((pData->tplName == NULL) ?
+		(uchar*)"RSYSLOG_ForwardFormat" : pData->tplName), OMSR_NO_RQD_TPL_OPTS));
+	CHKiRet(setupInstStatsCtrs(pData));
+CODE_STD_FINALIZERnewActInst
+	cnfparamvalsDestruct(pvals, &actpblk);
+ENDnewActInst
+
+
+BEGINparseSelectorAct
+CODESTARTparseSelectorAct
+CODE_STD_STRING_REQUESTparseSelectorAct(1)
+	if(!strncmp((char*) p, ":omshmring:", sizeof(":omshmring:") - 1)) {
+		errmsg.LogError(0, RS_RET_LEGA_ACT_NOT_SUPPORTED,
+			"omshmring supports only v6 config format, use: "
+			"action(type=\"omshmring\" ring=...)");
+	}
+	ABORT_FINALIZE(RS_RET_CONFLINE_UNPROCESSED);
+CODE_STD_FINALIZERparseSelectorAct
+ENDparseSelectorAct
+
+
+BEGINmodExit
+CODESTARTmodExit
+	objRelease(errmsg, CORE_COMPONENT);
+	objRelease(statsobj, CORE_COMPONENT);
+ENDmodExit
+
+
+BEGINqueryEtryPt
+CODESTARTqueryEtryPt
+CODEqueryEtryPt_STD_OMODTX_QUERIES
+CODEqueryEtryPt_STD_OMOD8_QUERIES
+CODEqueryEtryPt_STD_CONF2_OMOD_QUERIES
+ENDqueryEtryPt
+
+
+BEGINmodInit()
+CODESTARTmodInit
+	*ipIFVersProvided = CURR_MOD_IF_VERSION; /* we only support the current interface specification */
+CODEmodInit_QueryRegCFSLineHdlr
+	CHKiRet(objUse(errmsg, CORE_COMPONENT));
+	CHKiRet(objUse(statsobj, CORE_COMPONENT));
+	DBGPRINTF("omshmring: version %s initializing\n", VERSION);
+ENDmodInit
+/* vi:set ai:
+ */
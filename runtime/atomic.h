@@ -44,6 +44,7 @@
 #	define ATOMIC_INC(data, phlpmut) ((void) __sync_fetch_and_add(data, 1))
 #	define ATOMIC_INC_AND_FETCH_int(data, phlpmut) __sync_fetch_and_add(data, 1)
 #	define ATOMIC_INC_AND_FETCH_unsigned(data, phlpmut) __sync_fetch_and_add(data, 1)
+#	define ATOMIC_FETCH_AND_ADD_unsigned(data, val, phlpmut) __sync_fetch_and_add(data, val)
 #	define ATOMIC_DEC(data, phlpmut) ((void) __sync_sub_and_fetch(data, 1))
 #	define ATOMIC_DEC_AND_FETCH(data, phlpmut) __sync_sub_and_fetch(data, 1)
 #	define ATOMIC_FETCH_32BIT(data, phlpmut) ((unsigned) __sync_fetch_and_and(data, 0xffffffff))
@@ -157,6 +158,16 @@
 		return(val);
 	}
 
+	static inline unsigned
+	ATOMIC_FETCH_AND_ADD_unsigned(unsigned *data, unsigned val, pthread_mutex_t *phlpmut) {
+		unsigned oldval;
+		pthread_mutex_lock(phlpmut);
+		oldval = *data;
+		*data += val;
+		pthread_mutex_unlock(phlpmut);
+		return(oldval);
+	}
+
 	static inline int
 	ATOMIC_DEC_AND_FETCH(int *data, pthread_mutex_t *phlpmut) {
 		int val;
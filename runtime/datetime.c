@@ -30,6 +30,9 @@
 #include <stdarg.h>
 #include <ctype.h>
 #include <assert.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
 #ifdef HAVE_SYS_TIME_H
 #	include <sys/time.h>
 #endif
@@ -49,6 +52,44 @@ DEFobjCurrIf(errmsg)
 /* the following table of ten powers saves us some computation */
 static const int tenPowers[6] = { 1, 10, 100, 1000, 10000, 100000 };
 
+/* Per-thread cache for formatting and parsing timestamps. At high message
+ * rates, thousands of messages share the same second, so we remember the
+ * last formatted string per format (keyed on the full second plus the
+ * timezone offset) and only patch in the fractional seconds, if needed.
+ * This is only done for formats which are costly to generate: the other
+ * ones just store a few digits, which is faster than the cache lookup.
+ * Likewise, the parsers remember the last "date and time up to the second"
+ * prefix they successfully parsed and skip re-parsing it if the next
+ * timestamp has the identical prefix. As this is per thread, no locking
+ * is required.
+ */
+enum dtFmt_e {
+	DT_FMT_3339 = 0,	/* buf holds date-time (19 chars) followed by TZ suffix */
+	DT_FMT_UNIX = 1,
+	DT_NFMTS = 2
+};
+#define DT_3339_DATETIME_LEN 19	/* "yyyy-mm-ddThh:mm:ss" */
+#define DT_3164_DATETIME_LEN 15	/* "Mmm dd hh:mm:ss" */
+
+struct dtThrdCache_s {
+	struct {
+		uint64_t key;	/* 0 - unused */
+		int len;	/* length of formatted string in buf */
+		char buf[32];
+	} fmt[DT_NFMTS];
+	struct {	/* last successfully parsed RFC3339 prefix */
+		int valid;
+		uchar prefix[DT_3339_DATETIME_LEN];
+		int year, month, day, hour, minute, second;
+	} parse3339;
+	struct {	/* last successfully parsed RFC3164 prefix (without year) */
+		int valid;
+		uchar prefix[DT_3164_DATETIME_LEN];
+		int month, day, hour, minute, second;
+	} parse3164;
+};
+static pthread_key_t keyThrdCache;
+
 /* the following table saves us from computing an additional date to get
  * the ordinal day of the year - at least from 1967-2099 */
 static const int yearInSec_startYear = 1967;
@@ -241,6 +282,69 @@ srSLMGParseInt32(uchar** ppsz, int *pLenStr)
 }
 
 
+/* obtain the calling thread's timestamp cache. Returns NULL if we are
+ * out of memory, in which case the caller must do without cache.
+ */
+static struct dtThrdCache_s *
+getThrdCache(void)
+{
+	struct dtThrdCache_s *pCache;
+
+	if((pCache = pthread_getspecific(keyThrdCache)) == NULL) {
+		if((pCache = calloc(1, sizeof(struct dtThrdCache_s))) == NULL)
+			return NULL;
+		if(pthread_setspecific(keyThrdCache, pCache) != 0) {
+			free(pCache);
+			return NULL;
+		}
+	}
+	return pCache;
+}
+
+/* build the format cache key from all fields up to the second, including
+ * the timezone offset. The top bit is always set, so that a key is never 0.
+ */
+static inline uint64_t
+fmtCacheKey(const struct syslogTime *const ts)
+{
+	return   ((uint64_t) 1 << 63)
+	       | ((uint64_t) (ts->year & 0xffff) << 45)
+	       | ((uint64_t) (ts->month & 0x0f) << 41)
+	       | ((uint64_t) (ts->day & 0x1f) << 36)
+	       | ((uint64_t) (ts->hour & 0x1f) << 31)
+	       | ((uint64_t) (ts->minute & 0x3f) << 25)
+	       | ((uint64_t) (ts->second & 0x3f) << 19)
+	       | ((uint64_t) (uchar) ts->OffsetMode << 11)
+	       | ((uint64_t) (ts->OffsetHour & 0x1f) << 6)
+	       | (uint64_t) (ts->OffsetMinute & 0x3f);
+}
+
+/* check if the formatted string for ts is cached. If so, copy it to pBuf
+ * (including the '\0') and return its length, otherwise return -1.
+ */
+static inline int
+fmtCacheGet(struct dtThrdCache_s *const pCache, const enum dtFmt_e fmt,
+	const uint64_t key, char *const pBuf)
+{
+	if(pCache == NULL || pCache->fmt[fmt].key != key)
+		return -1;
+	memcpy(pBuf, pCache->fmt[fmt].buf, pCache->fmt[fmt].len + 1);
+	return pCache->fmt[fmt].len;
+}
+
+static inline void
+fmtCacheSet(struct dtThrdCache_s *const pCache, const enum dtFmt_e fmt,
+	const uint64_t key, const char *const pBuf, const int len)
+{
+	if(pCache == NULL || len >= (int) sizeof(pCache->fmt[fmt].buf))
+		return;
+	memcpy(pCache->fmt[fmt].buf, pBuf, len);
+	pCache->fmt[fmt].buf[len] = '\0';
+	pCache->fmt[fmt].len = len;
+	pCache->fmt[fmt].key = key;
+}
+
+
 /**
  * Parse a TIMESTAMP-3339.
  * updates the parse pointer position. The pTime parameter
@@ -269,6 +373,7 @@ ParseTIMESTAMP3339(struct syslogTime *pTime, uchar** ppszTS, int *pLenStr)
 	int OffsetMinute;	/* UTC offset in minutes */
 	int lenStr;
 	/* end variables to temporarily hold time information while we parse */
+	struct dtThrdCache_s *pCache;
 	DEFiRet;
 
 	assert(pTime != NULL);
@@ -276,6 +381,23 @@ ParseTIMESTAMP3339(struct syslogTime *pTime, uchar** ppszTS, int *pLenStr)
 	assert(pszTS != NULL);
 
 	lenStr = *pLenStr;
+
+	/* fast path: same date and time (up to the second) as last time? */
+	pCache = getThrdCache();
+	if(   pCache != NULL && pCache->parse3339.valid
+	   && lenStr > DT_3339_DATETIME_LEN && !isdigit(pszTS[DT_3339_DATETIME_LEN])
+	   && !memcmp(pszTS, pCache->parse3339.prefix, DT_3339_DATETIME_LEN)) {
+		year = pCache->parse3339.year;
+		month = pCache->parse3339.month;
+		day = pCache->parse3339.day;
+		hour = pCache->parse3339.hour;
+		minute = pCache->parse3339.minute;
+		second = pCache->parse3339.second;
+		pszTS += DT_3339_DATETIME_LEN;
+		lenStr -= DT_3339_DATETIME_LEN;
+		goto parse_secfrac;
+	}
+
 	year = srSLMGParseInt32(&pszTS, &lenStr);
 
 	/* We take the liberty to accept slightly malformed timestamps e.g. in 
@@ -319,6 +441,19 @@ ParseTIMESTAMP3339(struct syslogTime *pTime, uchar** ppszTS, int *pLenStr)
 	if(second < 0 || second > 60)
 		ABORT_FINALIZE(RS_RET_INVLD_TIME);
 
+	/* remember canonical prefixes for the fast path */
+	if(pCache != NULL && pszTS - *ppszTS == DT_3339_DATETIME_LEN) {
+		memcpy(pCache->parse3339.prefix, *ppszTS, DT_3339_DATETIME_LEN);
+		pCache->parse3339.year = year;
+		pCache->parse3339.month = month;
+		pCache->parse3339.day = day;
+		pCache->parse3339.hour = hour;
+		pCache->parse3339.minute = minute;
+		pCache->parse3339.second = second;
+		pCache->parse3339.valid = 1;
+	}
+
+parse_secfrac:
 	/* Now let's see if we have secfrac */
 	if(lenStr > 0 && *pszTS == '.') {
 		--lenStr;
@@ -443,6 +578,7 @@ ParseTIMESTAMP3164(struct syslogTime *pTime, uchar** ppszTS, int *pLenStr,
 	/* end variables to temporarily hold time information while we parse */
 	int lenStr;
 	uchar *pszTS;
+	struct dtThrdCache_s *pCache;
 	DEFiRet;
 
 	assert(ppszTS != NULL);
@@ -455,6 +591,24 @@ ParseTIMESTAMP3164(struct syslogTime *pTime, uchar** ppszTS, int *pLenStr,
 	if(lenStr < 3)
 		ABORT_FINALIZE(RS_RET_INVLD_TIME);
 
+	/* fast path: same "Mmm dd hh:mm:ss" as last time? Note that a cached
+	 * prefix never starts with a digit, so a prepended year does not match.
+	 */
+	pCache = getThrdCache();
+	if(   pCache != NULL && pCache->parse3164.valid
+	   && lenStr >= DT_3164_DATETIME_LEN
+	   && (lenStr == DT_3164_DATETIME_LEN || !isdigit(pszTS[DT_3164_DATETIME_LEN]))
+	   && !memcmp(pszTS, pCache->parse3164.prefix, DT_3164_DATETIME_LEN)) {
+		month = pCache->parse3164.month;
+		day = pCache->parse3164.day;
+		hour = pCache->parse3164.hour;
+		minute = pCache->parse3164.minute;
+		second = pCache->parse3164.second;
+		pszTS += DT_3164_DATETIME_LEN;
+		lenStr -= DT_3164_DATETIME_LEN;
+		goto parse_secfrac;
+	}
+
 	/* first check if we have a year in front of the timestamp. some devices (e.g. Brocade)
 	 * do this. As it is pretty straightforward to detect and chance of misinterpretation
 	 * is low, we try to parse it.
@@ -668,6 +822,18 @@ ParseTIMESTAMP3164(struct syslogTime *pTime, uchar** ppszTS, int *pLenStr,
 	if(second < 0 || second > 60)
 		ABORT_FINALIZE(RS_RET_INVLD_TIME);
 
+	/* remember canonical prefixes (without any year) for the fast path */
+	if(pCache != NULL && year == 0 && pszTS - *ppszTS == DT_3164_DATETIME_LEN) {
+		memcpy(pCache->parse3164.prefix, *ppszTS, DT_3164_DATETIME_LEN);
+		pCache->parse3164.month = month;
+		pCache->parse3164.day = day;
+		pCache->parse3164.hour = hour;
+		pCache->parse3164.minute = minute;
+		pCache->parse3164.second = second;
+		pCache->parse3164.valid = 1;
+	}
+
+parse_secfrac:
 	/* as an extension e.g. found in CISCO IOS, we support sub-second resultion.
 	 * It's presence is indicated by a dot immediately following the second.
 	 */
@@ -844,6 +1010,30 @@ formatTimestampToPgSQL(struct syslogTime *ts, char *pBuf)
 }
 
 
+/* write the digits of the fractional seconds (secfracPrecision must be
+ * greater than 0). Returns the number of digits written, the buffer is
+ * NOT '\0'-terminated.
+ */
+static inline int
+addSecFracDigits(const struct syslogTime *const ts, char *const pBuf)
+{
+	int iBuf = 0;
+	int power;
+	int secfrac;
+	short digit;
+
+	power = tenPowers[(ts->secfracPrecision - 1) % 6];
+	secfrac = ts->secfrac;
+	while(power > 0) {
+		digit = secfrac / power;
+		secfrac -= digit * power;
+		power /= 10;
+		pBuf[iBuf++] = digit + '0';
+	}
+	return iBuf;
+}
+
+
 /**
  * Format a syslogTimestamp to just the fractional seconds.
  * The caller must provide the timestamp as well as a character
@@ -857,9 +1047,6 @@ static int
 formatTimestampSecFrac(struct syslogTime *ts, char* pBuf)
 {
 	int iBuf;
-	int power;
-	int secfrac;
-	short digit;
 
 	assert(ts != NULL);
 	assert(pBuf != NULL);
@@ -867,14 +1054,7 @@ formatTimestampSecFrac(struct syslogTime *ts, char* pBuf)
 	iBuf = 0;
 	if(ts->secfracPrecision > 0)
 	{	
-		power = tenPowers[(ts->secfracPrecision - 1) % 6];
-		secfrac = ts->secfrac;
-		while(power > 0) {
-			digit = secfrac / power;
-			secfrac -= digit * power;
-			power /= 10;
-			pBuf[iBuf++] = digit + '0';
-		}
+		iBuf = addSecFracDigits(ts, pBuf);
 	} else {
 		pBuf[iBuf++] = '0';
 	}
@@ -896,14 +1076,30 @@ static int
 formatTimestamp3339(struct syslogTime *ts, char* pBuf)
 {
 	int iBuf;
-	int power;
-	int secfrac;
-	short digit;
+	int iTZ;
+	struct dtThrdCache_s *pCache;
+	uint64_t key;
 
 	BEGINfunc
 	assert(ts != NULL);
 	assert(pBuf != NULL);
 
+	pCache = getThrdCache();
+	key = fmtCacheKey(ts);
+	if(pCache != NULL && pCache->fmt[DT_FMT_3339].key == key) {
+		/* cached, we just need to add the secfrac */
+		memcpy(pBuf, pCache->fmt[DT_FMT_3339].buf, DT_3339_DATETIME_LEN);
+		iBuf = DT_3339_DATETIME_LEN;
+		if(ts->secfracPrecision > 0) {
+			pBuf[iBuf++] = '.';
+			iBuf += addSecFracDigits(ts, pBuf + iBuf);
+		}
+		iTZ = pCache->fmt[DT_FMT_3339].len - DT_3339_DATETIME_LEN;
+		memcpy(pBuf + iBuf, pCache->fmt[DT_FMT_3339].buf + DT_3339_DATETIME_LEN, iTZ + 1);
+		iBuf += iTZ;
+		goto done;
+	}
+
 	/* start with fixed parts */
 	/* year yyyy */
 	pBuf[0] = (ts->year / 1000) % 10 + '0';
@@ -935,16 +1131,10 @@ formatTimestamp3339(struct syslogTime *ts, char* pBuf)
 
 	if(ts->secfracPrecision > 0) {
 		pBuf[iBuf++] = '.';
-		power = tenPowers[(ts->secfracPrecision - 1) % 6];
-		secfrac = ts->secfrac;
-		while(power > 0) {
-			digit = secfrac / power;
-			secfrac -= digit * power;
-			power /= 10;
-			pBuf[iBuf++] = digit + '0';
-		}
+		iBuf += addSecFracDigits(ts, pBuf + iBuf);
 	}
 
+	iTZ = iBuf;
 	if(ts->OffsetMode == 'Z') {
 		pBuf[iBuf++] = 'Z';
 	} else {
@@ -958,6 +1148,15 @@ formatTimestamp3339(struct syslogTime *ts, char* pBuf)
 
 	pBuf[iBuf] = '\0';
 
+	if(pCache != NULL) {
+		/* cache date-time part and TZ suffix, but not the secfrac */
+		memcpy(pCache->fmt[DT_FMT_3339].buf, pBuf, DT_3339_DATETIME_LEN);
+		memcpy(pCache->fmt[DT_FMT_3339].buf + DT_3339_DATETIME_LEN, pBuf + iTZ, iBuf - iTZ + 1);
+		pCache->fmt[DT_FMT_3339].len = DT_3339_DATETIME_LEN + iBuf - iTZ;
+		pCache->fmt[DT_FMT_3339].key = key;
+	}
+
+done:
 	ENDfunc
 	return iBuf;
 }
@@ -1128,7 +1327,14 @@ done:
 static int
 formatTimestampUnix(struct syslogTime *ts, char *pBuf)
 {
-	snprintf(pBuf, 11, "%u", (unsigned) syslogTime2time_t(ts));
+	struct dtThrdCache_s *const pCache = getThrdCache();
+	const uint64_t key = fmtCacheKey(ts);
+	int len;
+
+	if(fmtCacheGet(pCache, DT_FMT_UNIX, key, pBuf) < 0) {
+		len = snprintf(pBuf, 11, "%u", (unsigned) syslogTime2time_t(ts));
+		fmtCacheSet(pCache, DT_FMT_UNIX, key, pBuf, (len > 10) ? 10 : len);
+	}
 	return 11;
 }
 
@@ -1278,6 +1484,8 @@ ENDobjQueryInterface(datetime)
 BEGINAbstractObjClassInit(datetime, 1, OBJ_IS_CORE_MODULE) /* class, version */
 	/* request objects we use */
 	CHKiRet(objUse(errmsg, CORE_COMPONENT));
+	if(pthread_key_create(&keyThrdCache, free) != 0)
+		ABORT_FINALIZE(RS_RET_ERR);
 ENDObjClassInit(datetime)
 
 /* vi:set ai:
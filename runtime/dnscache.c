@@ -7,6 +7,11 @@
  * In any case, even the initial implementaton is far faster than what we had
  * before. -- rgerhards, 2011-06-06
  *
+ * The cache is now split into shards, each with its own lock, entries expire
+ * after a configurable TTL and the cache size is bounded. Optionally, misses
+ * are resolved by a pool of resolver threads, so that a slow DNS server does
+ * not stall the callers (usually main queue workers).
+ *
  * Copyright 2011-2014 by Rainer Gerhards and Adiscon GmbH.
  *
  * This file is part of the rsyslog runtime library.
@@ -34,6 +39,9 @@
 #include <netdb.h>
 #include <unistd.h>
 #include <ctype.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
 
 #include "syslogd-types.h"
 #include "glbl.h"
@@ -43,24 +51,65 @@
 #include "net.h"
 #include "hashtable.h"
 #include "prop.h"
+#include "statsobj.h"
+#include "srUtils.h"
 #include "dnscache.h"
 
 /* module data structures */
+#define DNSCACHE_NSHARDS 16	/* must be power of 2 */
+#define DNSCACHE_HTAB_SIZE 256	/* hash chains per shard, must be power of 2 */
+#define DNSCACHE_MAX_REQ 10000	/* max queued resolution requests if cache size is unlimited */
+
 struct dnscache_entry_s {
 	struct sockaddr_storage addr;
 	prop_t *fqdn;
 	prop_t *fqdnLowerCase;
 	prop_t *localName; /* only local name, without domain part (if configured so) */
 	prop_t *ip;
-	struct dnscache_entry_s *next;
-	unsigned nUsed;
+	rsRetVal resolveState;	/* result of resolveAddr() */
+	unsigned hash;
+	time_t expires;		/* 0 - never */
+	sbool bPending;		/* resolution requested, but not yet done (async mode) */
+	struct dnscache_entry_s *next;	/* hash chain */
+	struct dnscache_entry_s *ageNext; /* insertion order list, for eviction */
+	struct dnscache_entry_s *agePrev;
 };
 typedef struct dnscache_entry_s dnscache_entry_t;
-struct dnscache_s {
-	pthread_rwlock_t rwlock;
-	struct hashtable *ht;
+
+struct dnscache_shard_s {
+	pthread_mutex_t mut;
+	pthread_cond_t condResolved;	/* signalled when a pending entry was resolved */
+	dnscache_entry_t *htab[DNSCACHE_HTAB_SIZE];
+	dnscache_entry_t *oldest;
+	dnscache_entry_t *newest;
 	unsigned nEntries;
 };
+typedef struct dnscache_shard_s dnscache_shard_t;
+
+/* a resolution request for the resolver pool */
+struct dnscache_req_s {
+	struct sockaddr_storage addr;
+	struct dnscache_req_s *next;
+};
+typedef struct dnscache_req_s dnscache_req_t;
+
+struct dnscache_s {
+	dnscache_shard_t shards[DNSCACHE_NSHARDS];
+	unsigned maxPerShard;	/* 0 - unlimited */
+	int ttl;		/* seconds, 0 - never expire */
+	int negativeTTL;	/* seconds, for failed lookups */
+	int timeout;		/* ms to wait for async resolution, 0 - do not wait */
+	/* resolver pool (async mode), only used if nResolvers > 0 */
+	int nResolvers;
+	pthread_t *resolvers;
+	pthread_mutex_t mutReq;
+	pthread_cond_t condReq;
+	dnscache_req_t *reqRoot;
+	dnscache_req_t *reqLast;
+	unsigned nReq;		/* number of queued requests */
+	unsigned maxReq;	/* if reached, misses are not queued but use the IP address */
+	sbool bShutdown;
+};
 typedef struct dnscache_s dnscache_t;
 
 
@@ -69,9 +118,17 @@ DEFobjStaticHelpers
 DEFobjCurrIf(glbl)
 DEFobjCurrIf(errmsg)
 DEFobjCurrIf(prop)
+DEFobjCurrIf(statsobj)
 static dnscache_t dnsCache;
 static prop_t *staticErrValue;
 
+static statsobj_t *stats = NULL;
+STATSCOUNTER_DEF(ctrHits, mutCtrHits)
+STATSCOUNTER_DEF(ctrMisses, mutCtrMisses)
+STATSCOUNTER_DEF(ctrTimeouts, mutCtrTimeouts)
+STATSCOUNTER_DEF(ctrExpired, mutCtrExpired)
+STATSCOUNTER_DEF(ctrEvicted, mutCtrEvicted)
+
 
 /* Our hash function.
  * TODO: check how well it performs on socket addresses!
@@ -97,11 +154,15 @@ key_equals_fn(void *key1, void *key2)
 		   && !memcmp(key1, key2, SALEN((struct sockaddr*) key1)));
 }
 
-/* destruct a cache entry.
- * Precondition: entry must already be unlinked from list
- */
+static inline dnscache_shard_t *
+getShard(const unsigned hash)
+{
+	return &dnsCache.shards[hash & (DNSCACHE_NSHARDS - 1)];
+}
+
+/* free the properties of an entry (but not the entry itself) */
 static void
-entryDestruct(dnscache_entry_t *etry)
+entryFreeProps(dnscache_entry_t *etry)
 {
 	if(etry->fqdn != NULL)
 		prop.Destruct(&etry->fqdn);
@@ -111,25 +172,115 @@ entryDestruct(dnscache_entry_t *etry)
 		prop.Destruct(&etry->localName);
 	if(etry->ip != NULL)
 		prop.Destruct(&etry->ip);
+}
+
+/* destruct a cache entry.
+ * Precondition: entry must already be unlinked from list
+ */
+static void
+entryDestruct(dnscache_entry_t *etry)
+{
+	entryFreeProps(etry);
 	free(etry);
 }
 
+
+/* find an entry inside a shard. Shard must be locked. */
+static inline dnscache_entry_t*
+findEntry(dnscache_shard_t *shard, struct sockaddr_storage *addr, const unsigned hash)
+{
+	dnscache_entry_t *etry;
+
+	for(etry = shard->htab[(hash / DNSCACHE_NSHARDS) & (DNSCACHE_HTAB_SIZE - 1)] ;
+	    etry != NULL ; etry = etry->next) {
+		if(etry->hash == hash && key_equals_fn(&etry->addr, addr))
+			break;
+	}
+	return etry;
+}
+
+
+/* unlink an entry from its shard and destruct it. Shard must be locked. */
+static void
+removeEntry(dnscache_shard_t *shard, dnscache_entry_t *etry)
+{
+	dnscache_entry_t **pp;
+
+	for(pp = &shard->htab[(etry->hash / DNSCACHE_NSHARDS) & (DNSCACHE_HTAB_SIZE - 1)] ;
+	    *pp != etry ; pp = &(*pp)->next)
+		/* just search */;
+	*pp = etry->next;
+
+	if(etry->agePrev == NULL)
+		shard->oldest = etry->ageNext;
+	else
+		etry->agePrev->ageNext = etry->ageNext;
+	if(etry->ageNext == NULL)
+		shard->newest = etry->agePrev;
+	else
+		etry->ageNext->agePrev = etry->agePrev;
+
+	--shard->nEntries;
+	entryDestruct(etry);
+}
+
+
+/* link a new entry into its shard. If the shard is full, the oldest
+ * entry is evicted. Shard must be locked.
+ */
+static void
+insertEntry(dnscache_shard_t *shard, dnscache_entry_t *etry)
+{
+	dnscache_entry_t **pp;
+
+	if(dnsCache.maxPerShard > 0 && shard->nEntries >= dnsCache.maxPerShard
+	   && shard->oldest != NULL) {
+		removeEntry(shard, shard->oldest);
+		STATSCOUNTER_INC(ctrEvicted, mutCtrEvicted);
+	}
+
+	pp = &shard->htab[(etry->hash / DNSCACHE_NSHARDS) & (DNSCACHE_HTAB_SIZE - 1)];
+	etry->next = *pp;
+	*pp = etry;
+	etry->ageNext = NULL;
+	etry->agePrev = shard->newest;
+	if(shard->newest == NULL)
+		shard->oldest = etry;
+	else
+		shard->newest->ageNext = etry;
+	shard->newest = etry;
+	++shard->nEntries;
+}
+
+
+static inline time_t
+getExpiry(const rsRetVal resolveState, prop_t *const fqdn, prop_t *const ip)
+{
+	int ttl;
+	/* if the name is the IP, the lookup did not provide a name */
+	ttl = (resolveState == RS_RET_OK && fqdn != ip) ? dnsCache.ttl : dnsCache.negativeTTL;
+	return (ttl == 0) ? 0 : time(NULL) + ttl;
+}
+
+
 /* init function (must be called once) */
 rsRetVal
 dnscacheInit(void)
 {
+	int i;
 	DEFiRet;
-	if((dnsCache.ht = create_hashtable(100, hash_from_key_fn, key_equals_fn,
-				(void(*)(void*))entryDestruct)) == NULL) {
-		DBGPRINTF("dnscache: error creating hash table!\n");
-		ABORT_FINALIZE(RS_RET_ERR); // TODO: make this degrade, but run!
+	memset(&dnsCache, 0, sizeof(dnsCache));
+	for(i = 0 ; i < DNSCACHE_NSHARDS ; ++i) {
+		pthread_mutex_init(&dnsCache.shards[i].mut, NULL);
+		pthread_cond_init(&dnsCache.shards[i].condResolved, NULL);
 	}
-	dnsCache.nEntries = 0;
-	pthread_rwlock_init(&dnsCache.rwlock, NULL);
+	pthread_mutex_init(&dnsCache.mutReq, NULL);
+	pthread_cond_init(&dnsCache.condReq, NULL);
 	CHKiRet(objGetObjInterface(&obj)); /* this provides the root pointer for all other queries */
 	CHKiRet(objUse(glbl, CORE_COMPONENT));
 	CHKiRet(objUse(errmsg, CORE_COMPONENT));
 	CHKiRet(objUse(prop, CORE_COMPONENT));
+	CHKiRet(objUse(statsobj, CORE_COMPONENT));
 
 	prop.Construct(&staticErrValue);
 	prop.SetString(staticErrValue, (uchar*)"???", 3);
@@ -142,24 +293,44 @@ finalize_it:
 rsRetVal
 dnscacheDeinit(void)
 {
+	dnscache_req_t *req, *toDel;
+	int i;
 	DEFiRet;
+
+	if(dnsCache.nResolvers > 0) {
+		pthread_mutex_lock(&dnsCache.mutReq);
+		dnsCache.bShutdown = 1;
+		pthread_cond_broadcast(&dnsCache.condReq);
+		pthread_mutex_unlock(&dnsCache.mutReq);
+		for(i = 0 ; i < dnsCache.nResolvers ; ++i)
+			pthread_join(dnsCache.resolvers[i], NULL);
+		free(dnsCache.resolvers);
+		for(req = dnsCache.reqRoot ; req != NULL ; ) {
+			toDel = req;
+			req = req->next;
+			free(toDel);
+		}
+	}
+	if(stats != NULL)
+		statsobj.Destruct(&stats);
+
 	prop.Destruct(&staticErrValue);
-	hashtable_destroy(dnsCache.ht, 1); /* 1 => free all values automatically */
-	pthread_rwlock_destroy(&dnsCache.rwlock);
+	for(i = 0 ; i < DNSCACHE_NSHARDS ; ++i) {
+		while(dnsCache.shards[i].oldest != NULL)
+			removeEntry(&dnsCache.shards[i], dnsCache.shards[i].oldest);
+		pthread_mutex_destroy(&dnsCache.shards[i].mut);
+		pthread_cond_destroy(&dnsCache.shards[i].condResolved);
+	}
+	pthread_mutex_destroy(&dnsCache.mutReq);
+	pthread_cond_destroy(&dnsCache.condReq);
 	objRelease(glbl, CORE_COMPONENT);
 	objRelease(errmsg, CORE_COMPONENT);
 	objRelease(prop, CORE_COMPONENT);
+	objRelease(statsobj, CORE_COMPONENT);
 	RETiRet;
 }
 
 
-static inline dnscache_entry_t*
-findEntry(struct sockaddr_storage *addr)
-{
-	return((dnscache_entry_t*) hashtable_search(dnsCache.ht, addr));
-}
-
-
 /* This is a cancel-safe getnameinfo() version, because we learned
  * (via drd/valgrind) that getnameinfo() seems to have some issues
  * when being cancelled, at least if the module was dlloaded.
@@ -362,49 +533,270 @@ finalize_it:
 }
 
 
-static inline rsRetVal
-addEntry(struct sockaddr_storage *addr, dnscache_entry_t **pEtry)
+/* obtain the numerical IP address as a property. This is cheap, as no
+ * DNS lookup is involved. It is used as fallback for entries which are
+ * not yet resolved.
+ */
+static rsRetVal
+getIPProp(struct sockaddr_storage *addr, prop_t **ip)
 {
-	int r;
-	struct sockaddr_storage *keybuf;
-	dnscache_entry_t *etry = NULL;
+	char szIP[80]; /* large enough for IPv6 */
 	DEFiRet;
 
-	CHKmalloc(etry = MALLOC(sizeof(dnscache_entry_t)));
-	CHKiRet(resolveAddr(addr, etry));
-	memcpy(&etry->addr, addr, SALEN((struct sockaddr*) addr));
-	etry->nUsed = 0;
-	*pEtry = etry;
+	if(mygetnameinfo((struct sockaddr *)addr, SALEN((struct sockaddr *)addr),
+			 szIP, sizeof(szIP), NULL, 0, NI_NUMERICHOST) != 0) {
+		ABORT_FINALIZE(RS_RET_INVALID_SOURCE);
+	}
+	CHKiRet(prop.CreateStringProp(ip, (uchar*)szIP, strlen(szIP)));
+finalize_it:
+	RETiRet;
+}
+
+
+/* store the result of a resolution into an entry. The properties are
+ * handed over from the temporary entry. Shard must be locked.
+ */
+static void
+setResolved(dnscache_entry_t *etry, dnscache_entry_t *res, rsRetVal resolveState)
+{
+	entryFreeProps(etry);
+	etry->fqdn = res->fqdn;
+	etry->fqdnLowerCase = res->fqdnLowerCase;
+	etry->localName = res->localName;
+	etry->ip = res->ip;
+	etry->resolveState = resolveState;
+	etry->expires = getExpiry(resolveState, res->fqdn, res->ip);
+	etry->bPending = 0;
+}
 
-	CHKmalloc(keybuf = malloc(sizeof(struct sockaddr_storage)));
-	memcpy(keybuf, addr, sizeof(struct sockaddr_storage));
 
-	pthread_rwlock_unlock(&dnsCache.rwlock); /* release read lock */
-	pthread_rwlock_wrlock(&dnsCache.rwlock); /* and re-aquire for writing */
-	r = hashtable_insert(dnsCache.ht, keybuf, *pEtry);
-	if(r == 0) {
-		DBGPRINTF("dnscache: inserting element failed\n");
+/* the resolver pool thread: pick up requests and resolve them */
+static void *
+resolverWorker(void __attribute__((unused)) *arg)
+{
+	dnscache_req_t *req;
+	dnscache_entry_t res;
+	dnscache_entry_t *etry;
+	dnscache_shard_t *shard;
+	rsRetVal localRet;
+	unsigned hash;
+	sigset_t sigSet;
+
+	/* block all signals, they are handled by the main thread */
+	sigfillset(&sigSet);
+	pthread_sigmask(SIG_BLOCK, &sigSet, NULL);
+
+	while(1) {
+		pthread_mutex_lock(&dnsCache.mutReq);
+		while(dnsCache.reqRoot == NULL && !dnsCache.bShutdown)
+			pthread_cond_wait(&dnsCache.condReq, &dnsCache.mutReq);
+		if(dnsCache.bShutdown) {
+			pthread_mutex_unlock(&dnsCache.mutReq);
+			break;
+		}
+		req = dnsCache.reqRoot;
+		dnsCache.reqRoot = req->next;
+		if(dnsCache.reqRoot == NULL)
+			dnsCache.reqLast = NULL;
+		--dnsCache.nReq;
+		pthread_mutex_unlock(&dnsCache.mutReq);
+
+		memset(&res, 0, sizeof(res));
+		localRet = resolveAddr(&req->addr, &res);
+
+		hash = hash_from_key_fn(&req->addr);
+		shard = getShard(hash);
+		pthread_mutex_lock(&shard->mut);
+		etry = findEntry(shard, &req->addr, hash);
+		if(etry != NULL && etry->bPending) {
+			setResolved(etry, &res, localRet);
+			pthread_cond_broadcast(&shard->condResolved);
+		} else {
+			/* entry was evicted in the meantime, result no longer needed */
+			entryFreeProps(&res);
+		}
+		pthread_mutex_unlock(&shard->mut);
+		free(req);
 	}
-	pthread_rwlock_unlock(&dnsCache.rwlock);
-	pthread_rwlock_rdlock(&dnsCache.rwlock); /* we need this again */
+	return NULL;
+}
+
 
+/* hand a miss over to the resolver pool. Evicted pending entries are
+ * requested again, so the queue is bounded: if it is full, we return
+ * RS_RET_QUEUE_FULL and the caller must use the IP address.
+ */
+static rsRetVal
+requestResolution(struct sockaddr_storage *addr)
+{
+	dnscache_req_t *req;
+	DEFiRet;
+
+	pthread_mutex_lock(&dnsCache.mutReq);
+	if(dnsCache.nReq >= dnsCache.maxReq) {
+		pthread_mutex_unlock(&dnsCache.mutReq);
+		ABORT_FINALIZE(RS_RET_QUEUE_FULL);
+	}
+	if((req = malloc(sizeof(dnscache_req_t))) == NULL) {
+		pthread_mutex_unlock(&dnsCache.mutReq);
+		ABORT_FINALIZE(RS_RET_OUT_OF_MEMORY);
+	}
+	memcpy(&req->addr, addr, sizeof(struct sockaddr_storage));
+	req->next = NULL;
+	if(dnsCache.reqLast == NULL)
+		dnsCache.reqRoot = req;
+	else
+		dnsCache.reqLast->next = req;
+	dnsCache.reqLast = req;
+	++dnsCache.nReq;
+	pthread_cond_signal(&dnsCache.condReq);
+	pthread_mutex_unlock(&dnsCache.mutReq);
 finalize_it:
-	if(iRet != RS_RET_OK && etry != NULL) {
-		/* Note: sub-fields cannot be populated in this case */
-		free(etry);
+	RETiRet;
+}
+
+
+/* Activate the cache with the configured settings. This must be called
+ * after the config has been loaded, but before any lookups happen.
+ * maxEntries == 0 means unlimited, ttl == 0 means entries never expire.
+ * If nResolvers > 0, misses are resolved asynchronously by that many
+ * threads, and lookups wait at most timeout ms for the result before
+ * falling back to the IP address.
+ */
+rsRetVal
+dnscacheActivate(const unsigned maxEntries, const int ttl, const int negativeTTL,
+	const int nResolvers, const int timeout)
+{
+	int i;
+	DEFiRet;
+
+	dnsCache.maxPerShard = (maxEntries + DNSCACHE_NSHARDS - 1) / DNSCACHE_NSHARDS;
+	dnsCache.ttl = ttl;
+	dnsCache.negativeTTL = negativeTTL;
+	dnsCache.timeout = timeout;
+	dnsCache.maxReq = (maxEntries == 0) ? DNSCACHE_MAX_REQ : maxEntries;
+
+	if(stats == NULL) {
+		STATSCOUNTER_INIT(ctrHits, mutCtrHits);
+		STATSCOUNTER_INIT(ctrMisses, mutCtrMisses);
+		STATSCOUNTER_INIT(ctrTimeouts, mutCtrTimeouts);
+		STATSCOUNTER_INIT(ctrExpired, mutCtrExpired);
+		STATSCOUNTER_INIT(ctrEvicted, mutCtrEvicted);
+		CHKiRet(statsobj.Construct(&stats));
+		CHKiRet(statsobj.SetName(stats, UCHAR_CONSTANT("dnscache")));
+		CHKiRet(statsobj.SetOrigin(stats, UCHAR_CONSTANT("core")));
+		CHKiRet(statsobj.AddCounter(stats, UCHAR_CONSTANT("hits"),
+			ctrType_IntCtr, CTR_FLAG_RESETTABLE, &ctrHits));
+		CHKiRet(statsobj.AddCounter(stats, UCHAR_CONSTANT("misses"),
+			ctrType_IntCtr, CTR_FLAG_RESETTABLE, &ctrMisses));
+		CHKiRet(statsobj.AddCounter(stats, UCHAR_CONSTANT("timeouts"),
+			ctrType_IntCtr, CTR_FLAG_RESETTABLE, &ctrTimeouts));
+		CHKiRet(statsobj.AddCounter(stats, UCHAR_CONSTANT("expired"),
+			ctrType_IntCtr, CTR_FLAG_RESETTABLE, &ctrExpired));
+		CHKiRet(statsobj.AddCounter(stats, UCHAR_CONSTANT("evicted"),
+			ctrType_IntCtr, CTR_FLAG_RESETTABLE, &ctrEvicted));
+		CHKiRet(statsobj.ConstructFinalize(stats));
+	}
+
+	if(nResolvers > 0 && dnsCache.nResolvers == 0) {
+		CHKmalloc(dnsCache.resolvers = calloc(nResolvers, sizeof(pthread_t)));
+		for(i = 0 ; i < nResolvers ; ++i) {
+			if(pthread_create(&dnsCache.resolvers[i], NULL, resolverWorker, NULL) != 0) {
+				errmsg.LogError(errno, RS_RET_ERR, "dnscache: could not create "
+					"resolver thread, continuing with %d resolvers", i);
+				break;
+			}
+		}
+		dnsCache.nResolvers = i;
 	}
+	DBGPRINTF("dnscache: activated, max %u entries, ttl %d/%d, %d resolvers, timeout %d ms\n",
+		  maxEntries, ttl, negativeTTL, dnsCache.nResolvers, timeout);
+
+finalize_it:
 	RETiRet;
 }
 
 
-/* validate if an entry is still valid and, if not, re-query it.
- * In the initial implementation, this is a dummy!
- * TODO: implement!
+/* resolve a miss synchronously on the caller's thread. Resolution is done
+ * without holding any lock. If another thread added the same address in
+ * the meantime, its entry is used. Shard must NOT be locked.
  */
-static inline rsRetVal
-validateEntry(dnscache_entry_t __attribute__((unused)) *etry, struct sockaddr_storage __attribute__((unused)) *addr)
+static rsRetVal
+addEntrySync(dnscache_shard_t *shard, struct sockaddr_storage *addr, const unsigned hash)
 {
-	return RS_RET_OK;
+	dnscache_entry_t *etry;
+	rsRetVal localRet;
+	DEFiRet;
+
+	CHKmalloc(etry = calloc(1, sizeof(dnscache_entry_t)));
+	localRet = resolveAddr(addr, etry);
+	memcpy(&etry->addr, addr, SALEN((struct sockaddr*) addr));
+	etry->hash = hash;
+	etry->resolveState = localRet;
+	etry->expires = getExpiry(localRet, etry->fqdn, etry->ip);
+
+	pthread_mutex_lock(&shard->mut);
+	if(findEntry(shard, addr, hash) == NULL) {
+		insertEntry(shard, etry);
+	} else {
+		entryDestruct(etry);
+	}
+	pthread_mutex_unlock(&shard->mut);
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* add a pending entry for a miss and request async resolution. The
+ * entry carries the IP address, which is used as fallback until the
+ * name is known. If the request queue is full, no entry is added and
+ * RS_RET_QUEUE_FULL is returned. Shard must be locked.
+ */
+static rsRetVal
+addEntryAsync(dnscache_shard_t *shard, struct sockaddr_storage *addr, const unsigned hash)
+{
+	dnscache_entry_t *etry = NULL;
+	DEFiRet;
+
+	CHKmalloc(etry = calloc(1, sizeof(dnscache_entry_t)));
+	CHKiRet(getIPProp(addr, &etry->ip));
+	memcpy(&etry->addr, addr, SALEN((struct sockaddr*) addr));
+	etry->hash = hash;
+	etry->resolveState = RS_RET_OK;
+	etry->bPending = 1;
+	CHKiRet(requestResolution(addr));
+	insertEntry(shard, etry);
+	etry = NULL;
+
+finalize_it:
+	if(etry != NULL)
+		entryDestruct(etry);
+	RETiRet;
+}
+
+
+/* hand out the IP address for all names. Used if the name is not (yet)
+ * known. The caller keeps its own reference to ipProp.
+ */
+static void
+useIPForNames(prop_t *const ipProp, prop_t **fqdn, prop_t **fqdnLowerCase,
+	      prop_t **localName, prop_t **ip)
+{
+	prop.AddRef(ipProp);
+	*ip = ipProp;
+	if(fqdn != NULL) {
+		prop.AddRef(ipProp);
+		*fqdn = ipProp;
+	}
+	if(fqdnLowerCase != NULL) {
+		prop.AddRef(ipProp);
+		*fqdnLowerCase = ipProp;
+	}
+	if(localName != NULL) {
+		prop.AddRef(ipProp);
+		*localName = ipProp;
+	}
 }
 
 
@@ -412,39 +804,109 @@ validateEntry(dnscache_entry_t __attribute__((unused)) *etry, struct sockaddr_st
  * and IP address. If the entry is not yet inside the cache, it is added.
  * If the entry can not be resolved, an error is reported back. If fqdn
  * or fqdnLowerCase are NULL, they are not set.
+ * In async mode, an entry which is still pending after the timeout is
+ * reported with its IP address as name. The same happens if the entry
+ * was evicted while we waited or could not be queued for resolution.
  */
 rsRetVal
 dnscacheLookup(struct sockaddr_storage *addr, prop_t **fqdn, prop_t **fqdnLowerCase,
 	       prop_t **localName, prop_t **ip)
 {
 	dnscache_entry_t *etry;
+	dnscache_shard_t *shard;
+	struct timespec tTimeout;
+	int bTimeoutSet = 0;
+	int bMissCounted = 0;
+	int bUseAddr = 0;	/* no entry available, use IP address from addr */
+	prop_t *ipProp;
+	rsRetVal localRet;
+	unsigned hash;
 	DEFiRet;
 
-	pthread_rwlock_rdlock(&dnsCache.rwlock); /* TODO: optimize this! */
-	etry = findEntry(addr);
-	dbgprintf("dnscache: entry %p found\n", etry);
-	if(etry == NULL) {
-		CHKiRet(addEntry(addr, &etry));
-	} else {
-		CHKiRet(validateEntry(etry, addr));
-	}
-	prop.AddRef(etry->ip);
-	*ip = etry->ip;
-	if(fqdn != NULL) {
-		prop.AddRef(etry->fqdn);
-		*fqdn = etry->fqdn;
+	hash = hash_from_key_fn(addr);
+	shard = getShard(hash);
+	pthread_mutex_lock(&shard->mut);
+	while(1) {
+		etry = findEntry(shard, addr, hash);
+		if(etry != NULL && etry->expires != 0 && !etry->bPending
+		   && etry->expires <= time(NULL)) {
+			removeEntry(shard, etry);
+			STATSCOUNTER_INC(ctrExpired, mutCtrExpired);
+			etry = NULL;
+		}
+		if(etry == NULL) {
+			if(!bMissCounted) {
+				STATSCOUNTER_INC(ctrMisses, mutCtrMisses);
+				bMissCounted = 1;
+			}
+			if(dnsCache.nResolvers == 0) {
+				pthread_mutex_unlock(&shard->mut);
+				CHKiRet(addEntrySync(shard, addr, hash));
+				pthread_mutex_lock(&shard->mut);
+				continue; /* entry may already be evicted again, so re-check */
+			}
+			localRet = addEntryAsync(shard, addr, hash);
+			if(localRet == RS_RET_QUEUE_FULL) {
+				bUseAddr = 1;
+				break;
+			} else if(localRet != RS_RET_OK) {
+				pthread_mutex_unlock(&shard->mut);
+				ABORT_FINALIZE(RS_RET_OUT_OF_MEMORY);
+			}
+			continue;
+		}
+		if(!etry->bPending)
+			break;
+		/* we need to wait for the resolver pool */
+		if(dnsCache.timeout == 0)
+			break;
+		if(!bTimeoutSet) {
+			timeoutComp(&tTimeout, dnsCache.timeout);
+			bTimeoutSet = 1;
+		}
+		if(pthread_cond_timedwait(&shard->condResolved, &shard->mut, &tTimeout) == ETIMEDOUT) {
+			etry = findEntry(shard, addr, hash);
+			if(etry == NULL || etry->bPending)
+				STATSCOUNTER_INC(ctrTimeouts, mutCtrTimeouts);
+			if(etry == NULL)
+				bUseAddr = 1; /* evicted while we waited */
+			break;
+		}
 	}
-	if(fqdnLowerCase != NULL) {
-		prop.AddRef(etry->fqdnLowerCase);
-		*fqdnLowerCase = etry->fqdnLowerCase;
+	if(!bMissCounted)
+		STATSCOUNTER_INC(ctrHits, mutCtrHits);
+
+	if(bUseAddr) {
+		pthread_mutex_unlock(&shard->mut);
+		CHKiRet(getIPProp(addr, &ipProp));
+		useIPForNames(ipProp, fqdn, fqdnLowerCase, localName, ip);
+		prop.Destruct(&ipProp);
+		FINALIZE;
 	}
-	if(localName != NULL) {
-		prop.AddRef(etry->localName);
-		*localName = etry->localName;
+
+	iRet = etry->resolveState;
+	if(etry->bPending) {
+		/* not yet resolved: use IP address for all names */
+		useIPForNames(etry->ip, fqdn, fqdnLowerCase, localName, ip);
+	} else if(iRet == RS_RET_OK) {
+		prop.AddRef(etry->ip);
+		*ip = etry->ip;
+		if(fqdn != NULL) {
+			prop.AddRef(etry->fqdn);
+			*fqdn = etry->fqdn;
+		}
+		if(fqdnLowerCase != NULL) {
+			prop.AddRef(etry->fqdnLowerCase);
+			*fqdnLowerCase = etry->fqdnLowerCase;
+		}
+		if(localName != NULL) {
+			prop.AddRef(etry->localName);
+			*localName = etry->localName;
+		}
 	}
+	pthread_mutex_unlock(&shard->mut);
 
 finalize_it:
-	pthread_rwlock_unlock(&dnsCache.rwlock);
 	if(iRet != RS_RET_OK && iRet != RS_RET_ADDRESS_UNKNOWN) {
 		DBGPRINTF("dnscacheLookup failed with iRet %d\n", iRet);
 		prop.AddRef(staticErrValue);
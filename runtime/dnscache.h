@@ -24,6 +24,7 @@
 
 rsRetVal dnscacheInit(void);
 rsRetVal dnscacheDeinit(void);
+rsRetVal dnscacheActivate(unsigned maxEntries, int ttl, int negativeTTL, int nResolvers, int timeout);
 rsRetVal dnscacheLookup(struct sockaddr_storage *addr, prop_t **fqdn, prop_t **fqdnLowerCase, prop_t **localName, prop_t **ip);
 
 #endif /* #ifndef INCLUDED_DNSCACHE_H */
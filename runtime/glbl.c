@@ -86,6 +86,7 @@ static int bParseHOSTNAMEandTAG = 1;	/* parser modification (based on startup pa
 static int bPreserveFQDN = 0;		/* should FQDNs always be preserved? */
 static int iMaxLine = 8096;		/* maximum length of a syslog message */
 static int iGnuTLSLoglevel = 0;
+static int bGnuTLSkTLS = 0;		/* hand established gtls sessions over to kernel TLS? */
 static int iDefPFFamily = PF_UNSPEC;     /* protocol family (IPv4, IPv6 or both) */
 static int bDropMalPTRMsgs = 0;/* Drop messages which have malicious PTR records during DNS lookup */
 static int option_DisallowWarning = 1;	/* complain if message from disallowed sender is received */
@@ -117,6 +118,15 @@ int glblReportGoneAwaySenders = 0;
 int glblSenderStatsTimeout = 12 * 60 * 60; /* 12 hr timeout for senders */
 int glblSenderKeepTrack = 0;  /* keep track of known senders? */
 int glblUnloadModules = 1;
+unsigned glblPipelineTraceSampleRate = 0; /* 0 - pipeline tracing disabled */
+uchar *glblPipelineTraceFile = NULL; /* file to write pipeline trace records to */
+int glblDnscacheMaxEntries = 100000; /* 0 - unlimited */
+int glblDnscacheTTL = 0; /* seconds a resolved name is cached, 0 - forever */
+int glblDnscacheNegativeTTL = 5 * 60; /* seconds a failed lookup is cached, 0 - forever */
+int glblDnscacheResolvers = 0; /* 0 - resolve on the caller thread */
+int glblDnscacheTimeout = 1000; /* ms to wait for async resolution before using IP */
+int glblParserAdaptive = 0; /* try last successful parser per input/sender first? */
+int glblParserAdaptiveRevalidate = 1000; /* re-check memo every n hits, 0 - never */
 
 pid_t glbl_ourpid;
 #ifndef HAVE_ATOMIC_BUILTINS
@@ -139,6 +149,7 @@ static struct cnfparamdescr cnfparamdescr[] = {
 	{ "debug.onshutdown", eCmdHdlrBinary, 0 },
 	{ "debug.logfile", eCmdHdlrString, 0 },
 	{ "debug.gnutls", eCmdHdlrPositiveInt, 0 },
+	{ "gnutls.ktls", eCmdHdlrBinary, 0 },
 	{ "debug.unloadmodules", eCmdHdlrBinary, 0 },
 	{ "defaultnetstreamdrivercafile", eCmdHdlrString, 0 },
 	{ "defaultnetstreamdriverkeyfile", eCmdHdlrString, 0 },
@@ -167,7 +178,16 @@ static struct cnfparamdescr cnfparamdescr[] = {
 	{ "net.aclresolvehostname", eCmdHdlrBinary, 0 },
 	{ "net.enabledns", eCmdHdlrBinary, 0 },
 	{ "net.permitACLwarning", eCmdHdlrBinary, 0 },
-	{ "processinternalmessages", eCmdHdlrBinary, 0 }
+	{ "processinternalmessages", eCmdHdlrBinary, 0 },
+	{ "pipelinetrace.samplerate", eCmdHdlrNonNegInt, 0 },
+	{ "pipelinetrace.file", eCmdHdlrString, 0 },
+	{ "dnscache.maxentries", eCmdHdlrNonNegInt, 0 },
+	{ "dnscache.ttl", eCmdHdlrNonNegInt, 0 },
+	{ "dnscache.negativettl", eCmdHdlrNonNegInt, 0 },
+	{ "dnscache.resolvers", eCmdHdlrNonNegInt, 0 },
+	{ "dnscache.timeout", eCmdHdlrNonNegInt, 0 },
+	{ "parser.adaptive", eCmdHdlrBinary, 0 },
+	{ "parser.adaptive.revalidate", eCmdHdlrNonNegInt, 0 }
 };
 static struct cnfparamblk paramblk =
 	{ CNFPARAMBLK_VERSION,
@@ -203,6 +223,12 @@ GetGnuTLSLoglevel(void)
 	return(iGnuTLSLoglevel);
 }
 
+int
+GetGnuTLSkTLS(void)
+{
+	return(bGnuTLSkTLS);
+}
+
 /* define a macro for the simple properties' set and get functions
  * (which are always the same). This is only suitable for pretty
  * simple cases which require neither checks nor memory allocation.
@@ -1089,6 +1115,8 @@ glblDoneLoadCnf(void)
 			errmsg.LogError(0, RS_RET_OK, "debug: onShutdown set to %d", glblDebugOnShutdown);
 		} else if(!strcmp(paramblk.descr[i].name, "debug.gnutls")) {
 			iGnuTLSLoglevel = (int) cnfparamvals[i].val.d.n;
+		} else if(!strcmp(paramblk.descr[i].name, "gnutls.ktls")) {
+			bGnuTLSkTLS = (int) cnfparamvals[i].val.d.n;
 		} else if(!strcmp(paramblk.descr[i].name, "debug.unloadmodules")) {
 			glblUnloadModules = (int) cnfparamvals[i].val.d.n;
 		} else if(!strcmp(paramblk.descr[i].name, "parser.controlcharacterescapeprefix")) {
@@ -1148,6 +1176,26 @@ glblDoneLoadCnf(void)
 		        setDisableDNS(!((int) cnfparamvals[i].val.d.n));
 		} else if(!strcmp(paramblk.descr[i].name, "net.permitwarning")) {
 		        setOption_DisallowWarning(!((int) cnfparamvals[i].val.d.n));
+		} else if(!strcmp(paramblk.descr[i].name, "pipelinetrace.samplerate")) {
+		        glblPipelineTraceSampleRate = (unsigned) cnfparamvals[i].val.d.n;
+		} else if(!strcmp(paramblk.descr[i].name, "pipelinetrace.file")) {
+			free(glblPipelineTraceFile);
+			glblPipelineTraceFile = (uchar*)
+				es_str2cstr(cnfparamvals[i].val.d.estr, NULL);
+		} else if(!strcmp(paramblk.descr[i].name, "dnscache.maxentries")) {
+		        glblDnscacheMaxEntries = (int) cnfparamvals[i].val.d.n;
+		} else if(!strcmp(paramblk.descr[i].name, "dnscache.ttl")) {
+		        glblDnscacheTTL = (int) cnfparamvals[i].val.d.n;
+		} else if(!strcmp(paramblk.descr[i].name, "dnscache.negativettl")) {
+		        glblDnscacheNegativeTTL = (int) cnfparamvals[i].val.d.n;
+		} else if(!strcmp(paramblk.descr[i].name, "dnscache.resolvers")) {
+		        glblDnscacheResolvers = (int) cnfparamvals[i].val.d.n;
+		} else if(!strcmp(paramblk.descr[i].name, "dnscache.timeout")) {
+		        glblDnscacheTimeout = (int) cnfparamvals[i].val.d.n;
+		} else if(!strcmp(paramblk.descr[i].name, "parser.adaptive")) {
+		        glblParserAdaptive = (int) cnfparamvals[i].val.d.n;
+		} else if(!strcmp(paramblk.descr[i].name, "parser.adaptive.revalidate")) {
+		        glblParserAdaptiveRevalidate = (int) cnfparamvals[i].val.d.n;
 		} else {
 			dbgprintf("glblDoneLoadCnf: program error, non-handled "
 			  "param '%s'\n", paramblk.descr[i].name);
@@ -1214,6 +1262,7 @@ BEGINObjClassExit(glbl, OBJ_IS_CORE_MODULE) /* class, version */
 	free(LocalHostName);
 	free(LocalHostNameOverride);
 	free(LocalFQDNName);
+	free(glblPipelineTraceFile);
 	freeTimezoneInfo();
 	objRelease(prop, CORE_COMPONENT);
 	if(propLocalHostNameToDelete != NULL)
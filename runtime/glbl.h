@@ -114,6 +114,15 @@ extern int glblReportGoneAwaySenders;
 extern int glblSenderStatsTimeout;
 extern int glblSenderKeepTrack;
 extern int glblUnloadModules;
+extern unsigned glblPipelineTraceSampleRate;
+extern uchar *glblPipelineTraceFile;
+extern int glblDnscacheMaxEntries;
+extern int glblDnscacheTTL;
+extern int glblDnscacheNegativeTTL;
+extern int glblDnscacheResolvers;
+extern int glblDnscacheTimeout;
+extern int glblParserAdaptive;
+extern int glblParserAdaptiveRevalidate;
 extern short janitorInterval;
 
 static inline pid_t glblGetOurPid(void) { return glbl_ourpid; }
@@ -128,5 +137,6 @@ void glblDoneLoadCnf(void);
 const uchar * glblGetWorkDirRaw(void);
 tzinfo_t* glblFindTimezoneInfo(char *id);
 int GetGnuTLSLoglevel(void);
+int GetGnuTLSkTLS(void);
 
 #endif /* #ifndef GLBL_H_INCLUDED */
@@ -0,0 +1,564 @@
+/* libshmring.c - shared memory ring buffer for local message exchange
+ *
+ * Writers reserve space by advancing the head via compare-and-swap, copy
+ * the record and then set its state word, which "commits" it. The reader
+ * processes committed records in order, stopping at the first one which
+ * is not yet committed. Consumed space is zeroed by the reader before it
+ * hands it back to the writers (by advancing the tail). So the state word
+ * of a record which is not yet committed is always zero, no matter where
+ * the record boundaries were in the previous round through the ring.
+ *
+ * Wakeups: a reader which finds the ring empty announces that it is going
+ * to sleep and then waits on a futex; writers only issue a system call if
+ * they see that announcement. Memory barriers on both sides make sure that
+ * either the reader sees the new record or the writer sees the reader
+ * waiting. The same scheme is used for writers waiting for free space
+ * (if they want to block instead of dropping records).
+ *
+ * This file is part of rsyslog.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "libshmring.h"
+
+#define MIN_RING_SIZE 4096
+#define MAX_RING_SIZE (1u << 30)	/* pad records must fit into the length bits */
+
+
+static int
+futexWait(uint32_t *const addr, const uint32_t val, const int timeoutMs)
+{
+	struct timespec ts;
+	struct timespec *pts = NULL;
+
+	if(timeoutMs >= 0) {
+		ts.tv_sec = timeoutMs / 1000;
+		ts.tv_nsec = (timeoutMs % 1000) * 1000000;
+		pts = &ts;
+	}
+	return syscall(SYS_futex, addr, FUTEX_WAIT, val, pts, NULL, 0);
+}
+
+
+static void
+futexWake(uint32_t *const addr, const int n)
+{
+	syscall(SYS_futex, addr, FUTEX_WAKE, n, NULL, NULL, 0);
+}
+
+
+/* map the ring file and check that it contains a valid ring of the
+ * expected size (if size is 0, any valid size is accepted).
+ */
+static int
+mapRing(shmring_t *const pRing, const uint64_t size)
+{
+	struct stat st;
+	struct shmringHdr_s *hdr;
+	uint64_t ringSize;
+
+	if(fstat(pRing->fd, &st) != 0)
+		return SHMRING_ERR_IO;
+	if((size_t) st.st_size < sizeof(struct shmringHdr_s))
+		return SHMRING_ERR_INVALID;
+	pRing->lenMap = st.st_size;
+	hdr = mmap(NULL, pRing->lenMap, PROT_READ | PROT_WRITE, MAP_SHARED, pRing->fd, 0);
+	if(hdr == MAP_FAILED)
+		return SHMRING_ERR_IO;
+	pRing->hdr = hdr;
+	ringSize = hdr->size;
+	if(   __atomic_load_n(&hdr->magic, __ATOMIC_ACQUIRE) != SHMRING_MAGIC
+	   || hdr->version != SHMRING_VERSION
+	   || ringSize < MIN_RING_SIZE || ringSize > MAX_RING_SIZE
+	   || (ringSize & (ringSize - 1)) != 0
+	   || ringSize + sizeof(struct shmringHdr_s) != pRing->lenMap
+	   || (size != 0 && ringSize != size)) {
+		return SHMRING_ERR_INVALID;
+	}
+	pRing->size = ringSize;
+	pRing->data = (uint8_t*) hdr + sizeof(struct shmringHdr_s);
+	return SHMRING_OK;
+}
+
+
+static void
+unmapRing(shmring_t *const pRing)
+{
+	if(pRing->hdr != NULL) {
+		munmap(pRing->hdr, pRing->lenMap);
+		pRing->hdr = NULL;
+	}
+}
+
+
+/* create a ring (done by the reader). If a valid ring of the same size
+ * already exists, it is re-used, so that records written while the
+ * reader was not running are not lost and writers can stay attached.
+ * Otherwise, a new ring file is created; writers attached to a previous
+ * one need to re-open the ring. The size is rounded up to a power of two.
+ */
+int
+shmringCreate(shmring_t **const ppRing, const char *const path, uint64_t size, const mode_t mode)
+{
+	shmring_t *pRing;
+	struct shmringHdr_s *hdr;
+	uint64_t s;
+	int r;
+
+	if(size > MAX_RING_SIZE)
+		return SHMRING_ERR_TOOBIG;
+	for(s = MIN_RING_SIZE ; s < size ; s <<= 1)
+		/* just count */;
+	size = s;
+
+	if((pRing = calloc(1, sizeof(shmring_t))) == NULL)
+		return SHMRING_ERR_OOM;
+	pRing->fd = open(path, O_RDWR | O_CLOEXEC);
+	if(pRing->fd != -1) {
+		if(mapRing(pRing, size) == SHMRING_OK)
+			goto done;
+		unmapRing(pRing);
+		close(pRing->fd);
+		unlink(path);
+	}
+
+	/* create new ring; the file is zero-filled by ftruncate() */
+	pRing->fd = open(path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, mode);
+	if(pRing->fd == -1) {
+		r = SHMRING_ERR_IO;
+		goto fail;
+	}
+	if(fchmod(pRing->fd, mode) != 0 /* umask shall not apply */
+	   || ftruncate(pRing->fd, sizeof(struct shmringHdr_s) + size) != 0) {
+		r = SHMRING_ERR_IO;
+		goto fail;
+	}
+	pRing->lenMap = sizeof(struct shmringHdr_s) + size;
+	hdr = mmap(NULL, pRing->lenMap, PROT_READ | PROT_WRITE, MAP_SHARED, pRing->fd, 0);
+	if(hdr == MAP_FAILED) {
+		r = SHMRING_ERR_IO;
+		goto fail;
+	}
+	pRing->hdr = hdr;
+	hdr->version = SHMRING_VERSION;
+	hdr->size = size;
+	__atomic_store_n(&hdr->magic, SHMRING_MAGIC, __ATOMIC_RELEASE);
+	pRing->size = size;
+	pRing->data = (uint8_t*) hdr + sizeof(struct shmringHdr_s);
+
+done:
+	pRing->rdpos = pRing->relpos = __atomic_load_n(&pRing->hdr->tail, __ATOMIC_ACQUIRE);
+	*ppRing = pRing;
+	return SHMRING_OK;
+
+fail:
+	unmapRing(pRing);
+	if(pRing->fd != -1)
+		close(pRing->fd);
+	free(pRing);
+	return r;
+}
+
+
+/* attach to an existing ring. This may be a writer or the reader, if
+ * the ring was created by the writer side.
+ */
+int
+shmringOpen(shmring_t **const ppRing, const char *const path)
+{
+	shmring_t *pRing;
+	int r;
+
+	if((pRing = calloc(1, sizeof(shmring_t))) == NULL)
+		return SHMRING_ERR_OOM;
+	pRing->fd = open(path, O_RDWR | O_CLOEXEC);
+	if(pRing->fd == -1) {
+		free(pRing);
+		return SHMRING_ERR_IO;
+	}
+	if((r = mapRing(pRing, 0)) != SHMRING_OK) {
+		unmapRing(pRing);
+		close(pRing->fd);
+		free(pRing);
+		return r;
+	}
+	pRing->rdpos = pRing->relpos = __atomic_load_n(&pRing->hdr->tail, __ATOMIC_ACQUIRE);
+	*ppRing = pRing;
+	return SHMRING_OK;
+}
+
+
+void
+shmringClose(shmring_t *const pRing)
+{
+	if(pRing == NULL)
+		return;
+	unmapRing(pRing);
+	close(pRing->fd);
+	free(pRing);
+}
+
+
+/* max payload size. Limiting records to a quarter of the ring makes
+ * sure a record plus the padding that may precede it always fits.
+ */
+size_t
+shmringMaxRecLen(shmring_t *const pRing)
+{
+	return pRing->size / 4;
+}
+
+
+/* reserve space for a record of the given (padded) size. Returns the
+ * start position of the record and, via pPad, the number of padding bytes
+ * that need to be written in front of it (at the end of the data area).
+ */
+static int
+reserve(shmring_t *const pRing, const uint64_t need, uint64_t *const pPos, uint64_t *const pPad)
+{
+	struct shmringHdr_s *const hdr = pRing->hdr;
+	uint64_t head;
+	uint64_t tail;
+	uint64_t offs;
+	uint64_t pad;
+
+	do {
+		/* load tail first, so head is never older than tail */
+		tail = __atomic_load_n(&hdr->tail, __ATOMIC_ACQUIRE);
+		head = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+		offs = head & (pRing->size - 1);
+		pad = (offs + need > pRing->size) ? pRing->size - offs : 0;
+		if(head + pad + need - tail > pRing->size)
+			return SHMRING_ERR_FULL;
+	} while(!__atomic_compare_exchange_n(&hdr->head, &head, head + pad + need, 0,
+					     __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+	*pPos = head;
+	*pPad = pad;
+	return SHMRING_OK;
+}
+
+
+/* copy a record into reserved space and commit it. pos is the
+ * start of the reservation, including padding. Returns the position
+ * of the next record.
+ */
+static uint64_t
+commitRec(shmring_t *const pRing, uint64_t pos, const uint64_t pad, const void *const data, const size_t len)
+{
+	struct shmringRec_s *rec;
+
+	if(pad != 0) {
+		rec = (struct shmringRec_s*) (pRing->data + (pos & (pRing->size - 1)));
+		__atomic_store_n(&rec->state, SHMRING_REC_COMMIT | SHMRING_REC_PAD | (uint32_t) pad,
+				 __ATOMIC_RELEASE);
+		pos += pad;
+	}
+	rec = (struct shmringRec_s*) (pRing->data + (pos & (pRing->size - 1)));
+	memcpy(rec + 1, data, len);
+	__atomic_store_n(&rec->state, SHMRING_REC_COMMIT | (uint32_t) len, __ATOMIC_RELEASE);
+	return pos + SHMRING_REC_SIZE(len);
+}
+
+
+/* wake the reader, if it waits for data */
+static void
+notifyReader(shmring_t *const pRing)
+{
+	struct shmringHdr_s *const hdr = pRing->hdr;
+
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if(__atomic_load_n(&hdr->readerWaiting, __ATOMIC_RELAXED)) {
+		__atomic_fetch_add(&hdr->dataSeq, 1, __ATOMIC_RELAXED);
+		futexWake(&hdr->dataSeq, 1);
+	}
+}
+
+
+/* write a single record. If the ring is full, SHMRING_ERR_FULL is
+ * returned and nothing is written. Drops are NOT counted, as the caller
+ * may decide to wait and retry; a caller which gives up on the record
+ * must report it via shmringAddDrops().
+ */
+int
+shmringWrite(shmring_t *const pRing, const void *const data, const size_t len)
+{
+	uint64_t pos;
+	uint64_t pad;
+
+	if(len > shmringMaxRecLen(pRing))
+		return SHMRING_ERR_TOOBIG;
+	if(reserve(pRing, SHMRING_REC_SIZE(len), &pos, &pad) != SHMRING_OK)
+		return SHMRING_ERR_FULL;
+	commitRec(pRing, pos, pad, data, len);
+	notifyReader(pRing);
+	return SHMRING_OK;
+}
+
+
+/* write as many of the given records as currently fit into the ring,
+ * with a single reservation and a single reader notification. Records
+ * are written in order, so what is written is always a prefix of recs.
+ * Returns the number of records written or SHMRING_ERR_TOOBIG if one of
+ * the records can never fit (in which case nothing is written). Drops are
+ * NOT counted, as the caller may decide to wait and retry.
+ */
+int
+shmringWriteBatch(shmring_t *const pRing, const struct shmringBuf_s *const recs, const unsigned nRecs)
+{
+	struct shmringHdr_s *const hdr = pRing->hdr;
+	const uint64_t mask = pRing->size - 1;
+	uint64_t head;
+	uint64_t tail;
+	uint64_t end;
+	uint64_t need;
+	uint64_t pad;
+	unsigned n;
+	unsigned i;
+
+	for(i = 0 ; i < nRecs ; ++i) {
+		if(recs[i].len > shmringMaxRecLen(pRing))
+			return SHMRING_ERR_TOOBIG;
+	}
+	do {
+		tail = __atomic_load_n(&hdr->tail, __ATOMIC_ACQUIRE);
+		head = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+		end = head;
+		for(n = 0 ; n < nRecs ; ++n) {
+			need = SHMRING_REC_SIZE(recs[n].len);
+			if((end & mask) + need > pRing->size)
+				need += pRing->size - (end & mask);
+			if(end + need - tail > pRing->size)
+				break;
+			end += need;
+		}
+		if(n == 0)
+			return 0;
+	} while(!__atomic_compare_exchange_n(&hdr->head, &head, end, 0,
+					     __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+	for(i = 0 ; i < n ; ++i) {
+		need = SHMRING_REC_SIZE(recs[i].len);
+		pad = ((head & mask) + need > pRing->size) ? pRing->size - (head & mask) : 0;
+		head = commitRec(pRing, head, pad, recs[i].data, recs[i].len);
+	}
+	notifyReader(pRing);
+	return n;
+}
+
+
+static int
+hasSpace(shmring_t *const pRing, const uint64_t need)
+{
+	const uint64_t tail = __atomic_load_n(&pRing->hdr->tail, __ATOMIC_ACQUIRE);
+	const uint64_t head = __atomic_load_n(&pRing->hdr->head, __ATOMIC_ACQUIRE);
+	const uint64_t offs = head & (pRing->size - 1);
+	const uint64_t pad = (offs + need > pRing->size) ? pRing->size - offs : 0;
+	return head + pad + need - tail <= pRing->size;
+}
+
+
+/* wait until there is space for a record of the given length, the
+ * timeout expires or we are interrupted by a signal. Use a negative
+ * timeout to wait forever. Returns 1 if space is available, 0 otherwise.
+ * Note that another writer may take the space before we can use it.
+ */
+int
+shmringWaitSpace(shmring_t *const pRing, const size_t len, const int timeoutMs)
+{
+	struct shmringHdr_s *const hdr = pRing->hdr;
+	const uint64_t need = SHMRING_REC_SIZE(len);
+	uint32_t seq;
+
+	seq = __atomic_load_n(&hdr->spaceSeq, __ATOMIC_ACQUIRE);
+	__atomic_fetch_add(&hdr->writerWaiting, 1, __ATOMIC_SEQ_CST);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if(!hasSpace(pRing, need))
+		futexWait(&hdr->spaceSeq, seq, timeoutMs);
+	__atomic_fetch_sub(&hdr->writerWaiting, 1, __ATOMIC_RELAXED);
+	return hasSpace(pRing, need);
+}
+
+
+/* account for records the caller decided to drop */
+void
+shmringAddDrops(shmring_t *const pRing, const uint64_t nDrops)
+{
+	__atomic_fetch_add(&pRing->hdr->drops, nDrops, __ATOMIC_RELAXED);
+}
+
+
+uint64_t
+shmringGetDrops(shmring_t *const pRing)
+{
+	return __atomic_load_n(&pRing->hdr->drops, __ATOMIC_RELAXED);
+}
+
+
+/* check that a record of the given size at rdpos lies within space
+ * reserved by writers. We only look at the (contended) head if the cached
+ * value is not sufficient.
+ */
+static int
+withinHead(shmring_t *const pRing, const uint64_t need)
+{
+	if(pRing->rdpos + need <= pRing->headCache)
+		return 1;
+	pRing->headCache = __atomic_load_n(&pRing->hdr->head, __ATOMIC_ACQUIRE);
+	return pRing->rdpos + need <= pRing->headCache;
+}
+
+
+/* get the next committed record, if there is any. Returns 1 if a record
+ * is available, 0 if not and SHMRING_ERR_CORRUPT if the ring contains
+ * an invalid record. The data stays valid until shmringRelease() is
+ * called. Note that we must never trust the shared memory content, as
+ * writers may be buggy.
+ */
+int
+shmringPeek(shmring_t *const pRing, const void **const pData, size_t *const pLen)
+{
+	struct shmringRec_s *rec;
+	uint64_t offs;
+	uint32_t state;
+	size_t len;
+
+	while(1) {
+		/* if we have processed a full ring without releasing it,
+		 * the next record is one of our own unreleased ones
+		 */
+		if(pRing->rdpos - pRing->relpos >= pRing->size)
+			return 0;
+		offs = pRing->rdpos & (pRing->size - 1);
+		rec = (struct shmringRec_s*) (pRing->data + offs);
+		state = __atomic_load_n(&rec->state, __ATOMIC_ACQUIRE);
+		if((state & SHMRING_REC_COMMIT) == 0)
+			return 0;
+		len = state & SHMRING_REC_LENMASK;
+		if(state & SHMRING_REC_PAD) {
+			if(offs + len != pRing->size || !withinHead(pRing, len))
+				return SHMRING_ERR_CORRUPT;
+			pRing->rdpos += len;
+			continue;
+		}
+		if(   len > shmringMaxRecLen(pRing) || offs + SHMRING_REC_SIZE(len) > pRing->size
+		   || !withinHead(pRing, SHMRING_REC_SIZE(len)))
+			return SHMRING_ERR_CORRUPT;
+		/* remember what we checked, the writer may still modify the record */
+		pRing->lenCurr = SHMRING_REC_SIZE(len);
+		*pData = rec + 1;
+		*pLen = len;
+		return 1;
+	}
+}
+
+
+/* move on to the next record. Must only be called after shmringPeek()
+ * returned a record. We advance by the length shmringPeek() has checked,
+ * NOT by what is in shared memory now.
+ */
+void
+shmringAdvance(shmring_t *const pRing)
+{
+	pRing->rdpos += pRing->lenCurr;
+	pRing->lenCurr = 0;
+}
+
+
+/* hand the space of all records processed so far back to the writers.
+ * It is zeroed first, see file header for why. Doing this once per batch
+ * saves cache line transfers of the tail.
+ */
+void
+shmringRelease(shmring_t *const pRing)
+{
+	struct shmringHdr_s *const hdr = pRing->hdr;
+	uint64_t offs;
+	uint64_t n;
+
+	if(pRing->relpos == pRing->rdpos)
+		return;
+	while(pRing->relpos < pRing->rdpos) {
+		offs = pRing->relpos & (pRing->size - 1);
+		n = pRing->rdpos - pRing->relpos;
+		if(n > pRing->size - offs)
+			n = pRing->size - offs;
+		memset(pRing->data + offs, 0, n);
+		pRing->relpos += n;
+	}
+	__atomic_store_n(&hdr->tail, pRing->relpos, __ATOMIC_RELEASE);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if(__atomic_load_n(&hdr->writerWaiting, __ATOMIC_RELAXED)) {
+		__atomic_fetch_add(&hdr->spaceSeq, 1, __ATOMIC_RELAXED);
+		futexWake(&hdr->spaceSeq, INT_MAX);
+	}
+}
+
+
+/* skip everything currently in the ring. This is used to recover from
+ * a corrupt ring. Records still being written are lost as well.
+ */
+void
+shmringResync(shmring_t *const pRing)
+{
+	pRing->rdpos = __atomic_load_n(&pRing->hdr->head, __ATOMIC_ACQUIRE);
+	shmringRelease(pRing);
+}
+
+
+static int
+hasData(shmring_t *const pRing)
+{
+	const struct shmringRec_s *const rec =
+		(struct shmringRec_s*) (pRing->data + (pRing->rdpos & (pRing->size - 1)));
+	if(pRing->rdpos - pRing->relpos >= pRing->size)
+		return 1; /* caller must release first */
+	return (__atomic_load_n(&rec->state, __ATOMIC_ACQUIRE) & SHMRING_REC_COMMIT) != 0;
+}
+
+
+/* wait until data is available, the timeout expires or we are interrupted
+ * by a signal. Use a negative timeout to wait forever. Returns 1 if data
+ * is available, 0 otherwise.
+ */
+int
+shmringWait(shmring_t *const pRing, const int timeoutMs)
+{
+	struct shmringHdr_s *const hdr = pRing->hdr;
+	uint32_t seq;
+
+	seq = __atomic_load_n(&hdr->dataSeq, __ATOMIC_ACQUIRE);
+	__atomic_store_n(&hdr->readerWaiting, 1, __ATOMIC_SEQ_CST);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if(!hasData(pRing))
+		futexWait(&hdr->dataSeq, seq, timeoutMs);
+	__atomic_store_n(&hdr->readerWaiting, 0, __ATOMIC_RELAXED);
+	return hasData(pRing);
+}
@@ -0,0 +1,140 @@
+/* libshmring.h - shared memory ring buffer for local message exchange
+ *
+ * The ring lives in a file which is mmap()ed by both the producer(s)
+ * and the consumer. Usually, that file is placed on tmpfs (/dev/shm).
+ * Records are variable-sized and are written without any system call;
+ * a futex is only used to wake up a sleeping reader (or, if the writer
+ * wants to block when the ring is full, a sleeping writer). Multiple
+ * writers may share a ring, they reserve space via compare-and-swap.
+ * Note that a writer which dies between reservation and commit stalls
+ * the ring, so a ring per producer is recommended.
+ *
+ * One side creates the ring (shmringCreate), the other one attaches to
+ * it (shmringOpen). With imshmring, rsyslog is the reader and creates
+ * the ring; with omshmring, rsyslog is the writer and creates it. There
+ * must only be a single reader per ring. A reader processes records like
+ * this:
+ *    while(shmringPeek(ring, &data, &len) == 1) {
+ *        ...process data...
+ *        shmringAdvance(ring);
+ *    }
+ *    shmringRelease(ring);
+ *    if nothing was processed, shmringWait(ring, timeout);
+ *
+ * This library does not depend on the rsyslog runtime. Producers (or
+ * readers of rsyslog output) can simply build it into their application.
+ * If the ring is full, writers either wait for space (shmringWaitSpace)
+ * or drop the record. Dropped records must be reported via
+ * shmringAddDrops(), so that the reader can tell how many were lost.
+ *
+ * Linux only, as we need futexes.
+ *
+ * This file is part of rsyslog.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef INCLUDED_LIBSHMRING_H
+#define INCLUDED_LIBSHMRING_H
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#define SHMRING_MAGIC 0x52534d52	/* "RSMR" */
+#define SHMRING_VERSION 1
+
+/* return codes */
+#define SHMRING_OK 0
+#define SHMRING_ERR_FULL -1	/* ring is full, record was not written */
+#define SHMRING_ERR_TOOBIG -2	/* record larger than permitted for this ring */
+#define SHMRING_ERR_IO -3	/* system error, see errno */
+#define SHMRING_ERR_INVALID -4	/* ring file does not contain a valid ring */
+#define SHMRING_ERR_CORRUPT -5	/* invalid record found (reader side) */
+#define SHMRING_ERR_OOM -6
+
+/* The shared header. Producer and consumer state are kept in separate
+ * cache lines, so that they do not bounce between CPUs. The data area
+ * directly follows the header. All positions are byte offsets which
+ * grow forever; the offset into the data area is (pos & (size-1)).
+ */
+struct shmringHdr_s {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t size;			/* size of data area, power of two */
+	uint8_t pad0[48];
+	/* writer side */
+	uint64_t head;			/* end of reserved space */
+	uint64_t drops;			/* records dropped by writers, see shmringAddDrops() */
+	uint32_t spaceSeq;		/* futex: bumped when space is freed and a writer waits */
+	uint32_t writerWaiting;		/* number of writers waiting for space */
+	uint8_t pad1[40];
+	/* reader side */
+	uint64_t tail;			/* end of space released by reader */
+	uint32_t dataSeq;		/* futex: bumped when data arrives and the reader waits */
+	uint32_t readerWaiting;		/* reader sleeps, writers must wake it */
+	uint8_t pad2[48];
+};
+
+/* Each record starts with this header, records are 8-byte aligned. A
+ * record never wraps, if it does not fit into the rest of the data
+ * area, a padding record is written and the record starts at offset 0.
+ */
+struct shmringRec_s {
+	uint32_t state;			/* 0 - free, else SHMRING_REC_* | length */
+	uint32_t reserved;
+};
+#define SHMRING_REC_COMMIT 0x80000000u	/* record is complete */
+#define SHMRING_REC_PAD 0x40000000u	/* padding up to end of data area */
+#define SHMRING_REC_LENMASK 0x3fffffffu
+#define SHMRING_REC_SIZE(len) (sizeof(struct shmringRec_s) + (((len) + 7) & ~((size_t) 7)))
+
+typedef struct shmring_s {
+	struct shmringHdr_s *hdr;
+	uint8_t *data;			/* start of data area */
+	uint64_t size;			/* mirrored from header, never trust shared memory */
+	uint64_t rdpos;			/* reader: next record to read (not yet released) */
+	uint64_t relpos;		/* reader: end of space released to writers */
+	uint64_t headCache;		/* reader: last head seen, to check records against */
+	uint64_t lenCurr;		/* reader: size of record returned by shmringPeek() */
+	size_t lenMap;
+	int fd;
+} shmring_t;
+
+/* a record to be written by shmringWriteBatch() */
+struct shmringBuf_s {
+	const void *data;
+	size_t len;
+};
+
+/* creation/attachment */
+int shmringCreate(shmring_t **ppRing, const char *path, uint64_t size, mode_t mode);
+int shmringOpen(shmring_t **ppRing, const char *path);
+void shmringClose(shmring_t *pRing);
+size_t shmringMaxRecLen(shmring_t *pRing);
+
+/* writer side */
+int shmringWrite(shmring_t *pRing, const void *data, size_t len);
+int shmringWriteBatch(shmring_t *pRing, const struct shmringBuf_s *recs, unsigned nRecs);
+int shmringWaitSpace(shmring_t *pRing, size_t len, int timeoutMs);
+void shmringAddDrops(shmring_t *pRing, uint64_t nDrops);
+uint64_t shmringGetDrops(shmring_t *pRing);
+
+/* reader side */
+int shmringPeek(shmring_t *pRing, const void **pData, size_t *pLen);
+void shmringAdvance(shmring_t *pRing);
+void shmringRelease(shmring_t *pRing);
+void shmringResync(shmring_t *pRing);
+int shmringWait(shmring_t *pRing, int timeoutMs);
+
+#endif  /* #ifndef INCLUDED_LIBSHMRING_H */
@@ -64,6 +64,7 @@
 #include "var.h"
 #include "rsconf.h"
 #include "parserif.h"
+#include "msgtrace.h"
 #include <errno.h>
 
 /* TODO: move the global variable root to the config object - had no time to to it
@@ -804,10 +805,10 @@ static inline rsRetVal msgBaseConstruct(msg_t **ppThis)
 	pM->msgFlags = 0;
 	pM->iLenRawMsg = 0;
 	pM->iLenMSG = 0;
-	pM->iLenTAG = 0;
-	pM->iLenHOSTNAME = 0;
 	pM->pszRawMsg = NULL;
-	pM->pszHOSTNAME = NULL;
+	pM->pRawChunk = NULL;
+	pM->pHOSTNAME = NULL;
+	pM->pTAG = NULL;
 	pM->pszRcvdAt3164 = NULL;
 	pM->pszRcvdAt3339 = NULL;
 	pM->pszRcvdAt_MySQL = NULL;
@@ -817,7 +818,7 @@ static inline rsRetVal msgBaseConstruct(msg_t **ppThis)
 	pM->pszTIMESTAMP_MySQL = NULL;
         pM->pszTIMESTAMP_PgSQL = NULL;
 	pM->pszStrucData = NULL;
-	pM->pCSAPPNAME = NULL;
+	pM->pAPPNAME = NULL;
 	pM->pCSPROCID = NULL;
 	pM->pCSMSGID = NULL;
 	pM->pInputName = NULL;
@@ -829,7 +830,6 @@ static inline rsRetVal msgBaseConstruct(msg_t **ppThis)
 	pM->dfltTZ[0] = '\0';
 	memset(&pM->tRcvdAt, 0, sizeof(pM->tRcvdAt));
 	memset(&pM->tTIMESTAMP, 0, sizeof(pM->tTIMESTAMP));
-	pM->TAG.pszTAG = NULL;
 	pM->pszTimestamp3164[0] = '\0';
 	pM->pszTimestamp3339[0] = '\0';
 	pM->pszTIMESTAMP_SecFrac[0] = '\0';
@@ -837,6 +837,7 @@ static inline rsRetVal msgBaseConstruct(msg_t **ppThis)
 	pM->pszTIMESTAMP_Unix[0] = '\0';
 	pM->pszRcvdAt_Unix[0] = '\0';
 	pM->pszUUID = NULL;
+	pM->pTrace = NULL;
 	pthread_mutex_init(&pM->mut, NULL);
 
 	/* DEV debugging only! dbgprintf("msgConstruct\t0x%x, ref 1\n", (int)pM);*/
@@ -914,13 +915,22 @@ msgConstructForDeserializer(msg_t **ppThis)
  */
 static inline void freeTAG(msg_t *pThis)
 {
-	if(pThis->iLenTAG >= CONF_TAG_BUFSIZE)
-		free(pThis->TAG.pszTAG);
+	if(pThis->pTAG != NULL)
+		prop.Destruct(&pThis->pTAG);
 }
 static inline void freeHOSTNAME(msg_t *pThis)
 {
-	if(pThis->iLenHOSTNAME >= CONF_HOSTNAME_BUFSIZE)
-		free(pThis->pszHOSTNAME);
+	if(pThis->pHOSTNAME != NULL)
+		prop.Destruct(&pThis->pHOSTNAME);
+}
+static inline void freeRawMsg(msg_t *pThis)
+{
+	if(pThis->pRawChunk != NULL) {
+		msgChunkRelease(pThis->pRawChunk);
+		pThis->pRawChunk = NULL;
+	} else if(pThis->pszRawMsg != pThis->szRawMsg) {
+		free(pThis->pszRawMsg);
+	}
 }
 
 
@@ -940,8 +950,9 @@ CODESTARTobjDestruct(msg)
 	if(currRefCount == 0)
 	{
 		/* DEV Debugging Only! dbgprintf("msgDestruct\t0x%lx, RefCount now 0, doing DESTROY\n", (unsigned long)pThis); */
-		if(pThis->pszRawMsg != pThis->szRawMsg)
-			free(pThis->pszRawMsg);
+		if(pThis->pTrace != NULL)
+			msgtraceFinish(pThis); /* must be done while props are still valid */
+		freeRawMsg(pThis);
 		freeTAG(pThis);
 		freeHOSTNAME(pThis);
 		if(pThis->pInputName != NULL)
@@ -963,8 +974,8 @@ CODESTARTobjDestruct(msg)
 		free(pThis->pszStrucData);
 		if(pThis->iLenPROGNAME >= CONF_PROGNAME_BUFSIZE)
 			free(pThis->PROGNAME.ptr);
-		if(pThis->pCSAPPNAME != NULL)
-			rsCStrDestruct(&pThis->pCSAPPNAME);
+		if(pThis->pAPPNAME != NULL)
+			prop.Destruct(&pThis->pAPPNAME);
 		if(pThis->pCSPROCID != NULL)
 			rsCStrDestruct(&pThis->pCSPROCID);
 		if(pThis->pCSMSGID != NULL)
@@ -1062,8 +1073,6 @@ msg_t* MsgDup(msg_t* pOld)
 	pNew->offMSG = pOld->offMSG;
 	pNew->iLenRawMsg = pOld->iLenRawMsg;
 	pNew->iLenMSG = pOld->iLenMSG;
-	pNew->iLenTAG = pOld->iLenTAG;
-	pNew->iLenHOSTNAME = pOld->iLenHOSTNAME;
 	if((pOld->msgFlags & NEEDS_DNSRESOL)) {
 			localRet = msgSetFromSockinfo(pNew, pOld->rcvFrom.pfrominet);
 			if(localRet != RS_RET_OK) {
@@ -1087,16 +1096,18 @@ msg_t* MsgDup(msg_t* pOld)
 		pNew->pInputName = pOld->pInputName;
 		prop.AddRef(pNew->pInputName);
 	}
-	if(pOld->iLenTAG > 0) {
-		if(pOld->iLenTAG < CONF_TAG_BUFSIZE) {
-			memcpy(pNew->TAG.szBuf, pOld->TAG.szBuf, pOld->iLenTAG + 1);
-		} else {
-			if((pNew->TAG.pszTAG = srUtilStrDup(pOld->TAG.pszTAG, pOld->iLenTAG)) == NULL) {
-				msgDestruct(&pNew);
-				return NULL;
-			}
-			pNew->iLenTAG = pOld->iLenTAG;
-		}
+	/* interned properties are shared, so we just need a new reference */
+	if(pOld->pTAG != NULL) {
+		pNew->pTAG = pOld->pTAG;
+		prop.AddRef(pNew->pTAG);
+	}
+	if(pOld->pHOSTNAME != NULL) {
+		pNew->pHOSTNAME = pOld->pHOSTNAME;
+		prop.AddRef(pNew->pHOSTNAME);
+	}
+	if(pOld->pAPPNAME != NULL) {
+		pNew->pAPPNAME = pOld->pAPPNAME;
+		prop.AddRef(pNew->pAPPNAME);
 	}
 	if(pOld->iLenRawMsg < CONF_RAWMSG_BUFSIZE) {
 		memcpy(pNew->szRawMsg, pOld->szRawMsg, pOld->iLenRawMsg + 1);
@@ -1104,16 +1115,6 @@ msg_t* MsgDup(msg_t* pOld)
 	} else {
 		tmpCOPYSZ(RawMsg);
 	}
-	if(pOld->pszHOSTNAME == NULL) {
-		pNew->pszHOSTNAME = NULL;
-	} else {
-		if(pOld->iLenHOSTNAME < CONF_HOSTNAME_BUFSIZE) {
-			memcpy(pNew->szHOSTNAME, pOld->szHOSTNAME, pOld->iLenHOSTNAME + 1);
-			pNew->pszHOSTNAME = pNew->szHOSTNAME;
-		} else {
-			tmpCOPYSZ(HOSTNAME);
-		}
-	}
 	if(pOld->pszStrucData == NULL) {
 		pNew->pszStrucData = NULL;
 	} else {
@@ -1121,7 +1122,6 @@ msg_t* MsgDup(msg_t* pOld)
 		pNew->lenStrucData = pOld->lenStrucData;
 	}
 
-	tmpCOPYCSTR(APPNAME);
 	tmpCOPYCSTR(PROCID);
 	tmpCOPYCSTR(MSGID);
 
@@ -1173,10 +1173,11 @@ static rsRetVal MsgSerialize(msg_t *pThis, strm_t *pStrm)
 	objSerializeSCALAR(pStrm, tTIMESTAMP, SYSLOGTIME);
 
 	CHKiRet(obj.SerializeProp(pStrm, UCHAR_CONSTANT("pszTAG"), PROPTYPE_PSZ, (void*)
-		((pThis->iLenTAG < CONF_TAG_BUFSIZE) ? pThis->TAG.szBuf : pThis->TAG.pszTAG)));
+		((pThis->pTAG == NULL) ? NULL : propGetSzStr(pThis->pTAG))));
 
 	objSerializePTR(pStrm, pszRawMsg, PSZ);
-	objSerializePTR(pStrm, pszHOSTNAME, PSZ);
+	CHKiRet(obj.SerializeProp(pStrm, UCHAR_CONSTANT("pszHOSTNAME"), PROPTYPE_PSZ, (void*)
+		((pThis->pHOSTNAME == NULL) ? NULL : propGetSzStr(pThis->pHOSTNAME))));
 	getInputName(pThis, &psz, &len);
 	CHKiRet(obj.SerializeProp(pStrm, UCHAR_CONSTANT("pszInputName"), PROPTYPE_PSZ, (void*) psz));
 	psz = getRcvFrom(pThis); 
@@ -1194,7 +1195,9 @@ static rsRetVal MsgSerialize(msg_t *pThis, strm_t *pStrm)
 		CHKiRet(obj.SerializeProp(pStrm, UCHAR_CONSTANT("localvars"), PROPTYPE_PSZ, (void*) psz));
 	}
 
-	objSerializePTR(pStrm, pCSAPPNAME, CSTR);
+	/* APP-NAME was a cstr in older versions, so keep the property name */
+	CHKiRet(obj.SerializeProp(pStrm, UCHAR_CONSTANT("pCSAPPNAME"), PROPTYPE_PSZ, (void*)
+		((pThis->pAPPNAME == NULL) ? NULL : propGetSzStr(pThis->pAPPNAME))));
 	objSerializePTR(pStrm, pCSPROCID, CSTR);
 	objSerializePTR(pStrm, pCSMSGID, CSTR);
 	
@@ -1425,6 +1428,7 @@ static rsRetVal aquirePROCIDFromTAG(msg_t * const pM)
 {
 	register int i;
 	uchar *pszTag;
+	int lenTag;
 	DEFiRet;
 
 	assert(pM != NULL);
@@ -1435,25 +1439,28 @@ static rsRetVal aquirePROCIDFromTAG(msg_t * const pM)
 	if(msgGetProtocolVersion(pM) != 0)
 		return RS_RET_OK; /* we can only emulate if we have legacy format */
 
-	pszTag = (uchar*) ((pM->iLenTAG < CONF_TAG_BUFSIZE) ? pM->TAG.szBuf : pM->TAG.pszTAG);
+	if(pM->pTAG == NULL)
+		return RS_RET_OK; /* no TAG, nothing to emulate from */
+	pszTag = propGetSzStr(pM->pTAG);
+	lenTag = pM->pTAG->len;
 
 	/* find first '['... */
 	i = 0;
-	while((i < pM->iLenTAG) && (pszTag[i] != '['))
+	while((i < lenTag) && (pszTag[i] != '['))
 		++i;
-	if(!(i < pM->iLenTAG))
+	if(!(i < lenTag))
 		return RS_RET_OK;	/* no [, so can not emulate... */
 	
 	++i; /* skip '[' */
 
 	/* now obtain the PROCID string... */
 	CHKiRet(cstrConstruct(&pM->pCSPROCID));
-	while((i < pM->iLenTAG) && (pszTag[i] != ']')) {
+	while((i < lenTag) && (pszTag[i] != ']')) {
 		CHKiRet(cstrAppendChar(pM->pCSPROCID, pszTag[i]));
 		++i;
 	}
 
-	if(!(i < pM->iLenTAG)) {
+	if(!(i < lenTag)) {
 		/* oops... it looked like we had a PROCID, but now it has
 		 * turned out this is not true. In this case, we need to free
 		 * the buffer and simply return. Note that this is NOT an error
@@ -1489,13 +1496,20 @@ static inline rsRetVal
 aquireProgramName(msg_t * const pM)
 {
 	int i;
+	int lenTag;
 	uchar *pszTag, *pszProgName;
 	DEFiRet;
 
 	assert(pM != NULL);
-	pszTag = (uchar*) ((pM->iLenTAG < CONF_TAG_BUFSIZE) ? pM->TAG.szBuf : pM->TAG.pszTAG);
+	if(pM->pTAG == NULL) {
+		pszTag = (uchar*) "";
+		lenTag = 0;
+	} else {
+		pszTag = propGetSzStr(pM->pTAG);
+		lenTag = pM->pTAG->len;
+	}
 	for(  i = 0
-	    ; (i < pM->iLenTAG) && isprint((int) pszTag[i])
+	    ; (i < lenTag) && isprint((int) pszTag[i])
 	      && (pszTag[i] != '\0') && (pszTag[i] != ':')
 	      && (pszTag[i] != '[')  && (pszTag[i] != '/')
 	    ; ++i)
@@ -2123,14 +2137,23 @@ MsgSetAfterPRIOffs(msg_t * const pMsg, short offs)
  */
 rsRetVal MsgSetAPPNAME(msg_t *__restrict__ const pMsg, const char* pszAPPNAME)
 {
+	if(pszAPPNAME == NULL)
+		pszAPPNAME = "";
+	return MsgSetAPPNAMEWithLen(pMsg, (const uchar*) pszAPPNAME, strlen(pszAPPNAME));
+}
+
+/* same as MsgSetAPPNAME(), but for a string that is not NUL-terminated,
+ * e.g. a field inside the raw message.
+ */
+rsRetVal MsgSetAPPNAMEWithLen(msg_t *__restrict__ const pMsg, const uchar *psz, const int len)
+{
+	prop_t *pNew;
 	DEFiRet;
 	assert(pMsg != NULL);
-	if(pMsg->pCSAPPNAME == NULL) {
-		/* we need to obtain the object first */
-		CHKiRet(rsCStrConstruct(&pMsg->pCSAPPNAME));
-	}
-	/* if we reach this point, we have the object */
-	iRet = rsCStrSetSzStr(pMsg->pCSAPPNAME, (uchar*) pszAPPNAME);
+	CHKiRet(prop.Intern(&pNew, psz, len));
+	if(pMsg->pAPPNAME != NULL)
+		prop.Destruct(&pMsg->pAPPNAME);
+	pMsg->pAPPNAME = pNew;
 
 finalize_it:
 	RETiRet;
@@ -2155,6 +2178,31 @@ finalize_it:
 	RETiRet;
 }
 
+/* set a cstr property from a string that is not NUL-terminated. If the
+ * cstr already exists, its buffer is reused.
+ */
+static rsRetVal
+setCStrWithLen(cstr_t **ppCStr, const uchar *psz, const int len)
+{
+	DEFiRet;
+	if(*ppCStr == NULL) {
+		CHKiRet(cstrConstruct(ppCStr));
+	} else {
+		CHKiRet(rsCStrTruncate(*ppCStr, cstrLen(*ppCStr)));
+	}
+	CHKiRet(rsCStrAppendStrWithLen(*ppCStr, psz, len));
+	cstrFinalize(*ppCStr);
+finalize_it:
+	RETiRet;
+}
+
+/* same as MsgSetPROCID(), but for a string that is not NUL-terminated */
+rsRetVal MsgSetPROCIDWithLen(msg_t *__restrict__ const pMsg, const uchar *psz, const int len)
+{
+	ISOBJ_TYPE_assert(pMsg, msg);
+	return setCStrWithLen(&pMsg->pCSPROCID, psz, len);
+}
+
 
 /* check if we have a procid, and, if not, try to aquire/emulate it.
  * This must be called WITHOUT the message lock being held.
@@ -2223,6 +2271,13 @@ finalize_it:
 	RETiRet;
 }
 
+/* same as MsgSetMSGID(), but for a string that is not NUL-terminated */
+rsRetVal MsgSetMSGIDWithLen(msg_t * const pMsg, const uchar *psz, const int len)
+{
+	ISOBJ_TYPE_assert(pMsg, msg);
+	return setCStrWithLen(&pMsg->pCSMSGID, psz, len);
+}
+
 
 /* Return state of last parser. If it had success, "OK" is returned, else
  * "FAIL". All from the constant pool.
@@ -2356,30 +2411,18 @@ void MsgSetRuleset(msg_t * const pMsg, ruleset_t *pRuleset)
 
 /* set TAG in msg object
  * (rewritten 2009-06-18 rgerhards)
+ * The TAG is interned, so messages with the same TAG share a single
+ * property. An empty TAG is the same as no TAG at all.
  */
 void MsgSetTAG(msg_t *__restrict__ const pMsg, const uchar* pszBuf, const size_t lenBuf)
 {
-	uchar *pBuf;
 	assert(pMsg != NULL);
 
 	freeTAG(pMsg);
-
-	pMsg->iLenTAG = lenBuf;
-	if(pMsg->iLenTAG < CONF_TAG_BUFSIZE) {
-		/* small enough: use fixed buffer (faster!) */
-		pBuf = pMsg->TAG.szBuf;
-	} else {
-		if((pBuf = (uchar*) MALLOC(pMsg->iLenTAG + 1)) == NULL) {
-			/* truncate message, better than completely loosing it... */
-			pBuf = pMsg->TAG.szBuf;
-			pMsg->iLenTAG = CONF_TAG_BUFSIZE - 1;
-		} else {
-			pMsg->TAG.pszTAG = pBuf;
-		}
-	}
-
-	memcpy(pBuf, pszBuf, pMsg->iLenTAG);
-	pBuf[pMsg->iLenTAG] = '\0'; /* this also works with truncation! */
+	if(lenBuf == 0)
+		return;
+	if(prop.Intern(&pMsg->pTAG, pszBuf, lenBuf) != RS_RET_OK)
+		pMsg->pTAG = NULL; /* out of memory, better lose TAG than message */
 }
 
 
@@ -2399,7 +2442,7 @@ tryEmulateTAG(msg_t * const pM, sbool bLockMutex)
 
 	if(bLockMutex == LOCK_MUTEX)
 		MsgLock(pM);
-	if(pM->iLenTAG > 0) {
+	if(pM->pTAG != NULL) {
 		if(bLockMutex == LOCK_MUTEX)
 			MsgUnlock(pM);
 		return; /* done, no need to emulate */
@@ -2414,6 +2457,8 @@ tryEmulateTAG(msg_t * const pM, sbool bLockMutex)
 			lenTAG = snprintf((char*)bufTAG, CONF_TAG_MAXSIZE, "%s[%s]",
 					  getAPPNAME(pM, MUTEX_ALREADY_LOCKED), getPROCID(pM, MUTEX_ALREADY_LOCKED));
 			bufTAG[sizeof(bufTAG)-1] = '\0'; /* just to make sure... */
+			if(lenTAG >= sizeof(bufTAG))
+				lenTAG = sizeof(bufTAG) - 1; /* snprintf() truncated */
 			MsgSetTAG(pM, bufTAG, lenTAG);
 		}
 	}
@@ -2429,14 +2474,14 @@ getTAG(msg_t * const pM, uchar **ppBuf, int *piLen)
 		*ppBuf = UCHAR_CONSTANT("");
 		*piLen = 0;
 	} else {
-		if(pM->iLenTAG == 0)
+		if(pM->pTAG == NULL)
 			tryEmulateTAG(pM, LOCK_MUTEX);
-		if(pM->iLenTAG == 0) {
+		if(pM->pTAG == NULL) {
 			*ppBuf = UCHAR_CONSTANT("");
 			*piLen = 0;
 		} else {
-			*ppBuf = (pM->iLenTAG < CONF_TAG_BUFSIZE) ? pM->TAG.szBuf : pM->TAG.pszTAG;
-			*piLen = pM->iLenTAG;
+			*ppBuf = propGetSzStr(pM->pTAG);
+			*piLen = pM->pTAG->len;
 		}
 	}
 }
@@ -2447,14 +2492,14 @@ int getHOSTNAMELen(msg_t * const pM)
 	if(pM == NULL)
 		return 0;
 	else
-		if(pM->pszHOSTNAME == NULL) {
+		if(pM->pHOSTNAME == NULL) {
 			resolveDNS(pM);
 			if(pM->rcvFrom.pRcvFrom == NULL)
 				return 0;
 			else
 				return prop.GetStringLen(pM->rcvFrom.pRcvFrom);
 		} else
-			return pM->iLenHOSTNAME;
+			return pM->pHOSTNAME->len;
 }
 
 
@@ -2463,7 +2508,7 @@ const char *getHOSTNAME(msg_t * const pM)
 	if(pM == NULL)
 		return "";
 	else
-		if(pM->pszHOSTNAME == NULL) {
+		if(pM->pHOSTNAME == NULL) {
 			resolveDNS(pM);
 			if(pM->rcvFrom.pRcvFrom == NULL) {
 				return "";
@@ -2474,7 +2519,7 @@ const char *getHOSTNAME(msg_t * const pM)
 				return (char*) psz;
 			}
 		} else {
-			return (char*) pM->pszHOSTNAME;
+			return (char*) propGetSzStr(pM->pHOSTNAME);
 		}
 }
 
@@ -2512,6 +2557,20 @@ finalize_it:
 	RETiRet;
 }
 
+/* same as MsgSetStructuredData(), but for a string that is not NUL-terminated */
+rsRetVal MsgSetStructuredDataWithLen(msg_t * const pMsg, const uchar *psz, const int len)
+{
+	DEFiRet;
+	ISOBJ_TYPE_assert(pMsg, msg);
+	free(pMsg->pszStrucData);
+	CHKmalloc(pMsg->pszStrucData = (uchar*)malloc(len + 1));
+	memcpy(pMsg->pszStrucData, psz, len);
+	pMsg->pszStrucData[len] = '\0';
+	pMsg->lenStrucData = len;
+finalize_it:
+	RETiRet;
+}
+
 
 /* get the "STRUCTURED-DATA" as sz string, including length */
 void
@@ -2557,7 +2616,7 @@ uchar *getProgramName(msg_t * const pM, sbool bLockMutex)
 static void tryEmulateAPPNAME(msg_t * const pM)
 {
 	assert(pM != NULL);
-	if(pM->pCSAPPNAME != NULL)
+	if(pM->pAPPNAME != NULL)
 		return; /* we are already done */
 
 	if(msgGetProtocolVersion(pM) == 0) {
@@ -2574,12 +2633,12 @@ static void tryEmulateAPPNAME(msg_t * const pM)
  */
 static inline void prepareAPPNAME(msg_t * const pM, sbool bLockMutex)
 {
-	if(pM->pCSAPPNAME == NULL) {
+	if(pM->pAPPNAME == NULL) {
 		if(bLockMutex == LOCK_MUTEX)
 			MsgLock(pM);
 
 		/* re-query as things might have changed during locking */
-		if(pM->pCSAPPNAME == NULL)
+		if(pM->pAPPNAME == NULL)
 			tryEmulateAPPNAME(pM);
 
 		if(bLockMutex == LOCK_MUTEX)
@@ -2597,10 +2656,10 @@ char *getAPPNAME(msg_t * const pM, sbool bLockMutex)
 	if(bLockMutex == LOCK_MUTEX)
 		MsgLock(pM);
 	prepareAPPNAME(pM, MUTEX_ALREADY_LOCKED);
-	if(pM->pCSAPPNAME == NULL)
+	if(pM->pAPPNAME == NULL)
 		pszRet = UCHAR_CONSTANT("");
 	else 
-		pszRet = rsCStrGetSzStrNoNULL(pM->pCSAPPNAME);
+		pszRet = propGetSzStr(pM->pAPPNAME);
 	if(bLockMutex == LOCK_MUTEX)
 		MsgUnlock(pM);
 	return (char*)pszRet;
@@ -2612,7 +2671,7 @@ static int getAPPNAMELen(msg_t * const pM, sbool bLockMutex)
 {
 	assert(pM != NULL);
 	prepareAPPNAME(pM, bLockMutex);
-	return (pM->pCSAPPNAME == NULL) ? 0 : rsCStrLen(pM->pCSAPPNAME);
+	return (pM->pAPPNAME == NULL) ? 0 : pM->pAPPNAME->len;
 }
 
 /* rgerhards 2008-09-10: set pszInputName in msg object. This calls AddRef()
@@ -2744,19 +2803,9 @@ void MsgSetHOSTNAME(msg_t *pThis, const uchar* pszHOSTNAME, const int lenHOSTNAM
 	assert(pThis != NULL);
 
 	freeHOSTNAME(pThis);
-
-	pThis->iLenHOSTNAME = lenHOSTNAME;
-	if(pThis->iLenHOSTNAME < CONF_HOSTNAME_BUFSIZE) {
-		/* small enough: use fixed buffer (faster!) */
-		pThis->pszHOSTNAME = pThis->szHOSTNAME;
-	} else if((pThis->pszHOSTNAME = (uchar*) MALLOC(pThis->iLenHOSTNAME + 1)) == NULL) {
-		/* truncate message, better than completely loosing it... */
-		pThis->pszHOSTNAME = pThis->szHOSTNAME;
-		pThis->iLenHOSTNAME = CONF_HOSTNAME_BUFSIZE - 1;
-	}
-
-	memcpy(pThis->pszHOSTNAME, pszHOSTNAME, pThis->iLenHOSTNAME);
-	pThis->pszHOSTNAME[pThis->iLenHOSTNAME] = '\0'; /* this also works with truncation! */
+	/* hostnames repeat very often, so we share them via the intern table */
+	if(prop.Intern(&pThis->pHOSTNAME, pszHOSTNAME, lenHOSTNAME) != RS_RET_OK)
+		pThis->pHOSTNAME = NULL;
 }
 
 
@@ -2803,8 +2852,7 @@ rsRetVal MsgReplaceMSG(msg_t *pThis, const uchar* pszMSG, int lenMSG)
 		/*  we have lost our "bet" and need to alloc a new buffer ;) */
 		CHKmalloc(bufNew = MALLOC(lenNew + 1));
 		memcpy(bufNew, pThis->pszRawMsg, pThis->offMSG);
-		if(pThis->pszRawMsg != pThis->szRawMsg)
-			free(pThis->pszRawMsg);
+		freeRawMsg(pThis);
 		pThis->pszRawMsg = bufNew;
 	}
 
@@ -2827,8 +2875,7 @@ void MsgSetRawMsg(msg_t *pThis, const char* pszRawMsg, size_t lenMsg)
 {
 	int deltaSize;
 	assert(pThis != NULL);
-	if(pThis->pszRawMsg != pThis->szRawMsg)
-		free(pThis->pszRawMsg);
+	freeRawMsg(pThis);
 
 	deltaSize = lenMsg - pThis->iLenRawMsg;
 	pThis->iLenRawMsg = lenMsg;
@@ -2862,6 +2909,110 @@ void MsgSetRawMsgWOSize(msg_t * const pMsg, char* pszRawMsg)
 }
 
 
+/* set raw message from an input-owned chunk without copying it. The
+ * message data is the lenMsg bytes at *ppBuf, which must be inside *ppChunk.
+ * The message keeps a reference to the chunk, which it releases on
+ * destruction. The byte after the message is overwritten with the
+ * terminating '\0', so the caller must have received into a buffer one
+ * byte larger than the message. On return, *ppBuf points to where the next
+ * message can be received into, with at least lenNext bytes available;
+ * if the current chunk is too full for that, a new one with room for
+ * lenNext + MSGCHUNK_DFLT_SIZE bytes is allocated and the caller's
+ * reference to the old chunk is dropped. So consecutive messages share a
+ * chunk, which is freed when the last one of them is destroyed.
+ * Small messages are still copied into the msg_t-included buffer (which is
+ * cheaper and does not keep the chunk alive). If a new chunk cannot be
+ * allocated, the message is copied as well. In both cases, *ppBuf is
+ * left unchanged.
+ */
+void MsgSetRawMsgFromChunk(msg_t *const pThis, msgChunk_t **const ppChunk, uchar **const ppBuf,
+	const size_t lenMsg, const size_t lenNext)
+{
+	msgChunk_t *const pChunk = *ppChunk;
+	msgChunk_t *pNew = NULL;
+	uchar *pNext;
+	int deltaSize;
+	assert(pThis != NULL);
+	assert(*ppBuf >= pChunk->buf && *ppBuf + lenMsg < pChunk->buf + pChunk->size);
+
+	if(lenMsg < CONF_RAWMSG_BUFSIZE) {
+		MsgSetRawMsg(pThis, (char*) *ppBuf, lenMsg);
+		return;
+	}
+
+	pNext = *ppBuf + lenMsg + 1;
+	if(pNext + lenNext > pChunk->buf + pChunk->size) {
+		if(msgChunkConstruct(&pNew, lenNext + MSGCHUNK_DFLT_SIZE) != RS_RET_OK) {
+			MsgSetRawMsg(pThis, (char*) *ppBuf, lenMsg);
+			return;
+		}
+		pNext = pNew->buf;
+	}
+
+	freeRawMsg(pThis);
+	ATOMIC_INC(&pChunk->iRefCount, &pChunk->mutRefCount);
+	pThis->pRawChunk = pChunk;
+	deltaSize = lenMsg - pThis->iLenRawMsg;
+	pThis->iLenRawMsg = lenMsg;
+	pThis->pszRawMsg = *ppBuf;
+	pThis->pszRawMsg[lenMsg] = '\0';
+	/* correct other information */
+	if(pThis->iLenRawMsg > pThis->offMSG)
+		pThis->iLenMSG += deltaSize;
+	else
+		pThis->iLenMSG = 0;
+
+	if(pNew != NULL) {
+		msgChunkRelease(pChunk);
+		*ppChunk = pNew;
+	}
+	*ppBuf = pNext;
+}
+
+
+/* construct a chunk with size usable bytes. The caller holds the
+ * initial reference.
+ */
+rsRetVal msgChunkConstruct(msgChunk_t **const ppThis, const size_t size)
+{
+	msgChunk_t *pThis;
+	DEFiRet;
+
+	CHKmalloc(pThis = malloc(sizeof(msgChunk_t) + size));
+	pThis->iRefCount = 1;
+	INIT_ATOMIC_HELPER_MUT(pThis->mutRefCount);
+	pThis->size = size;
+	pThis->buf = (uchar*) (pThis + 1);
+	*ppThis = pThis;
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* release a reference to a chunk, freeing it if this was the last one */
+void msgChunkRelease(msgChunk_t *const pThis)
+{
+	int currRefCount;
+	currRefCount = ATOMIC_DEC_AND_FETCH(&pThis->iRefCount, &pThis->mutRefCount);
+	if(currRefCount == 0) {
+		DESTROY_ATOMIC_HELPER_MUT(pThis->mutRefCount);
+		free(pThis);
+	}
+}
+
+
+/* if no message references the chunk any longer, let the input start
+ * over at its beginning. Must only be called when the input has no
+ * partial message in the chunk.
+ */
+void msgChunkRewind(msgChunk_t *const pThis, uchar **const ppBuf)
+{
+	if(ATOMIC_FETCH_32BIT(&pThis->iRefCount, &pThis->mutRefCount) == 1)
+		*ppBuf = pThis->buf;
+}
+
+
 /* create textual representation of facility and severity.
  * The variable pRes must point to a user-supplied buffer of
  * at least 20 characters.
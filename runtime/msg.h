@@ -72,12 +72,12 @@ struct msg {
 	int	msgFlags;	/* flags associated with this message */
 	int	iLenRawMsg;	/* length of raw message */
 	int	iLenMSG;	/* Length of the MSG part */
-	int	iLenTAG;	/* Length of the TAG part */
-	int	iLenHOSTNAME;	/* Length of HOSTNAME */
 	int	iLenPROGNAME;	/* Length of PROGNAME (-1 = not yet set) */
 	uchar	*pszRawMsg;	/* message as it was received on the wire. This is important in case we
 				 * need to preserve cryptographic verifiers.  */
-	uchar	*pszHOSTNAME;	/* HOSTNAME from syslog message */
+	struct msgChunk_s *pRawChunk; /* chunk pszRawMsg points into, NULL if not chunk-based */
+	prop_t	*pHOSTNAME;	/* HOSTNAME from syslog message (interned) */
+	prop_t	*pTAG;		/* TAG from syslog message (interned) */
 	char *pszRcvdAt3164;	/* time as RFC3164 formatted string (always 15 charcters) */
 	char *pszRcvdAt3339;	/* time as RFC3164 formatted string (32 charcters at most) */
 	char *pszRcvdAt_MySQL;	/* rcvdAt as MySQL formatted string (always 14 charcters) */
@@ -88,7 +88,7 @@ struct msg {
         char *pszTIMESTAMP_PgSQL;/* TIMESTAMP as PgSQL formatted string (always 21 characters) */
 	uchar *pszStrucData;    /* STRUCTURED-DATA */
 	uint16_t lenStrucData;	/* (cached) length of STRUCTURED-DATA */
-	cstr_t *pCSAPPNAME;	/* APP-NAME */
+	prop_t *pAPPNAME;	/* APP-NAME (interned) */
 	cstr_t *pCSPROCID;	/* PROCID */
 	cstr_t *pCSMSGID;	/* MSGID */
 	prop_t *pInputName;	/* input name property */
@@ -112,15 +112,10 @@ struct msg {
 	struct json_object *localvars;
 	/* some fixed-size buffers to save malloc()/free() for frequently used fields (from the default templates) */
 	uchar szRawMsg[CONF_RAWMSG_BUFSIZE];	/* most messages are small, and these are stored here (without malloc/free!) */
-	uchar szHOSTNAME[CONF_HOSTNAME_BUFSIZE];
 	union {
 		uchar	*ptr;	/* pointer to progname value */
 		uchar	szBuf[CONF_PROGNAME_BUFSIZE];
 	} PROGNAME;
-	union {
-		uchar	*pszTAG;	/* pointer to tag value */
-		uchar	szBuf[CONF_TAG_BUFSIZE];
-	} TAG;
 	char pszTimestamp3164[CONST_LEN_TIMESTAMP_3164 + 1];
 	char pszTimestamp3339[CONST_LEN_TIMESTAMP_3339 + 1];
 	char pszTIMESTAMP_SecFrac[7]; /* Note: a pointer is 64 bits/8 char, so this is actually fewer than a pointer! */
@@ -129,9 +124,24 @@ struct msg {
 	char pszRcvdAt_Unix[12];
 	char dfltTZ[8];	    /* 7 chars max, less overhead than ptr! */
 	uchar *pszUUID; /* The message's UUID */
+	struct msgTrace_s *pTrace; /* pipeline trace, NULL if message is not sampled (see msgtrace.c) */
 };
 
 
+/* A reference-counted memory chunk. Inputs may receive many messages into
+ * one chunk and let each message's raw buffer point into it instead of
+ * copying (see MsgSetRawMsgFromChunk()). The chunk is freed when the
+ * input and all messages referencing it have released it.
+ */
+typedef struct msgChunk_s {
+	int iRefCount;
+	DEF_ATOMIC_HELPER_MUT(mutRefCount)
+	size_t size;		/* usable size of buf */
+	uchar *buf;		/* chunk data, allocated together with this struct */
+} msgChunk_t;
+
+#define MSGCHUNK_DFLT_SIZE (16 * 1024)	/* space for packing messages, in addition to one max-size message */
+
 /* message flags (msgFlags), not an enum for historical reasons
  */
 #define NOFLAG		0x000	/* no flag is set (to be used when a flag must be specified and none is required) */
@@ -165,13 +175,17 @@ void setProtocolVersion(msg_t *pM, int iNewVersion);
 void MsgSetInputName(msg_t *pMsg, prop_t*);
 void MsgSetDfltTZ(msg_t *pThis, char *tz);
 rsRetVal MsgSetAPPNAME(msg_t *pMsg, const char* pszAPPNAME);
+rsRetVal MsgSetAPPNAMEWithLen(msg_t *pMsg, const uchar *psz, const int len);
 rsRetVal MsgSetPROCID(msg_t *pMsg, const char* pszPROCID);
+rsRetVal MsgSetPROCIDWithLen(msg_t *pMsg, const uchar *psz, const int len);
 rsRetVal MsgSetMSGID(msg_t *pMsg, const char* pszMSGID);
+rsRetVal MsgSetMSGIDWithLen(msg_t *pMsg, const uchar *psz, const int len);
 void MsgSetParseSuccess(msg_t *pMsg, int bSuccess);
 void MsgSetTAG(msg_t *pMsg, const uchar* pszBuf, const size_t lenBuf);
 void MsgSetRuleset(msg_t *pMsg, ruleset_t*);
 rsRetVal MsgSetFlowControlType(msg_t *pMsg, flowControl_t eFlowCtl);
 rsRetVal MsgSetStructuredData(msg_t *const pMsg, const char* pszStrucData);
+rsRetVal MsgSetStructuredDataWithLen(msg_t *const pMsg, const uchar *psz, const int len);
 rsRetVal MsgAddToStructuredData(msg_t *pMsg, uchar *toadd, rs_size_t len);
 void MsgGetStructuredData(msg_t *pM, uchar **pBuf, rs_size_t *len);
 rsRetVal msgSetFromSockinfo(msg_t *pThis, struct sockaddr_storage *sa);
@@ -184,6 +198,10 @@ rsRetVal MsgSetAfterPRIOffs(msg_t *pMsg, short offs);
 void MsgSetMSGoffs(msg_t *pMsg, short offs);
 void MsgSetRawMsgWOSize(msg_t *pMsg, char* pszRawMsg);
 void MsgSetRawMsg(msg_t *pMsg, const char* pszRawMsg, size_t lenMsg);
+void MsgSetRawMsgFromChunk(msg_t *pMsg, msgChunk_t **ppChunk, uchar **ppBuf, size_t lenMsg, size_t lenNext);
+rsRetVal msgChunkConstruct(msgChunk_t **ppThis, size_t size);
+void msgChunkRelease(msgChunk_t *pThis);
+void msgChunkRewind(msgChunk_t *pThis, uchar **ppBuf);
 rsRetVal MsgReplaceMSG(msg_t *pThis, const uchar* pszMSG, int lenMSG);
 uchar *MsgGetProp(msg_t *pMsg, struct templateEntry *pTpe, msgPropDescr_t *pProp,
 		  rs_size_t *pPropLen, unsigned short *pbMustBeFreed, struct syslogTime *ttNow);
@@ -0,0 +1,364 @@
+/* msgtrace.c
+ * Sampled per-message pipeline tracing. For every n-th message submitted
+ * by an input, we record monotonic timestamps when it passes the main
+ * processing stages (queue enqueue/dequeue, ruleset execution, action
+ * enqueue and action completion). When the message is finally destroyed,
+ * the trace is emitted: the per-stage latencies are added to the
+ * "pipelinetrace" stats object (so they show up via impstats) and, if
+ * configured, a one-line JSON record is written to the trace file.
+ *
+ * As only sampled messages carry a trace, the cost for all others is a
+ * single NULL pointer check per stage, and a single compare at submit time.
+ *
+ * This file is part of the rsyslog runtime library.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "rsyslog.h"
+#include "obj.h"
+#include "errmsg.h"
+#include "prop.h"
+#include "msg.h"
+#include "statsobj.h"
+#include "unicode-helper.h"
+#include "msgtrace.h"
+
+/* definitions for objects we access */
+DEFobjStaticHelpers
+DEFobjCurrIf(errmsg)
+DEFobjCurrIf(statsobj)
+DEFobjCurrIf(prop)
+
+/* static data */
+unsigned msgtraceSampleRate = 0;	/* 0 - tracing disabled */
+static unsigned nSubmitted = 0;		/* sample counter, wraps, but we do not care */
+DEF_ATOMIC_HELPER_MUT(mutSubmitted)
+static int fdTrace = -1;		/* trace record file, -1 if none */
+static uchar *pszTraceFile = NULL;
+static pthread_mutex_t mutTraceFile = PTHREAD_MUTEX_INITIALIZER;
+
+static statsobj_t *stats = NULL;
+STATSCOUNTER_DEF(ctrSampled, mutCtrSampled)
+STATSCOUNTER_DEF(ctrCompleted, mutCtrCompleted)
+STATSCOUNTER_DEF(ctrSubmitEnq, mutCtrSubmitEnq)
+STATSCOUNTER_DEF(ctrQueueWait, mutCtrQueueWait)
+STATSCOUNTER_DEF(ctrDeqExec, mutCtrDeqExec)
+STATSCOUNTER_DEF(ctrRulesetExec, mutCtrRulesetExec)
+STATSCOUNTER_DEF(ctrActions, mutCtrActions)
+STATSCOUNTER_DEF(ctrActionLatency, mutCtrActionLatency)
+STATSCOUNTER_DEF(ctrTotal, mutCtrTotal)
+
+static const char *stageNames[MSGTRACE_NSTAGES] = {
+	"submit", "queue.enq", "queue.deq", "exec.begin", "exec.end" };
+
+
+/* attach a trace to a message */
+static inline void
+startTrace(msg_t *const pMsg, const uint64_t now)
+{
+	struct msgTrace_s *pTrace;
+
+	if(pMsg->pTrace != NULL) /* already sampled, e.g. resubmitted */
+		return;
+	if((pTrace = calloc(1, sizeof(struct msgTrace_s))) == NULL)
+		return; /* we just do not trace in this case */
+	pTrace->ts[MSGTRACE_SUBMIT] = now;
+	pMsg->pTrace = pTrace;
+	STATSCOUNTER_INC(ctrSampled, mutCtrSampled);
+}
+
+
+/* sample a single message. This is called for every submitted message if
+ * tracing is enabled, so it needs to be cheap.
+ */
+void
+msgtraceDoSample(msg_t *const pMsg)
+{
+	const unsigned n = ATOMIC_INC_AND_FETCH_unsigned(&nSubmitted, &mutSubmitted);
+	if(n % msgtraceSampleRate == 0)
+		startTrace(pMsg, msgtraceNow());
+}
+
+
+/* sample a batch of messages. We need just a single atomic operation for the
+ * whole batch and then check which of the messages fall on the sample points.
+ */
+void
+msgtraceDoSampleBatch(msg_t **const ppMsgs, const int nMsgs)
+{
+	unsigned first;
+	unsigned offs;
+	uint64_t now;
+	int i;
+
+	if(nMsgs <= 0)
+		return;
+	first = ATOMIC_FETCH_AND_ADD_unsigned(&nSubmitted, nMsgs, &mutSubmitted);
+	offs = first % msgtraceSampleRate;
+	i = (offs == 0) ? 0 : msgtraceSampleRate - offs;
+	if(i >= nMsgs)
+		return;
+	now = msgtraceNow();
+	for( ; i < nMsgs ; i += msgtraceSampleRate)
+		startTrace(ppMsgs[i], now);
+}
+
+
+/* compute the delta between two stages; returns -1 if one of them
+ * was not reached.
+ */
+static inline long long
+stageDelta(const struct msgTrace_s *const pTrace, const int from, const int to)
+{
+	if(pTrace->ts[from] == 0 || pTrace->ts[to] == 0 || pTrace->ts[to] < pTrace->ts[from])
+		return -1;
+	return (long long) (pTrace->ts[to] - pTrace->ts[from]);
+}
+
+
+/* add the latencies to the stats counters */
+static void
+updateStats(const struct msgTrace_s *const pTrace, const uint64_t tsDone)
+{
+	long long delta;
+	int nEvts;
+	int i, j;
+
+	STATSCOUNTER_INC(ctrCompleted, mutCtrCompleted);
+	if((delta = stageDelta(pTrace, MSGTRACE_SUBMIT, MSGTRACE_QENQ)) >= 0)
+		STATSCOUNTER_ADD(ctrSubmitEnq, mutCtrSubmitEnq, delta);
+	if((delta = stageDelta(pTrace, MSGTRACE_QENQ, MSGTRACE_QDEQ)) >= 0)
+		STATSCOUNTER_ADD(ctrQueueWait, mutCtrQueueWait, delta);
+	if((delta = stageDelta(pTrace, MSGTRACE_QDEQ, MSGTRACE_EXEC_BEGIN)) >= 0)
+		STATSCOUNTER_ADD(ctrDeqExec, mutCtrDeqExec, delta);
+	if((delta = stageDelta(pTrace, MSGTRACE_EXEC_BEGIN, MSGTRACE_EXEC_END)) >= 0)
+		STATSCOUNTER_ADD(ctrRulesetExec, mutCtrRulesetExec, delta);
+	STATSCOUNTER_ADD(ctrTotal, mutCtrTotal, tsDone - pTrace->ts[MSGTRACE_SUBMIT]);
+
+	/* match action enqueue/done event pairs */
+	nEvts = pTrace->nActEvts < MSGTRACE_MAX_ACTEVTS ? pTrace->nActEvts : MSGTRACE_MAX_ACTEVTS;
+	for(i = 0 ; i < nEvts ; ++i) {
+		if(pTrace->actEvts[i].evtType != MSGTRACE_ACT_ENQ)
+			continue;
+		for(j = 0 ; j < nEvts ; ++j) {
+			if(   pTrace->actEvts[j].evtType == MSGTRACE_ACT_DONE
+			   && pTrace->actEvts[j].iActionNbr == pTrace->actEvts[i].iActionNbr
+			   && pTrace->actEvts[j].ts >= pTrace->actEvts[i].ts) {
+				STATSCOUNTER_INC(ctrActions, mutCtrActions);
+				STATSCOUNTER_ADD(ctrActionLatency, mutCtrActionLatency,
+					pTrace->actEvts[j].ts - pTrace->actEvts[i].ts);
+				break;
+			}
+		}
+	}
+}
+
+
+/* add a string to a JSON record, escaped as required by RFC7159.
+ * The input name is user-configurable, so it may contain anything.
+ * Returns the new length, which is always less than the buffer size.
+ */
+static size_t
+addJSONStr(char *const buf, const size_t lenBuf, size_t len, const uchar *psz)
+{
+	for( ; *psz != '\0' && len + 6 < lenBuf ; ++psz) {
+		if(*psz == '"' || *psz == '\\') {
+			buf[len++] = '\\';
+			buf[len++] = *psz;
+		} else if(*psz < 0x20) {
+			len += snprintf(buf+len, lenBuf-len, "\\u%4.4x", *psz);
+		} else {
+			buf[len++] = *psz;
+		}
+	}
+	buf[len] = '\0';
+	return len;
+}
+
+
+/* write the trace record to the trace file. The record is a single JSON
+ * object per line. All times are in microseconds. The submit time is
+ * the absolute monotonic clock value, all others are relative to it.
+ */
+static void
+writeTraceRecord(msg_t *const pMsg, const struct msgTrace_s *const pTrace, const uint64_t tsDone)
+{
+	char buf[2048];
+	size_t len;
+	int nEvts;
+	int i;
+	const uint64_t tsBase = pTrace->ts[MSGTRACE_SUBMIT];
+
+	len = snprintf(buf, sizeof(buf), "{\"input\":\"");
+	if(pMsg->pInputName != NULL)
+		len = addJSONStr(buf, sizeof(buf), len, propGetSzStr(pMsg->pInputName));
+	len += snprintf(buf+len, sizeof(buf)-len, "\",\"submit\":%llu", (unsigned long long) tsBase);
+	for(i = MSGTRACE_SUBMIT + 1 ; i < MSGTRACE_NSTAGES && len < sizeof(buf) ; ++i) {
+		len += snprintf(buf+len, sizeof(buf)-len, ",\"%s\":%lld", stageNames[i],
+				stageDelta(pTrace, MSGTRACE_SUBMIT, i));
+	}
+	nEvts = pTrace->nActEvts < MSGTRACE_MAX_ACTEVTS ? pTrace->nActEvts : MSGTRACE_MAX_ACTEVTS;
+	if(len < sizeof(buf))
+		len += snprintf(buf+len, sizeof(buf)-len, ",\"actions\":[");
+	for(i = 0 ; i < nEvts && len < sizeof(buf) ; ++i) {
+		len += snprintf(buf+len, sizeof(buf)-len, "%s{\"nbr\":%d,\"evt\":\"%s\",\"t\":%lld}",
+				(i == 0) ? "" : ",", pTrace->actEvts[i].iActionNbr,
+				(pTrace->actEvts[i].evtType == MSGTRACE_ACT_ENQ) ? "enq" : "done",
+				(long long) (pTrace->actEvts[i].ts - tsBase));
+	}
+	if(len < sizeof(buf))
+		len += snprintf(buf+len, sizeof(buf)-len, "],\"done\":%lld}\n",
+				(long long) (tsDone - tsBase));
+	if(len >= sizeof(buf)) { /* truncated, make sure we at least keep line structure */
+		len = sizeof(buf) - 1;
+		buf[len-1] = '\n';
+	}
+
+	pthread_mutex_lock(&mutTraceFile);
+	if(write(fdTrace, buf, len) != (ssize_t) len) {
+		DBGPRINTF("msgtrace: error writing trace record, errno %d\n", errno);
+	}
+	pthread_mutex_unlock(&mutTraceFile);
+}
+
+
+/* finish a trace. Called from the msg destructor when the last reference
+ * to a traced message goes away, so we are the only one accessing it.
+ */
+void
+msgtraceFinish(msg_t *const pMsg)
+{
+	struct msgTrace_s *const pTrace = pMsg->pTrace;
+	uint64_t tsDone;
+
+	if(pTrace == NULL)
+		return;
+	tsDone = msgtraceNow();
+	updateStats(pTrace, tsDone);
+	if(fdTrace != -1)
+		writeTraceRecord(pMsg, pTrace, tsDone);
+	free(pTrace);
+	pMsg->pTrace = NULL;
+}
+
+
+/* activate tracing. This is called once the config has been loaded. If
+ * tracing is not configured, nothing happens and no stats object is created.
+ */
+rsRetVal
+msgtraceActivate(const unsigned sampleRate, const uchar *const fileName)
+{
+	DEFiRet;
+
+	if(sampleRate == 0)
+		FINALIZE;
+
+	if(fileName != NULL && pszTraceFile == NULL) {
+		CHKmalloc(pszTraceFile = ustrdup(fileName));
+		fdTrace = open((char*) pszTraceFile, O_WRONLY|O_CREAT|O_APPEND|O_NOCTTY|O_CLOEXEC,
+			       S_IRUSR|S_IWUSR|S_IRGRP);
+		if(fdTrace == -1) {
+			errmsg.LogError(errno, RS_RET_FILE_OPEN_ERROR, "pipeline trace: "
+				"cannot open trace file '%s' - trace records are only "
+				"available via stats", pszTraceFile);
+		}
+	}
+
+	if(stats == NULL) {
+		STATSCOUNTER_INIT(ctrSampled, mutCtrSampled);
+		STATSCOUNTER_INIT(ctrCompleted, mutCtrCompleted);
+		STATSCOUNTER_INIT(ctrSubmitEnq, mutCtrSubmitEnq);
+		STATSCOUNTER_INIT(ctrQueueWait, mutCtrQueueWait);
+		STATSCOUNTER_INIT(ctrDeqExec, mutCtrDeqExec);
+		STATSCOUNTER_INIT(ctrRulesetExec, mutCtrRulesetExec);
+		STATSCOUNTER_INIT(ctrActions, mutCtrActions);
+		STATSCOUNTER_INIT(ctrActionLatency, mutCtrActionLatency);
+		STATSCOUNTER_INIT(ctrTotal, mutCtrTotal);
+		CHKiRet(statsobj.Construct(&stats));
+		CHKiRet(statsobj.SetName(stats, UCHAR_CONSTANT("pipelinetrace")));
+		CHKiRet(statsobj.SetOrigin(stats, UCHAR_CONSTANT("core")));
+		CHKiRet(statsobj.AddCounter(stats, UCHAR_CONSTANT("sampled"),
+			ctrType_IntCtr, CTR_FLAG_RESETTABLE, &ctrSampled));
+		CHKiRet(statsobj.AddCounter(stats, UCHAR_CONSTANT("completed"),
+			ctrType_IntCtr, CTR_FLAG_RESETTABLE, &ctrCompleted));
+		CHKiRet(statsobj.AddCounter(stats, UCHAR_CONSTANT("submit.enq.us"),
+			ctrType_IntCtr, CTR_FLAG_RESETTABLE, &ctrSubmitEnq));
+		CHKiRet(statsobj.AddCounter(stats, UCHAR_CONSTANT("queue.wait.us"),
+			ctrType_IntCtr, CTR_FLAG_RESETTABLE, &ctrQueueWait));
+		CHKiRet(statsobj.AddCounter(stats, UCHAR_CONSTANT("deq.exec.us"),
+			ctrType_IntCtr, CTR_FLAG_RESETTABLE, &ctrDeqExec));
+		CHKiRet(statsobj.AddCounter(stats, UCHAR_CONSTANT("ruleset.exec.us"),
+			ctrType_IntCtr, CTR_FLAG_RESETTABLE, &ctrRulesetExec));
+		CHKiRet(statsobj.AddCounter(stats, UCHAR_CONSTANT("actions"),
+			ctrType_IntCtr, CTR_FLAG_RESETTABLE, &ctrActions));
+		CHKiRet(statsobj.AddCounter(stats, UCHAR_CONSTANT("action.us"),
+			ctrType_IntCtr, CTR_FLAG_RESETTABLE, &ctrActionLatency));
+		CHKiRet(statsobj.AddCounter(stats, UCHAR_CONSTANT("total.us"),
+			ctrType_IntCtr, CTR_FLAG_RESETTABLE, &ctrTotal));
+		CHKiRet(statsobj.ConstructFinalize(stats));
+	}
+
+	/* enable as last step, so that everything is set up when the
+	 * first message is sampled.
+	 */
+	msgtraceSampleRate = sampleRate;
+	DBGPRINTF("msgtrace: pipeline tracing activated, sample rate 1 in %u, file '%s'\n",
+		  msgtraceSampleRate, (pszTraceFile == NULL) ? "(none)" : (char*) pszTraceFile);
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* init function (must be called once) */
+rsRetVal
+msgtraceInit(void)
+{
+	DEFiRet;
+	CHKiRet(objGetObjInterface(&obj));
+	CHKiRet(objUse(errmsg, CORE_COMPONENT));
+	CHKiRet(objUse(statsobj, CORE_COMPONENT));
+	CHKiRet(objUse(prop, CORE_COMPONENT));
+	INIT_ATOMIC_HELPER_MUT(mutSubmitted);
+finalize_it:
+	RETiRet;
+}
+
+/* deinit function (must be called once) */
+void
+msgtraceExit(void)
+{
+	msgtraceSampleRate = 0;
+	if(stats != NULL)
+		statsobj.Destruct(&stats);
+	if(fdTrace != -1) {
+		close(fdTrace);
+		fdTrace = -1;
+	}
+	free(pszTraceFile);
+	pszTraceFile = NULL;
+	objRelease(errmsg, CORE_COMPONENT);
+	objRelease(statsobj, CORE_COMPONENT);
+	objRelease(prop, CORE_COMPONENT);
+}
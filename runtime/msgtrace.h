@@ -0,0 +1,127 @@
+/* header for msgtrace.c - sampled per-message pipeline tracing
+ *
+ * This file is part of the rsyslog runtime library.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef INCLUDED_MSGTRACE_H
+#define INCLUDED_MSGTRACE_H
+
+#include <time.h>
+#include <stdint.h>
+#include "msg.h"
+
+/* the pipeline stages we record. Each one is stamped only once, on
+ * first occurence. So if a message travels through multiple queues
+ * (e.g. a ruleset queue and then an action queue), the "queue" stages
+ * reflect the first one, which is the one that we are interested in.
+ * Action stages are recorded separately, see below.
+ */
+typedef enum msgtraceStage_e {
+	MSGTRACE_SUBMIT = 0,	/* input submitted message to core */
+	MSGTRACE_QENQ = 1,	/* message was added to (main or ruleset) queue */
+	MSGTRACE_QDEQ = 2,	/* message was dequeued by a worker */
+	MSGTRACE_EXEC_BEGIN = 3,/* ruleset execution started */
+	MSGTRACE_EXEC_END = 4,	/* ruleset execution done */
+	MSGTRACE_NSTAGES = 5
+} msgtraceStage_t;
+
+/* action-related events. A message may be processed by many actions,
+ * so we keep a small array of events, each tagged with the action number.
+ */
+#define MSGTRACE_ACT_ENQ 0	/* message submitted to action (queue) */
+#define MSGTRACE_ACT_DONE 1	/* action has processed (committed) message */
+#define MSGTRACE_MAX_ACTEVTS 16	/* max action events we record per message */
+
+struct msgTraceActEvt_s {
+	int iActionNbr;
+	int evtType;
+	uint64_t ts;
+};
+
+struct msgTrace_s {
+	uint64_t ts[MSGTRACE_NSTAGES];	/* monotonic time in microseconds, 0 - not reached */
+	int nActEvts;			/* number of action events claimed (may exceed max!) */
+	struct msgTraceActEvt_s actEvts[MSGTRACE_MAX_ACTEVTS];
+};
+
+/* The sample rate is accessed directly by the hot path, so that we just need a
+ * single compare when tracing is turned off (the default). 0 means off, n means
+ * that every n-th message is traced.
+ */
+extern unsigned msgtraceSampleRate;
+
+/* prototypes */
+rsRetVal msgtraceInit(void);
+void msgtraceExit(void);
+rsRetVal msgtraceActivate(unsigned sampleRate, const uchar *fileName);
+void msgtraceDoSample(msg_t *pMsg);
+void msgtraceDoSampleBatch(msg_t **ppMsgs, int nMsgs);
+void msgtraceFinish(msg_t *pMsg);
+
+
+/* return current monotonic time in microseconds */
+static inline uint64_t
+msgtraceNow(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t) t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+/* decide if a newly submitted message should be traced */
+static inline void
+msgtraceSample(msg_t *const pMsg)
+{
+	if(msgtraceSampleRate)
+		msgtraceDoSample(pMsg);
+}
+
+static inline void
+msgtraceSampleBatch(msg_t **const ppMsgs, const int nMsgs)
+{
+	if(msgtraceSampleRate)
+		msgtraceDoSampleBatch(ppMsgs, nMsgs);
+}
+
+/* record a pipeline stage. Only the first occurence of a stage is recorded.
+ * Note that each stage is written by exactly one thread at a time, because
+ * the message is handed over between threads via the queue mutexes.
+ */
+static inline void
+msgtraceStamp(msg_t *const pMsg, const msgtraceStage_t stage)
+{
+	if(pMsg->pTrace != NULL && pMsg->pTrace->ts[stage] == 0)
+		pMsg->pTrace->ts[stage] = msgtraceNow();
+}
+
+/* record an action event. Multiple action workers may concurrently
+ * work on the same message, so the event slot is claimed atomically.
+ */
+static inline void
+msgtraceActEvt(msg_t *const pMsg, const int actionNbr, const int evtType)
+{
+	int i;
+	if(pMsg->pTrace == NULL)
+		return;
+	i = ATOMIC_INC_AND_FETCH_int(&pMsg->pTrace->nActEvts, &pMsg->mut) - 1;
+	if(i < MSGTRACE_MAX_ACTEVTS) {
+		pMsg->pTrace->actEvts[i].iActionNbr = actionNbr;
+		pMsg->pTrace->actEvts[i].evtType = evtType;
+		pMsg->pTrace->actEvts[i].ts = msgtraceNow();
+	}
+}
+
+#endif /* #ifndef INCLUDED_MSGTRACE_H */
@@ -1211,9 +1211,13 @@ closeUDPListenSockets(int *pSockArr)
  * bIsServer indicates if a server socket should be created
  * 1 - server, 0 - client
  * param rcvbuf indicates desired rcvbuf size; 0 means OS default
+ * if bReusePort is set, SO_REUSEPORT is enabled, so that multiple sockets
+ * can be bound to the same address and port (the kernel then distributes
+ * incoming packets among them).
  */
 static int *
-create_udp_socket(uchar *hostname, uchar *pszPort, int bIsServer, int rcvbuf, int ipfreebind)
+create_udp_socket(uchar *hostname, uchar *pszPort, int bIsServer, int rcvbuf, int ipfreebind,
+	int bReusePort)
 {
         struct addrinfo hints, *res, *r;
         int error, maxs, *s, *socks, on = 1;
@@ -1287,6 +1291,18 @@ create_udp_socket(uchar *hostname, uchar *pszPort, int bIsServer, int rcvbuf, in
 			*s = -1;
 			continue;
 		}
+#		ifdef SO_REUSEPORT
+		if(bReusePort && setsockopt(*s, SOL_SOCKET, SO_REUSEPORT,
+			       (char *) &on, sizeof(on)) < 0 ) {
+			errmsg.LogError(errno, NO_ERRCODE, "setsockopt(REUSEPORT)");
+                        close(*s);
+			*s = -1;
+			continue;
+		}
+#		else
+		if(bReusePort)
+			DBGPRINTF("create_udp_socket: SO_REUSEPORT not supported on this platform\n");
+#		endif
 
 		/* We need to enable BSD compatibility. Otherwise an attacker
 		 * could flood our log files by sending us tons of ICMP errors.
@@ -280,6 +280,32 @@ SetKeepAliveIntvl(netstrm_t *pThis, int keepAliveIntvl)
 	RETiRet;
 }
 
+/* continue a pending protocol handshake (e.g. TLS) - slim wrapper for NSD
+ * driver function. Returns RS_RET_OK once no handshake is pending any
+ * longer and RS_RET_RETRY if more data from the peer is needed.
+ */
+static rsRetVal
+Handshake(netstrm_t *pThis)
+{
+	DEFiRet;
+	ISOBJ_TYPE_assert(pThis, netstrm);
+	iRet = pThis->Drvr.Handshake(pThis->pDrvrData);
+	RETiRet;
+}
+
+/* check if the driver has already read data from the socket that has
+ * not yet been handed to us by Rcv() - slim wrapper for NSD driver function.
+ * The socket does not signal that data as readable again.
+ */
+static rsRetVal
+HasRcvPending(netstrm_t *pThis, int *pbPending)
+{
+	DEFiRet;
+	ISOBJ_TYPE_assert(pThis, netstrm);
+	iRet = pThis->Drvr.HasRcvPending(pThis->pDrvrData, pbPending);
+	RETiRet;
+}
+
 /* check connection - slim wrapper for NSD driver function */
 static rsRetVal
 CheckConnection(netstrm_t *pThis)
@@ -387,6 +413,8 @@ CODESTARTobjQueryInterface(netstrm)
 	pIf->SetKeepAliveProbes = SetKeepAliveProbes;
 	pIf->SetKeepAliveTime = SetKeepAliveTime;
 	pIf->SetKeepAliveIntvl = SetKeepAliveIntvl;
+	pIf->Handshake = Handshake;
+	pIf->HasRcvPending = HasRcvPending;
 finalize_it:
 ENDobjQueryInterface(netstrm)
 
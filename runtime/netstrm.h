@@ -75,13 +75,17 @@ BEGINinterface(netstrm) /* name must also be changed in ENDinterface macro! */
 	rsRetVal (*SetKeepAliveProbes)(netstrm_t *pThis, int keepAliveProbes);
 	rsRetVal (*SetKeepAliveTime)(netstrm_t *pThis, int keepAliveTime);
 	rsRetVal (*SetKeepAliveIntvl)(netstrm_t *pThis, int keepAliveIntvl);
+	/* v8 */
+	rsRetVal (*Handshake)(netstrm_t *pThis);
+	rsRetVal (*HasRcvPending)(netstrm_t *pThis, int *pbPending);
 ENDinterface(netstrm)
-#define netstrmCURR_IF_VERSION 7 /* increment whenever you change the interface structure! */
+#define netstrmCURR_IF_VERSION 8 /* increment whenever you change the interface structure! */
 /* interface version 3 added GetRemAddr()
  * interface version 4 added EnableKeepAlive() -- rgerhards, 2009-06-02
  * interface version 5 changed return of CheckConnection from void to rsRetVal -- alorbach, 2012-09-06
  * interface version 6 changed signature of GetRemoteIP() -- rgerhards, 2013-01-21
  * interface version 7 added KeepAlive parameter set functions
+ * interface version 8 added Handshake() and HasRcvPending()
  * */
 
 /* prototypes */
@@ -83,13 +83,17 @@ BEGINinterface(nsd) /* name must also be changed in ENDinterface macro! */
 	rsRetVal (*SetKeepAliveIntvl)(nsd_t *pThis, int keepAliveIntvl);
 	rsRetVal (*SetKeepAliveProbes)(nsd_t *pThis, int keepAliveProbes);
 	rsRetVal (*SetKeepAliveTime)(nsd_t *pThis, int keepAliveTime);
+	/* v9 */
+	rsRetVal (*Handshake)(nsd_t *pThis);
+	rsRetVal (*HasRcvPending)(nsd_t *pThis, int *pbPending);
 ENDinterface(nsd)
-#define nsdCURR_IF_VERSION 8 /* increment whenever you change the interface structure! */
+#define nsdCURR_IF_VERSION 9 /* increment whenever you change the interface structure! */
 /* interface version 4 added GetRemAddr()
  * interface version 5 added EnableKeepAlive() -- rgerhards, 2009-06-02
  * interface version 6 changed return of CheckConnection from void to rsRetVal -- alorbach, 2012-09-06
  * interface version 7 changed signature ofGetRempoteIP() -- rgerhards, 2013-01-21
  * interface version 8 added keep alive parameter set functions
+ * interface version 9 added Handshake() and HasRcvPending()
  */
 
 /* interface  for the select call */
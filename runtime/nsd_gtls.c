@@ -37,6 +37,20 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <pthread.h>
+#if defined(HAVE_GNUTLS_RECORD_GET_STATE) && defined(HAVE_LINUX_TLS_H)
+#	include <sys/socket.h>
+#	include <netinet/tcp.h>
+#	include <linux/tls.h>
+#	if defined(TLS_RX) && defined(TLS_GET_RECORD_TYPE)
+#		define ENABLE_KTLS 1
+#		ifndef TCP_ULP
+#			define TCP_ULP 31
+#		endif
+#		ifndef SOL_TLS
+#			define SOL_TLS 282
+#		endif
+#	endif
+#endif
 
 #include "rsyslog.h"
 #include "syslogd-types.h"
@@ -46,9 +60,12 @@
 #include "stringbuf.h"
 #include "errmsg.h"
 #include "net.h"
+#include "srUtils.h"
 #include "datetime.h"
+#include "statsobj.h"
 #include "nsd_ptcp.h"
 #include "nsdsel_gtls.h"
+#include "nsdpoll_gtls.h"
 #include "nsd_gtls.h"
 #include "unicode-helper.h"
 
@@ -69,6 +86,7 @@ DEFobjCurrIf(glbl)
 DEFobjCurrIf(net)
 DEFobjCurrIf(datetime)
 DEFobjCurrIf(nsd_ptcp)
+DEFobjCurrIf(statsobj)
 
 static int bGlblSrvrInitDone = 0;	/**< 0 - server global init not yet done, 1 - already done */
 
@@ -86,6 +104,35 @@ static pthread_mutex_t mutGtlsStrerror; /**< a mutex protecting the potentially
 
 /* ------------------------------ GnuTLS specifics ------------------------------ */
 static gnutls_certificate_credentials_t xcred;
+#ifdef HAVE_GNUTLS_SESSION_TICKET_ENABLE_SERVER
+static gnutls_datum_t ticketKey = { NULL, 0 }; /**< key for the session tickets we issue as server */
+#endif
+
+/* As client, we remember the session of the last connection to each peer,
+ * so that a reconnect can resume it instead of doing a full handshake. The
+ * cache is kept in most-recently-used order and is bounded.
+ */
+#define GTLS_SESSCACHE_MAX 256
+typedef struct gtlsSessCacheEntry_s {
+	char *pszPeer;		/**< "host:port" */
+	gnutls_datum_t data;	/**< session data, as provided by GnuTLS */
+	struct gtlsSessCacheEntry_s *pNext;
+} gtlsSessCacheEntry_t;
+static gtlsSessCacheEntry_t *sessCacheRoot = NULL;
+static int sessCacheSize = 0;
+static pthread_mutex_t mutSessCache;
+
+/* handshake statistics */
+static statsobj_t *stats = NULL;
+STATSCOUNTER_DEF(ctrSrvHandshakes, mutCtrSrvHandshakes)
+STATSCOUNTER_DEF(ctrSrvResumed, mutCtrSrvResumed)
+STATSCOUNTER_DEF(ctrClntHandshakes, mutCtrClntHandshakes)
+STATSCOUNTER_DEF(ctrClntResumed, mutCtrClntResumed)
+STATSCOUNTER_DEF(ctrHandshakeFailed, mutCtrHandshakeFailed)
+#ifdef ENABLE_KTLS
+STATSCOUNTER_DEF(ctrKTLSRcv, mutCtrKTLSRcv)	/* sessions whose receive side was handed over to kTLS */
+STATSCOUNTER_DEF(ctrKTLSSend, mutCtrKTLSSend)	/* same for the send side */
+#endif
 
 /* This defines a log function to be provided to GnuTLS. It hopefully
  * helps us track down hard to find problems.
@@ -613,6 +660,10 @@ gtlsGlblInit(void)
 		ABORT_FINALIZE(RS_RET_GNUTLS_ERR);
 	}
 
+#	ifdef HAVE_GNUTLS_SESSION_TICKET_ENABLE_SERVER
+	CHKgnutls(gnutls_session_ticket_key_generate(&ticketKey));
+#	endif
+
 	if(GetGnuTLSLoglevel() > 0){
 		gnutls_global_set_log_function(logFunction);
 		gnutls_global_set_log_level(GetGnuTLSLoglevel()); 
@@ -641,6 +692,11 @@ gtlsInitSession(nsd_gtls_t *pThis)
 	/* request client certificate if any.  */
 	gnutls_certificate_server_set_request( session, GNUTLS_CERT_REQUEST);
 
+#	ifdef HAVE_GNUTLS_SESSION_TICKET_ENABLE_SERVER
+	/* permit reconnecting clients to resume their session */
+	CHKgnutls(gnutls_session_ticket_enable_server(session, &ticketKey));
+#	endif
+
 	pThis->sess = session;
 
 #	if HAVE_GNUTLS_CERTIFICATE_SET_RETRIEVE_FUNCTION 
@@ -1115,7 +1171,22 @@ finalize_it:
 static rsRetVal
 gtlsGlblExit(void)
 {
+	gtlsSessCacheEntry_t *pEntry, *pDel;
 	DEFiRet;
+
+	for(pEntry = sessCacheRoot ; pEntry != NULL ; ) {
+		pDel = pEntry;
+		pEntry = pEntry->pNext;
+		free(pDel->pszPeer);
+		gnutls_free(pDel->data.data);
+		free(pDel);
+	}
+	sessCacheRoot = NULL;
+	sessCacheSize = 0;
+#	ifdef HAVE_GNUTLS_SESSION_TICKET_ENABLE_SERVER
+	gnutls_free(ticketKey.data);
+	ticketKey.data = NULL;
+#	endif
 	/* X509 stuff */
 	gnutls_certificate_free_credentials(xcred);
 	gnutls_global_deinit(); /* we are done... */
@@ -1123,6 +1194,334 @@ gtlsGlblExit(void)
 }
 
 
+/* ------------------------------ kernel TLS (kTLS) support ------------------------------ */
+#ifdef ENABLE_KTLS
+#define KTLS_CONTENTTYPE_ALERT 21
+#define KTLS_CONTENTTYPE_APPDATA 23
+
+/* hand one direction of the session over to the kernel. GnuTLS gives us the
+ * current keys and sequence number, the kernel continues from there.
+ * Returns 0 on success, -1 if the session parameters are not supported by
+ * kTLS or the kernel rejected them.
+ */
+static int
+ktlsSetCryptoInfo(nsd_gtls_t *pThis, const int sock, const int bRcv)
+{
+	gnutls_datum_t macKey, iv, cipherKey;
+	unsigned char seq[8];
+	union {
+		struct tls12_crypto_info_aes_gcm_128 gcm128;
+		struct tls12_crypto_info_aes_gcm_256 gcm256;
+	} ci;
+	socklen_t lenCi;
+	unsigned short version;
+	size_t lenIV;
+
+	switch(gnutls_protocol_get_version(pThis->sess)) {
+	case GNUTLS_TLS1_2:
+		version = TLS_1_2_VERSION;
+		lenIV = 4; /* implicit part of the nonce only */
+		break;
+#	if GNUTLS_VERSION_NUMBER >= 0x030603 && defined(TLS_1_3_VERSION)
+	case GNUTLS_TLS1_3:
+		version = TLS_1_3_VERSION;
+		lenIV = 12;
+		break;
+#	endif
+	default:
+		return -1;
+	}
+
+	if(gnutls_record_get_state(pThis->sess, bRcv, &macKey, &iv, &cipherKey, seq) != 0
+	   || iv.size != lenIV)
+		return -1;
+
+	/* the structures differ in key length only. For TLS 1.2, the explicit
+	 * part of the nonce is the record sequence number (as GnuTLS does it).
+	 */
+#	define KTLS_FILL_CRYPTO_INFO(CI, CIPHER) \
+		if(cipherKey.size != sizeof(CI.key)) \
+			return -1; \
+		CI.info.version = version; \
+		CI.info.cipher_type = CIPHER; \
+		memcpy(CI.salt, iv.data, sizeof(CI.salt)); \
+		if(version == TLS_1_2_VERSION) \
+			memcpy(CI.iv, seq, sizeof(CI.iv)); \
+		else \
+			memcpy(CI.iv, iv.data + sizeof(CI.salt), sizeof(CI.iv)); \
+		memcpy(CI.key, cipherKey.data, sizeof(CI.key)); \
+		memcpy(CI.rec_seq, seq, sizeof(CI.rec_seq)); \
+		lenCi = sizeof(CI)
+
+	memset(&ci, 0, sizeof(ci));
+	switch(gnutls_cipher_get(pThis->sess)) {
+	case GNUTLS_CIPHER_AES_128_GCM:
+		KTLS_FILL_CRYPTO_INFO(ci.gcm128, TLS_CIPHER_AES_GCM_128);
+		break;
+	case GNUTLS_CIPHER_AES_256_GCM:
+		KTLS_FILL_CRYPTO_INFO(ci.gcm256, TLS_CIPHER_AES_GCM_256);
+		break;
+	default:
+		return -1;
+	}
+#	undef KTLS_FILL_CRYPTO_INFO
+
+	return setsockopt(sock, SOL_TLS, bRcv ? TLS_RX : TLS_TX, &ci, lenCi);
+}
+
+
+/* receive data on a session whose receive direction is done by the kernel.
+ * The kernel hands over the content of one record type per call. Anything
+ * but application data cannot be processed without GnuTLS. An alert most
+ * probably is the peer's close_notify, so we treat it as EOS.
+ */
+static rsRetVal
+ktlsRcv(nsd_gtls_t *pThis, uchar *pBuf, ssize_t *pLenBuf)
+{
+	char cbuf[CMSG_SPACE(sizeof(unsigned char))];
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	unsigned char recType;
+	ssize_t lenRcvd;
+	int sock;
+	char errStr[1024];
+	DEFiRet;
+
+	CHKiRet(nsd_ptcp.GetSock(pThis->pTcp, &sock));
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = pBuf;
+	iov.iov_len = *pLenBuf;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cbuf;
+	msg.msg_controllen = sizeof(cbuf);
+
+	lenRcvd = recvmsg(sock, &msg, MSG_DONTWAIT);
+	if(lenRcvd == 0) {
+		ABORT_FINALIZE(RS_RET_CLOSED);
+	} else if(lenRcvd < 0) {
+		if(errno == EAGAIN || errno == EINTR)
+			ABORT_FINALIZE(RS_RET_RETRY);
+		rs_strerror_r(errno, errStr, sizeof(errStr));
+		dbgprintf("error during kTLS recv on NSD %p: %s\n", pThis, errStr);
+		ABORT_FINALIZE(RS_RET_RCV_ERR);
+	}
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	if(cmsg != NULL && cmsg->cmsg_level == SOL_TLS && cmsg->cmsg_type == TLS_GET_RECORD_TYPE) {
+		recType = *((unsigned char*) CMSG_DATA(cmsg));
+		if(recType == KTLS_CONTENTTYPE_ALERT) {
+			ABORT_FINALIZE(RS_RET_CLOSED);
+		} else if(recType != KTLS_CONTENTTYPE_APPDATA) {
+			errmsg.LogError(0, RS_RET_GNUTLS_ERR, "nsd_gtls: peer sent TLS record of type %u, "
+				"which cannot be processed after handover to kernel TLS - closing "
+				"session", recType);
+			ABORT_FINALIZE(RS_RET_GNUTLS_ERR);
+		}
+	}
+	*pLenBuf = lenRcvd;
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* send a close_notify alert on a session whose send direction is done by
+ * the kernel. GnuTLS can no longer do this for us, as its record state is
+ * out of sync with the kernel's. This is best effort only.
+ */
+static void
+ktlsSendCloseNotify(nsd_gtls_t *pThis)
+{
+	char cbuf[CMSG_SPACE(sizeof(unsigned char))];
+	unsigned char alert[2] = { 1, 0 }; /* warning, close_notify */
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	int sock;
+
+	if(nsd_ptcp.GetSock(pThis->pTcp, &sock) != RS_RET_OK)
+		return;
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = alert;
+	iov.iov_len = sizeof(alert);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cbuf;
+	msg.msg_controllen = sizeof(cbuf);
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_TLS;
+	cmsg->cmsg_type = TLS_SET_RECORD_TYPE;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(unsigned char));
+	*((unsigned char*) CMSG_DATA(cmsg)) = KTLS_CONTENTTYPE_ALERT;
+	if(sendmsg(sock, &msg, MSG_DONTWAIT) < 0)
+		dbgprintf("nsd_gtls %p: could not send kTLS close_notify\n", pThis);
+}
+#endif /* #ifdef ENABLE_KTLS */
+
+
+/* Hand an established session over to kernel TLS, if configured
+ * (global "gnutls.ktls") and supported by the negotiated parameters and
+ * the kernel. Each direction is handed over individually. If it is, the
+ * kernel does all record processing for it and we do plain socket i/o
+ * via nsd_ptcp. If not, GnuTLS simply continues to do the job, so failure
+ * is not an error.
+ * Must be called directly after the handshake has completed.
+ */
+static void
+gtlsEnableKTLS(nsd_gtls_t *pThis)
+{
+#ifdef ENABLE_KTLS
+	static int bWarnedULP = 0;
+	char errStr[1024];
+	int sock;
+
+	if(!GetGnuTLSkTLS() || pThis->bKTLSRcv || pThis->bKTLSSend)
+		return;
+
+	/* GnuTLS already decrypted data from the socket, we cannot hand
+	 * over the receive side in that case (rare, as we do this right
+	 * after the handshake).
+	 */
+	if(gnutls_record_check_pending(pThis->sess) > 0 || gtlsHasRcvInBuffer(pThis)) {
+		dbgprintf("nsd_gtls %p: data already buffered, not using kTLS\n", pThis);
+		return;
+	}
+
+	if(nsd_ptcp.GetSock(pThis->pTcp, &sock) != RS_RET_OK)
+		return;
+	if(setsockopt(sock, SOL_TCP, TCP_ULP, "tls", sizeof("tls")) != 0) {
+		if(!bWarnedULP) {
+			bWarnedULP = 1;
+			rs_strerror_r(errno, errStr, sizeof(errStr));
+			errmsg.LogError(0, RS_RET_GNUTLS_ERR, "nsd_gtls: kernel TLS requested but "
+				"not available (is the tls kernel module loaded?): %s - using "
+				"GnuTLS for record processing", errStr);
+		}
+		return;
+	}
+
+	if(ktlsSetCryptoInfo(pThis, sock, 1) == 0) {
+		pThis->bKTLSRcv = 1;
+		STATSCOUNTER_INC(ctrKTLSRcv, mutCtrKTLSRcv);
+	}
+	if(ktlsSetCryptoInfo(pThis, sock, 0) == 0) {
+		pThis->bKTLSSend = 1;
+		STATSCOUNTER_INC(ctrKTLSSend, mutCtrKTLSSend);
+	}
+	dbgprintf("nsd_gtls %p: kTLS receive %s, send %s\n", pThis,
+		pThis->bKTLSRcv ? "on" : "off", pThis->bKTLSSend ? "on" : "off");
+#else
+	(void) pThis; /* kTLS not supported by this build */
+#endif
+}
+
+/* ------------------------------ end kernel TLS (kTLS) support ------------------------------ */
+
+
+/* load the session we remember for a peer (if any) into a new client
+ * session, so that GnuTLS tries to resume it.
+ */
+static void
+gtlsSessCacheLoad(nsd_gtls_t *pThis, const char *const pszPeer)
+{
+	gtlsSessCacheEntry_t *pEntry;
+
+	pthread_mutex_lock(&mutSessCache);
+	for(pEntry = sessCacheRoot ; pEntry != NULL ; pEntry = pEntry->pNext) {
+		if(!strcmp(pEntry->pszPeer, pszPeer)) {
+			gnutls_session_set_data(pThis->sess, pEntry->data.data, pEntry->data.size);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&mutSessCache);
+}
+
+
+/* remember the session of an established client connection. If the cache
+ * is full, the least recently used entry is dropped.
+ */
+static void
+gtlsSessCacheStore(nsd_gtls_t *pThis, const char *const pszPeer)
+{
+	gtlsSessCacheEntry_t *pEntry, *pPrev;
+	gnutls_datum_t data;
+
+	if(gnutls_session_get_data2(pThis->sess, &data) != 0)
+		return;
+
+	pthread_mutex_lock(&mutSessCache);
+	for(pPrev = NULL, pEntry = sessCacheRoot ; pEntry != NULL ; pPrev = pEntry, pEntry = pEntry->pNext) {
+		if(!strcmp(pEntry->pszPeer, pszPeer))
+			break;
+	}
+	if(pEntry != NULL) {
+		/* unlink, it will be re-added at the root */
+		if(pPrev == NULL)
+			sessCacheRoot = pEntry->pNext;
+		else
+			pPrev->pNext = pEntry->pNext;
+		gnutls_free(pEntry->data.data);
+	} else {
+		if((pEntry = calloc(1, sizeof(gtlsSessCacheEntry_t))) == NULL
+		   || (pEntry->pszPeer = strdup(pszPeer)) == NULL) {
+			free(pEntry);
+			gnutls_free(data.data);
+			goto done;
+		}
+		++sessCacheSize;
+	}
+	pEntry->data = data;
+	pEntry->pNext = sessCacheRoot;
+	sessCacheRoot = pEntry;
+
+	if(sessCacheSize > GTLS_SESSCACHE_MAX) {
+		for(pPrev = sessCacheRoot ; pPrev->pNext->pNext != NULL ; pPrev = pPrev->pNext)
+			/* find last entry */;
+		pEntry = pPrev->pNext;
+		pPrev->pNext = NULL;
+		free(pEntry->pszPeer);
+		gnutls_free(pEntry->data.data);
+		free(pEntry);
+		--sessCacheSize;
+	}
+done:
+	pthread_mutex_unlock(&mutSessCache);
+}
+
+
+/* must be called when a handshake has completed successfully (including
+ * the authorization check). Does the accounting and things that can only
+ * be done on an established session.
+ */
+void
+gtlsHandshakeDone(nsd_gtls_t *pThis)
+{
+	const int bResumed = gnutls_session_is_resumed(pThis->sess);
+
+	if(pThis->bIsInitiator) {
+		STATSCOUNTER_INC(ctrClntHandshakes, mutCtrClntHandshakes);
+		if(bResumed)
+			STATSCOUNTER_INC(ctrClntResumed, mutCtrClntResumed);
+	} else {
+		STATSCOUNTER_INC(ctrSrvHandshakes, mutCtrSrvHandshakes);
+		if(bResumed)
+			STATSCOUNTER_INC(ctrSrvResumed, mutCtrSrvResumed);
+	}
+	dbgprintf("nsd_gtls %p: handshake done, session %s\n", pThis, bResumed ? "resumed" : "new");
+	gtlsEnableKTLS(pThis);
+}
+
+
+/* must be called when a handshake failed on the TLS level */
+void
+gtlsHandshakeFailed(void)
+{
+	STATSCOUNTER_INC(ctrHandshakeFailed, mutCtrHandshakeFailed);
+}
+
+
 /* end a GnuTLS session
  * The function checks if we have a session and ends it only if so. So it can
  * always be called, even if there currently is no session.
@@ -1134,7 +1533,13 @@ gtlsEndSess(nsd_gtls_t *pThis)
 	DEFiRet;
 
 	if(pThis->bHaveSess) {
-		if(pThis->bIsInitiator) {
+		if(pThis->bKTLSSend || pThis->bKTLSRcv) {
+			/* GnuTLS' record state is out of sync, so gnutls_bye() must not be used */
+#			ifdef ENABLE_KTLS
+			if(pThis->bIsInitiator && pThis->bKTLSSend)
+				ktlsSendCloseNotify(pThis);
+#			endif
+		} else if(pThis->bIsInitiator) {
 			gnuRet = gnutls_bye(pThis->sess, GNUTLS_SHUT_RDWR);
 			while(gnuRet == GNUTLS_E_INTERRUPTED || gnuRet == GNUTLS_E_AGAIN) {
 				gnuRet = gnutls_bye(pThis->sess, GNUTLS_SHUT_RDWR);
@@ -1462,7 +1867,6 @@ static rsRetVal
 AcceptConnReq(nsd_t *pNsd, nsd_t **ppNew)
 {
 	DEFiRet;
-	int gnuRet;
 	nsd_gtls_t *pNew = NULL;
 	nsd_gtls_t *pThis = (nsd_gtls_t*) pNsd;
 
@@ -1483,24 +1887,13 @@ AcceptConnReq(nsd_t *pNsd, nsd_t **ppNew)
 	pNew->authMode = pThis->authMode;
 	pNew->pPermPeers = pThis->pPermPeers;
 
-	/* we now do the handshake. This is a bit complicated, because we are 
-	 * on non-blocking sockets. Usually, the handshake will not complete
-	 * immediately, so that we need to retry it some time later.
+	/* We do not do the handshake right here. It can not complete before
+	 * the client's hello arrives anyhow, and it is CPU-intense. So we leave
+	 * it to whoever processes the session once the socket becomes readable
+	 * (Handshake(), Rcv() or, in select() mode, nsdsel_gtls). This keeps
+	 * the accepting thread free to service other sessions.
 	 */
-	gnuRet = gnutls_handshake(pNew->sess);
-	if(gnuRet == GNUTLS_E_AGAIN || gnuRet == GNUTLS_E_INTERRUPTED) {
-		pNew->rtryCall = gtlsRtry_handshake;
-		dbgprintf("GnuTLS handshake does not complete immediately - setting to retry (this is OK and normal)\n");
-	} else if(gnuRet == 0) {
-		/* we got a handshake, now check authorization */
-		CHKiRet(gtlsChkPeerAuth(pNew));
-	} else {
-		uchar *pGnuErr = gtlsStrerror(gnuRet);
-		errmsg.LogError(0, RS_RET_TLS_HANDSHAKE_ERR, 
-			"gnutls returned error on handshake: %s\n", pGnuErr);
-		free(pGnuErr);
-		ABORT_FINALIZE(RS_RET_TLS_HANDSHAKE_ERR);
-	}
+	pNew->rtryCall = gtlsRtry_handshake;
 
 	pNew->iMode = 1; /* this session is now in TLS mode! */
 
@@ -1515,6 +1908,78 @@ finalize_it:
 }
 
 
+/* retry a handshake that did not complete in AcceptConnReq(). If the
+ * handshake still needs more data, RS_RET_RETRY is returned and we will be
+ * called again once the socket becomes readable.
+ */
+static rsRetVal
+gtlsRetryHandshake(nsd_gtls_t *pThis)
+{
+	int gnuRet;
+	uchar *pGnuErr;
+	DEFiRet;
+
+	gnuRet = gnutls_handshake(pThis->sess);
+	if(gnuRet == GNUTLS_E_AGAIN || gnuRet == GNUTLS_E_INTERRUPTED) {
+		ABORT_FINALIZE(RS_RET_RETRY);
+	} else if(gnuRet != 0) {
+		pThis->rtryCall = gtlsRtry_None;
+		gtlsHandshakeFailed();
+		pGnuErr = gtlsStrerror(gnuRet);
+		errmsg.LogError(0, RS_RET_TLS_HANDSHAKE_ERR,
+			"gnutls returned error on handshake: %s\n", pGnuErr);
+		free(pGnuErr);
+		ABORT_FINALIZE(RS_RET_TLS_HANDSHAKE_ERR);
+	}
+	pThis->rtryCall = gtlsRtry_None;
+	/* we got a handshake, now check authorization */
+	CHKiRet(gtlsChkPeerAuth(pThis));
+	gtlsHandshakeDone(pThis);
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* continue a pending handshake. This permits the upper layer to do the
+ * (CPU-intense) handshake on a thread of its choice, before the session
+ * takes part in regular data processing.
+ */
+static rsRetVal
+Handshake(nsd_t *pNsd)
+{
+	nsd_gtls_t *pThis = (nsd_gtls_t*) pNsd;
+	DEFiRet;
+	ISOBJ_TYPE_assert(pThis, nsd_gtls);
+
+	if(pThis->bAbortConn)
+		ABORT_FINALIZE(RS_RET_CONNECTION_ABORTREQ);
+	if(pThis->iMode == 1 && pThis->rtryCall == gtlsRtry_handshake)
+		CHKiRet(gtlsRetryHandshake(pThis));
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* check if there is received data that Rcv() has not yet handed over.
+ * This is the case if our receive buffer is not exhausted or GnuTLS has
+ * already decrypted more data (e.g. a record larger than our buffer, or
+ * application data read along with the handshake). The socket does not
+ * signal this data as readable again, so the caller must not wait for it.
+ */
+static rsRetVal
+HasRcvPending(nsd_t *pNsd, int *pbPending)
+{
+	nsd_gtls_t *pThis = (nsd_gtls_t*) pNsd;
+	ISOBJ_TYPE_assert(pThis, nsd_gtls);
+
+	*pbPending = pThis->iMode == 1
+		&& (gtlsHasRcvInBuffer(pThis) || gnutls_record_check_pending(pThis->sess) > 0);
+	return RS_RET_OK;
+}
+
+
 /* receive data from a tcp socket
  * The lenBuf parameter must contain the max buffer size on entry and contains
  * the number of octets read on exit. This function
@@ -1542,6 +2007,7 @@ Rcv(nsd_t *pNsd, uchar *pBuf, ssize_t *pLenBuf)
 {
 	DEFiRet;
 	ssize_t iBytesCopy; /* how many bytes are to be copied to the client buffer? */
+	ssize_t iCopied;
 	nsd_gtls_t *pThis = (nsd_gtls_t*) pNsd;
 	ISOBJ_TYPE_assert(pThis, nsd_gtls);
 
@@ -1555,6 +2021,20 @@ Rcv(nsd_t *pNsd, uchar *pBuf, ssize_t *pLenBuf)
 
 	/* --- in TLS mode now --- */
 
+	/* In select() mode, nsdsel_gtls finishes pending handshakes before we
+	 * are called. The epoll() driver does not, so we need to do it here.
+	 */
+	if(pThis->rtryCall == gtlsRtry_handshake) {
+		CHKiRet(gtlsRetryHandshake(pThis));
+	}
+
+#	ifdef ENABLE_KTLS
+	if(pThis->bKTLSRcv) {
+		CHKiRet(ktlsRcv(pThis, pBuf, pLenBuf));
+		FINALIZE;
+	}
+#	endif
+
 	/* Buffer logic applies only if we are in TLS mode. Here we 
 	 * assume that we will switch from plain to TLS, but never back. This
 	 * assumption may be unsafe, but it is the model for the time being and I
@@ -1590,7 +2070,27 @@ Rcv(nsd_t *pNsd, uchar *pBuf, ssize_t *pLenBuf)
 
 	memcpy(pBuf, pThis->pszRcvBuf + pThis->ptrRcvBuf, iBytesCopy);
 	pThis->ptrRcvBuf += iBytesCopy;
-	*pLenBuf = iBytesCopy;
+	iCopied = iBytesCopy;
+
+	/* GnuTLS may already have decrypted further data. The socket will not
+	 * signal it again, so we hand it over right now, as long as the caller's
+	 * buffer has room. Whatever does not fit is reported by HasRcvPending().
+	 */
+	while(pThis->lenRcvBuf == -1 && iCopied < *pLenBuf
+	      && gnutls_record_check_pending(pThis->sess) > 0) {
+		if(gtlsRecordRecv(pThis) != RS_RET_OK || pThis->lenRcvBuf == 0)
+			break; /* let the next call handle it */
+		iBytesCopy = pThis->lenRcvBuf;
+		if(iBytesCopy > *pLenBuf - iCopied) {
+			iBytesCopy = *pLenBuf - iCopied;
+		} else {
+			pThis->lenRcvBuf = -1;
+		}
+		memcpy(pBuf + iCopied, pThis->pszRcvBuf, iBytesCopy);
+		pThis->ptrRcvBuf = iBytesCopy;
+		iCopied += iBytesCopy;
+	}
+	*pLenBuf = iCopied;
 
 finalize_it:
 	if (iRet != RS_RET_OK && 
@@ -1630,6 +2130,12 @@ Send(nsd_t *pNsd, uchar *pBuf, ssize_t *pLenBuf)
 	}
 
 	/* in TLS mode now */
+	if(pThis->bKTLSSend) {
+		/* the kernel builds the records for us */
+		CHKiRet(nsd_ptcp.Send(pThis->pTcp, pBuf, pLenBuf));
+		FINALIZE;
+	}
+
 	while(1) { /* loop broken inside */
 		iSent = gnutls_record_send(pThis->sess, pBuf, *pLenBuf);
 		if(iSent >= 0) {
@@ -1674,6 +2180,7 @@ Connect(nsd_t *pNsd, int family, uchar *port, uchar *host)
 	nsd_gtls_t *pThis = (nsd_gtls_t*) pNsd;
 	int sock;
 	int gnuRet;
+	char szPeer[1024];
 #	ifdef HAVE_GNUTLS_CERTIFICATE_TYPE_SET_PRIORITY
 	static const int cert_type_priority[2] = { GNUTLS_CRT_X509, 0 };
 #	endif
@@ -1740,8 +2247,14 @@ Connect(nsd_t *pNsd, int family, uchar *port, uchar *host)
 	 */
 	CHKmalloc(pThis->pszConnectHost = (uchar*)strdup((char*)host));
 
+	/* try to resume the last session we had with this peer */
+	snprintf(szPeer, sizeof(szPeer), "%s:%s", (char*) host, (char*) port);
+	gtlsSessCacheLoad(pThis, szPeer);
+
 	/* and perform the handshake */
-	CHKgnutls(gnutls_handshake(pThis->sess));
+	if((gnuRet = gnutls_handshake(pThis->sess)) != 0)
+		gtlsHandshakeFailed();
+	CHKgnutls(gnuRet);
 	dbgprintf("GnuTLS handshake succeeded\n");
 
 	/* now check if the remote peer is permitted to talk to us - ideally, we 
@@ -1749,6 +2262,8 @@ Connect(nsd_t *pNsd, int family, uchar *port, uchar *host)
 	 * the necessary callbacks -- rgerhards, 2008-05-26
 	 */
 	CHKiRet(gtlsChkPeerAuth(pThis));
+	gtlsSessCacheStore(pThis, szPeer);
+	gtlsHandshakeDone(pThis);
 
 finalize_it:
 	if(iRet != RS_RET_OK) {
@@ -1795,6 +2310,8 @@ CODESTARTobjQueryInterface(nsd_gtls)
 	pIf->SetKeepAliveIntvl = SetKeepAliveIntvl;
 	pIf->SetKeepAliveProbes = SetKeepAliveProbes;
 	pIf->SetKeepAliveTime = SetKeepAliveTime;
+	pIf->Handshake = Handshake;
+	pIf->HasRcvPending = HasRcvPending;
 finalize_it:
 ENDobjQueryInterface(nsd_gtls)
 
@@ -1803,13 +2320,17 @@ ENDobjQueryInterface(nsd_gtls)
  */
 BEGINObjClassExit(nsd_gtls, OBJ_IS_LOADABLE_MODULE) /* CHANGE class also in END MACRO! */
 CODESTARTObjClassExit(nsd_gtls)
+	if(stats != NULL)
+		statsobj.Destruct(&stats);
 	gtlsGlblExit();	/* shut down GnuTLS */
+	pthread_mutex_destroy(&mutSessCache);
 
 	/* release objects we no longer need */
 	objRelease(nsd_ptcp, LM_NSD_PTCP_FILENAME);
 	objRelease(net, LM_NET_FILENAME);
 	objRelease(glbl, CORE_COMPONENT);
 	objRelease(datetime, CORE_COMPONENT);
+	objRelease(statsobj, CORE_COMPONENT);
 	objRelease(errmsg, CORE_COMPONENT);
 ENDObjClassExit(nsd_gtls)
 
@@ -1825,9 +2346,41 @@ BEGINObjClassInit(nsd_gtls, 1, OBJ_IS_LOADABLE_MODULE) /* class, version */
 	CHKiRet(objUse(glbl, CORE_COMPONENT));
 	CHKiRet(objUse(net, LM_NET_FILENAME));
 	CHKiRet(objUse(nsd_ptcp, LM_NSD_PTCP_FILENAME));
+	CHKiRet(objUse(statsobj, CORE_COMPONENT));
 
 	/* now do global TLS init stuff */
+	pthread_mutex_init(&mutSessCache, NULL);
 	CHKiRet(gtlsGlblInit());
+
+	/* handshake statistics. The resumption ratio is resumed/handshakes. */
+	STATSCOUNTER_INIT(ctrSrvHandshakes, mutCtrSrvHandshakes);
+	STATSCOUNTER_INIT(ctrSrvResumed, mutCtrSrvResumed);
+	STATSCOUNTER_INIT(ctrClntHandshakes, mutCtrClntHandshakes);
+	STATSCOUNTER_INIT(ctrClntResumed, mutCtrClntResumed);
+	STATSCOUNTER_INIT(ctrHandshakeFailed, mutCtrHandshakeFailed);
+	CHKiRet(statsobj.Construct(&stats));
+	CHKiRet(statsobj.SetName(stats, UCHAR_CONSTANT("nsd_gtls")));
+	CHKiRet(statsobj.SetOrigin(stats, UCHAR_CONSTANT("nsd_gtls")));
+	CHKiRet(statsobj.AddCounter(stats, UCHAR_CONSTANT("server.handshakes"),
+		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &ctrSrvHandshakes));
+	CHKiRet(statsobj.AddCounter(stats, UCHAR_CONSTANT("server.resumed"),
+		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &ctrSrvResumed));
+	CHKiRet(statsobj.AddCounter(stats, UCHAR_CONSTANT("client.handshakes"),
+		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &ctrClntHandshakes));
+	CHKiRet(statsobj.AddCounter(stats, UCHAR_CONSTANT("client.resumed"),
+		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &ctrClntResumed));
+	CHKiRet(statsobj.AddCounter(stats, UCHAR_CONSTANT("handshakes.failed"),
+		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &ctrHandshakeFailed));
+#	ifdef ENABLE_KTLS
+	/* sessions handed over to kernel TLS, only present if kTLS is supported */
+	STATSCOUNTER_INIT(ctrKTLSRcv, mutCtrKTLSRcv);
+	STATSCOUNTER_INIT(ctrKTLSSend, mutCtrKTLSSend);
+	CHKiRet(statsobj.AddCounter(stats, UCHAR_CONSTANT("ktls.rx"),
+		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &ctrKTLSRcv));
+	CHKiRet(statsobj.AddCounter(stats, UCHAR_CONSTANT("ktls.tx"),
+		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &ctrKTLSSend));
+#	endif
+	CHKiRet(statsobj.ConstructFinalize(stats));
 ENDObjClassInit(nsd_gtls)
 
 
@@ -1836,6 +2389,9 @@ ENDObjClassInit(nsd_gtls)
 
 BEGINmodExit
 CODESTARTmodExit
+#	ifdef HAVE_EPOLL_CREATE /* module only available if epoll() is supported! */
+	nsdpoll_gtlsClassExit();
+#	endif
 	nsdsel_gtlsClassExit();
 	nsd_gtlsClassExit();
 	pthread_mutex_destroy(&mutGtlsStrerror);
@@ -1855,6 +2411,9 @@ CODESTARTmodInit
 	/* Initialize all classes that are in our module - this includes ourselfs */
 	CHKiRet(nsd_gtlsClassInit(pModInfo)); /* must be done after tcps_sess, as we use it */
 	CHKiRet(nsdsel_gtlsClassInit(pModInfo)); /* must be done after tcps_sess, as we use it */
+#	ifdef HAVE_EPOLL_CREATE /* module only available if epoll() is supported! */
+	CHKiRet(nsdpoll_gtlsClassInit(pModInfo));
+#	endif
 
 	pthread_mutex_init(&mutGtlsStrerror, NULL);
 ENDmodInit
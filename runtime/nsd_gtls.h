@@ -63,6 +63,8 @@ struct nsd_gtls_s {
 	char *pszRcvBuf;
 	int lenRcvBuf;		/**< -1: empty, 0: connection closed, 1..NSD_GTLS_MAX_RCVBUF-1: data of that size present */
 	int ptrRcvBuf;		/**< offset for next recv operation if 0 < lenRcvBuf < NSD_GTLS_MAX_RCVBUF */
+	sbool bKTLSRcv;		/**< receive direction was handed over to kernel TLS */
+	sbool bKTLSSend;	/**< send direction was handed over to kernel TLS */
 };
 
 /* interface is defined in nsd.h, we just implement it! */
@@ -74,6 +76,8 @@ PROTOTYPEObj(nsd_gtls);
 uchar *gtlsStrerror(int error);
 rsRetVal gtlsChkPeerAuth(nsd_gtls_t *pThis);
 rsRetVal gtlsRecordRecv(nsd_gtls_t *pThis);
+void gtlsHandshakeDone(nsd_gtls_t *pThis);
+void gtlsHandshakeFailed(void);
 static inline rsRetVal gtlsHasRcvInBuffer(nsd_gtls_t *pThis) {
 	/* we have a valid receive buffer one such is allocated and 
 	 * NOT exhausted!
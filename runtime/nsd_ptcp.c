@@ -769,6 +769,27 @@ finalize_it:
 }
 
 
+/* continue a pending handshake. Plain tcp does not have any, so there
+ * is nothing to do.
+ */
+static rsRetVal
+Handshake(nsd_t __attribute__((unused)) *pNsd)
+{
+	return RS_RET_OK;
+}
+
+
+/* check for received data not yet handed to the caller. We do not
+ * buffer anything, so there never is any.
+ */
+static rsRetVal
+HasRcvPending(nsd_t __attribute__((unused)) *pNsd, int *pbPending)
+{
+	*pbPending = 0;
+	return RS_RET_OK;
+}
+
+
 /* This function checks if the connection is still alive - well, kind of... It
  * is primarily being used for plain TCP syslog and it is quite a hack. However,
  * as it seems to work, it is worth supporting it. The bottom line is that it
@@ -848,6 +869,8 @@ CODESTARTobjQueryInterface(nsd_ptcp)
 	pIf->SetKeepAliveIntvl = SetKeepAliveIntvl;
 	pIf->SetKeepAliveProbes = SetKeepAliveProbes;
 	pIf->SetKeepAliveTime = SetKeepAliveTime;
+	pIf->Handshake = Handshake;
+	pIf->HasRcvPending = HasRcvPending;
 finalize_it:
 ENDobjQueryInterface(nsd_ptcp)
 
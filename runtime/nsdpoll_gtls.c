@@ -0,0 +1,145 @@
+/* nsdpoll_gtls.c
+ *
+ * An implementation of the nsd epoll() interface for GnuTLS.
+ * All socket handling is done by the aggregated ptcp poll driver. The
+ * TLS-specific work (handshake retries) is handled inside nsd_gtls' Rcv(),
+ * which the upper layer calls as soon as the socket is readable. Data that
+ * GnuTLS has already read from the socket is not signalled by epoll. So
+ * the upper layer must keep calling Rcv() as long as the driver's
+ * HasRcvPending() reports such data, as tcpsrv's doReceive() does.
+ *
+ * This file is part of the rsyslog runtime library.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "config.h"
+
+#ifdef HAVE_EPOLL_CREATE /* this module requires epoll! */
+
+#include <stdlib.h>
+#include <assert.h>
+#include <gnutls/gnutls.h>
+
+#include "rsyslog.h"
+#include "module-template.h"
+#include "obj.h"
+#include "nsd.h"
+#include "nsd_gtls.h"
+#include "nsd_ptcp.h"
+#include "nsdpoll_ptcp.h"
+#include "nsdpoll_gtls.h"
+
+/* static data */
+DEFobjStaticHelpers
+DEFobjCurrIf(glbl)
+DEFobjCurrIf(nsdpoll_ptcp)
+
+
+/* Standard-Constructor
+ */
+BEGINobjConstruct(nsdpoll_gtls) /* be sure to specify the object type also in END macro! */
+	iRet = nsdpoll_ptcp.Construct(&pThis->pTcp);
+ENDobjConstruct(nsdpoll_gtls)
+
+
+/* destructor for the nsdpoll_gtls object */
+BEGINobjDestruct(nsdpoll_gtls) /* be sure to specify the object type also in END and CODESTART macros! */
+CODESTARTobjDestruct(nsdpoll_gtls)
+	if(pThis->pTcp != NULL)
+		nsdpoll_ptcp.Destruct(&pThis->pTcp);
+ENDobjDestruct(nsdpoll_gtls)
+
+
+/* Modify socket set. We hand the plain tcp driver down to ptcp, which
+ * does the actual epoll_ctl() call.
+ */
+static rsRetVal
+Ctl(nsdpoll_t *pNsdpoll, nsd_t *pNsd, int id, void *pUsr, int mode, int op)
+{
+	nsdpoll_gtls_t *pThis = (nsdpoll_gtls_t*) pNsdpoll;
+	nsd_gtls_t *pNsdGTLS = (nsd_gtls_t*) pNsd;
+	DEFiRet;
+
+	ISOBJ_TYPE_assert(pThis, nsdpoll_gtls);
+	ISOBJ_TYPE_assert(pNsdGTLS, nsd_gtls);
+	iRet = nsdpoll_ptcp.Ctl(pThis->pTcp, pNsdGTLS->pTcp, id, pUsr, mode, op);
+	RETiRet;
+}
+
+
+/* Wait for io to become ready. This is purely a socket operation, so
+ * ptcp does it for us.
+ */
+static rsRetVal
+Wait(nsdpoll_t *pNsdpoll, int timeout, int *numEntries, nsd_epworkset_t workset[])
+{
+	nsdpoll_gtls_t *pThis = (nsdpoll_gtls_t*) pNsdpoll;
+	DEFiRet;
+
+	ISOBJ_TYPE_assert(pThis, nsdpoll_gtls);
+	assert(workset != NULL);
+	iRet = nsdpoll_ptcp.Wait(pThis->pTcp, timeout, numEntries, workset);
+	RETiRet;
+}
+
+
+/* ------------------------------ end support for the epoll() interface ------------------------------ */
+
+
+/* queryInterface function
+ */
+BEGINobjQueryInterface(nsdpoll_gtls)
+CODESTARTobjQueryInterface(nsdpoll_gtls)
+	if(pIf->ifVersion != nsdCURR_IF_VERSION) {/* check for current version, increment on each change */
+		ABORT_FINALIZE(RS_RET_INTERFACE_NOT_SUPPORTED);
+	}
+
+	/* ok, we have the right interface, so let's fill it
+	 * Please note that we may also do some backwards-compatibility
+	 * work here (if we can support an older interface version - that,
+	 * of course, also affects the "if" above).
+	 */
+	pIf->Construct = (rsRetVal(*)(nsdpoll_t**)) nsdpoll_gtlsConstruct;
+	pIf->Destruct = (rsRetVal(*)(nsdpoll_t**)) nsdpoll_gtlsDestruct;
+	pIf->Ctl = Ctl;
+	pIf->Wait = Wait;
+finalize_it:
+ENDobjQueryInterface(nsdpoll_gtls)
+
+
+/* exit our class
+ */
+BEGINObjClassExit(nsdpoll_gtls, OBJ_IS_CORE_MODULE) /* CHANGE class also in END MACRO! */
+CODESTARTObjClassExit(nsdpoll_gtls)
+	/* release objects we no longer need */
+	objRelease(glbl, CORE_COMPONENT);
+	objRelease(nsdpoll_ptcp, LM_NSD_PTCP_FILENAME);
+ENDObjClassExit(nsdpoll_gtls)
+
+
+/* Initialize the nsdpoll_gtls class. Must be called as the very first method
+ * before anything else is called inside this class.
+ */
+BEGINObjClassInit(nsdpoll_gtls, 1, OBJ_IS_CORE_MODULE) /* class, version */
+	/* request objects we use */
+	CHKiRet(objUse(glbl, CORE_COMPONENT));
+	CHKiRet(objUse(nsdpoll_ptcp, LM_NSD_PTCP_FILENAME));
+
+	/* set our own handlers */
+ENDObjClassInit(nsdpoll_gtls)
+#endif /* #ifdef HAVE_EPOLL_CREATE this module requires epoll! */
+
+/* vi:set ai:
+ */
@@ -144,6 +144,9 @@ doRetry(nsd_gtls_t *pNsd)
 				pNsd->rtryCall = gtlsRtry_None; /* we are done */
 				/* we got a handshake, now check authorization */
 				CHKiRet(gtlsChkPeerAuth(pNsd));
+				gtlsHandshakeDone(pNsd);
+			} else if(gnuRet != GNUTLS_E_AGAIN && gnuRet != GNUTLS_E_INTERRUPTED) {
+				gtlsHandshakeFailed();
 			}
 			break;
 		case gtlsRtry_recv:
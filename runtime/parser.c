@@ -29,7 +29,14 @@
 #include <ctype.h>
 #include <string.h>
 #include <assert.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
 #include <zlib.h>
+#if defined(__SSE2__) || defined(__AVX2__)
+#	include <immintrin.h>
+#endif
 
 #include "rsyslog.h"
 #include "dirty.h"
@@ -42,6 +49,8 @@
 #include "unicode-helper.h"
 #include "dirty.h"
 #include "cfsysline.h"
+#include "prop.h"
+#include "statsobj.h"
 
 /* some defines */
 #define DEFUPRI		(LOG_USER|LOG_NOTICE)
@@ -52,6 +61,7 @@ DEFobjCurrIf(glbl)
 DEFobjCurrIf(errmsg)
 DEFobjCurrIf(datetime)
 DEFobjCurrIf(ruleset)
+DEFobjCurrIf(statsobj)
 
 /* static data */
 
@@ -69,6 +79,39 @@ parserList_t *pParsLstRoot = NULL;
  */
 parserList_t *pDfltParsLst = NULL;
 
+/* The adaptive parser memo. For each (input name, sender) pair, we remember
+ * which parser of the chain successfully parsed the last message. The next
+ * message from that pair is offered to this parser first, so that mixed-format
+ * inputs do not need to run all the failing parsers in front of it. This is
+ * based on the assumption that a given sender always uses the same format.
+ * If that does not hold, and the memorized parser also accepts the other
+ * format (as pmrfc3164 does), the result is different from what the full
+ * chain would have produced. So this must be explicitely enabled via the
+ * "parser.adaptive" global parameter. Every "parser.adaptive.revalidate"
+ * hits, a message is run through the full chain to re-check the memo.
+ *
+ * The memo is a fixed-size direct-mapped table; on collision, the older
+ * entry is simply overwritten. Locking is done via a set of mutexes, each
+ * of which guards a range of entries.
+ */
+#define PARSER_MEMO_SIZE 4096	/* must be a multiple of PARSER_MEMO_NMUT */
+#define PARSER_MEMO_NMUT 64
+typedef struct parserMemo_s {
+	uint64_t key;		/* hash of input name and sender, 0 - unused */
+	parserList_t *pList;	/* chain the memo applies to */
+	parserList_t *pNode;	/* node of the parser that succeeded last */
+	unsigned nHits;		/* hits since last validation */
+} parserMemo_t;
+static parserMemo_t *parserMemo = NULL;	/* NULL - adaptive mode off */
+static pthread_mutex_t mutParserMemo[PARSER_MEMO_NMUT];
+static unsigned parserMemoRevalidate = 0;
+
+static statsobj_t *stats = NULL;
+STATSCOUNTER_DEF(ctrMsgs, mutCtrMsgs)
+STATSCOUNTER_DEF(ctrAttempts, mutCtrAttempts)
+STATSCOUNTER_DEF(ctrMemoHits, mutCtrMemoHits)
+STATSCOUNTER_DEF(ctrMemoMisses, mutCtrMemoMisses)
+
 
 /* intialize (but NOT allocate) a parser list. Primarily meant as a hook
  * which can be used to extend the list in the future. So far, just sets
@@ -362,6 +405,64 @@ finalize_it:
 }
 
 
+/* find the first character in a buffer that may need sanitation, that is
+ * a control character (< 32) or, if b8Bit is set, a character > 127. Returns
+ * the offset of that character or len if there is none. The vast majority
+ * of messages is clean, so we use SIMD instructions where available to
+ * prove that in a few instructions per 16 or 32 bytes. We use whatever
+ * the compiler is told to support: AVX2 if built with -mavx2, else SSE2,
+ * which is always present on x86-64. Other platforms use a word-at-a-time
+ * scan.
+ */
+static inline size_t
+findCharToSanitize(const uchar *const buf, const size_t len, const int b8Bit)
+{
+	size_t i = 0;
+#if defined(__AVX2__)
+	const __m256i ctlMax32 = _mm256_set1_epi8(31);
+	for( ; i + 32 <= len ; i += 32) {
+		const __m256i v = _mm256_loadu_si256((const __m256i*) (buf + i));
+		/* unsigned v <= 31 <=> min(v, 31) == v */
+		unsigned mask = (unsigned) _mm256_movemask_epi8(
+				_mm256_cmpeq_epi8(_mm256_min_epu8(v, ctlMax32), v));
+		if(b8Bit)
+			mask |= (unsigned) _mm256_movemask_epi8(v);
+		if(mask)
+			return i + __builtin_ctz(mask);
+	}
+#endif
+#if defined(__SSE2__)
+	const __m128i ctlMax = _mm_set1_epi8(31);
+	for( ; i + 16 <= len ; i += 16) {
+		const __m128i v = _mm_loadu_si128((const __m128i*) (buf + i));
+		unsigned mask = (unsigned) _mm_movemask_epi8(
+				_mm_cmpeq_epi8(_mm_min_epu8(v, ctlMax), v));
+		if(b8Bit)
+			mask |= (unsigned) _mm_movemask_epi8(v);
+		if(mask)
+			return i + __builtin_ctz(mask);
+	}
+#else
+	/* SWAR: a byte is < 32 if subtracting 32 sets its high bit while
+	 * it was not set before. The high bit alone flags bytes > 127.
+	 */
+	const uint64_t ones = 0x0101010101010101ull;
+	const uint64_t highs = 0x8080808080808080ull;
+	for( ; i + 8 <= len ; i += 8) {
+		uint64_t w;
+		memcpy(&w, buf + i, 8);
+		if((((w - 32 * ones) & ~w) | (b8Bit ? w : 0)) & highs)
+			break; /* locate exact position below */
+	}
+#endif
+	for( ; i < len ; ++i) {
+		if(buf[i] < 32 || (b8Bit && buf[i] > 127))
+			return i;
+	}
+	return len;
+}
+
+
 /* sanitize a received message
  * if a message gets to large during sanitization, it is truncated. This is
  * as specified in the upcoming syslog RFC series.
@@ -385,11 +486,19 @@ SanitizeMsg(msg_t *pMsg)
 	size_t lenMsg;
 	size_t iSrc;
 	size_t iDst;
+	size_t iFirst;
 	size_t iMaxLine;
 	size_t maxDest;
+	size_t lenClean;
 	uchar pc;
 	sbool bUpdatedLen = RSFALSE;
 	uchar szSanBuf[32*1024]; /* buffer used for sanitizing a string */
+	/* the config settings are needed per character, so we query them once */
+	const int bSpaceLF = glbl.GetParserSpaceLFOnReceive();
+	const int bEscapeCC = glbl.GetParserEscapeControlCharactersOnReceive();
+	const int bEscape8Bit = glbl.GetParserEscape8BitCharactersOnReceive();
+	const int bEscapeTab = glbl.GetParserEscapeControlCharacterTab();
+	const int bCStyle = glbl.GetParserEscapeControlCharactersCStyle();
 
 	assert(pMsg != NULL);
 	assert(pMsg->iLenRawMsg > 0);
@@ -429,22 +538,33 @@ SanitizeMsg(msg_t *pMsg)
 	 * like to pay the performance penalty. So the penalty is only with those
 	 * that actually use it, because we may call the sanitizer without actual
 	 * need below (but it then still will work perfectly well!). -- rgerhards, 2009-11-27
+	 * The sweep skips clean runs via findCharToSanitize(). If LFs are to be
+	 * replaced by spaces, we need to continue after the first character
+	 * needing sanitation, so we remember where that was in iFirst.
 	 */
 	int bNeedSanitize = 0;
-	for(iSrc = 0 ; iSrc < lenMsg ; iSrc++) {
+	iFirst = 0;
+	for(iSrc = findCharToSanitize(pszMsg, lenMsg, bEscape8Bit)
+	    ; iSrc < lenMsg
+	    ; iSrc += findCharToSanitize(pszMsg + iSrc, lenMsg - iSrc, bEscape8Bit)) {
 		if(pszMsg[iSrc] < 32) {
-			if(glbl.GetParserSpaceLFOnReceive() && pszMsg[iSrc] == '\n') {
+			if(bSpaceLF && pszMsg[iSrc] == '\n') {
 				pszMsg[iSrc] = ' ';
-			} else if(pszMsg[iSrc] == '\0' || glbl.GetParserEscapeControlCharactersOnReceive()) {
+			} else if(pszMsg[iSrc] == '\0' || bEscapeCC) {
+				if(!bNeedSanitize)
+					iFirst = iSrc;
 				bNeedSanitize = 1;
-				if (!glbl.GetParserSpaceLFOnReceive()) {
+				if (!bSpaceLF) {
 					break;
 			    }
 			}
-		} else if(pszMsg[iSrc] > 127 && glbl.GetParserEscape8BitCharactersOnReceive()) {
+		} else { /* > 127, only reported if 8-bit chars are to be escaped */
+			if(!bNeedSanitize)
+				iFirst = iSrc;
 			bNeedSanitize = 1;
 			break;
 		}
+		++iSrc;
 	}
 
 	if(!bNeedSanitize) {
@@ -453,8 +573,8 @@ SanitizeMsg(msg_t *pMsg)
 		FINALIZE;
 	}
 
-	/* now copy over the message and sanitize it. Note that up to iSrc-1 there was
-	 * obviously no need to sanitize, so we can go over that quickly...
+	/* now copy over the message and sanitize it. Note that up to iFirst there
+	 * was obviously no need to sanitize, so we can go over that quickly...
 	 */
 	iMaxLine = glbl.GetMaxLine();
 	maxDest = lenMsg * 4; /* message can grow at most four-fold */
@@ -465,22 +585,32 @@ SanitizeMsg(msg_t *pMsg)
 		pDst = szSanBuf;
 	else 
 		CHKmalloc(pDst = MALLOC(iMaxLine + 1));
-	if(iSrc > 0) {
-		iSrc--; /* go back to where everything is OK */
-		memcpy(pDst, pszMsg, iSrc); /* fast copy known good */
-	}
+	iSrc = iFirst;
+	if(iSrc > maxDest - 3)
+		iSrc = maxDest - 3; /* same truncation as in the loop below */
+	memcpy(pDst, pszMsg, iSrc); /* fast copy known good */
 	iDst = iSrc;
 	while(iSrc < lenMsg && iDst < maxDest - 3) { /* leave some space if last char must be escaped */
-		if((pszMsg[iSrc] < 32) && (pszMsg[iSrc] != '\t' || glbl.GetParserEscapeControlCharacterTab())) {
+		/* copy clean runs in one go */
+		lenClean = findCharToSanitize(pszMsg + iSrc, lenMsg - iSrc, bEscape8Bit);
+		if(lenClean > 0) {
+			if(lenClean > maxDest - 3 - iDst)
+				lenClean = maxDest - 3 - iDst;
+			memcpy(pDst + iDst, pszMsg + iSrc, lenClean);
+			iSrc += lenClean;
+			iDst += lenClean;
+			continue;
+		}
+		if((pszMsg[iSrc] < 32) && (pszMsg[iSrc] != '\t' || bEscapeTab)) {
 			/* note: \0 must always be escaped, the rest of the code currently
 			 * can not handle it! -- rgerhards, 2009-08-26
 			 */
-			if(pszMsg[iSrc] == '\0' || glbl.GetParserEscapeControlCharactersOnReceive()) {
+			if(pszMsg[iSrc] == '\0' || bEscapeCC) {
 				/* we are configured to escape control characters. Please note
 				 * that this most probably break non-western character sets like
 				 * Japanese, Korean or Chinese. rgerhards, 2007-07-17
 				 */
-				if (glbl.GetParserEscapeControlCharactersCStyle()) {
+				if (bCStyle) {
 					pDst[iDst++] = '\\';
 
 					switch (pszMsg[iSrc]) {
@@ -529,8 +659,8 @@ SanitizeMsg(msg_t *pMsg)
 				}
 			}
 
-		} else if(pszMsg[iSrc] > 127 && glbl.GetParserEscape8BitCharactersOnReceive()) {
-			if (glbl.GetParserEscapeControlCharactersCStyle()) {
+		} else if(pszMsg[iSrc] > 127 && bEscape8Bit) {
+			if (bCStyle) {
 				pDst[iDst++] = '\\';
 				pDst[iDst++] = 'x';
 
@@ -603,6 +733,116 @@ ParsePRI(msg_t *pMsg)
 }
 
 
+/* FNV-1a, continued from the provided hash value */
+static inline uint64_t
+memoHash(uint64_t h, const uchar *p, const size_t len)
+{
+	size_t i;
+	for(i = 0 ; i < len ; ++i) {
+		h ^= p[i];
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+/* compute the memo key for a message. The sender is identified by its IP
+ * address. If the name has not yet been resolved, we use the raw socket
+ * address, so that no name resolution is triggered by the parser.
+ */
+static uint64_t
+memoKey(msg_t *const pMsg)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+	struct sockaddr_storage *sa;
+
+	if(pMsg->pInputName != NULL)
+		h = memoHash(h, propGetSzStr(pMsg->pInputName), pMsg->pInputName->len);
+	h = memoHash(h, (const uchar*) "|", 1);
+	if(pMsg->msgFlags & NEEDS_DNSRESOL) {
+		sa = pMsg->rcvFrom.pfrominet;
+		if(sa->ss_family == AF_INET) {
+			h = memoHash(h, (uchar*) &((struct sockaddr_in*)sa)->sin_addr,
+				sizeof(struct in_addr));
+		} else if(sa->ss_family == AF_INET6) {
+			h = memoHash(h, (uchar*) &((struct sockaddr_in6*)sa)->sin6_addr,
+				sizeof(struct in6_addr));
+		}
+	} else if(pMsg->pRcvFromIP != NULL) {
+		h = memoHash(h, propGetSzStr(pMsg->pRcvFromIP), pMsg->pRcvFromIP->len);
+	} else if(pMsg->rcvFrom.pRcvFrom != NULL) {
+		h = memoHash(h, propGetSzStr(pMsg->rcvFrom.pRcvFrom), pMsg->rcvFrom.pRcvFrom->len);
+	}
+	return h | 1; /* 0 is reserved for "unused" */
+}
+
+/* look up the memo for a message. Returns the node of the parser to try
+ * first, or NULL if there is none or the memo is due for validation.
+ */
+static parserList_t *
+memoLookup(const uint64_t key, parserList_t *const pList)
+{
+	const unsigned idx = key % PARSER_MEMO_SIZE;
+	pthread_mutex_t *const mut = &mutParserMemo[idx % PARSER_MEMO_NMUT];
+	parserMemo_t *const pEntry = &parserMemo[idx];
+	parserList_t *pNode = NULL;
+
+	pthread_mutex_lock(mut);
+	if(pEntry->key == key && pEntry->pList == pList) {
+		if(parserMemoRevalidate == 0 || ++pEntry->nHits < parserMemoRevalidate)
+			pNode = pEntry->pNode;
+	}
+	pthread_mutex_unlock(mut);
+	return pNode;
+}
+
+static void
+memoStore(const uint64_t key, parserList_t *const pList, parserList_t *const pNode)
+{
+	const unsigned idx = key % PARSER_MEMO_SIZE;
+	pthread_mutex_t *const mut = &mutParserMemo[idx % PARSER_MEMO_NMUT];
+	parserMemo_t *const pEntry = &parserMemo[idx];
+
+	pthread_mutex_lock(mut);
+	pEntry->key = key;
+	pEntry->pList = pList;
+	pEntry->pNode = pNode;
+	pEntry->nHits = 0;
+	pthread_mutex_unlock(mut);
+}
+
+/* do standard sanitization and PRI parsing if the parser requests it
+ * and this has not already been done for this message.
+ */
+static inline rsRetVal
+prepareForParser(msg_t *const pMsg, parser_t *const pParser,
+	sbool *const pbIsSanitized, sbool *const pbPRIisParsed)
+{
+	DEFiRet;
+	if(pParser->bDoSanitazion && *pbIsSanitized == RSFALSE) {
+		CHKiRet(SanitizeMsg(pMsg));
+		if(pParser->bDoPRIParsing && *pbPRIisParsed == RSFALSE) {
+			CHKiRet(ParsePRI(pMsg));
+			*pbPRIisParsed = RSTRUE;
+		}
+		*pbIsSanitized = RSTRUE;
+	}
+finalize_it:
+	RETiRet;
+}
+
+static inline rsRetVal
+callParser(parser_t *const pParser, msg_t *const pMsg)
+{
+	rsRetVal localRet;
+	if(pParser->pModule->mod.pm.parse2 == NULL)
+		localRet = pParser->pModule->mod.pm.parse(pMsg);
+	else
+		localRet = pParser->pModule->mod.pm.parse2(pParser->pInst, pMsg);
+	DBGPRINTF("Parser '%s' returned %d\n", pParser->pName, localRet);
+	return localRet;
+}
+
+
 /* Parse a received message. The object's rawmsg property is taken and
  * parsed according to the relevant standards. This can later be
  * extended to support configured parsers.
@@ -612,8 +852,12 @@ static rsRetVal
 ParseMsg(msg_t *pMsg)
 {
 	rsRetVal localRet = RS_RET_ERR;
+	parserList_t *pParserListRoot;
 	parserList_t *pParserList;
-	parser_t *pParser;
+	parserList_t *pMemoNode = NULL;
+	parserList_t *pNode;
+	uint64_t memoKeyVal = 0;
+	int nAttempts = 0;
 	sbool bIsSanitized;
 	sbool bPRIisParsed;
 	static int iErrMsgRateLimiter = 0;
@@ -636,34 +880,63 @@ ParseMsg(msg_t *pMsg)
 	 * will cause it to happen. After that, access to the unsanitized message is no
 	 * loger possible.
 	 */
-	pParserList = ruleset.GetParserList(ourConf, pMsg);
-	if(pParserList == NULL) {
-		pParserList = pDfltParsLst;
+	pParserListRoot = ruleset.GetParserList(ourConf, pMsg);
+	if(pParserListRoot == NULL) {
+		pParserListRoot = pDfltParsLst;
 	}
-	DBGPRINTF("parse using parser list %p%s.\n", pParserList,
-		  (pParserList == pDfltParsLst) ? " (the default list)" : "");
+	DBGPRINTF("parse using parser list %p%s.\n", pParserListRoot,
+		  (pParserListRoot == pDfltParsLst) ? " (the default list)" : "");
 
 	bIsSanitized = RSFALSE;
 	bPRIisParsed = RSFALSE;
+
+	/* in adaptive mode, try the memorized parser first. We must bring the
+	 * message into the same state the full chain would have done before
+	 * calling that parser, so we need to prepare it for all parsers in front.
+	 * A memo for the first parser in chain does not buy us anything.
+	 * The stats counters are only maintained in adaptive mode, as they are
+	 * global and thus contended.
+	 */
+	if(parserMemo != NULL) {
+		STATSCOUNTER_INC(ctrMsgs, mutCtrMsgs);
+		if(pParserListRoot != NULL && pParserListRoot->pNext != NULL) {
+			memoKeyVal = memoKey(pMsg);
+			pMemoNode = memoLookup(memoKeyVal, pParserListRoot);
+			if(pMemoNode == pParserListRoot)
+				pMemoNode = NULL;
+		}
+	}
+	if(pMemoNode != NULL) {
+		pNode = pParserListRoot;
+		do {
+			CHKiRet(prepareForParser(pMsg, pNode->pParser, &bIsSanitized, &bPRIisParsed));
+		} while(pNode != pMemoNode && (pNode = pNode->pNext) != NULL);
+		++nAttempts;
+		localRet = callParser(pMemoNode->pParser, pMsg);
+		if(localRet != RS_RET_COULD_NOT_PARSE) {
+			STATSCOUNTER_INC(ctrMemoHits, mutCtrMemoHits);
+			goto parsed;
+		}
+		STATSCOUNTER_INC(ctrMemoMisses, mutCtrMemoMisses);
+	}
+
+	pParserList = pParserListRoot;
 	while(pParserList != NULL) {
-		pParser = pParserList->pParser;
-		if(pParser->bDoSanitazion && bIsSanitized == RSFALSE) {
-			CHKiRet(SanitizeMsg(pMsg));
-			if(pParser->bDoPRIParsing && bPRIisParsed == RSFALSE) {
-				CHKiRet(ParsePRI(pMsg));
-				bPRIisParsed = RSTRUE;
-			}
-			bIsSanitized = RSTRUE;
+		if(pParserList != pMemoNode) { /* memo parser already failed */
+			CHKiRet(prepareForParser(pMsg, pParserList->pParser, &bIsSanitized, &bPRIisParsed));
+			++nAttempts;
+			localRet = callParser(pParserList->pParser, pMsg);
+			if(localRet != RS_RET_COULD_NOT_PARSE)
+				break;
 		}
-		if(pParser->pModule->mod.pm.parse2 == NULL)
-			localRet = pParser->pModule->mod.pm.parse(pMsg);
-		else
-			localRet = pParser->pModule->mod.pm.parse2(pParser->pInst, pMsg);
-		DBGPRINTF("Parser '%s' returned %d\n", pParser->pName, localRet);
-		if(localRet != RS_RET_COULD_NOT_PARSE)
-			break;
 		pParserList = pParserList->pNext;
 	}
+	if(memoKeyVal != 0 && localRet == RS_RET_OK)
+		memoStore(memoKeyVal, pParserListRoot, pParserList);
+
+parsed:
+	if(parserMemo != NULL)
+		STATSCOUNTER_ADD(ctrAttempts, mutCtrAttempts, nAttempts);
 
 	/* We need to log a warning message and drop the message if we did not find a parser.
 	 * Note that we log at most the first 1000 message, as this may very well be a problem
@@ -686,6 +959,49 @@ ParseMsg(msg_t *pMsg)
 finalize_it:
 	RETiRet;
 }
+
+
+/* Activate parser settings after the config has been loaded. This sets up
+ * the adaptive parser memo and the parser stats counters, if requested.
+ * revalidate == 0 means the memo is never re-checked.
+ */
+rsRetVal
+parserActivate(const int bAdaptive, const unsigned revalidate)
+{
+	DEFiRet;
+
+	if(!bAdaptive)
+		FINALIZE;
+
+	if(stats == NULL) {
+		STATSCOUNTER_INIT(ctrMsgs, mutCtrMsgs);
+		STATSCOUNTER_INIT(ctrAttempts, mutCtrAttempts);
+		STATSCOUNTER_INIT(ctrMemoHits, mutCtrMemoHits);
+		STATSCOUNTER_INIT(ctrMemoMisses, mutCtrMemoMisses);
+		CHKiRet(statsobj.Construct(&stats));
+		CHKiRet(statsobj.SetName(stats, UCHAR_CONSTANT("parser")));
+		CHKiRet(statsobj.SetOrigin(stats, UCHAR_CONSTANT("core")));
+		CHKiRet(statsobj.AddCounter(stats, UCHAR_CONSTANT("messages"),
+			ctrType_IntCtr, CTR_FLAG_RESETTABLE, &ctrMsgs));
+		CHKiRet(statsobj.AddCounter(stats, UCHAR_CONSTANT("attempts"),
+			ctrType_IntCtr, CTR_FLAG_RESETTABLE, &ctrAttempts));
+		CHKiRet(statsobj.AddCounter(stats, UCHAR_CONSTANT("memo.hits"),
+			ctrType_IntCtr, CTR_FLAG_RESETTABLE, &ctrMemoHits));
+		CHKiRet(statsobj.AddCounter(stats, UCHAR_CONSTANT("memo.misses"),
+			ctrType_IntCtr, CTR_FLAG_RESETTABLE, &ctrMemoMisses));
+		CHKiRet(statsobj.ConstructFinalize(stats));
+	}
+
+	parserMemoRevalidate = revalidate;
+	if(parserMemo == NULL) {
+		CHKmalloc(parserMemo = calloc(PARSER_MEMO_SIZE, sizeof(parserMemo_t)));
+	}
+	DBGPRINTF("parser: adaptive mode on, revalidate every %u hits\n", revalidate);
+
+finalize_it:
+	RETiRet;
+}
+
 /* queryInterface function-- rgerhards, 2009-11-03
  */
 BEGINobjQueryInterface(parser)
@@ -738,12 +1054,20 @@ destroyMasterParserList(void)
  * rgerhards, 2009-11-04
  */
 BEGINObjClassExit(parser, OBJ_IS_CORE_MODULE) /* class, version */
+	int i;
 	DestructParserList(&pDfltParsLst);
 	destroyMasterParserList();
+	if(stats != NULL)
+		statsobj.Destruct(&stats);
+	free(parserMemo);
+	parserMemo = NULL;
+	for(i = 0 ; i < PARSER_MEMO_NMUT ; ++i)
+		pthread_mutex_destroy(&mutParserMemo[i]);
 	objRelease(glbl, CORE_COMPONENT);
 	objRelease(errmsg, CORE_COMPONENT);
 	objRelease(datetime, CORE_COMPONENT);
 	objRelease(ruleset, CORE_COMPONENT);
+	objRelease(statsobj, CORE_COMPONENT);
 ENDObjClassExit(parser)
 
 
@@ -752,11 +1076,16 @@ ENDObjClassExit(parser)
  * rgerhards, 2009-11-02
  */
 BEGINObjClassInit(parser, 1, OBJ_IS_CORE_MODULE) /* class, version */
+	int i;
 	/* request objects we use */
 	CHKiRet(objUse(glbl, CORE_COMPONENT));
 	CHKiRet(objUse(errmsg, CORE_COMPONENT));
 	CHKiRet(objUse(datetime, CORE_COMPONENT));
 	CHKiRet(objUse(ruleset, CORE_COMPONENT));
+	CHKiRet(objUse(statsobj, CORE_COMPONENT));
+
+	for(i = 0 ; i < PARSER_MEMO_NMUT ; ++i)
+		pthread_mutex_init(&mutParserMemo[i], NULL);
 
 	InitParserList(&pParsLstRoot);
 	InitParserList(&pDfltParsLst);
@@ -69,6 +69,7 @@ void printParserList(parserList_t *pList);
 /* prototypes */
 PROTOTYPEObj(parser);
 rsRetVal parserConstructViaModAndName(modInfo_t *pMod, uchar *const pName, void *parserInst);
+rsRetVal parserActivate(int bAdaptive, unsigned revalidate);
 
 
 #endif /* #ifndef INCLUDED_PARSER_H */
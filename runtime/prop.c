@@ -10,6 +10,17 @@
  * as such we may use some methods in here which do not look elegant, but
  * which are fast...
  *
+ * Properties with values that repeat very often (like HOSTNAME, TAG and
+ * APP-NAME) can be obtained via Intern(). This looks up the value in a
+ * global, lock-striped table and hands out a reference to an already
+ * existing property if there is one. That saves the per-message copy and
+ * permits pointer compares. The table has a fixed size (64 stripes of 1024
+ * entries each) and uses FIFO replacement: if a stripe is full, the entry
+ * that was added first is dropped, no matter how often it is used. It is
+ * then re-added on its next use. A dropped property lives on as long as
+ * messages reference it. We do not do LRU, as that would require list
+ * updates on every lookup hit, which is by far the most frequent case.
+ *
  * Module begun 2009-06-17 by Rainer Gerhards
  *
  * Copyright 2009-2016 Adiscon GmbH.
@@ -35,6 +46,7 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
+#include <pthread.h>
 
 #include "rsyslog.h"
 #include "obj.h"
@@ -46,6 +58,27 @@
 /* static data */
 DEFobjStaticHelpers
 
+/* intern table. The number of stripes and buckets must be a power of 2. */
+#define PROP_INTERN_STRIPES 64
+#define PROP_INTERN_BUCKETS 256		/* hash buckets per stripe */
+#define PROP_INTERN_MAX_PER_STRIPE 1024	/* max entries per stripe, FIFO replacement */
+#define PROP_INTERN_MAXLEN 255		/* longer values are not interned */
+
+typedef struct propInternEntry_s {
+	prop_t *pProp;		/* the table holds one reference to it */
+	unsigned hash;
+	struct propInternEntry_s *pNext;	/* hash chain */
+	struct propInternEntry_s *pNextAge;	/* insertion order, oldest first */
+} propInternEntry_t;
+
+static struct propInternStripe_s {
+	pthread_mutex_t mut;
+	propInternEntry_t *buckets[PROP_INTERN_BUCKETS];
+	propInternEntry_t *pOldest;
+	propInternEntry_t *pNewest;
+	int nEntries;
+} internTab[PROP_INTERN_STRIPES];
+
 
 /* Standard-Constructor
  */
@@ -81,10 +114,12 @@ static rsRetVal SetString(prop_t *pThis, const uchar *psz, const int len)
 		free(pThis->szVal.psz);
 	pThis->len = len;
 	if(len < CONF_PROP_BUFSIZE) {
-		memcpy(pThis->szVal.sz, psz, len + 1);
+		memcpy(pThis->szVal.sz, psz, len);
+		pThis->szVal.sz[len] = '\0';
 	} else {
 		CHKmalloc(pThis->szVal.psz = MALLOC(len + 1));
-		memcpy(pThis->szVal.psz, psz, len + 1);
+		memcpy(pThis->szVal.psz, psz, len);
+		pThis->szVal.psz[len] = '\0';
 	}
 
 finalize_it:
@@ -195,6 +230,113 @@ finalize_it:
 }
 
 
+/* FNV-1a, good enough for the short strings we intern */
+static inline unsigned
+internHash(const uchar *psz, const int len)
+{
+	unsigned hash = 2166136261u;
+	int i;
+	for(i = 0 ; i < len ; ++i) {
+		hash ^= psz[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+/* remove the oldest entry from a stripe. Must be called with the
+ * stripe mutex locked.
+ */
+static void
+internEvictOldest(struct propInternStripe_s *const pStripe)
+{
+	propInternEntry_t *const pEntry = pStripe->pOldest;
+	propInternEntry_t **ppLink;
+
+	ppLink = &pStripe->buckets[(pEntry->hash / PROP_INTERN_STRIPES) % PROP_INTERN_BUCKETS];
+	while(*ppLink != pEntry)
+		ppLink = &(*ppLink)->pNext;
+	*ppLink = pEntry->pNext;
+
+	pStripe->pOldest = pEntry->pNextAge;
+	if(pStripe->pOldest == NULL)
+		pStripe->pNewest = NULL;
+	--pStripe->nEntries;
+
+	propDestruct(&pEntry->pProp); /* drop table reference only */
+	free(pEntry);
+}
+
+/* obtain a property for the provided string from the intern table. If there
+ * already is a property with the same value, a new reference to it is
+ * returned. Otherwise, a new property is created and added to the table.
+ * In any case, the caller owns one reference and must Destruct() it when
+ * done. The string does not need to be NUL-terminated.
+ */
+static rsRetVal
+Intern(prop_t **ppThis, const uchar *psz, const int len)
+{
+	struct propInternStripe_s *pStripe;
+	propInternEntry_t *pEntry;
+	propInternEntry_t **ppBucket;
+	prop_t *pProp = NULL;
+	unsigned hash;
+	DEFiRet;
+	assert(ppThis != NULL);
+
+	if(len > PROP_INTERN_MAXLEN) {
+		/* such values are unlikely to repeat, do not pollute the table */
+		CHKiRet(CreateStringProp(ppThis, psz, len));
+		FINALIZE;
+	}
+
+	hash = internHash(psz, len);
+	pStripe = &internTab[hash % PROP_INTERN_STRIPES];
+	ppBucket = &pStripe->buckets[(hash / PROP_INTERN_STRIPES) % PROP_INTERN_BUCKETS];
+
+	pthread_mutex_lock(&pStripe->mut);
+	for(pEntry = *ppBucket ; pEntry != NULL ; pEntry = pEntry->pNext) {
+		if(pEntry->hash == hash && pEntry->pProp->len == len
+		   && !memcmp(propGetSzStr(pEntry->pProp), psz, len)) {
+			AddRef(pEntry->pProp);
+			*ppThis = pEntry->pProp;
+			pthread_mutex_unlock(&pStripe->mut);
+			FINALIZE;
+		}
+	}
+
+	/* not yet known, create it */
+	if((iRet = CreateStringProp(&pProp, psz, len)) != RS_RET_OK
+	   || (pEntry = malloc(sizeof(propInternEntry_t))) == NULL) {
+		pthread_mutex_unlock(&pStripe->mut);
+		if(iRet == RS_RET_OK)
+			iRet = RS_RET_OUT_OF_MEMORY;
+		FINALIZE;
+	}
+	if(pStripe->nEntries >= PROP_INTERN_MAX_PER_STRIPE)
+		internEvictOldest(pStripe);
+	AddRef(pProp); /* one for the table, one for the caller */
+	pEntry->pProp = pProp;
+	pEntry->hash = hash;
+	pEntry->pNext = *ppBucket;
+	*ppBucket = pEntry;
+	pEntry->pNextAge = NULL;
+	if(pStripe->pNewest == NULL)
+		pStripe->pOldest = pEntry;
+	else
+		pStripe->pNewest->pNextAge = pEntry;
+	pStripe->pNewest = pEntry;
+	++pStripe->nEntries;
+	pthread_mutex_unlock(&pStripe->mut);
+	*ppThis = pProp;
+	pProp = NULL;
+
+finalize_it:
+	if(pProp != NULL)
+		propDestruct(&pProp);
+	RETiRet;
+}
+
+
 /* debugprint for the prop object */
 BEGINobjDebugPrint(prop) /* be sure to specify the object type also in END and CODESTART macros! */
 CODESTARTobjDebugPrint(prop)
@@ -226,6 +368,7 @@ CODESTARTobjQueryInterface(prop)
 	pIf->AddRef = AddRef;
 	pIf->CreateStringProp = CreateStringProp;
 	pIf->CreateOrReuseStringProp = CreateOrReuseStringProp;
+	pIf->Intern = Intern;
 
 finalize_it:
 ENDobjQueryInterface(prop)
@@ -235,6 +378,13 @@ ENDobjQueryInterface(prop)
  * rgerhards, 2009-04-06
  */
 BEGINObjClassExit(prop, OBJ_IS_CORE_MODULE) /* class, version */
+	int i;
+CODESTARTObjClassExit(prop)
+	for(i = 0 ; i < PROP_INTERN_STRIPES ; ++i) {
+		while(internTab[i].pOldest != NULL)
+			internEvictOldest(&internTab[i]);
+		pthread_mutex_destroy(&internTab[i].mut);
+	}
 //	objRelease(errmsg, CORE_COMPONENT);
 ENDObjClassExit(prop)
 
@@ -244,12 +394,16 @@ ENDObjClassExit(prop)
  * rgerhards, 2008-02-19
  */
 BEGINObjClassInit(prop, 1, OBJ_IS_CORE_MODULE) /* class, version */
+	int i;
 	/* request objects we use */
 //	CHKiRet(objUse(errmsg, CORE_COMPONENT));
 
 	/* set our own handlers */
 	OBJSetMethodHandler(objMethod_DEBUGPRINT, propDebugPrint);
 	OBJSetMethodHandler(objMethod_CONSTRUCTION_FINALIZER, propConstructFinalize);
+
+	for(i = 0 ; i < PROP_INTERN_STRIPES ; ++i)
+		pthread_mutex_init(&internTab[i].mut, NULL);
 ENDObjClassInit(prop)
 
 /* vi:set ai:
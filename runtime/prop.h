@@ -22,6 +22,7 @@
  */
 #ifndef INCLUDED_PROP_H
 #define INCLUDED_PROP_H
+#include <string.h>
 #include "atomic.h"
 
 /* the prop object */
@@ -48,8 +49,11 @@ BEGINinterface(prop) /* name must also be changed in ENDinterface macro! */
 	rsRetVal (*AddRef)(prop_t *pThis);
 	rsRetVal (*CreateStringProp)(prop_t **ppThis, const uchar* psz, const int len);
 	rsRetVal (*CreateOrReuseStringProp)(prop_t **ppThis, const uchar *psz, const int len);
+	/* v2 */
+	rsRetVal (*Intern)(prop_t **ppThis, const uchar *psz, const int len);
 ENDinterface(prop)
-#define propCURR_IF_VERSION 1 /* increment whenever you change the interface structure! */
+#define propCURR_IF_VERSION 2 /* increment whenever you change the interface structure! */
+/* version 2 added Intern() */
 
 
 /* get classic c-style string */
@@ -59,6 +63,22 @@ propGetSzStr(prop_t *pThis)
 	return(pThis->len < CONF_PROP_BUFSIZE) ? pThis->szVal.sz : pThis->szVal.psz;
 }
 
+/* check if two properties hold the same string. Properties obtained via
+ * Intern() are shared, so in the common case this is a pointer compare.
+ * Note that equal strings may still live in different properties (e.g.
+ * after an intern table entry was evicted), so we must fall back to the
+ * string compare if the pointers differ.
+ */
+static inline int
+propEqual(prop_t *const p1, prop_t *const p2)
+{
+	if(p1 == p2)
+		return 1;
+	if(p1 == NULL || p2 == NULL || p1->len != p2->len)
+		return 0;
+	return !memcmp(propGetSzStr(p1), propGetSzStr(p2), p1->len);
+}
+
 /* prototypes */
 PROTOTYPEObj(prop);
 
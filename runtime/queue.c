@@ -60,6 +60,7 @@
 #include "unicode-helper.h"
 #include "statsobj.h"
 #include "parserif.h"
+#include "msgtrace.h"
 
 #ifdef OS_SOLARIS
 #	include <sched.h>
@@ -1678,6 +1679,7 @@ DequeueConsumableElements(qqueue_t *pThis, wti_t *pWti, int *piRemainingQueueSiz
 		}
 
 		/* all well, use this element */
+		msgtraceStamp(pMsg, MSGTRACE_QDEQ);
 		pWti->batch.pElem[nDequeued].pMsg = pMsg;
 		pWti->batch.eltState[nDequeued] = BATCH_STATE_RDY;
 		++nDequeued;
@@ -2821,6 +2823,7 @@ doEnqSingleObj(qqueue_t *pThis, flowControl_t flowCtlType, msg_t *pMsg)
 	}
 
 	/* and finally enqueue the message */
+	msgtraceStamp(pMsg, MSGTRACE_QENQ);
 	CHKiRet(qqueueAdd(pThis, pMsg));
 	STATSCOUNTER_SETMAX_NOMUT(pThis->ctrMaxqsize, pThis->iQueueSize);
 
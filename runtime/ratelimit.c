@@ -24,6 +24,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <netdb.h>
+#include <sys/socket.h>
 
 #include "rsyslog.h"
 #include "errmsg.h"
@@ -34,6 +36,11 @@
 #include "msg.h"
 #include "rsconf.h"
 #include "dirty.h"
+#include "template.h"
+#include "hashtable.h"
+#include "dynstats.h"
+#include "prop.h"
+#include "net.h"
 
 /* definitions for objects we access */
 DEFobjStaticHelpers
@@ -44,6 +51,50 @@ DEFobjCurrIf(parser)
 
 /* static data */
 
+/* Keyed ratelimiting. Instead of a single window for the whole ratelimiter,
+ * each key (e.g. sender IP) gets its own token bucket. The buckets are kept
+ * in a bounded hash table which is split into stripes, each one with its own
+ * mutex, hash chains and LRU list. So concurrent input threads usually do not
+ * contend, and a flood of new keys can not exhaust memory: if a stripe is
+ * full, its least recently used bucket is recycled.
+ */
+#define RATELIMIT_NSTRIPES 16	/* must be a power of 2 */
+
+typedef enum {
+	RL_KEY_EXPLICIT = 0,	/* key is provided by caller (RainerScript) */
+	RL_KEY_FROMHOST_IP = 1,
+	RL_KEY_HOSTNAME = 2,
+	RL_KEY_TEMPLATE = 3
+} ratelimitKeyType_t;
+
+struct ratelimitBkt_s {
+	struct ratelimitBkt_s *hnext;	/* next entry in hash chain */
+	struct ratelimitBkt_s *lruPrev;
+	struct ratelimitBkt_s *lruNext;
+	uchar *key;
+	unsigned hash;
+	uint64_t credit;	/* one message costs <interval> units, we gain <burst> units per second */
+	time_t lastRefill;
+	unsigned missed;
+};
+
+struct ratelimitStripe_s {
+	pthread_mutex_t mut;
+	struct ratelimitBkt_s **htab;
+	struct ratelimitBkt_s *lruHead;	/* most recently used */
+	struct ratelimitBkt_s *lruTail;	/* eviction candidate */
+	unsigned nBkts;
+};
+
+struct ratelimitKeyed_s {
+	ratelimitKeyType_t keyType;
+	struct template *pTpl;		/* for RL_KEY_TEMPLATE */
+	dynstats_bucket_t *pStatsBkt;	/* where to count per-key drops, NULL if not desired */
+	unsigned maxPerStripe;
+	unsigned htabSize;		/* per stripe, power of 2 */
+	struct ratelimitStripe_s stripes[RATELIMIT_NSTRIPES];
+};
+
 /* generate a "repeated n times" message */
 static msg_t *
 ratelimitGenRepMsg(ratelimit_t *ratelimit)
@@ -83,7 +134,10 @@ doLastMessageRepeatedNTimes(ratelimit_t *ratelimit, msg_t *pMsg, msg_t **ppRepMs
 	if( ratelimit->pMsg != NULL &&
 	    getMSGLen(pMsg) == getMSGLen(ratelimit->pMsg) &&
 	    !ustrcmp(getMSG(pMsg), getMSG(ratelimit->pMsg)) &&
-	    !strcmp(getHOSTNAME(pMsg), getHOSTNAME(ratelimit->pMsg)) &&
+	    /* HOSTNAME is interned, so usually a pointer compare is sufficient */
+	    ((pMsg->pHOSTNAME != NULL && ratelimit->pMsg->pHOSTNAME != NULL)
+	      ? propEqual(pMsg->pHOSTNAME, ratelimit->pMsg->pHOSTNAME)
+	      : !strcmp(getHOSTNAME(pMsg), getHOSTNAME(ratelimit->pMsg))) &&
 	    !strcmp(getPROCID(pMsg, LOCK_MUTEX), getPROCID(ratelimit->pMsg, LOCK_MUTEX)) &&
 	    !strcmp(getAPPNAME(pMsg, LOCK_MUTEX), getAPPNAME(ratelimit->pMsg, LOCK_MUTEX))) {
 		ratelimit->nsupp++;
@@ -183,6 +237,219 @@ finalize_it:
 }
 
 
+/* unlink bucket from its stripe's LRU list */
+static inline void
+lruUnlink(struct ratelimitStripe_s *const stripe, struct ratelimitBkt_s *const bkt)
+{
+	if(bkt->lruPrev == NULL)
+		stripe->lruHead = bkt->lruNext;
+	else
+		bkt->lruPrev->lruNext = bkt->lruNext;
+	if(bkt->lruNext == NULL)
+		stripe->lruTail = bkt->lruPrev;
+	else
+		bkt->lruNext->lruPrev = bkt->lruPrev;
+}
+
+static inline void
+lruPushHead(struct ratelimitStripe_s *const stripe, struct ratelimitBkt_s *const bkt)
+{
+	bkt->lruPrev = NULL;
+	bkt->lruNext = stripe->lruHead;
+	if(stripe->lruHead != NULL)
+		stripe->lruHead->lruPrev = bkt;
+	stripe->lruHead = bkt;
+	if(stripe->lruTail == NULL)
+		stripe->lruTail = bkt;
+}
+
+
+/* obtain a bucket for a key that is not yet present in the stripe. If the
+ * stripe is full, the least recently used bucket is recycled. Must be
+ * called with the stripe locked. Returns NULL on out of memory.
+ */
+static struct ratelimitBkt_s *
+getNewBkt(ratelimit_t *const ratelimit, struct ratelimitStripe_s *const stripe,
+	const uchar *const key, const unsigned hash, const time_t tt)
+{
+	struct ratelimitKeyed_s *const pKeyed = ratelimit->pKeyed;
+	struct ratelimitBkt_s *bkt;
+	struct ratelimitBkt_s **pp;
+	uchar *keyCopy;
+
+	if((keyCopy = ustrdup(key)) == NULL)
+		return NULL;
+
+	if(stripe->nBkts >= pKeyed->maxPerStripe) {
+		bkt = stripe->lruTail;
+		lruUnlink(stripe, bkt);
+		for(pp = &stripe->htab[(bkt->hash / RATELIMIT_NSTRIPES) & (pKeyed->htabSize - 1)] ;
+		    *pp != bkt ; pp = &(*pp)->hnext)
+			/* just search */;
+		*pp = bkt->hnext;
+		DBGPRINTF("ratelimit:%s: evicting key '%s'\n", ratelimit->name, bkt->key);
+		free(bkt->key);
+	} else {
+		if((bkt = malloc(sizeof(struct ratelimitBkt_s))) == NULL) {
+			free(keyCopy);
+			return NULL;
+		}
+		++stripe->nBkts;
+	}
+
+	bkt->key = keyCopy;
+	bkt->hash = hash;
+	bkt->credit = (uint64_t) ratelimit->burst * ratelimit->interval;
+	bkt->lastRefill = tt;
+	bkt->missed = 0;
+	pp = &stripe->htab[(hash / RATELIMIT_NSTRIPES) & (pKeyed->htabSize - 1)];
+	bkt->hnext = *pp;
+	*pp = bkt;
+	lruPushHead(stripe, bkt);
+	return bkt;
+}
+
+
+/* Check if a message with the given key is within its rate limit. This is
+ * a token bucket per key: a key may send <burst> messages at once, and
+ * regains credit for <burst> messages per <interval> seconds. Thread-safe.
+ * Returns 1 if the message shall be processed, 0 otherwise.
+ */
+int
+ratelimitKeyCheck(ratelimit_t *const ratelimit, const uchar *const key, time_t tt)
+{
+	struct ratelimitKeyed_s *const pKeyed = ratelimit->pKeyed;
+	struct ratelimitStripe_s *stripe;
+	struct ratelimitBkt_s *bkt;
+	const uint64_t maxCredit = (uint64_t) ratelimit->burst * ratelimit->interval;
+	unsigned hash;
+	unsigned lost = 0;
+	int bBeginDrop = 0;
+	int ret = 1;
+	uchar msgbuf[1024];
+
+	if(ratelimit->interval == 0 || pKeyed == NULL)
+		goto done;
+
+	if(ratelimit->bNoTimeCache)
+		tt = time(NULL);
+
+	hash = hash_from_string((void*) key);
+	stripe = &pKeyed->stripes[hash & (RATELIMIT_NSTRIPES - 1)];
+
+	pthread_mutex_lock(&stripe->mut);
+	for(bkt = stripe->htab[(hash / RATELIMIT_NSTRIPES) & (pKeyed->htabSize - 1)] ;
+	    bkt != NULL ; bkt = bkt->hnext) {
+		if(bkt->hash == hash && !ustrcmp(bkt->key, key))
+			break;
+	}
+	if(bkt == NULL) {
+		if((bkt = getNewBkt(ratelimit, stripe, key, hash, tt)) == NULL) {
+			/* out of memory: we do not drop messages due to our own problems */
+			pthread_mutex_unlock(&stripe->mut);
+			goto done;
+		}
+	} else if(bkt != stripe->lruHead) {
+		lruUnlink(stripe, bkt);
+		lruPushHead(stripe, bkt);
+	}
+
+	if(tt > bkt->lastRefill) {
+		bkt->credit += (uint64_t) (tt - bkt->lastRefill) * ratelimit->burst;
+		if(bkt->credit > maxCredit)
+			bkt->credit = maxCredit;
+	}
+	bkt->lastRefill = tt; /* also handles time going backwards */
+
+	if(bkt->credit >= ratelimit->interval) {
+		bkt->credit -= ratelimit->interval;
+		lost = bkt->missed;
+		bkt->missed = 0;
+	} else {
+		bBeginDrop = (bkt->missed++ == 0);
+		ret = 0;
+	}
+	pthread_mutex_unlock(&stripe->mut);
+
+	/* logging and stats are done outside of the lock */
+	if(ret == 0 && pKeyed->pStatsBkt != NULL)
+		dynstats_inc(pKeyed->pStatsBkt, (uchar*) key);
+	if(bBeginDrop) {
+		snprintf((char*)msgbuf, sizeof(msgbuf),
+			 "%s: begin to drop messages from '%s' due to rate-limiting",
+			 ratelimit->name, key);
+		logmsgInternal(RS_RET_RATE_LIMITED, LOG_SYSLOG|LOG_INFO, msgbuf, 0);
+	} else if(lost > 0) {
+		snprintf((char*)msgbuf, sizeof(msgbuf),
+			 "%s: %u messages from '%s' lost due to rate-limiting",
+			 ratelimit->name, lost, key);
+		logmsgInternal(RS_RET_RATE_LIMITED, LOG_SYSLOG|LOG_INFO, msgbuf, 0);
+	}
+
+done:
+	return ret;
+}
+
+
+/* obtain the ratelimit key for a message. For templates, the generated
+ * string is returned inside iparam and must be freed by the caller.
+ */
+static const uchar *
+getMsgKey(ratelimit_t *const ratelimit, msg_t *const pMsg, uchar *const buf,
+	const size_t lenBuf, actWrkrIParams_t *const iparam)
+{
+	const uchar *key;
+	int r;
+
+	switch(ratelimit->pKeyed->keyType) {
+	case RL_KEY_FROMHOST_IP:
+		if(pMsg->msgFlags & NEEDS_DNSRESOL) {
+			/* do not trigger a reverse DNS lookup on the input thread,
+			 * we just need the numerical address.
+			 */
+			r = getnameinfo((struct sockaddr*) pMsg->rcvFrom.pfrominet,
+					SALEN((struct sockaddr*) pMsg->rcvFrom.pfrominet),
+					(char*) buf, lenBuf, NULL, 0, NI_NUMERICHOST);
+			key = (r == 0) ? buf : UCHAR_CONSTANT("");
+		} else {
+			key = (pMsg->pRcvFromIP == NULL) ? UCHAR_CONSTANT("")
+							 : propGetSzStr(pMsg->pRcvFromIP);
+		}
+		break;
+	case RL_KEY_HOSTNAME:
+		key = (uchar*) getHOSTNAME(pMsg);
+		break;
+	case RL_KEY_TEMPLATE:
+		if(tplToString(ratelimit->pKeyed->pTpl, pMsg, iparam, NULL) == RS_RET_OK)
+			key = iparam->param;
+		else
+			key = UCHAR_CONSTANT("");
+		break;
+	case RL_KEY_EXPLICIT:
+	default:
+		key = UCHAR_CONSTANT("");
+		break;
+	}
+	return key;
+}
+
+
+/* keyed variant of the linux-like ratelimit check for a message */
+static int
+withinKeyedRatelimit(ratelimit_t *const ratelimit, msg_t *const pMsg)
+{
+	uchar keybuf[NI_MAXHOST];
+	actWrkrIParams_t iparam;
+	int ret;
+
+	wtiInitIParam(&iparam);
+	ret = ratelimitKeyCheck(ratelimit,
+		getMsgKey(ratelimit, pMsg, keybuf, sizeof(keybuf), &iparam), pMsg->ttGenTime);
+	free(iparam.param);
+	return ret;
+}
+
+
 /* ratelimit a message, that means:
  * - handle "last message repeated n times" logic
  * - handle actual (discarding) rate-limiting
@@ -215,7 +482,9 @@ ratelimitMsg(ratelimit_t *ratelimit, msg_t *pMsg, msg_t **ppRepMsg)
 	/* Only the messages having severity level at or below the
 	 * treshold (the value is >=) are subject to ratelimiting. */
 	if(ratelimit->interval && (pMsg->iSeverity >= ratelimit->severity)) {
-		if(withinRatelimit(ratelimit, pMsg->ttGenTime) == 0) {
+		if(  (ratelimit->pKeyed == NULL)
+		   ? withinRatelimit(ratelimit, pMsg->ttGenTime) == 0
+		   : withinKeyedRatelimit(ratelimit, pMsg) == 0) {
 			msgDestruct(&pMsg);
 			ABORT_FINALIZE(RS_RET_DISCARDMSG);
 		}
@@ -350,6 +619,117 @@ ratelimitSetSeverity(ratelimit_t *ratelimit, intTiny severity)
 	ratelimit->severity = severity;
 }
 
+/* check the keyed ratelimiting settings of an input at config time.
+ * If the key is invalid, an error is emitted and the key is discarded, so
+ * that the input uses the regular (per listener) ratelimiter. An unknown
+ * stats bucket is discarded as well, keyed ratelimiting then works without
+ * per-key drop counts.
+ */
+void
+ratelimitCheckKeyCnf(const char *const modname, uchar **const ppszKey, uchar **const ppszStatsBucket)
+{
+	uchar *const keyspec = *ppszKey;
+
+	if(keyspec == NULL)
+		return;
+	if(   strcasecmp((char*)keyspec, "fromhost-ip")
+	   && strcasecmp((char*)keyspec, "hostname")
+	   && tplFind(loadConf, (char*)keyspec, ustrlen(keyspec)) == NULL) {
+		errmsg.LogError(0, RS_RET_NOT_FOUND, "%s: ratelimit.key template '%s' not "
+			"found - keyed ratelimiting disabled", modname, keyspec);
+		free(keyspec);
+		*ppszKey = NULL;
+		return;
+	}
+	if(*ppszStatsBucket != NULL && dynstats_findBucket(*ppszStatsBucket) == NULL) {
+		errmsg.LogError(0, RS_RET_NOT_FOUND, "%s: ratelimit.keystats dyn_stats bucket "
+			"'%s' not found - ignored", modname, *ppszStatsBucket);
+		free(*ppszStatsBucket);
+		*ppszStatsBucket = NULL;
+	}
+}
+
+
+/* Turn on keyed ratelimiting. Each distinct key gets its own interval/burst
+ * budget, as set via ratelimitSetLinuxLike(). keyspec is "fromhost-ip",
+ * "hostname" or the name of a template that generates the key. If keyspec
+ * is NULL, keys are provided by the caller via ratelimitKeyCheck(). Up to
+ * maxKeys keys are tracked (0 means default). If statsBucket is given, drops
+ * are counted per key in that dyn_stats bucket.
+ * Keyed ratelimiting is always thread-safe.
+ */
+rsRetVal
+ratelimitSetKeyed(ratelimit_t *ratelimit, const uchar *keyspec, unsigned maxKeys,
+	const uchar *statsBucket)
+{
+	struct ratelimitKeyed_s *pKeyed = NULL;
+	int i;
+	DEFiRet;
+
+	CHKmalloc(pKeyed = calloc(1, sizeof(struct ratelimitKeyed_s)));
+	if(keyspec == NULL) {
+		pKeyed->keyType = RL_KEY_EXPLICIT;
+	} else if(!strcasecmp((char*)keyspec, "fromhost-ip")) {
+		pKeyed->keyType = RL_KEY_FROMHOST_IP;
+	} else if(!strcasecmp((char*)keyspec, "hostname")) {
+		pKeyed->keyType = RL_KEY_HOSTNAME;
+	} else {
+		pKeyed->keyType = RL_KEY_TEMPLATE;
+		/* already checked by ratelimitCheckKeyCnf() */
+		pKeyed->pTpl = tplFind(loadConf, (char*)keyspec, ustrlen(keyspec));
+		if(pKeyed->pTpl == NULL)
+			ABORT_FINALIZE(RS_RET_NOT_FOUND);
+	}
+
+	if(statsBucket != NULL)
+		pKeyed->pStatsBkt = dynstats_findBucket(statsBucket);
+
+	if(maxKeys == 0)
+		maxKeys = RATELIMIT_DFLT_MAXKEYS;
+	pKeyed->maxPerStripe = (maxKeys + RATELIMIT_NSTRIPES - 1) / RATELIMIT_NSTRIPES;
+	for(pKeyed->htabSize = 8 ; pKeyed->htabSize < pKeyed->maxPerStripe ; pKeyed->htabSize <<= 1)
+		/* just size */;
+	for(i = 0 ; i < RATELIMIT_NSTRIPES ; ++i) {
+		pthread_mutex_init(&pKeyed->stripes[i].mut, NULL);
+		CHKmalloc(pKeyed->stripes[i].htab =
+			calloc(pKeyed->htabSize, sizeof(struct ratelimitBkt_s*)));
+	}
+
+	DBGPRINTF("ratelimit:%s: keyed ratelimiting, key '%s', max %u keys\n", ratelimit->name,
+		  keyspec == NULL ? "(explicit)" : (char*) keyspec, maxKeys);
+	ratelimit->pKeyed = pKeyed;
+	pKeyed = NULL;
+
+finalize_it:
+	if(pKeyed != NULL) {
+		for(i = 0 ; i < RATELIMIT_NSTRIPES ; ++i)
+			free(pKeyed->stripes[i].htab);
+		free(pKeyed);
+	}
+	RETiRet;
+}
+
+
+static void
+keyedDestruct(struct ratelimitKeyed_s *pKeyed)
+{
+	struct ratelimitBkt_s *bkt, *toDel;
+	int i;
+
+	for(i = 0 ; i < RATELIMIT_NSTRIPES ; ++i) {
+		for(bkt = pKeyed->stripes[i].lruHead ; bkt != NULL ; ) {
+			toDel = bkt;
+			bkt = bkt->lruNext;
+			free(toDel->key);
+			free(toDel);
+		}
+		free(pKeyed->stripes[i].htab);
+		pthread_mutex_destroy(&pKeyed->stripes[i].mut);
+	}
+	free(pKeyed);
+}
+
+
 void
 ratelimitDestruct(ratelimit_t *ratelimit)
 {
@@ -363,6 +743,8 @@ ratelimitDestruct(ratelimit_t *ratelimit)
 		msgDestruct(&ratelimit->pMsg);
 	}
 	tellLostCnt(ratelimit);
+	if(ratelimit->pKeyed != NULL)
+		keyedDestruct(ratelimit->pKeyed);
 	if(ratelimit->bThreadSafe)
 		pthread_mutex_destroy(&ratelimit->mut);
 	free(ratelimit->name);
@@ -37,14 +37,21 @@ struct ratelimit_s {
 	sbool bThreadSafe;	/**< do we need to operate in Thread-Safe mode? */
 	sbool bNoTimeCache;	/**< if we shall not used cached reception time */
 	pthread_mutex_t mut;	/**< mutex if thread-safe operation desired */
+	struct ratelimitKeyed_s *pKeyed; /**< per-key limiter state, NULL if not keyed */
 };
 
+#define RATELIMIT_DFLT_MAXKEYS 10000 /* default max nbr of keys tracked by keyed limiter */
+
 /* prototypes */
 rsRetVal ratelimitNew(ratelimit_t **ppThis, const char *modname, const char *dynname);
 void ratelimitSetThreadSafe(ratelimit_t *ratelimit);
 void ratelimitSetLinuxLike(ratelimit_t *ratelimit, unsigned short interval, unsigned short burst);
 void ratelimitSetNoTimeCache(ratelimit_t *ratelimit);
 void ratelimitSetSeverity(ratelimit_t *ratelimit, intTiny severity);
+void ratelimitCheckKeyCnf(const char *modname, uchar **ppszKey, uchar **ppszStatsBucket);
+rsRetVal ratelimitSetKeyed(ratelimit_t *ratelimit, const uchar *keyspec, unsigned maxKeys,
+	const uchar *statsBucket);
+int ratelimitKeyCheck(ratelimit_t *ratelimit, const uchar *key, time_t tt);
 rsRetVal ratelimitMsg(ratelimit_t *ratelimit, msg_t *pMsg, msg_t **ppRep);
 rsRetVal ratelimitAddMsg(ratelimit_t *ratelimit, multi_submit_t *pMultiSub, msg_t *pMsg);
 void ratelimitDestruct(ratelimit_t *pThis);
@@ -67,6 +67,8 @@
 #include "modules.h"
 #include "dirty.h"
 #include "template.h"
+#include "msgtrace.h"
+#include "dnscache.h"
 
 extern char* yytext;
 /* static data */
@@ -844,6 +846,13 @@ activate(rsconf_t *cnf)
 		generateConfigDAG(ourConf->globals.pszConfDAGFile);
 #	endif
 	setUmask(cnf->globals.umask);
+	/* tracing must be set up before privileges are dropped, as we may
+	 * need to open the trace file. Failure is not fatal.
+	 */
+	msgtraceActivate(glblPipelineTraceSampleRate, glblPipelineTraceFile);
+	dnscacheActivate(glblDnscacheMaxEntries, glblDnscacheTTL, glblDnscacheNegativeTTL,
+			 glblDnscacheResolvers, glblDnscacheTimeout);
+	parserActivate(glblParserAdaptive, glblParserAdaptiveRevalidate);
 
 	/* the output part and the queue is now ready to run. So it is a good time
 	 * to initialize the inputs. Please note that the net code above should be
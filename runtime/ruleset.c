@@ -49,6 +49,7 @@
 #include "srUtils.h"
 #include "modules.h"
 #include "wti.h"
+#include "msgtrace.h"
 #include "dirty.h" /* for main ruleset queue creation */
 
 /* static data */
@@ -592,7 +593,9 @@ processBatch(batch_t *pBatch, wti_t *pWti)
 		pMsg = pBatch->pElem[i].pMsg;
 		DBGPRINTF("processBATCH: next msg %d: %.128s\n", i, pMsg->pszRawMsg);
 		pRuleset = (pMsg->pRuleset == NULL) ? ourConf->rulesets.pDflt : pMsg->pRuleset;
+		msgtraceStamp(pMsg, MSGTRACE_EXEC_BEGIN);
 		localRet = scriptExec(pRuleset->root, pMsg, pWti);
+		msgtraceStamp(pMsg, MSGTRACE_EXEC_END);
 		/* the most important case here is that processing may be aborted
 		 * due to pbShutdownImmediate, in which case we MUST NOT flag this
 		 * message as committed. If we would do so, the message would
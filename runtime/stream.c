@@ -193,6 +193,105 @@ finalize_it:
  * strm instance object.
  */
 
+/* check if an (open) file is gzip-compressed. We look at the magic
+ * bytes only, so we also detect compressed files without .gz suffix.
+ */
+static int
+fdIsGzip(const int fd)
+{
+	uchar magic[2];
+	return pread(fd, magic, sizeof(magic), 0) == sizeof(magic)
+		&& magic[0] == 0x1f && magic[1] == 0x8b;
+}
+
+
+/* same as above, but for a file that is not yet open */
+static int
+fileIsGzip(const char *const name)
+{
+	int fd;
+	int r;
+
+	if((fd = open(name, O_RDONLY | O_CLOEXEC | O_NOCTTY)) == -1)
+		return 0;
+	r = fdIsGzip(fd);
+	close(fd);
+	return r;
+}
+
+
+/* prepare a read stream for a gzip-compressed file. We inflate on the fly
+ * when reading, so offsets (and thus the persisted state) are in terms of the
+ * *uncompressed* data. In read mode, zstrm and pZipBuf are used for the
+ * inflater and the compressed data read from disk.
+ */
+static rsRetVal
+strmInflateInit(strm_t *pThis)
+{
+	int zRet;
+	DEFiRet;
+
+	CHKiRet(objUse(zlibw, LM_ZLIBW_FILENAME));
+	if(pThis->pZipBuf == NULL)
+		CHKmalloc(pThis->pZipBuf = (Bytef*) MALLOC(pThis->sIOBufSize));
+	pThis->zstrm.zalloc = Z_NULL;
+	pThis->zstrm.zfree = Z_NULL;
+	pThis->zstrm.opaque = Z_NULL;
+	pThis->zstrm.next_in = Z_NULL;
+	pThis->zstrm.avail_in = 0;
+	/* 15 is the max window size, +16 selects gzip format */
+	zRet = zlibw.InflateInit2(&pThis->zstrm, 15 + 16);
+	if(zRet != Z_OK) {
+		DBGPRINTF("error %d returned from zlib/inflateInit2()\n", zRet);
+		ABORT_FINALIZE(RS_RET_ZLIB_ERR);
+	}
+	pThis->bzInitDone = RSTRUE;
+	pThis->bIsCompressed = 1;
+	DBGPRINTF("stream: file '%s' is gzip-compressed, decompressing on read\n",
+		pThis->pszCurrFName);
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* read and inflate data from a compressed file. Semantics are the same as
+ * for read(): returns the number of (uncompressed) bytes read, 0 on EOF of the
+ * compressed file and -1 on error. A file may consist of multiple gzip members,
+ * as permitted by RFC1952. Note that a compressed file may still be in the
+ * process of being written (e.g. by logrotate), in which case we return EOF and
+ * continue where we left off on the next call.
+ */
+static ssize_t
+doInflateRead(strm_t *pThis, const size_t toRead)
+{
+	ssize_t lenRead;
+	int zRet;
+
+	pThis->zstrm.next_out = pThis->pIOBuf;
+	pThis->zstrm.avail_out = toRead;
+	while(pThis->zstrm.avail_out == toRead) {
+		if(pThis->zstrm.avail_in == 0) {
+			lenRead = read(pThis->fd, pThis->pZipBuf, pThis->sIOBufSize);
+			if(lenRead <= 0)
+				return lenRead;
+			pThis->zstrm.next_in = pThis->pZipBuf;
+			pThis->zstrm.avail_in = lenRead;
+		}
+		zRet = zlibw.Inflate(&pThis->zstrm, Z_NO_FLUSH);
+		if(zRet == Z_STREAM_END) {
+			zlibw.InflateReset(&pThis->zstrm);
+		} else if(zRet != Z_OK && zRet != Z_BUF_ERROR) {
+			DBGPRINTF("error %d returned from zlib/inflate() on file '%s': %s\n",
+				zRet, pThis->pszCurrFName,
+				pThis->zstrm.msg == NULL ? "" : pThis->zstrm.msg);
+			return -1;
+		}
+	}
+	return toRead - pThis->zstrm.avail_out;
+}
+
+
 /* do the physical open() call on a file.
  */
 static rsRetVal
@@ -246,6 +345,8 @@ doPhysOpen(strm_t *pThis)
 			ABORT_FINALIZE(RS_RET_IO_ERROR);
 		}
 		pThis->inode = statOpen.st_ino;
+		if(pThis->bDecompress && fdIsGzip(pThis->fd))
+			CHKiRet(strmInflateInit(pThis));
 	}
 
 	if(!ustrcmp(pThis->pszCurrFName, UCHAR_CONSTANT(_PATH_CONSOLE)) || isatty(pThis->fd)) {
@@ -307,7 +408,12 @@ CheckFileChange(strm_t *pThis)
 		(unsigned) statName.st_ino,
 		(long long unsigned) statName.st_size,
 		(long long unsigned) pThis->iCurrOffs);
-	if(pThis->inode != statName.st_ino || statName.st_size < pThis->iCurrOffs) {
+	/* for compressed files, the offset is in terms of uncompressed data and
+	 * thus cannot be compared to the file size.
+	 */
+	if(pThis->inode != statName.st_ino
+	   || (statName.st_size < pThis->iCurrOffs
+	       && !(pThis->bDecompress && fileIsGzip((char*) pThis->pszCurrFName)))) {
 		DBGPRINTF("stream: file %s has changed\n", pThis->pszCurrFName);
 		pThis->iCurrOffs = 0;
 	}
@@ -418,6 +524,12 @@ static rsRetVal strmCloseFile(strm_t *pThis)
 	/* the file may already be closed (or never have opened), so guard
 	 * against this. -- rgerhards, 2010-03-19
 	 */
+	if(pThis->bIsCompressed) {
+		zlibw.InflateEnd(&pThis->zstrm);
+		pThis->bzInitDone = 0;
+		pThis->bIsCompressed = 0;
+	}
+
 	if(pThis->fd != -1) {
 		currOffs = lseek64(pThis->fd, 0, SEEK_CUR);
 		close(pThis->fd);
@@ -515,7 +627,8 @@ strmHandleEOFMonitor(strm_t *pThis)
 	 * means file was truncated, we also reopen if 'reopenOnTruncate' is on
 	 */
 	if (pThis->inode != statName.st_ino
-		  || (pThis->bReopenOnTruncate && statName.st_size < pThis->iCurrOffs)) {
+		  || (pThis->bReopenOnTruncate && !pThis->bIsCompressed
+		      && statName.st_size < pThis->iCurrOffs)) {
 		DBGPRINTF("we had a file change on '%s'\n", pThis->pszCurrFName);
 		CHKiRet(strmCloseFile(pThis));
 		CHKiRet(strmOpenFile(pThis));
@@ -593,7 +706,10 @@ strmReadBuf(strm_t *pThis, int *padBytes)
 				toRead = (size_t) bytesLeft;
 			}
 		}
-		iLenRead = read(pThis->fd, pThis->pIOBuf, toRead);
+		if(pThis->bIsCompressed)
+			iLenRead = doInflateRead(pThis, toRead);
+		else
+			iLenRead = read(pThis->fd, pThis->pIOBuf, toRead);
 		DBGOPRINT((obj_t*) pThis, "file %d read %ld bytes\n", pThis->fd, iLenRead);
 		/* end crypto */
 		if(iLenRead == 0) {
@@ -680,6 +796,103 @@ static rsRetVal strmUnreadChar(strm_t *pThis, uchar c)
 	return RS_RET_OK;
 }
 
+
+/* read a single LF-terminated line, but without going through strmReadChar()
+ * for each octet. Instead, we search the read buffer via memchr() and, if the
+ * line is fully contained in it, hand out a view directly into the buffer. Only
+ * lines that straddle a buffer boundary (or continue a segment left over from a
+ * previous EOF) are copied, with the partial data being kept in prevLineSegment
+ * exactly as strmReadLine() does. This is what makes catching up on large files
+ * fast.
+ * The returned line does NOT include the LF and is NOT '\0'-terminated. It is
+ * only valid until the next read call on this stream. trimLineOverBytes has the
+ * same semantics as for strmReadLine().
+ */
+static rsRetVal
+strmReadLineView(strm_t *const pThis, uchar **const ppLine, size_t *const pLenLine,
+	const uint32_t trimLineOverBytes)
+{
+	int padBytes;
+	uchar *pStart = NULL;
+	uchar *pLF = NULL;
+	size_t lenAvail;
+	size_t lenLine = 0;
+	DEFiRet;
+
+	ASSERT(pThis != NULL);
+	ASSERT(ppLine != NULL);
+	ASSERT(pLenLine != NULL);
+
+	if(pThis->pLineView != NULL)
+		cstrDestruct(&pThis->pLineView);
+
+	if(pThis->iUngetC != -1) {
+		/* can only happen if ReadLine() mode 2 was used before, so no need to optimize */
+		if(pThis->prevLineSegment == NULL)
+			CHKiRet(cstrConstruct(&pThis->prevLineSegment));
+		if(pThis->iUngetC != '\n')
+			CHKiRet(cstrAppendChar(pThis->prevLineSegment, (uchar) pThis->iUngetC));
+		++pThis->iCurrOffs;
+		if(pThis->iUngetC == '\n') {
+			pStart = pThis->pIOBuf + pThis->iBufPtr; /* line is complete in segment */
+			pLF = pStart;
+		}
+		pThis->iUngetC = -1;
+	}
+
+	while(pLF == NULL) {
+		if(pThis->iBufPtr >= pThis->iBufPtrMax) {
+			padBytes = 0;
+			CHKiRet(strmReadBuf(pThis, &padBytes));
+			pThis->iCurrOffs += padBytes;
+		}
+		pStart = pThis->pIOBuf + pThis->iBufPtr;
+		lenAvail = pThis->iBufPtrMax - pThis->iBufPtr;
+		pLF = memchr(pStart, '\n', lenAvail);
+		if(pLF == NULL) {
+			/* line straddles buffers, so we need to copy what we have so far */
+			if(pThis->prevLineSegment == NULL)
+				CHKiRet(cstrConstruct(&pThis->prevLineSegment));
+			CHKiRet(rsCStrAppendStrWithLen(pThis->prevLineSegment, pStart, lenAvail));
+			pThis->iBufPtr += lenAvail;
+			pThis->iCurrOffs += lenAvail;
+		} else {
+			lenLine = pLF - pStart;
+			pThis->iBufPtr += lenLine + 1;
+			pThis->iCurrOffs += lenLine + 1;
+		}
+	}
+
+	if(pThis->prevLineSegment != NULL) {
+		CHKiRet(rsCStrAppendStrWithLen(pThis->prevLineSegment, pStart, lenLine));
+		pThis->pLineView = pThis->prevLineSegment;
+		pThis->prevLineSegment = NULL;
+		pStart = rsCStrGetSzStrNoNULL(pThis->pLineView); /* finalizes */
+		lenLine = cstrLen(pThis->pLineView);
+	}
+
+	if(trimLineOverBytes > 0 && lenLine > trimLineOverBytes) {
+		/* Truncate long line at trimLineOverBytes position */
+		dbgprintf("Truncate long line at %u, mode 0\n", trimLineOverBytes);
+		if(pThis->pLineView == NULL) {
+			CHKiRet(cstrConstruct(&pThis->pLineView));
+			CHKiRet(rsCStrAppendStrWithLen(pThis->pLineView, pStart, trimLineOverBytes));
+		} else {
+			rsCStrTruncate(pThis->pLineView, lenLine - trimLineOverBytes);
+		}
+		CHKiRet(cstrAppendChar(pThis->pLineView, '\n'));
+		pStart = rsCStrGetSzStrNoNULL(pThis->pLineView);
+		lenLine = cstrLen(pThis->pLineView);
+	}
+
+	*ppLine = pStart;
+	*pLenLine = lenLine;
+
+finalize_it:
+	RETiRet;
+}
+
+
 /* read a 'paragraph' from a strm file.
  * A paragraph may be terminated by a LF, by a LFLF, or by LF<not whitespace> depending on the option set.
  * The termination LF characters are read, but are
@@ -697,12 +910,23 @@ strmReadLine(strm_t *pThis, cstr_t **ppCStr, uint8_t mode, sbool bEscapeLF, uint
 {
         uchar c;
 	uchar finished;
-	rsRetVal readCharRet;
+	uchar *pLine;
+	size_t lenLine;
         DEFiRet;
 
         ASSERT(pThis != NULL);
         ASSERT(ppCStr != NULL);
 
+	if(mode == 0) {
+		/* the by far most common case, so we use the block-based reader */
+		*ppCStr = NULL;
+		CHKiRet(strmReadLineView(pThis, &pLine, &lenLine, trimLineOverBytes));
+		CHKiRet(cstrConstruct(ppCStr));
+		CHKiRet(rsCStrAppendStrWithLen(*ppCStr, pLine, lenLine));
+		cstrFinalize(*ppCStr);
+		FINALIZE;
+	}
+
         CHKiRet(cstrConstruct(ppCStr));
         CHKiRet(strmReadChar(pThis, &c));
 
@@ -713,23 +937,7 @@ strmReadLine(strm_t *pThis, cstr_t **ppCStr, uint8_t mode, sbool bEscapeLF, uint
 		CHKiRet(cstrAppendCStr(*ppCStr, pThis->prevLineSegment));
 		cstrDestruct(&pThis->prevLineSegment);
 	}
-        if(mode == 0) {
-		while(c != '\n') {
-                	CHKiRet(cstrAppendChar(*ppCStr, c));
-                	readCharRet = strmReadChar(pThis, &c);
-                	if(readCharRet == RS_RET_EOF) {/* end of file reached without \n? */
-				CHKiRet(rsCStrConstructFromCStr(&pThis->prevLineSegment, *ppCStr));
-                	}
-                	CHKiRet(readCharRet);
-        	}
-		if (trimLineOverBytes > 0 && (uint32_t) cstrLen(*ppCStr) > trimLineOverBytes) {
-			/* Truncate long line at trimLineOverBytes position */
-			dbgprintf("Truncate long line at %u, mode %d\n", trimLineOverBytes, mode);
-			rsCStrTruncate(*ppCStr, cstrLen(*ppCStr) - trimLineOverBytes);
-			cstrAppendChar(*ppCStr, '\n');
-		}
-		cstrFinalize(*ppCStr);
-	} else if(mode == 1) {
+        if(mode == 1) {
 		finished=0;
 		while(finished == 0){
         		if(c != '\n') {
@@ -829,32 +1037,21 @@ finalize_it:
 rsRetVal
 strmReadMultiLine(strm_t *pThis, cstr_t **ppCStr, regex_t *preg, sbool bEscapeLF)
 {
-        uchar c;
+	uchar *pLine;
+	size_t lenLine;
 	uchar finished = 0;
 	cstr_t *thisLine = NULL;
-	rsRetVal readCharRet;
         DEFiRet;
 
         ASSERT(pThis != NULL);
         ASSERT(ppCStr != NULL);
 
 	do {
-		CHKiRet(strmReadChar(pThis, &c)); /* immediately exit on EOF */
+		/* immediately exit on EOF, partial line is kept in prevLineSegment */
+		CHKiRet(strmReadLineView(pThis, &pLine, &lenLine, 0));
+		/* the regex engine needs a C string, so we need to copy */
 		CHKiRet(cstrConstruct(&thisLine));
-		/* append previous message to current message if necessary */
-		if(pThis->prevLineSegment != NULL) {
-			CHKiRet(cstrAppendCStr(thisLine, pThis->prevLineSegment));
-			cstrDestruct(&pThis->prevLineSegment);
-		}
-
-		while(c != '\n') {
-			CHKiRet(cstrAppendChar(thisLine, c));
-			readCharRet = strmReadChar(pThis, &c);
-			if(readCharRet == RS_RET_EOF) {/* end of file reached without \n? */
-				CHKiRet(rsCStrConstructFromCStr(&pThis->prevLineSegment, thisLine));
-			}
-			CHKiRet(readCharRet);
-		}
+		CHKiRet(rsCStrAppendStrWithLen(thisLine, pLine, lenLine));
 		cstrFinalize(thisLine);
 
 		/* we have a line, now let's assemble the message */
@@ -905,6 +1102,9 @@ BEGINobjConstruct(strm) /* be sure to specify the object type also in END macro!
 	pThis->pszSizeLimitCmd = NULL;
 	pThis->prevLineSegment = NULL;
 	pThis->prevMsgSegment = NULL;
+	pThis->pLineView = NULL;
+	pThis->bDecompress = 0;
+	pThis->bIsCompressed = 0;
 	pThis->bPrevWasNL = 0;
 ENDobjConstruct(strm)
 
@@ -1033,6 +1233,8 @@ CODESTARTobjDestruct(strm)
 		cstrDestruct(&pThis->prevLineSegment);
 	if(pThis->prevMsgSegment)
 		cstrDestruct(&pThis->prevMsgSegment);
+	if(pThis->pLineView)
+		cstrDestruct(&pThis->pLineView);
 	free(pThis->pszDir);
 	free(pThis->pZipBuf);
 	free(pThis->pszCurrFName);
@@ -1675,29 +1877,90 @@ finalize_it:
 }
 
 
+/* As the cryprov may use CBC or similiar things and compressed files
+ * cannot be seeked at all, we need to read skip data for them. We do so
+ * block-wise, from the begin of the file up to targetOffs, or up to EOF
+ * if targetOffs is -1.
+ */
+static rsRetVal
+strmSkipRead(strm_t *pThis, const off64_t targetOffs)
+{
+	size_t toSkip;
+	int padBytes;
+	rsRetVal localRet;
+	DEFiRet;
+
+	pThis->iCurrOffs = 0;
+	pThis->iBufPtr = pThis->iBufPtrMax = 0;
+	DBGOPRINT((obj_t*) pThis, "encrypted or compressed, doing skip read of %lld bytes\n",
+		(long long) targetOffs);
+	while(targetOffs == -1 || pThis->iCurrOffs < targetOffs) {
+		if(pThis->iBufPtr >= pThis->iBufPtrMax) {
+			padBytes = 0;
+			localRet = strmReadBuf(pThis, &padBytes);
+			if(localRet == RS_RET_EOF && targetOffs == -1)
+				break;
+			CHKiRet(localRet);
+			pThis->iCurrOffs += padBytes;
+		}
+		toSkip = pThis->iBufPtrMax - pThis->iBufPtr;
+		if(targetOffs != -1 && (off64_t) toSkip > targetOffs - pThis->iCurrOffs)
+			toSkip = targetOffs - pThis->iCurrOffs;
+		pThis->iBufPtr += toSkip;
+		pThis->iCurrOffs += toSkip;
+	}
+finalize_it:
+	RETiRet;
+}
+
+
 /* seek to current offset. This is primarily a helper to readjust the OS file
  * pointer after a strm object has been deserialized.
  */
 static rsRetVal strmSeekCurrOffs(strm_t *pThis)
 {
 	off64_t targetOffs;
-	uchar c;
 	DEFiRet;
 
 	ISOBJ_TYPE_assert(pThis, strm);
 
-	if(pThis->cryprov == NULL || pThis->tOperationsMode != STREAMMODE_READ) {
+	targetOffs = pThis->iCurrOffs;
+	if(pThis->tOperationsMode == STREAMMODE_READ && pThis->bDecompress && pThis->fd == -1) {
+		/* we need to open the file to know if it is compressed */
+		CHKiRet(strmOpenFile(pThis));
+		pThis->iCurrOffs = targetOffs;
+	}
+
+	if(   (pThis->cryprov == NULL && !pThis->bIsCompressed)
+	   || pThis->tOperationsMode != STREAMMODE_READ) {
 		iRet = strmSeek(pThis, pThis->iCurrOffs);
 		FINALIZE;
 	}
 
-	/* As the cryprov may use CBC or similiar things, we need to read skip data */
-	targetOffs = pThis->iCurrOffs;
-	pThis->iCurrOffs = 0;
-	DBGOPRINT((obj_t*) pThis, "encrypted, doing skip read of %lld bytes\n",
-		(long long) targetOffs);
-	while(targetOffs != pThis->iCurrOffs) {
-		CHKiRet(strmReadChar(pThis, &c));
+	CHKiRet(strmSkipRead(pThis, targetOffs));
+finalize_it:
+	RETiRet;
+}
+
+
+/* seek to the end of a file opened for reading. For encrypted and compressed
+ * files, offsets are in terms of decrypted/uncompressed data, so the file size
+ * does not help. We need to skip-read the whole file instead.
+ */
+static rsRetVal strmSeekEnd(strm_t *pThis)
+{
+	struct stat statBuf;
+	DEFiRet;
+
+	ISOBJ_TYPE_assert(pThis, strm);
+
+	CHKiRet(strmOpenFile(pThis));
+	if(pThis->cryprov == NULL && !pThis->bIsCompressed) {
+		if(fstat(pThis->fd, &statBuf) == -1)
+			ABORT_FINALIZE(RS_RET_IO_ERROR);
+		CHKiRet(strmSeek(pThis, statBuf.st_size));
+	} else {
+		CHKiRet(strmSkipRead(pThis, -1));
 	}
 finalize_it:
 	RETiRet;
@@ -1835,6 +2098,7 @@ DEFpropSetMeth(strm, iZipLevel, int)
 DEFpropSetMeth(strm, bVeryReliableZip, int)
 DEFpropSetMeth(strm, bSync, int)
 DEFpropSetMeth(strm, bReopenOnTruncate, int)
+DEFpropSetMeth(strm, bDecompress, int)
 DEFpropSetMeth(strm, sIOBufSize, size_t)
 DEFpropSetMeth(strm, iSizeLimit, off_t)
 DEFpropSetMeth(strm, iFlushInterval, int)
@@ -2171,6 +2435,7 @@ CODESTARTobjQueryInterface(strm)
 	pIf->ReadChar = strmReadChar;
 	pIf->UnreadChar = strmUnreadChar;
 	pIf->ReadLine = strmReadLine;
+	pIf->ReadLineView = strmReadLineView;
 	pIf->SeekCurrOffs = strmSeekCurrOffs;
 	pIf->Write = strmWrite;
 	pIf->WriteChar = strmWriteChar;
@@ -2197,6 +2462,8 @@ CODESTARTobjQueryInterface(strm)
 	pIf->SetbVeryReliableZip = strmSetbVeryReliableZip;
 	pIf->SetbSync = strmSetbSync;
 	pIf->SetbReopenOnTruncate = strmSetbReopenOnTruncate;
+	pIf->SetbDecompress = strmSetbDecompress;
+	pIf->SeekEnd = strmSeekEnd;
 	pIf->SetsIOBufSize = strmSetsIOBufSize;
 	pIf->SetiSizeLimit = strmSetiSizeLimit;
 	pIf->SetiFlushInterval = strmSetiFlushInterval;
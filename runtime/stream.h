@@ -112,6 +112,8 @@ typedef struct strm_s {
 	sbool bDisabled; /* should file no longer be written to? (currently set only if omfile file size limit fails) */
 	sbool bSync;	/* sync this file after every write? */
 	sbool bReopenOnTruncate;
+	sbool bDecompress;	/* read mode: transparently decompress gzip files? */
+	sbool bIsCompressed;	/* read mode: currently open file is gzip-compressed (zstrm used for inflate) */
 	size_t sIOBufSize;/* size of IO buffer */
 	uchar *pszDir; /* Directory */
 	int lenDir;
@@ -156,6 +158,7 @@ typedef struct strm_s {
 	sbool	bIsTTY;		/* is this a tty file? */
 	cstr_t *prevLineSegment; /* for ReadLine, previous, unprocessed part of file */
 	cstr_t *prevMsgSegment; /* for ReadMultiLine, previous, yet unprocessed part of msg */
+	cstr_t *pLineView; /* for ReadLineView, line assembled from multiple buffers (if any) */
 } strm_t;
 
 
@@ -203,11 +206,18 @@ BEGINinterface(strm) /* name must also be changed in ENDinterface macro! */
 	/* v9 added  2013-04-04 */
 	INTERFACEpropSetMeth(strm, cryprov, cryprov_if_t*);
 	INTERFACEpropSetMeth(strm, cryprovData, void*);
+	/* v13 added */
+	rsRetVal (*ReadLineView)(strm_t *pThis, uchar **ppLine, size_t *pLenLine, uint32_t trimLineOverBytes);
+	/* v14 added */
+	INTERFACEpropSetMeth(strm, bDecompress, int);
+	rsRetVal (*SeekEnd)(strm_t *pThis);
 ENDinterface(strm)
-#define strmCURR_IF_VERSION 12 /* increment whenever you change the interface structure! */
+#define strmCURR_IF_VERSION 14 /* increment whenever you change the interface structure! */
 /* V10, 2013-09-10: added new parameter bEscapeLF, changed mode to uint8_t (rgerhards) */
 /* V11, 2015-12-03: added new parameter bReopenOnTruncate */
 /* V12, 2015-12-11: added new parameter trimLineOverBytes, changed mode to uint32_t */
+/* V13: added ReadLineView() for block-based line reading */
+/* V14: added bDecompress property for reading gzip files and SeekEnd() */
 
 static inline int
 strmGetCurrFileNum(strm_t *pStrm) {
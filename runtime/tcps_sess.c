@@ -70,7 +70,8 @@ BEGINobjConstruct(tcps_sess) /* be sure to specify the object type also in END m
 		pThis->inputState = eAtStrtFram; /* indicate frame header expected */
 		pThis->eFraming = TCP_FRAMING_OCTET_STUFFING; /* just make sure... */
 		/* now allocate the message reception buffer */
-		CHKmalloc(pThis->pMsg = (uchar*) MALLOC(glbl.GetMaxLine() + 1));
+		CHKiRet(msgChunkConstruct(&pThis->pChunk, glbl.GetMaxLine() + 1 + MSGCHUNK_DFLT_SIZE));
+		pThis->pMsg = pThis->pChunk->buf;
 finalize_it:
 ENDobjConstruct(tcps_sess)
 
@@ -106,7 +107,8 @@ CODESTARTobjDestruct(tcps_sess)
 		CHKiRet(prop.Destruct(&pThis->fromHost));
 	if(pThis->fromHostIP != NULL)
 		CHKiRet(prop.Destruct(&pThis->fromHostIP));
-	free(pThis->pMsg);
+	if(pThis->pChunk != NULL)
+		msgChunkRelease(pThis->pChunk);
 ENDobjDestruct(tcps_sess)
 
 
@@ -250,7 +252,7 @@ defaultDoSubmitMessage(tcps_sess_t *pThis, struct syslogTime *stTime, time_t ttG
 
 	/* we now create our own message object and submit it to the queue */
 	CHKiRet(msgConstructWithTime(&pMsg, stTime, ttGenTime));
-	MsgSetRawMsg(pMsg, (char*)pThis->pMsg, pThis->iMsg);
+	MsgSetRawMsgFromChunk(pMsg, &pThis->pChunk, &pThis->pMsg, pThis->iMsg, glbl.GetMaxLine() + 1);
 	MsgSetInputName(pMsg, pThis->pLstnInfo->pInputName);
 	if(pThis->pLstnInfo->dfltTZ[0] != '\0')
 		MsgSetDfltTZ(pMsg, (char*) pThis->pLstnInfo->dfltTZ);
@@ -488,6 +490,8 @@ DataRcvd(tcps_sess_t *pThis, char *pData, const size_t iLen)
 	multiSub.ppMsgs = pMsgs;
 	multiSub.maxElem = NUM_MULTISUB;
 	multiSub.nElem = 0;
+	if(pThis->iMsg == 0) /* no partial message, so we may be able to recycle the chunk */
+		msgChunkRewind(pThis->pChunk, &pThis->pMsg);
 
 	 /* We now copy the message to the session buffer. */
 	pEnd = pData + iLen; /* this is one off, which is intensional */
@@ -44,7 +44,8 @@ struct tcps_sess_s {
 	} inputState;		/* our current state */
 	int iOctetsRemain;	/* Number of Octets remaining in message */
 	TCPFRAMINGMODE eFraming;
-	uchar *pMsg;		/* message (fragment) received */
+	uchar *pMsg;		/* message (fragment) received, points into pChunk */
+	struct msgChunk_s *pChunk; /* receive chunk, handed over to messages without copying */
 	prop_t *fromHost;	/* host name we received messages from */
 	prop_t *fromHostIP;
 	void *pUsr;		/* a user-pointer */
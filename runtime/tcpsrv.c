@@ -51,6 +51,7 @@
 #include <netinet/in.h>
 #include <netdb.h>
 #include <pthread.h>
+#include <signal.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #if HAVE_FCNTL_H
@@ -99,26 +100,45 @@ DEFobjCurrIf(nspoll)
 DEFobjCurrIf(prop)
 DEFobjCurrIf(statsobj)
 
-static void startWorkerPool(void);
-
-/* The following structure controls the worker threads. Global data is
- * needed for their access.
+/* The following structure controls the helper worker threads of a server
+ * in select() mode. Each server has its own pool.
  */
-static struct wrkrInfo_s {
+struct tcpsrv_wrkrInfo_s {
 	pthread_t tid;	/* the worker's thread ID */
 	pthread_cond_t run;
+	tcpsrv_t *pSrv;	/* the server we belong to */
 	int idx;
-	tcpsrv_t *pSrv; /* pSrv == NULL -> idle */
-	nspoll_t *pPoll;
 	void *pUsr;
+	sbool bBusy;	/* has the worker been assigned work? */
 	sbool enabled;
 	long long unsigned numCalled;	/* how often was this called */
-} wrkrInfo[4];
-static sbool bWrkrRunning; /* are the worker threads running? */
-static pthread_mutex_t wrkrMut;
-static pthread_cond_t wrkrIdle;
-static int wrkrMax = 4;
-static int wrkrRunning;
+};
+
+/* An event loop, used in epoll() mode. Each loop has its own nspoll set
+ * and thread. The first loop also services the listeners and hands new
+ * sessions over to the loops in a round-robin fashion. A session is
+ * processed by its loop only, for its whole lifetime.
+ * If handshake threads are configured, new TLS sessions first go to a
+ * handshake loop. That loop does nothing but the handshake and then hands
+ * the session over to a regular loop. So expensive handshakes (e.g. after
+ * a restart, when all clients reconnect) can not stall established sessions.
+ */
+typedef struct tcpsrv_evtLoop_s {
+	pthread_t tid;
+	tcpsrv_t *pSrv;
+	nspoll_t *pPoll;
+	int id;
+	sbool bThrdStarted;	/* do we have a thread (loops other than the first)? */
+	sbool bHandshake;	/* is this a handshake loop? */
+	int iNextEvtLoop;	/* handshake loops: regular loop that receives the next session */
+	long long unsigned numCalled;	/* number of events processed */
+} tcpsrvEvtLoop_t;
+
+/* loops other than the first are woken up by SIGTTIN on termination. To guard
+ * against the signal arriving just before we enter the wait, we do not
+ * block forever but re-check the termination state periodically.
+ */
+#define TCPSRV_EVTLOOP_TIMEOUT 1000 /* ms */
 
 /* add new listener port to listener port list
  * rgerhards, 2009-05-21
@@ -175,6 +195,10 @@ addNewLstnPort(tcpsrv_t *pThis, uchar *pszPort, int bSuppOctetFram, uchar *pszAd
 	CHKiRet(ratelimitNew(&pEntry->ratelimiter, "tcperver", NULL));
 	ratelimitSetLinuxLike(pEntry->ratelimiter, pThis->ratelimitInterval, pThis->ratelimitBurst);
 	ratelimitSetThreadSafe(pEntry->ratelimiter);
+	if(pThis->ratelimitKey != NULL) {
+		CHKiRet(ratelimitSetKeyed(pEntry->ratelimiter, pThis->ratelimitKey,
+			pThis->ratelimitMaxKeys, pThis->ratelimitKeyStats));
+	}
 	STATSCOUNTER_INIT(pEntry->ctrSubmit, pEntry->mutCtrSubmit);
 	CHKiRet(statsobj.AddCounter(pEntry->stats, UCHAR_CONSTANT("submitted"),
 		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &(pEntry->ctrSubmit)));
@@ -556,6 +580,9 @@ finalize_it:
 /* process a receive request on one of the streams
  * If pPoll is non-NULL, we have a netstream in epoll mode, which means we need
  * to remove any descriptor we close from the epoll set.
+ * The driver may have read more data from the socket than fits into our
+ * buffer (e.g. TLS records). The socket does not signal that data again, so
+ * we keep on receiving until the driver has nothing pending any longer.
  * rgerhards, 2009-07-020
  */
 static rsRetVal
@@ -567,56 +594,102 @@ doReceive(tcpsrv_t *pThis, tcps_sess_t **ppSess, nspoll_t *pPoll)
 	DEFiRet;
 	uchar *pszPeer;
 	int lenPeer;
+	int bPending;
 
 	ISOBJ_TYPE_assert(pThis, tcpsrv);
 	DBGPRINTF("netstream %p with new data\n", (*ppSess)->pStrm);
-	/* Receive message */
-	iRet = pThis->pRcvData(*ppSess, buf, sizeof(buf), &iRcvd);
-	switch(iRet) {
-	case RS_RET_CLOSED:
-		if(pThis->bEmitMsgOnClose) {
+	do {
+		bPending = 0;
+		/* Receive message */
+		iRet = pThis->pRcvData(*ppSess, buf, sizeof(buf), &iRcvd);
+		switch(iRet) {
+		case RS_RET_CLOSED:
+			if(pThis->bEmitMsgOnClose) {
+				errno = 0;
+				prop.GetString((*ppSess)->fromHostIP, &pszPeer, &lenPeer);
+				errmsg.LogError(0, RS_RET_PEER_CLOSED_CONN, "Netstream session %p closed by remote peer %s.\n",
+						(*ppSess)->pStrm, pszPeer);
+			}
+			CHKiRet(closeSess(pThis, ppSess, pPoll));
+			break;
+		case RS_RET_RETRY:
+			/* we simply ignore retry - this is not an error, but we also have not received anything */
+			break;
+		case RS_RET_OK:
+			/* valid data received, process it! */
+			localRet = tcps_sess.DataRcvd(*ppSess, buf, iRcvd);
+			if(localRet != RS_RET_OK && localRet != RS_RET_QUEUE_FULL) {
+				/* in this case, something went awfully wrong.
+				 * We are instructed to terminate the session.
+				 */
+				prop.GetString((*ppSess)->fromHostIP, &pszPeer, &lenPeer);
+				errmsg.LogError(0, localRet, "Tearing down TCP Session from %s - see "
+						    "previous messages for reason(s)\n", pszPeer);
+				CHKiRet(closeSess(pThis, ppSess, pPoll));
+			} else {
+				CHKiRet(netstrm.HasRcvPending((*ppSess)->pStrm, &bPending));
+			}
+			break;
+		default:
 			errno = 0;
 			prop.GetString((*ppSess)->fromHostIP, &pszPeer, &lenPeer);
-			errmsg.LogError(0, RS_RET_PEER_CLOSED_CONN, "Netstream session %p closed by remote peer %s.\n",
+			errmsg.LogError(0, iRet, "netstream session %p from %s will be closed due to error\n",
 					(*ppSess)->pStrm, pszPeer);
-		}
-		CHKiRet(closeSess(pThis, ppSess, pPoll));
-		break;
-	case RS_RET_RETRY:
-		/* we simply ignore retry - this is not an error, but we also have not received anything */
-		break;
-	case RS_RET_OK:
-		/* valid data received, process it! */
-		localRet = tcps_sess.DataRcvd(*ppSess, buf, iRcvd);
-		if(localRet != RS_RET_OK && localRet != RS_RET_QUEUE_FULL) {
-			/* in this case, something went awfully wrong.
-			 * We are instructed to terminate the session.
-			 */
-			prop.GetString((*ppSess)->fromHostIP, &pszPeer, &lenPeer);
-			errmsg.LogError(0, localRet, "Tearing down TCP Session from %s - see "
-					    "previous messages for reason(s)\n", pszPeer);
 			CHKiRet(closeSess(pThis, ppSess, pPoll));
+			break;
 		}
-		break;
-	default:
-		errno = 0;
-		prop.GetString((*ppSess)->fromHostIP, &pszPeer, &lenPeer);
-		errmsg.LogError(0, iRet, "netstream session %p from %s will be closed due to error\n",
-				(*ppSess)->pStrm, pszPeer);
-		CHKiRet(closeSess(pThis, ppSess, pPoll));
-		break;
-	}
+	} while(bPending);
 
 finalize_it:
 	RETiRet;
 }
 
+/* select the event loop for a new session (round-robin). Each caller
+ * (the first loop and each handshake loop) has its own round-robin
+ * position, so no locking is needed. Loops whose thread could not be
+ * started are skipped.
+ */
+static inline nspoll_t *
+nextEvtLoopPoll(tcpsrv_t *pThis, int *const piNext)
+{
+	int i;
+	do {
+		i = *piNext;
+		*piNext = (*piNext + 1) % pThis->iNumWrkr;
+	} while(i != 0 && !pThis->pEvtLoops[i].bThrdStarted);
+	return pThis->pEvtLoops[i].pPoll;
+}
+
+/* select the handshake loop for a newly accepted session (round-robin,
+ * only called by the first loop). Returns NULL if handshakes are to be done
+ * by the regular loops, either because no handshake threads are configured,
+ * none could be started or the driver is in plain tcp mode.
+ */
+static inline nspoll_t *
+nextHsLoopPoll(tcpsrv_t *pThis)
+{
+	int i;
+	int n;
+
+	if(pThis->pHsLoops == NULL || pThis->iDrvrMode == 0)
+		return NULL;
+	for(n = 0 ; n < pThis->iNumHsWrkr ; ++n) {
+		i = pThis->iNextHsLoop;
+		pThis->iNextHsLoop = (pThis->iNextHsLoop + 1) % pThis->iNumHsWrkr;
+		if(pThis->pHsLoops[i].bThrdStarted)
+			return pThis->pHsLoops[i].pPoll;
+	}
+	return NULL;
+}
+
+
 /* process a single workset item
  */
 static inline rsRetVal
 processWorksetItem(tcpsrv_t *pThis, nspoll_t *pPoll, int idx, void *pUsr)
 {
 	tcps_sess_t *pNewSess = NULL;
+	nspoll_t *pNewPoll;
 	DEFiRet;
 
 	DBGPRINTF("tcpsrv: processing item %d, pUsr %p, bAbortConn\n", idx, pUsr);
@@ -625,7 +698,10 @@ processWorksetItem(tcpsrv_t *pThis, nspoll_t *pPoll, int idx, void *pUsr)
 		iRet = SessAccept(pThis, pThis->ppLstnPort[idx], &pNewSess, pThis->ppLstn[idx]);
 		if(iRet == RS_RET_OK) {
 			if(pPoll != NULL) {
-				CHKiRet(nspoll.Ctl(pPoll, pNewSess->pStrm, 0, pNewSess, NSDPOLL_IN, NSDPOLL_ADD));
+				if((pNewPoll = nextHsLoopPoll(pThis)) == NULL)
+					pNewPoll = nextEvtLoopPoll(pThis, &pThis->iNextEvtLoop);
+				CHKiRet(nspoll.Ctl(pNewPoll, pNewSess->pStrm, 0, pNewSess,
+					NSDPOLL_IN, NSDPOLL_ADD));
 			}
 			DBGPRINTF("New session created with NSD %p.\n", pNewSess);
 		} else {
@@ -644,46 +720,116 @@ finalize_it:
 }
 
 
-/* worker to process incoming requests
+/* worker to process incoming requests (select mode)
  */
 static void *
 wrkr(void *myself)
 {
-	struct wrkrInfo_s *me = (struct wrkrInfo_s*) myself;
+	struct tcpsrv_wrkrInfo_s *me = (struct tcpsrv_wrkrInfo_s*) myself;
+	tcpsrv_t *pThis = me->pSrv;
 	
-	pthread_mutex_lock(&wrkrMut);
+	pthread_mutex_lock(&pThis->wrkrMut);
 	while(1) {
-		while(me->pSrv == NULL && glbl.GetGlobalInputTermState() == 0) {
-			pthread_cond_wait(&me->run, &wrkrMut);
+		while(!me->bBusy && !pThis->bWrkrStop && glbl.GetGlobalInputTermState() == 0) {
+			pthread_cond_wait(&me->run, &pThis->wrkrMut);
 		}
-		if(glbl.GetGlobalInputTermState() == 1) {
-			--wrkrRunning;
+		if(pThis->bWrkrStop || glbl.GetGlobalInputTermState() == 1) {
+			if(me->bBusy) {
+				--pThis->wrkrRunning;
+				pthread_cond_signal(&pThis->wrkrIdle);
+			}
 			break;
 		}
-		pthread_mutex_unlock(&wrkrMut);
+		pthread_mutex_unlock(&pThis->wrkrMut);
 
 		++me->numCalled;
-		processWorksetItem(me->pSrv, me->pPoll, me->idx, me->pUsr);
+		processWorksetItem(pThis, NULL, me->idx, me->pUsr);
 
-		pthread_mutex_lock(&wrkrMut);
-		me->pSrv = NULL;	/* indicate we are free again */
-		--wrkrRunning;
-		pthread_cond_signal(&wrkrIdle);
+		pthread_mutex_lock(&pThis->wrkrMut);
+		me->bBusy = 0;	/* indicate we are free again */
+		--pThis->wrkrRunning;
+		pthread_cond_signal(&pThis->wrkrIdle);
 	}
 	me->enabled = 0; /* indicate we are no longer available */
-	pthread_mutex_unlock(&wrkrMut);
+	pthread_mutex_unlock(&pThis->wrkrMut);
 
 	return NULL;
 }
 
 
+/* start the helper worker threads (select mode)
+ * Important: if we fork, this MUST be done AFTER forking
+ */
+static void
+startWorkerPool(tcpsrv_t *pThis)
+{
+	int i;
+	int r;
+	pthread_attr_t sessThrdAttr;
+
+	pThis->wrkrRunning = 0;
+	pThis->bWrkrStop = 0;
+	pThis->pWrkrInfo = calloc(pThis->iNumWrkr, sizeof(struct tcpsrv_wrkrInfo_s));
+	if(pThis->pWrkrInfo == NULL) {
+		errmsg.LogError(0, RS_RET_OUT_OF_MEMORY, "tcpsrv: could not allocate worker pool, "
+				"processing all requests on the receiving thread");
+		return;
+	}
+	pthread_attr_init(&sessThrdAttr);
+	pthread_attr_setstacksize(&sessThrdAttr, 4096*1024);
+	for(i = 0 ; i < pThis->iNumWrkr ; ++i) {
+		/* init worker info structure! */
+		pthread_cond_init(&pThis->pWrkrInfo[i].run, NULL);
+		pThis->pWrkrInfo[i].pSrv = pThis;
+		pThis->pWrkrInfo[i].bBusy = 0;
+		pThis->pWrkrInfo[i].numCalled = 0;
+		r = pthread_create(&pThis->pWrkrInfo[i].tid, &sessThrdAttr, wrkr, &(pThis->pWrkrInfo[i]));
+		if(r == 0) {
+			pThis->pWrkrInfo[i].enabled = 1;
+		} else {
+			char errStr[1024];
+			pThis->pWrkrInfo[i].enabled = 0;
+			rs_strerror_r(r, errStr, sizeof(errStr));
+			errmsg.LogError(0, NO_ERRCODE, "tcpsrv error creating thread %d: "
+			                "%s", i, errStr);
+		}
+	}
+	pThis->iWrkrPoolSize = pThis->iNumWrkr;
+	pthread_attr_destroy(&sessThrdAttr);
+}
+
+/* destroy worker pool structures and wait for workers to terminate
+ */
+static void
+stopWorkerPool(tcpsrv_t *pThis)
+{
+	int i;
+
+	pthread_mutex_lock(&pThis->wrkrMut);
+	pThis->bWrkrStop = 1;
+	for(i = 0 ; i < pThis->iWrkrPoolSize ; ++i) {
+		pthread_cond_signal(&pThis->pWrkrInfo[i].run); /* awake wrkr if not running */
+	}
+	pthread_mutex_unlock(&pThis->wrkrMut);
+	for(i = 0 ; i < pThis->iWrkrPoolSize ; ++i) {
+		if(pThis->pWrkrInfo[i].enabled)
+			pthread_join(pThis->pWrkrInfo[i].tid, NULL);
+		DBGPRINTF("tcpsrv: info: worker %d was called %llu times\n", i, pThis->pWrkrInfo[i].numCalled);
+		pthread_cond_destroy(&pThis->pWrkrInfo[i].run);
+	}
+	free(pThis->pWrkrInfo);
+	pThis->pWrkrInfo = NULL;
+	pThis->iWrkrPoolSize = 0;
+}
+
+
 /* Process a workset, that is handle io. We become activated
- * from either select or epoll handler. We split the workload
+ * from the select handler. We split the workload
  * out to a pool of threads, but try to avoid context switches
  * as much as possible.
  */
 static rsRetVal
-processWorkset(tcpsrv_t *pThis, nspoll_t *pPoll, int numEntries, nsd_epworkset_t workset[])
+processWorkset(tcpsrv_t *pThis, int numEntries, nsd_epworkset_t workset[])
 {
 	int i;
 	int origEntries = numEntries;
@@ -696,30 +842,30 @@ processWorkset(tcpsrv_t *pThis, nspoll_t *pPoll, int numEntries, nsd_epworkset_t
 			ABORT_FINALIZE(RS_RET_FORCE_TERM);
 		if(numEntries == 1) {
 			/* process self, save context switch */
-			processWorksetItem(pThis, pPoll, workset[numEntries-1].id, workset[numEntries-1].pUsr);
+			processWorksetItem(pThis, NULL, workset[numEntries-1].id, workset[numEntries-1].pUsr);
 		} else {
-			pthread_mutex_lock(&wrkrMut);
+			pthread_mutex_lock(&pThis->wrkrMut);
 			/* check if there is a free worker */
-			for(i = 0 ; (i < wrkrMax) && ((wrkrInfo[i].pSrv != NULL) || (wrkrInfo[i].enabled == 0)) ; ++i)
+			for(i = 0 ; (i < pThis->iWrkrPoolSize) && (pThis->pWrkrInfo[i].bBusy
+			    || (pThis->pWrkrInfo[i].enabled == 0)) ; ++i)
 				/*do search*/;
-			if(i < wrkrMax) {
+			if(i < pThis->iWrkrPoolSize) {
 				/* worker free -> use it! */
-				wrkrInfo[i].pSrv = pThis;
-				wrkrInfo[i].pPoll = pPoll;
-				wrkrInfo[i].idx = workset[numEntries -1].id;
-				wrkrInfo[i].pUsr = workset[numEntries -1].pUsr;
+				pThis->pWrkrInfo[i].bBusy = 1;
+				pThis->pWrkrInfo[i].idx = workset[numEntries -1].id;
+				pThis->pWrkrInfo[i].pUsr = workset[numEntries -1].pUsr;
 				/* Note: we must increment wrkrRunning HERE and not inside the worker's
 				 * code. This is because a worker may actually never start, and thus
 				 * increment wrkrRunning, before we finish and check the running worker
 				 * count. We can only avoid this by incrementing it here.
 				 */
-				++wrkrRunning;
-				pthread_cond_signal(&wrkrInfo[i].run);
-				pthread_mutex_unlock(&wrkrMut);
+				++pThis->wrkrRunning;
+				pthread_cond_signal(&pThis->pWrkrInfo[i].run);
+				pthread_mutex_unlock(&pThis->wrkrMut);
 			} else {
-				pthread_mutex_unlock(&wrkrMut);
+				pthread_mutex_unlock(&pThis->wrkrMut);
 				/* no free worker, so we process this one ourselfs */
-				processWorksetItem(pThis, pPoll, workset[numEntries-1].id,
+				processWorksetItem(pThis, NULL, workset[numEntries-1].id,
 						   workset[numEntries-1].pUsr);
 			}
 		}
@@ -731,11 +877,11 @@ processWorkset(tcpsrv_t *pThis, nspoll_t *pPoll, int numEntries, nsd_epworkset_t
 		 * rest of this module can not handle the concurrency introduced
 		 * by workers running during the epoll call.
 		 */
-		pthread_mutex_lock(&wrkrMut);
-		while(wrkrRunning > 0) {
-			pthread_cond_wait(&wrkrIdle, &wrkrMut);
+		pthread_mutex_lock(&pThis->wrkrMut);
+		while(pThis->wrkrRunning > 0) {
+			pthread_cond_wait(&pThis->wrkrIdle, &pThis->wrkrMut);
 		}
-		pthread_mutex_unlock(&wrkrMut);
+		pthread_mutex_unlock(&pThis->wrkrMut);
 	}
 
 finalize_it:
@@ -802,7 +948,7 @@ RunSelect(tcpsrv_t *pThis, nsd_epworkset_t workset[], size_t sizeWorkset)
 				workset[iWorkset].pUsr = (void*) pThis->ppLstn; /* this is a flag to indicate listen sock */
 				++iWorkset;
 				if(iWorkset >= (int) sizeWorkset) {
-					processWorkset(pThis, NULL, iWorkset, workset);
+					processWorkset(pThis, iWorkset, workset);
 					iWorkset = 0;
 				}
 				//DBGPRINTF("New connect on NSD %p.\n", pThis->ppLstn[i]);
@@ -822,7 +968,7 @@ RunSelect(tcpsrv_t *pThis, nsd_epworkset_t workset[], size_t sizeWorkset)
 				workset[iWorkset].pUsr = (void*) pThis->pSessions[iTCPSess];
 				++iWorkset;
 				if(iWorkset >= (int) sizeWorkset) {
-					processWorkset(pThis, NULL, iWorkset, workset);
+					processWorkset(pThis, iWorkset, workset);
 					iWorkset = 0;
 				}
 				--nfds; /* indicate we have processed one */
@@ -831,7 +977,7 @@ RunSelect(tcpsrv_t *pThis, nsd_epworkset_t workset[], size_t sizeWorkset)
 		}
 
 		if(iWorkset > 0)
-			processWorkset(pThis, NULL, iWorkset, workset);
+			processWorkset(pThis, iWorkset, workset);
 
 		/* we need to copy back close descriptors */
 		CHKiRet(nssel.Destruct(&pSel));
@@ -854,9 +1000,217 @@ finalize_it: /* this is a very special case - this time only we do not exit the
 #pragma GCC diagnostic warning "-Wempty-body"
 
 
+/* destruct an array of event loops. Threads must already have terminated. */
+static void
+destructEvtLoopArr(tcpsrvEvtLoop_t **ppLoops, const int nLoops)
+{
+	int i;
+
+	if(*ppLoops == NULL)
+		return;
+	for(i = 0 ; i < nLoops ; ++i) {
+		if((*ppLoops)[i].pPoll != NULL)
+			nspoll.Destruct(&(*ppLoops)[i].pPoll);
+	}
+	free(*ppLoops);
+	*ppLoops = NULL;
+}
+
+/* destruct the event loops, if any. Threads must already have terminated. */
+static void
+destructEvtLoops(tcpsrv_t *pThis)
+{
+	destructEvtLoopArr(&pThis->pEvtLoops, pThis->iNumWrkr);
+	destructEvtLoopArr(&pThis->pHsLoops, pThis->iNumHsWrkr);
+}
+
+
+/* construct an array of event loops, each with its own nspoll set */
+static rsRetVal
+constructEvtLoopArr(tcpsrv_t *pThis, tcpsrvEvtLoop_t **ppLoops, const int nLoops,
+	const int firstId, const sbool bHandshake)
+{
+	tcpsrvEvtLoop_t *pLoops;
+	int i;
+	DEFiRet;
+
+	CHKmalloc(pLoops = calloc(nLoops, sizeof(tcpsrvEvtLoop_t)));
+	*ppLoops = pLoops;
+	for(i = 0 ; i < nLoops ; ++i) {
+		pLoops[i].pSrv = pThis;
+		pLoops[i].id = firstId + i;
+		pLoops[i].bHandshake = bHandshake;
+		pLoops[i].iNextEvtLoop = i % pThis->iNumWrkr; /* spread handovers */
+		CHKiRet(nspoll.Construct(&pLoops[i].pPoll));
+		if(pThis->pszDrvrName != NULL)
+			CHKiRet(nspoll.SetDrvrName(pLoops[i].pPoll, pThis->pszDrvrName));
+		CHKiRet(nspoll.ConstructFinalize(pLoops[i].pPoll));
+	}
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* construct one event loop (with its own nspoll set) per worker, plus
+ * the handshake loops. If this fails, the driver does not support epoll()
+ * and we need to use select().
+ */
+static rsRetVal
+constructEvtLoops(tcpsrv_t *pThis)
+{
+	DEFiRet;
+
+	CHKiRet(constructEvtLoopArr(pThis, &pThis->pEvtLoops, pThis->iNumWrkr, 0, 0));
+	if(pThis->iNumHsWrkr > 0 && pThis->iDrvrMode != 0) {
+		CHKiRet(constructEvtLoopArr(pThis, &pThis->pHsLoops, pThis->iNumHsWrkr,
+			pThis->iNumWrkr, 1));
+	}
+	pThis->iNextEvtLoop = 0;
+	pThis->iNextHsLoop = 0;
+
+finalize_it:
+	if(iRet != RS_RET_OK)
+		destructEvtLoops(pThis);
+	RETiRet;
+}
+
+
+/* process an event on a handshake loop: continue the handshake and, once
+ * it is done, hand the session over to a regular loop. Data still waiting
+ * in the socket is then processed by that loop, as the socket is still
+ * readable. However, the driver may already have read application data
+ * along with the handshake (e.g. if the client sent it in the same flight
+ * as its Finished message). The socket does not signal that data again,
+ * so we process it right here, before the handover.
+ */
+static void
+processHandshakeItem(tcpsrvEvtLoop_t *const pLoop, tcps_sess_t *pSess)
+{
+	tcpsrv_t *const pThis = pLoop->pSrv;
+	rsRetVal localRet;
+	int bPending = 0;
+
+	localRet = netstrm.Handshake(pSess->pStrm);
+	if(localRet == RS_RET_RETRY)
+		return; /* wait for more data from peer */
+	if(localRet == RS_RET_OK)
+		localRet = netstrm.HasRcvPending(pSess->pStrm, &bPending);
+	if(localRet == RS_RET_OK && bPending) {
+		doReceive(pThis, &pSess, pLoop->pPoll);
+		if(pSess == NULL)
+			return; /* session was closed */
+	}
+	if(localRet == RS_RET_OK) {
+		localRet = nspoll.Ctl(pLoop->pPoll, pSess->pStrm, 0, pSess, NSDPOLL_IN, NSDPOLL_DEL);
+		if(localRet == RS_RET_OK) {
+			localRet = nspoll.Ctl(nextEvtLoopPoll(pThis, &pLoop->iNextEvtLoop), pSess->pStrm,
+				0, pSess, NSDPOLL_IN, NSDPOLL_ADD);
+			if(localRet == RS_RET_OK)
+				return;
+			/* session is in no poll set any longer */
+			closeSess(pThis, &pSess, NULL);
+			return;
+		}
+	}
+	DBGPRINTF("tcpsrv: handshake on netstream %p failed with %d, closing session\n",
+		pSess->pStrm, localRet);
+	closeSess(pThis, &pSess, pLoop->pPoll);
+}
+
+
+/* run a single event loop until input termination. All i/o of the
+ * sessions owned by this loop is done on the calling thread.
+ */
+static void
+runEvtLoop(tcpsrvEvtLoop_t *const pLoop)
+{
+	nsd_epworkset_t workset[128]; /* 128 is currently fixed num of concurrent requests */
+	int numEntries;
+	int i;
+	rsRetVal localRet;
+	const int timeout = (pLoop->id == 0) ? -1 : TCPSRV_EVTLOOP_TIMEOUT;
+
+	DBGPRINTF("tcpsrv: %s loop %d starting\n", pLoop->bHandshake ? "handshake" : "event", pLoop->id);
+	while(1) {
+		numEntries = sizeof(workset)/sizeof(nsd_epworkset_t);
+		localRet = nspoll.Wait(pLoop->pPoll, timeout, &numEntries, workset);
+		if(glbl.GetGlobalInputTermState() == 1)
+			break; /* terminate input! */
+
+		/* check if we need to ignore the i/o ready state. We do this if we got an invalid
+		 * return state. Validly, this can happen for RS_RET_EINTR, for other cases it may
+		 * not be the right thing, but what is the right thing is really hard at this point...
+		 */
+		if(localRet != RS_RET_OK)
+			continue;
+
+		for(i = 0 ; i < numEntries && glbl.GetGlobalInputTermState() == 0 ; ++i) {
+			if(pLoop->bHandshake)
+				processHandshakeItem(pLoop, (tcps_sess_t*) workset[i].pUsr);
+			else
+				processWorksetItem(pLoop->pSrv, pLoop->pPoll, workset[i].id, workset[i].pUsr);
+		}
+		pLoop->numCalled += numEntries;
+	}
+}
+
+static void *
+evtLoopThrd(void *myself)
+{
+	runEvtLoop((tcpsrvEvtLoop_t*) myself);
+	return NULL;
+}
+
+
+/* start the threads for an array of event loops, beginning at loop firstIdx */
+static void
+startEvtLoopThrds(tcpsrvEvtLoop_t *const pLoops, const int nLoops, const int firstIdx)
+{
+	pthread_attr_t thrdAttr;
+	int i;
+
+	pthread_attr_init(&thrdAttr);
+	pthread_attr_setstacksize(&thrdAttr, 4096*1024);
+	for(i = firstIdx ; i < nLoops ; ++i) {
+		if(pthread_create(&pLoops[i].tid, &thrdAttr, evtLoopThrd, &pLoops[i]) == 0) {
+			pLoops[i].bThrdStarted = 1;
+		} else {
+			errmsg.LogError(0, NO_ERRCODE, "tcpsrv: could not create thread for %s loop %d, "
+					"continuing with less loops",
+					pLoops[i].bHandshake ? "handshake" : "event", pLoops[i].id);
+		}
+	}
+	pthread_attr_destroy(&thrdAttr);
+}
+
+/* terminate the threads of an array of event loops */
+static void
+stopEvtLoopThrds(tcpsrvEvtLoop_t *const pLoops, const int nLoops)
+{
+	int i;
+
+	if(pLoops == NULL)
+		return;
+	for(i = 0 ; i < nLoops ; ++i) {
+		if(pLoops[i].bThrdStarted)
+			pthread_kill(pLoops[i].tid, SIGTTIN);
+	}
+	for(i = 0 ; i < nLoops ; ++i) {
+		if(pLoops[i].bThrdStarted)
+			pthread_join(pLoops[i].tid, NULL);
+		DBGPRINTF("tcpsrv: info: %s loop %d processed %llu events\n",
+			pLoops[i].bHandshake ? "handshake" : "event", pLoops[i].id,
+			pLoops[i].numCalled);
+	}
+}
+
+
 /* This function is called to gather input. It tries doing that via the epoll()
  * interface. If the driver does not support that, it falls back to calling its
  * select() equivalent.
+ * In epoll() mode, we run one event loop per worker. The first loop runs on
+ * the calling thread and services the listeners.
  * rgerhards, 2009-11-18
  */
 static rsRetVal
@@ -865,74 +1219,53 @@ Run(tcpsrv_t *pThis)
 	DEFiRet;
 	int i;
 	nsd_epworkset_t workset[128]; /* 128 is currently fixed num of concurrent requests */
-	int numEntries;
-	nspoll_t *pPoll = NULL;
+	nspoll_t *pLstnPoll;
 	rsRetVal localRet;
 
 	ISOBJ_TYPE_assert(pThis, tcpsrv);
 
-	/* check if we need to start the worker pool. Once it is running, all is
-	 * well. Shutdown is done on modExit.
-	 */
-	d_pthread_mutex_lock(&wrkrMut);
-	if(!bWrkrRunning) {
-		bWrkrRunning = 1;
-		startWorkerPool();
-	}
-	d_pthread_mutex_unlock(&wrkrMut);
-
-	/* this is an endless loop - it is terminated by the framework canelling
-	 * this thread. Thus, we also need to instantiate a cancel cleanup handler
-	 * to prevent us from leaking anything. -- rgerhards, 20080-04-24
-	 */
-	if((localRet = nspoll.Construct(&pPoll)) == RS_RET_OK) {
-		if(pThis->pszDrvrName != NULL)
-			CHKiRet(nspoll.SetDrvrName(pPoll, pThis->pszDrvrName));
-		localRet = nspoll.ConstructFinalize(pPoll);
-	}
-	if(localRet != RS_RET_OK) {
+	if((localRet = constructEvtLoops(pThis)) != RS_RET_OK) {
 		/* fall back to select */
 		DBGPRINTF("tcpsrv could not use epoll() interface, iRet=%d, using select()\n", localRet);
+		/* the worker pool is started here and not earlier, as we may be loaded
+		 * before rsyslog forks (the workers would then run in the parent).
+		 */
+		startWorkerPool(pThis);
 		iRet = RunSelect(pThis, workset, sizeof(workset)/sizeof(nsd_epworkset_t));
 		FINALIZE;
 	}
 
-	DBGPRINTF("tcpsrv uses epoll() interface, nsdpoll driver found\n");
+	DBGPRINTF("tcpsrv uses epoll() interface, nsdpoll driver found, %d event loop(s), "
+		"%d handshake loop(s)\n", pThis->iNumWrkr, (pThis->pHsLoops == NULL) ? 0 : pThis->iNumHsWrkr);
 
 	/* flag that we are in epoll mode */
 	pThis->bUsingEPoll = RSTRUE;
 
 	/* Add the TCP listen sockets to the list of sockets to monitor */
+	pLstnPoll = pThis->pEvtLoops[0].pPoll;
 	for(i = 0 ; i < pThis->iLstnCurr ; ++i) {
 		DBGPRINTF("Trying to add listener %d, pUsr=%p\n", i, pThis->ppLstn);
-		CHKiRet(nspoll.Ctl(pPoll, pThis->ppLstn[i], i, pThis->ppLstn, NSDPOLL_IN, NSDPOLL_ADD));
+		CHKiRet(nspoll.Ctl(pLstnPoll, pThis->ppLstn[i], i, pThis->ppLstn, NSDPOLL_IN, NSDPOLL_ADD));
 		DBGPRINTF("Added listener %d\n", i);
 	}
 
-	while(1) {
-		numEntries = sizeof(workset)/sizeof(nsd_epworkset_t);
-		localRet = nspoll.Wait(pPoll, -1, &numEntries, workset);
-		if(glbl.GetGlobalInputTermState() == 1)
-			break; /* terminate input! */
+	/* regular loops first, handshake loops hand sessions over to them */
+	startEvtLoopThrds(pThis->pEvtLoops, pThis->iNumWrkr, 1);
+	if(pThis->pHsLoops != NULL)
+		startEvtLoopThrds(pThis->pHsLoops, pThis->iNumHsWrkr, 0);
 
-		/* check if we need to ignore the i/o ready state. We do this if we got an invalid
-		 * return state. Validly, this can happen for RS_RET_EINTR, for other cases it may
-		 * not be the right thing, but what is the right thing is really hard at this point...
-		 */
-		if(localRet != RS_RET_OK)
-			continue;
+	runEvtLoop(&pThis->pEvtLoops[0]);
 
-		processWorkset(pThis, pPoll, numEntries, workset);
-	}
+	stopEvtLoopThrds(pThis->pHsLoops, pThis->iNumHsWrkr);
+	stopEvtLoopThrds(pThis->pEvtLoops, pThis->iNumWrkr);
 
 	/* remove the tcp listen sockets from the epoll set */
 	for(i = 0 ; i < pThis->iLstnCurr ; ++i) {
-		CHKiRet(nspoll.Ctl(pPoll, pThis->ppLstn[i], i, pThis->ppLstn, NSDPOLL_IN, NSDPOLL_DEL));
+		CHKiRet(nspoll.Ctl(pLstnPoll, pThis->ppLstn[i], i, pThis->ppLstn, NSDPOLL_IN, NSDPOLL_DEL));
 	}
 
 finalize_it:
-	if(pPoll != NULL)
-		nspoll.Destruct(&pPoll);
+	destructEvtLoops(pThis);
 	RETiRet;
 }
 
@@ -950,6 +1283,9 @@ BEGINobjConstruct(tcpsrv) /* be sure to specify the object type also in END macr
 	pThis->ratelimitBurst = 10000;
 	pThis->bUseFlowControl = 1;
 	pThis->pszDrvrName = NULL;
+	pThis->iNumWrkr = TCPSRV_DFLT_NUM_WRKR;
+	pthread_mutex_init(&pThis->wrkrMut, NULL);
+	pthread_cond_init(&pThis->wrkrIdle, NULL);
 ENDobjConstruct(tcpsrv)
 
 
@@ -993,6 +1329,11 @@ CODESTARTobjDestruct(tcpsrv)
 	if(pThis->OnDestruct != NULL)
 		pThis->OnDestruct(pThis->pUsr);
 
+	if(pThis->pWrkrInfo != NULL)
+		stopWorkerPool(pThis);
+	pthread_cond_destroy(&pThis->wrkrIdle);
+	pthread_mutex_destroy(&pThis->wrkrMut);
+
 	deinit_tcp_listener(pThis);
 
 	if(pThis->pNS != NULL)
@@ -1003,6 +1344,8 @@ CODESTARTobjDestruct(tcpsrv)
 	free(pThis->ppLstnPort);
 	free(pThis->pszInputName);
 	free(pThis->pszOrigin);
+	free(pThis->ratelimitKey);
+	free(pThis->ratelimitKeyStats);
 ENDobjDestruct(tcpsrv)
 
 
@@ -1227,6 +1570,52 @@ SetLinuxLikeRatelimiters(tcpsrv_t *pThis, int ratelimitInterval, int ratelimitBu
 }
 
 
+/* Set the number of worker threads. In epoll() mode, this is the number of
+ * event loops, in select() mode the number of helper workers.
+ */
+static rsRetVal
+SetNumWrkr(tcpsrv_t *pThis, int numWrkr)
+{
+	DEFiRet;
+	pThis->iNumWrkr = (numWrkr < 1) ? 1 : numWrkr;
+	RETiRet;
+}
+
+
+/* Set the number of handshake threads. If non-zero, new sessions do their
+ * (TLS) handshake on these threads instead of on the event loops. Only
+ * used in epoll() mode.
+ */
+static rsRetVal
+SetNumHandshakeWrkr(tcpsrv_t *pThis, int numWrkr)
+{
+	DEFiRet;
+	pThis->iNumHsWrkr = (numWrkr < 0) ? 0 : numWrkr;
+	RETiRet;
+}
+
+
+/* Set keyed ratelimiting for listeners created from now on. A NULL key
+ * turns keyed ratelimiting off again.
+ */
+static rsRetVal
+SetKeyedRatelimiter(tcpsrv_t *pThis, uchar *key, unsigned maxKeys, uchar *keyStats)
+{
+	DEFiRet;
+	free(pThis->ratelimitKey);
+	free(pThis->ratelimitKeyStats);
+	pThis->ratelimitKey = NULL;
+	pThis->ratelimitKeyStats = NULL;
+	if(key != NULL)
+		CHKmalloc(pThis->ratelimitKey = ustrdup(key));
+	if(keyStats != NULL)
+		CHKmalloc(pThis->ratelimitKeyStats = ustrdup(keyStats));
+	pThis->ratelimitMaxKeys = maxKeys;
+finalize_it:
+	RETiRet;
+}
+
+
 /* Set the ruleset (ptr) to use */
 static rsRetVal
 SetRuleset(tcpsrv_t *pThis, ruleset_t *pRuleset)
@@ -1395,6 +1784,9 @@ CODESTARTobjQueryInterface(tcpsrv)
 	pIf->SetOnMsgReceive = SetOnMsgReceive;
 	pIf->SetRuleset = SetRuleset;
 	pIf->SetLinuxLikeRatelimiters = SetLinuxLikeRatelimiters;
+	pIf->SetKeyedRatelimiter = SetKeyedRatelimiter;
+	pIf->SetNumWrkr = SetNumWrkr;
+	pIf->SetNumHandshakeWrkr = SetNumHandshakeWrkr;
 	pIf->SetNotificationOnRemoteClose = SetNotificationOnRemoteClose;
 
 finalize_it:
@@ -1446,67 +1838,13 @@ BEGINObjClassInit(tcpsrv, 1, OBJ_IS_LOADABLE_MODULE) /* class, version - CHANGE
 ENDObjClassInit(tcpsrv)
 
 
-/* start worker threads
- * Important: if we fork, this MUST be done AFTER forking
- */
-static void
-startWorkerPool(void)
-{
-	int i;
-	int r;
-	pthread_attr_t sessThrdAttr;
-
-	wrkrRunning = 0;
-	pthread_cond_init(&wrkrIdle, NULL);
-	pthread_attr_init(&sessThrdAttr);
-	pthread_attr_setstacksize(&sessThrdAttr, 4096*1024);
-	for(i = 0 ; i < wrkrMax ; ++i) {
-		/* init worker info structure! */
-		pthread_cond_init(&wrkrInfo[i].run, NULL);
-		wrkrInfo[i].pSrv = NULL;
-		wrkrInfo[i].numCalled = 0;
-		r = pthread_create(&wrkrInfo[i].tid, &sessThrdAttr, wrkr, &(wrkrInfo[i]));
-		if(r == 0) {
-			wrkrInfo[i].enabled = 1;
-		} else {
-			char errStr[1024];
-			wrkrInfo[i].enabled = 0;
-			rs_strerror_r(errno, errStr, sizeof(errStr));
-			errmsg.LogError(0, NO_ERRCODE, "tcpsrv error creating thread %d: "
-			                "%s", i, errStr);
-		}
-	}
-	pthread_attr_destroy(&sessThrdAttr);
-}
-
-/* destroy worker pool structures and wait for workers to terminate
- */
-static void
-stopWorkerPool(void)
-{
-	int i;
-	for(i = 0 ; i < wrkrMax ; ++i) {
-		pthread_cond_signal(&wrkrInfo[i].run); /* awake wrkr if not running */
-		pthread_join(wrkrInfo[i].tid, NULL);
-		DBGPRINTF("tcpsrv: info: worker %d was called %llu times\n", i, wrkrInfo[i].numCalled);
-		pthread_cond_destroy(&wrkrInfo[i].run);
-	}
-	pthread_cond_destroy(&wrkrIdle);
-}
-
-
 /* --------------- here now comes the plumbing that makes as a library module --------------- */
 
 BEGINmodExit
 CODESTARTmodExit
-	if(bWrkrRunning) {
-		stopWorkerPool();
-		bWrkrRunning = 0;
-	}
 	/* de-init in reverse order! */
 	tcpsrvClassExit();
 	tcps_sessClassExit();
-	pthread_mutex_destroy(&wrkrMut);
 ENDmodExit
 
 
@@ -1519,20 +1857,15 @@ ENDqueryEtryPt
 BEGINmodInit()
 CODESTARTmodInit
 	*ipIFVersProvided = CURR_MOD_IF_VERSION; /* we only support the current interface specification */
-	/* we just init the worker mutex, but do not start the workers themselves. This is deferred
-	 * to the first call of Run(). Reasons for this:
+	/* Note: worker threads and event loops are per server and started only
+	 * on Run(). Reasons for this:
 	 * 1. depending on load order, tcpsrv gets loaded during rsyslog startup BEFORE 
 	 *    it forks, in which case the workers would be running in the then-killed parent,
 	 *    leading to a defuncnt child (we actually had this bug).
 	 * 2. depending on circumstances, Run() would possibly never be called, in which case
 	 *    the worker threads would be totally useless.
-	 * Note that in order to guarantee a non-racy worker start, we need to guard the
-	 * startup sequence by a mutex, which is why we init it here (no problem with fork()
-	 * in this case as the mutex is a pure-memory structure).
 	 * rgerhards, 2012-05-18
 	 */
-	pthread_mutex_init(&wrkrMut, NULL);
-	bWrkrRunning = 0;
 
 	/* Initialize all classes that are in our module - this includes ourselfs */
 	CHKiRet(tcps_sessClassInit(pModInfo));
@@ -51,6 +51,10 @@ struct tcpLstnPortList_s {
 };
 
 #define TCPSRV_NO_ADDTL_DELIMITER -1 /* specifies that no additional delimiter is to be used in TCP framing */
+#define TCPSRV_DFLT_NUM_WRKR 4 /* default number of worker threads (event loops) per server */
+
+struct tcpsrv_wrkrInfo_s;
+struct tcpsrv_evtLoop_s;
 
 /* the tcpsrv object */
 struct tcpsrv_s {
@@ -83,7 +87,22 @@ struct tcpsrv_s {
 	int bDisableLFDelim;	/**< if 1, standard LF frame delimiter is disabled (*very dangerous*) */
 	int ratelimitInterval;
 	int ratelimitBurst;
+	uchar *ratelimitKey;	/**< if set, ratelimit per key instead of per listener */
+	unsigned ratelimitMaxKeys;
+	uchar *ratelimitKeyStats; /**< dyn_stats bucket for per-key drop counts */
 	tcps_sess_t **pSessions;/**< array of all of our sessions */
+	int iNumWrkr;		/**< number of worker threads; in epoll mode, each one runs its own event loop */
+	struct tcpsrv_evtLoop_s *pEvtLoops; /**< our event loops (epoll mode only) */
+	int iNextEvtLoop;	/**< event loop that receives the next accepted session */
+	int iNumHsWrkr;		/**< number of handshake threads (epoll mode, TLS only), 0 - none */
+	struct tcpsrv_evtLoop_s *pHsLoops; /**< our handshake loops */
+	int iNextHsLoop;	/**< handshake loop that receives the next accepted session */
+	struct tcpsrv_wrkrInfo_s *pWrkrInfo; /**< helper worker pool (select mode only) */
+	int iWrkrPoolSize;	/**< number of helper workers actually started */
+	int wrkrRunning;	/**< number of helper workers currently busy */
+	sbool bWrkrStop;	/**< helper workers shall terminate */
+	pthread_mutex_t wrkrMut;
+	pthread_cond_t wrkrIdle;
 	void *pUsr;		/**< a user-settable pointer (provides extensibility for "derived classes")*/
 	/* callbacks */
 	int      (*pIsPermittedHost)(struct sockaddr *addr, char *fromHostFQDN, void*pUsrSrv, void*pUsrSess);
@@ -168,8 +187,14 @@ BEGINinterface(tcpsrv) /* name must also be changed in ENDinterface macro! */
 	rsRetVal (*SetKeepAliveTime)(tcpsrv_t*, int);
 	/* added v18 */
 	rsRetVal (*SetbSPFramingFix)(tcpsrv_t*, sbool);
+	/* added v19 */
+	rsRetVal (*SetKeyedRatelimiter)(tcpsrv_t *pThis, uchar *key, unsigned maxKeys, uchar *keyStats);
+	/* added v20 */
+	rsRetVal (*SetNumWrkr)(tcpsrv_t *pThis, int numWrkr);
+	/* added v21 */
+	rsRetVal (*SetNumHandshakeWrkr)(tcpsrv_t *pThis, int numWrkr);
 ENDinterface(tcpsrv)
-#define tcpsrvCURR_IF_VERSION 18 /* increment whenever you change the interface structure! */
+#define tcpsrvCURR_IF_VERSION 21 /* increment whenever you change the interface structure! */
 /* change for v4:
  * - SetAddtlFrameDelim() added -- rgerhards, 2008-12-10
  * - SetInputName() added -- rgerhards, 2008-12-10
@@ -0,0 +1,50 @@
+#!/bin/bash
+# check that names are resolved via the async resolver pool of the dnscache,
+# both on a cache miss (first batch) and from the cache (second batch)
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[dnscache-async.sh\]: test dnscache with async resolver pool
+# we need a name for 127.0.0.1, usually "localhost" from /etc/hosts
+HOSTNAME_EXPECTED=$(getent hosts 127.0.0.1 | awk '{ print $2; exit }')
+if [ "x$HOSTNAME_EXPECTED" == "x" ]; then
+  echo "127.0.0.1 cannot be resolved on this system, skipping test"
+  exit 77
+fi
+. $srcdir/diag.sh init
+. $srcdir/diag.sh generate-conf
+. $srcdir/diag.sh add-conf '
+global(preserveFQDN="on"
+       dnscache.resolvers="2" dnscache.timeout="5000"
+       dnscache.ttl="3600" dnscache.maxentries="32")
+module(load="../plugins/imtcp/.libs/imtcp")
+input(type="imtcp" port="13514")
+
+template(name="outfmt" type="string" string="%msg:F,58:2%\n")
+template(name="hostfmt" type="string" string="%fromhost-ip% %fromhost%\n")
+:msg, contains, "msgnum:" {
+	action(type="omfile" template="outfmt" file="rsyslog.out.log")
+	action(type="omfile" template="hostfmt" file="rsyslog2.out.log")
+}
+'
+. $srcdir/diag.sh startup
+# cache is empty, so the name must be resolved by the resolver pool
+. $srcdir/diag.sh tcpflood -c5 -m500
+. $srcdir/diag.sh wait-queueempty
+NFOUND=$(grep -c "^127\.0\.0\.1 $HOSTNAME_EXPECTED\$" rsyslog2.out.log)
+if [ "$NFOUND" != "500" ]; then
+  echo "cache miss: expected 500 lines '127.0.0.1 $HOSTNAME_EXPECTED', got $NFOUND, file content:"
+  sort rsyslog2.out.log | uniq -c
+  . $srcdir/diag.sh error-exit 1
+fi
+# now the name must come from the cache
+. $srcdir/diag.sh tcpflood -c5 -m500 -i500
+. $srcdir/diag.sh shutdown-when-empty
+. $srcdir/diag.sh wait-shutdown
+. $srcdir/diag.sh seq-check 0 999
+NFOUND=$(grep -c "^127\.0\.0\.1 $HOSTNAME_EXPECTED\$" rsyslog2.out.log)
+if [ "$NFOUND" != "1000" ]; then
+  echo "cache hit: expected 1000 lines '127.0.0.1 $HOSTNAME_EXPECTED', got $NFOUND, file content:"
+  sort rsyslog2.out.log | uniq -c
+  exit 1
+fi;
+. $srcdir/diag.sh exit
@@ -0,0 +1,23 @@
+#!/bin/bash
+# check the AF_PACKET ring buffer UDP input on the loopback interface
+# released under ASL 2.0
+echo This test must be run as root [raw socket access required]
+if [ "$EUID" -ne 0 ]; then
+    exit 77 # Not root, skip this test
+fi
+. $srcdir/diag.sh init
+. $srcdir/diag.sh generate-conf
+. $srcdir/diag.sh add-conf '
+module(load="../plugins/imafpacket/.libs/imafpacket" block.size="65536" block.count="16")
+input(type="imafpacket" interface="lo" port="13514")
+
+template(name="outfmt" type="string" string="%msg:F,58:2%\n")
+:msg, contains, "msgnum:" action(type="omfile" template="outfmt"
+			         file="rsyslog.out.log")
+'
+. $srcdir/diag.sh startup
+. $srcdir/diag.sh tcpflood -t127.0.0.1 -Tudp -m200
+. $srcdir/diag.sh shutdown-when-empty
+. $srcdir/diag.sh wait-shutdown
+. $srcdir/diag.sh seq-check 0 199
+. $srcdir/diag.sh exit
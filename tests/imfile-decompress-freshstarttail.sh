@@ -0,0 +1,28 @@
+#!/bin/bash
+# check freshStartTail on a gzip-compressed file: the existing content must
+# be skipped up to its uncompressed end (not the compressed file size), so
+# only the gzip member appended later is read.
+# released under ASL 2.0
+. $srcdir/diag.sh init
+./inputfilegen 2000 > rsyslog.input.all
+sed -n '1,1000p' rsyslog.input.all | gzip > rsyslog.input.log.gz
+. $srcdir/diag.sh generate-conf
+. $srcdir/diag.sh add-conf '
+module(load="../plugins/imfile/.libs/imfile")
+input(type="imfile" file="./rsyslog.input.log.gz" tag="file:" decompress="on"
+	freshStartTail="on")
+
+template(name="outfmt" type="string" string="%msg:F,58:2%\n")
+:msg, contains, "msgnum:" action(type="omfile" template="outfmt"
+			         file="rsyslog.out.log")
+'
+. $srcdir/diag.sh startup
+# give imfile time to open the file and skip its current content
+sleep 2
+sed -n '1001,2000p' rsyslog.input.all | gzip >> rsyslog.input.log.gz
+sleep 1
+. $srcdir/diag.sh shutdown-when-empty
+. $srcdir/diag.sh wait-shutdown
+. $srcdir/diag.sh seq-check 1000 1999
+rm -f rsyslog.input.all rsyslog.input.log.gz
+. $srcdir/diag.sh exit
@@ -0,0 +1,31 @@
+#!/bin/bash
+# check that imfile resumes a gzip-compressed file at the persisted
+# (uncompressed) offset. The file is extended by a second gzip member
+# while rsyslog is stopped, so after the restart only the new part must
+# be read. seq-check detects lines that are read twice.
+# released under ASL 2.0
+. $srcdir/diag.sh init
+./inputfilegen 10000 > rsyslog.input.all
+sed -n '1,5000p' rsyslog.input.all | gzip > rsyslog.input.log.gz
+. $srcdir/diag.sh generate-conf
+. $srcdir/diag.sh add-conf '
+module(load="../plugins/imfile/.libs/imfile")
+input(type="imfile" file="./rsyslog.input.log.gz" tag="file:" decompress="on")
+
+template(name="outfmt" type="string" string="%msg:F,58:2%\n")
+:msg, contains, "msgnum:" action(type="omfile" template="outfmt"
+			         file="rsyslog.out.log")
+'
+. $srcdir/diag.sh startup
+# sleep a little to give rsyslog a chance to begin processing
+sleep 1
+. $srcdir/diag.sh shutdown-when-empty
+. $srcdir/diag.sh wait-shutdown
+sed -n '5001,10000p' rsyslog.input.all | gzip >> rsyslog.input.log.gz
+. $srcdir/diag.sh startup
+sleep 1
+. $srcdir/diag.sh shutdown-when-empty
+. $srcdir/diag.sh wait-shutdown
+. $srcdir/diag.sh seq-check 0 9999
+rm -f rsyslog.input.all rsyslog.input.log.gz
+. $srcdir/diag.sh exit
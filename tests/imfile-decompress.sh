@@ -0,0 +1,28 @@
+#!/bin/bash
+# check that imfile transparently reads gzip-compressed files if
+# decompress is turned on. The compressed file consists of two gzip
+# members, as permitted by RFC1952 (and created e.g. by appending).
+# released under ASL 2.0
+. $srcdir/diag.sh init
+./inputfilegen 30000 > rsyslog.input.all
+sed -n '1,10000p' rsyslog.input.all > rsyslog.input.0.log
+sed -n '10001,20000p' rsyslog.input.all | gzip > rsyslog.input.1.log.gz
+sed -n '20001,30000p' rsyslog.input.all | gzip >> rsyslog.input.1.log.gz
+rm -f rsyslog.input.all
+. $srcdir/diag.sh generate-conf
+. $srcdir/diag.sh add-conf '
+module(load="../plugins/imfile/.libs/imfile")
+input(type="imfile" file="./rsyslog.input.*" tag="file:" decompress="on")
+
+template(name="outfmt" type="string" string="%msg:F,58:2%\n")
+:msg, contains, "msgnum:" action(type="omfile" template="outfmt"
+			         file="rsyslog.out.log")
+'
+. $srcdir/diag.sh startup
+# sleep a little to give rsyslog a chance to begin processing
+sleep 1
+. $srcdir/diag.sh shutdown-when-empty
+. $srcdir/diag.sh wait-shutdown
+. $srcdir/diag.sh seq-check 0 29999
+rm -f rsyslog.input.0.log rsyslog.input.1.log.gz
+. $srcdir/diag.sh exit
@@ -0,0 +1,33 @@
+#!/bin/bash
+# check the block-based line reader of imfile (readMode 0). Lines are
+# of varying size, many of them straddle read buffer boundaries and some
+# are larger than the read buffer itself. The last line has no LF yet and
+# must only be processed once it is completed.
+# released under ASL 2.0
+. $srcdir/diag.sh init
+awk 'BEGIN { for(i = 0 ; i < 20000 ; ++i) {
+		pad = sprintf("%*s", (i * 397) % 9000, "");
+		gsub(/ /, "x", pad);
+		printf("msgnum:%8.8d:%s\n", i, pad);
+	} }' > rsyslog.input
+printf 'msgnum:%8.8d:' 20000 >> rsyslog.input
+. $srcdir/diag.sh generate-conf
+. $srcdir/diag.sh add-conf '
+global(maxMessageSize="16k")
+module(load="../plugins/imfile/.libs/imfile")
+input(type="imfile" file="./rsyslog.input" tag="file:" readMode="0")
+
+template(name="outfmt" type="string" string="%msg:F,58:2%\n")
+:msg, contains, "msgnum:" action(type="omfile" template="outfmt"
+			         file="rsyslog.out.log")
+'
+. $srcdir/diag.sh startup
+# sleep a little to give rsyslog a chance to begin processing
+sleep 1
+# now complete the last line
+echo 'xxx' >> rsyslog.input
+sleep 1
+. $srcdir/diag.sh shutdown-when-empty
+. $srcdir/diag.sh wait-shutdown
+. $srcdir/diag.sh seq-check 0 20000
+. $srcdir/diag.sh exit
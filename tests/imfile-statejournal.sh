@@ -0,0 +1,40 @@
+#!/bin/bash
+# check the imfile state journal. The file state must be persisted
+# to the journal on shutdown and be picked up again on restart, so
+# that each message is processed exactly once.
+# released under ASL 2.0
+. $srcdir/diag.sh init
+./inputfilegen 20000 > rsyslog.input.all
+sed -n '1,10000p' rsyslog.input.all > rsyslog.input
+. $srcdir/diag.sh generate-conf
+. $srcdir/diag.sh add-conf '
+global(workDirectory="test-spool")
+module(load="../plugins/imfile/.libs/imfile" stateJournal="imfile.journal"
+	stateJournal.fsync="on")
+input(type="imfile" file="./rsyslog.input" tag="file:")
+
+template(name="outfmt" type="string" string="%msg:F,58:2%\n")
+:msg, contains, "msgnum:" action(type="omfile" template="outfmt"
+			         file="rsyslog.out.log")
+'
+. $srcdir/diag.sh startup
+# sleep a little to give rsyslog a chance to begin processing
+sleep 1
+. $srcdir/diag.sh shutdown-when-empty
+. $srcdir/diag.sh wait-shutdown
+if [ ! -s test-spool/imfile.journal ]; then
+	echo "FAIL: state journal was not written"
+	. $srcdir/diag.sh error-exit 1
+fi
+if ls test-spool/imfile-state:* > /dev/null 2>&1; then
+	echo "FAIL: per-file state file written although journal is used"
+	. $srcdir/diag.sh error-exit 1
+fi
+sed -n '10001,20000p' rsyslog.input.all >> rsyslog.input
+. $srcdir/diag.sh startup
+sleep 1
+. $srcdir/diag.sh shutdown-when-empty
+. $srcdir/diag.sh wait-shutdown
+. $srcdir/diag.sh seq-check 0 19999
+rm -f rsyslog.input.all
+. $srcdir/diag.sh exit
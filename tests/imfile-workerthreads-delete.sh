@@ -0,0 +1,39 @@
+#!/bin/bash
+# check that files can be deleted while the worker pool is processing
+# them (inotify mode). Files are deleted while they are still being
+# written, so the workers usually have more data and want to re-queue
+# them. Afterwards, rsyslog must still be alive and process a new file.
+# released under ASL 2.0
+. $srcdir/diag.sh init
+. $srcdir/diag.sh generate-conf
+. $srcdir/diag.sh add-conf '
+module(load="../plugins/imfile/.libs/imfile" mode="inotify" workerThreads="4")
+input(type="imfile" file="./rsyslog.input.*.log" tag="file:" maxLinesAtOnce="10")
+input(type="imfile" file="./rsyslog.final.log" tag="final:")
+
+template(name="outfmt" type="string" string="%msg:F,58:2%\n")
+if $syslogtag == "final:" then
+	action(type="omfile" template="outfmt" file="rsyslog.out.log")
+'
+. $srcdir/diag.sh startup
+for r in 1 2 3 4 5; do
+	for i in 0 1 2 3; do
+		( for j in 1 2 3 4 5 6 7 8 9 10; do
+			./inputfilegen 500 >> rsyslog.input.$i.log
+			./msleep 20
+		done ) &
+	done
+	./msleep 100
+	rm -f rsyslog.input.*.log
+	wait
+	./msleep 100
+	rm -f rsyslog.input.*.log
+done
+./inputfilegen 1000 > rsyslog.final.log
+# sleep a little to give rsyslog a chance to begin processing
+sleep 2
+. $srcdir/diag.sh shutdown-when-empty
+. $srcdir/diag.sh wait-shutdown
+. $srcdir/diag.sh seq-check 0 999
+rm -f rsyslog.input.*.log rsyslog.final.log
+. $srcdir/diag.sh exit
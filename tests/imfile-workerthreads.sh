@@ -0,0 +1,37 @@
+#!/bin/bash
+# check imfile with a worker pool. Multiple files are processed
+# concurrently, maxLinesAtOnce is used as scheduling quantum. Messages
+# from each single file must still be in sequence.
+# released under ASL 2.0
+. $srcdir/diag.sh init
+for i in 0 1 2 3; do
+	./inputfilegen 40000 | sed -n "$((i * 10000 + 1)),$((i * 10000 + 10000))p" > rsyslog.input.$i.log
+done
+. $srcdir/diag.sh generate-conf
+. $srcdir/diag.sh add-conf '
+module(load="../plugins/imfile/.libs/imfile" workerThreads="3")
+input(type="imfile" file="./rsyslog.input.*.log" tag="file:"
+	maxLinesAtOnce="100" addMetadata="on")
+
+template(name="outfmt" type="string" string="%msg:F,58:2%\n")
+template(name="perfile" type="string" string="%$!metadata!filename% %msg:F,58:2%\n")
+:msg, contains, "msgnum:" {
+	action(type="omfile" template="outfmt" file="rsyslog.out.log")
+	action(type="omfile" template="perfile" file="rsyslog2.out.log")
+}
+'
+. $srcdir/diag.sh startup
+# sleep a little to give rsyslog a chance to begin processing
+sleep 2
+. $srcdir/diag.sh shutdown-when-empty
+. $srcdir/diag.sh wait-shutdown
+. $srcdir/diag.sh seq-check 0 39999
+awk '{ if(($1 in last) && $2 + 0 <= last[$1]) { print "out of order: " $0; err = 1 }
+       last[$1] = $2 + 0 }
+     END { exit err }' rsyslog2.out.log
+if [ $? -ne 0 ]; then
+	echo "FAIL: messages from a single file were reordered"
+	. $srcdir/diag.sh error-exit 1
+fi
+rm -f rsyslog.input.*.log rsyslog2.out.log
+. $srcdir/diag.sh exit
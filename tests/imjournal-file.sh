@@ -0,0 +1,56 @@
+#!/bin/bash
+# check imjournal batch mode and field whitelist. We read from a local
+# journal file, which we create via systemd-journal-remote from journal
+# export format, so that the test does not depend on the system journal.
+# released under ASL 2.0
+. $srcdir/diag.sh init
+JREMOTE=""
+for f in /lib/systemd/systemd-journal-remote /usr/lib/systemd/systemd-journal-remote; do
+	if [ -x $f ]; then
+		JREMOTE=$f
+	fi
+done
+if [ "x$JREMOTE" == "x" ]; then
+	echo "systemd-journal-remote not available - skipping test"
+	exit 77
+fi
+rm -f rsyslog.input.journal
+awk 'BEGIN { for(i = 0 ; i < 10000 ; ++i) {
+		printf("__REALTIME_TIMESTAMP=%d\n", 1473400000000000 + i)
+		printf("__MONOTONIC_TIMESTAMP=%d\n", 1000000 + i)
+		printf("_BOOT_ID=0123456789abcdef0123456789abcdef\n")
+		printf("MESSAGE=msgnum:%08d:\n", i)
+		printf("PRIORITY=6\n")
+		printf("SYSLOG_IDENTIFIER=tb\n")
+		printf("TB_FIELD=keep\n")
+		printf("TB_OTHER=drop\n\n")
+	} }' | $JREMOTE --output=`pwd`/rsyslog.input.journal -
+if [ ! -f rsyslog.input.journal ]; then
+	echo "could not create journal file - skipping test"
+	exit 77
+fi
+. $srcdir/diag.sh generate-conf
+. $srcdir/diag.sh add-conf '
+module(load="../plugins/imjournal/.libs/imjournal" file="./rsyslog.input.journal"
+	batchSize="100" fields=["TB_FIELD"])
+
+template(name="outfmt" type="string" string="%msg:F,58:2%\n")
+template(name="fields" type="string" string="%$!TB_FIELD% %$!TB_OTHER%\n")
+:msg, contains, "msgnum:" {
+	action(type="omfile" template="outfmt" file="rsyslog.out.log")
+	action(type="omfile" template="fields" file="rsyslog2.out.log")
+}
+'
+. $srcdir/diag.sh startup
+# sleep a little to give rsyslog a chance to begin processing
+sleep 2
+. $srcdir/diag.sh shutdown-when-empty
+. $srcdir/diag.sh wait-shutdown
+. $srcdir/diag.sh seq-check 0 9999
+if [ "$(sort -u rsyslog2.out.log)" != "keep " ]; then
+	echo "FAIL: field whitelist not honored, unique values:"
+	sort -u rsyslog2.out.log
+	. $srcdir/diag.sh error-exit 1
+fi
+rm -f rsyslog.input.journal rsyslog2.out.log
+. $srcdir/diag.sh exit
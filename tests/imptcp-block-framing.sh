@@ -0,0 +1,39 @@
+#!/bin/bash
+# check imptcp block framing with mixed octet-stuffed, octet-counted and
+# additional-delimiter frames, all received in a single block
+# released under ASL 2.0
+. $srcdir/diag.sh init
+. $srcdir/diag.sh generate-conf
+. $srcdir/diag.sh add-conf '
+module(load="../plugins/imptcp/.libs/imptcp")
+input(type="imptcp" port="13514" addtlframedelimiter="124")
+
+template(name="outfmt" type="string" string="%rawmsg%\n")
+:msg, contains, "msgnum:" action(type="omfile" template="outfmt"
+			         file="rsyslog.out.log")
+'
+. $srcdir/diag.sh startup
+m1='<167>Mar  6 16:57:54 172.20.245.8 test: msgnum:1 octet-counted'
+m3='<167>Mar  6 16:57:54 172.20.245.8 test: msgnum:3 octet-counted, with LF
+inside'
+printf '%s\n%d %s%s|%d %s%s\n' \
+	'<167>Mar  6 16:57:54 172.20.245.8 test: msgnum:0 LF-framed' \
+	${#m1} "$m1" \
+	'<167>Mar  6 16:57:54 172.20.245.8 test: msgnum:2 delimiter-framed' \
+	${#m3} "$m3" \
+	'<167>Mar  6 16:57:54 172.20.245.8 test: msgnum:4 LF-framed' > rsyslog.input
+. $srcdir/diag.sh tcpflood -B -I rsyslog.input
+. $srcdir/diag.sh shutdown-when-empty
+. $srcdir/diag.sh wait-shutdown
+echo '<167>Mar  6 16:57:54 172.20.245.8 test: msgnum:0 LF-framed
+<167>Mar  6 16:57:54 172.20.245.8 test: msgnum:1 octet-counted
+<167>Mar  6 16:57:54 172.20.245.8 test: msgnum:2 delimiter-framed
+<167>Mar  6 16:57:54 172.20.245.8 test: msgnum:3 octet-counted, with LF
+inside
+<167>Mar  6 16:57:54 172.20.245.8 test: msgnum:4 LF-framed' | cmp rsyslog.out.log
+if [ ! $? -eq 0 ]; then
+  echo "invalid output generated, rsyslog.out.log is:"
+  cat rsyslog.out.log
+  exit 1
+fi;
+. $srcdir/diag.sh exit
@@ -0,0 +1,20 @@
+#!/bin/bash
+# check imptcp in event loop mode, with connections spread over
+# multiple SO_REUSEPORT listeners
+# released under ASL 2.0
+. $srcdir/diag.sh init
+. $srcdir/diag.sh generate-conf
+. $srcdir/diag.sh add-conf '
+module(load="../plugins/imptcp/.libs/imptcp" eventLoops="4")
+input(type="imptcp" port="13514")
+
+template(name="outfmt" type="string" string="%msg:F,58:2%\n")
+:msg, contains, "msgnum:" action(type="omfile" template="outfmt"
+			         file="rsyslog.out.log")
+'
+. $srcdir/diag.sh startup
+. $srcdir/diag.sh tcpflood -c50 -m20000
+. $srcdir/diag.sh shutdown-when-empty
+. $srcdir/diag.sh wait-shutdown
+. $srcdir/diag.sh seq-check 0 19999
+. $srcdir/diag.sh exit
@@ -0,0 +1,40 @@
+#!/bin/bash
+# check the shared memory ring input with two rings, one of them
+# shared by multiple writer threads
+# released under ASL 2.0
+. $srcdir/diag.sh init
+rm -f rsyslog.ring1 rsyslog.ring2
+. $srcdir/diag.sh generate-conf
+. $srcdir/diag.sh add-conf '
+module(load="../plugins/imshmring/.libs/imshmring" batchsize="64")
+input(type="imshmring" ring="rsyslog.ring1" size="64k")
+input(type="imshmring" ring="rsyslog.ring2" size="64k")
+
+template(name="outfmt" type="string" string="%msg:F,58:2%\n")
+:msg, contains, "msgnum:" action(type="omfile" template="outfmt"
+			         file="rsyslog.out.log")
+'
+. $srcdir/diag.sh startup
+./shmring_writer -r rsyslog.ring1 -m 20000
+if [ "$?" -ne "0" ]; then
+  echo "shmring_writer failed on ring 1"
+  . $srcdir/diag.sh error-exit 1
+fi
+./shmring_writer -r rsyslog.ring2 -m 20000 -t 4
+if [ "$?" -ne "0" ]; then
+  echo "shmring_writer failed on ring 2"
+  . $srcdir/diag.sh error-exit 1
+fi
+./msleep 500 # give imshmring a chance to drain the rings
+. $srcdir/diag.sh shutdown-when-empty
+. $srcdir/diag.sh wait-shutdown
+# each ring delivers the full sequence, so we expect every number twice
+sort -g rsyslog.out.log | uniq -c | awk '$1 != 2 { bad=1 } END { exit bad }'
+if [ "$?" -ne "0" ]; then
+  echo "not every message was received exactly once per ring"
+  . $srcdir/diag.sh error-exit 1
+fi
+sort -gu rsyslog.out.log > rsyslog.out.log.tmp && mv rsyslog.out.log.tmp rsyslog.out.log
+. $srcdir/diag.sh seq-check 0 19999
+rm -f rsyslog.ring1 rsyslog.ring2
+. $srcdir/diag.sh exit
@@ -0,0 +1,29 @@
+#!/bin/bash
+# check that a reader batch which covers the whole ring does not deliver
+# records twice. The ring is as small as possible, so that far fewer
+# records fit into it than the reader batch size.
+# released under ASL 2.0
+. $srcdir/diag.sh init
+rm -f rsyslog.ring1
+. $srcdir/diag.sh generate-conf
+. $srcdir/diag.sh add-conf '
+module(load="../plugins/imshmring/.libs/imshmring" batchsize="256")
+input(type="imshmring" ring="rsyslog.ring1" size="4k")
+
+template(name="outfmt" type="string" string="%msg:F,58:2%\n")
+:msg, contains, "msgnum:" action(type="omfile" template="outfmt"
+			         file="rsyslog.out.log")
+'
+. $srcdir/diag.sh startup
+./shmring_writer -r rsyslog.ring1 -m 10000
+if [ "$?" -ne "0" ]; then
+  echo "shmring_writer failed"
+  . $srcdir/diag.sh error-exit 1
+fi
+./msleep 500 # give imshmring a chance to drain the ring
+. $srcdir/diag.sh shutdown-when-empty
+. $srcdir/diag.sh wait-shutdown
+# seq-check fails on duplicates as well as on missing records
+. $srcdir/diag.sh seq-check 0 9999
+rm -f rsyslog.ring1
+. $srcdir/diag.sh exit
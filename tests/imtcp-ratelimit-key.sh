@@ -0,0 +1,26 @@
+#!/bin/bash
+# check keyed ratelimiting on input level: the key is the last digit
+# of the message number, so we have 10 keys with their own budget
+# released under ASL 2.0
+. $srcdir/diag.sh init
+. $srcdir/diag.sh generate-conf
+. $srcdir/diag.sh add-conf '
+module(load="../plugins/imtcp/.libs/imtcp")
+template(name="lastdigit" type="list") {
+	property(name="msg" field.delimiter="58" field.number="2"
+		 position.from="8" position.to="8")
+}
+input(type="imtcp" port="13514" ratelimit.key="lastdigit"
+      ratelimit.interval="3600" ratelimit.burst="5")
+
+template(name="outfmt" type="string" string="%msg:F,58:2%\n")
+:msg, contains, "msgnum:" action(type="omfile" template="outfmt"
+			         file="rsyslog.out.log")
+'
+. $srcdir/diag.sh startup
+. $srcdir/diag.sh tcpflood -m1000
+. $srcdir/diag.sh shutdown-when-empty
+. $srcdir/diag.sh wait-shutdown
+# 10 keys with a burst of 5 each, so only msgnum 0..49 must pass
+. $srcdir/diag.sh seq-check 0 49
+. $srcdir/diag.sh exit
@@ -0,0 +1,44 @@
+#!/bin/bash
+# check that TLS data which GnuTLS has already read from the socket is
+# processed even if the socket does not signal any more data. We send
+# messages that are transferred in TLS records larger than the driver's
+# receive buffer and then keep the connection idle. All messages must be
+# processed while the sender is still idle, not only when it closes.
+# released under ASL 2.0
+. $srcdir/diag.sh init
+. $srcdir/diag.sh generate-conf
+. $srcdir/diag.sh add-conf '
+global(	maxMessageSize="64k"
+	defaultNetstreamDriver="gtls"
+	defaultNetstreamDriverCAFile="'$srcdir'/tls-certs/ca.pem"
+	defaultNetstreamDriverCertFile="'$srcdir'/tls-certs/cert.pem"
+	defaultNetstreamDriverKeyFile="'$srcdir'/tls-certs/key.pem")
+module(load="../plugins/imtcp/.libs/imtcp" workerThreads="2"
+	streamDriver.mode="1" streamDriver.authMode="anon")
+input(type="imtcp" port="13514")
+
+template(name="outfmt" type="string" string="%msg:F,58:2%\n")
+:msg, contains, "msgnum:" action(type="omfile" template="outfmt"
+			         file="rsyslog.out.log")
+'
+. $srcdir/diag.sh startup
+# send all 5 messages as one batch, then stay idle for 60 seconds
+./tcpflood -p13514 -m5 -b5 -W60000000 -d20000 -Ttls -Z$srcdir/tls-certs/cert.pem -z$srcdir/tls-certs/key.pem &
+TCPFLOOD_PID=$!
+i=0
+while [ "$(cat rsyslog.out.log 2>/dev/null | wc -l)" -lt 5 ]; do
+	if [ $i -ge 200 ]; then
+		echo "FAIL: messages not processed while the sender is idle, we have:"
+		cat rsyslog.out.log
+		kill $TCPFLOOD_PID
+		. $srcdir/diag.sh error-exit 1
+	fi
+	./msleep 100
+	let "i++"
+done
+kill $TCPFLOOD_PID
+wait $TCPFLOOD_PID
+. $srcdir/diag.sh shutdown-when-empty
+. $srcdir/diag.sh wait-shutdown
+. $srcdir/diag.sh seq-check 0 4
+. $srcdir/diag.sh exit
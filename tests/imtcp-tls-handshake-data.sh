@@ -0,0 +1,43 @@
+#!/bin/bash
+# check that application data the client sends directly after its
+# Finished message (usually in the same flight) is processed when the
+# handshake is done on a handshake thread, even if the client then
+# stays idle. GnuTLS may read that data during the handshake, so the
+# socket does not signal it again after the session was handed over.
+# released under ASL 2.0
+. $srcdir/diag.sh init
+. $srcdir/diag.sh generate-conf
+. $srcdir/diag.sh add-conf '
+global(	defaultNetstreamDriver="gtls"
+	defaultNetstreamDriverCAFile="'$srcdir'/tls-certs/ca.pem"
+	defaultNetstreamDriverCertFile="'$srcdir'/tls-certs/cert.pem"
+	defaultNetstreamDriverKeyFile="'$srcdir'/tls-certs/key.pem")
+module(load="../plugins/imtcp/.libs/imtcp" workerThreads="2"
+	streamDriver.mode="1" streamDriver.authMode="anon"
+	streamDriver.handshakeThreads="1")
+input(type="imtcp" port="13514")
+
+template(name="outfmt" type="string" string="%msg:F,58:2%\n")
+:msg, contains, "msgnum:" action(type="omfile" template="outfmt"
+			         file="rsyslog.out.log")
+'
+. $srcdir/diag.sh startup
+# send one message right after the handshake, then stay idle for 60 seconds
+./tcpflood -p13514 -m1 -b1 -W60000000 -Ttls -Z$srcdir/tls-certs/cert.pem -z$srcdir/tls-certs/key.pem &
+TCPFLOOD_PID=$!
+i=0
+while [ "$(cat rsyslog.out.log 2>/dev/null | wc -l)" -lt 1 ]; do
+	if [ $i -ge 200 ]; then
+		echo "FAIL: message not processed while the sender is idle"
+		kill $TCPFLOOD_PID
+		. $srcdir/diag.sh error-exit 1
+	fi
+	./msleep 100
+	let "i++"
+done
+kill $TCPFLOOD_PID
+wait $TCPFLOOD_PID
+. $srcdir/diag.sh shutdown-when-empty
+. $srcdir/diag.sh wait-shutdown
+. $srcdir/diag.sh seq-check 0 0
+. $srcdir/diag.sh exit
@@ -0,0 +1,50 @@
+#!/bin/bash
+# check imtcp in TLS mode with kernel TLS offload. Besides checking that
+# all messages arrive, we check via the nsd_gtls stats that sessions were
+# actually handed over to kTLS. Skipped if the tls kernel module is not
+# loaded or rsyslog was built without kTLS support.
+# released under ASL 2.0
+. $srcdir/diag.sh init
+if [ ! -f /proc/net/tls_stat ]; then
+  echo "tls kernel module not loaded, skipping test"
+  exit 77
+fi
+. $srcdir/diag.sh generate-conf
+. $srcdir/diag.sh add-conf '
+global(	gnutls.ktls="on"
+	defaultNetstreamDriver="gtls"
+	defaultNetstreamDriverCAFile="'$srcdir'/tls-certs/ca.pem"
+	defaultNetstreamDriverCertFile="'$srcdir'/tls-certs/cert.pem"
+	defaultNetstreamDriverKeyFile="'$srcdir'/tls-certs/key.pem")
+module(load="../plugins/imtcp/.libs/imtcp"
+	streamDriver.mode="1" streamDriver.authMode="anon")
+input(type="imtcp" port="13514")
+module(load="../plugins/impstats/.libs/impstats" interval="1" severity="7"
+       ruleset="stats" bracketing="on")
+ruleset(name="stats") {
+	action(type="omfile" file="rsyslog.out.stats.log")
+}
+
+template(name="outfmt" type="string" string="%msg:F,58:2%\n")
+:msg, contains, "msgnum:" action(type="omfile" template="outfmt"
+			         file="rsyslog.out.log")
+'
+. $srcdir/diag.sh startup
+. $srcdir/diag.sh tcpflood -p13514 -c10 -m50000 -Ttls -Z$srcdir/tls-certs/cert.pem -z$srcdir/tls-certs/key.pem
+. $srcdir/diag.sh wait-queueempty
+. $srcdir/diag.sh wait-for-stats-flush 'rsyslog.out.stats.log'
+. $srcdir/diag.sh shutdown-when-empty
+. $srcdir/diag.sh wait-shutdown
+. $srcdir/diag.sh seq-check 0 49999
+if ! grep -q 'nsd_gtls:.* ktls\.rx=' rsyslog.out.stats.log; then
+  echo "rsyslog built without kTLS support, skipping test"
+  exit 77
+fi
+# counters are cumulative, so we use the highest value seen
+KTLSRX=$(sed -n -E 's/^.*nsd_gtls:.* ktls\.rx=([0-9]+).*$/\1/p' rsyslog.out.stats.log | sort -n | tail -1)
+if [ "$KTLSRX" -eq 0 ]; then
+  echo "kTLS requested, but no session was handed over to it:"
+  grep 'nsd_gtls:' rsyslog.out.stats.log | tail -1
+  exit 1
+fi
+. $srcdir/diag.sh exit
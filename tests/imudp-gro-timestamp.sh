@@ -0,0 +1,68 @@
+#!/bin/bash
+# check imudp with UDP_GRO and kernel receive timestamps enabled. The
+# messages are sent with UDP_SEGMENT, so they arrive as coalesced
+# datagrams that must be split. While sending, rsyslogd is stopped, so
+# that the time of processing is clearly later than the kernel receive
+# timestamp, which must be used as timegenerated.
+# released under ASL 2.0
+. $srcdir/diag.sh init
+. $srcdir/diag.sh generate-conf
+. $srcdir/diag.sh add-conf '
+module(load="../plugins/imudp/.libs/imudp" gro="on" kerneltimestamp="on")
+input(type="imudp" address="127.0.0.1" port="13514" rcvbufsize="1m")
+module(load="../plugins/impstats/.libs/impstats" interval="1" severity="7"
+       ruleset="stats" bracketing="on")
+ruleset(name="stats") {
+	action(type="omfile" file="rsyslog.out.stats.log")
+}
+
+template(name="outfmt" type="string" string="%msg:F,58:2%\n")
+template(name="tsfmt" type="string"
+	 string="%timegenerated:::date-unixtimestamp%.%timegenerated:::date-subseconds%\n")
+:msg, contains, "msgnum:" {
+	action(type="omfile" template="outfmt" file="rsyslog.out.log")
+	action(type="omfile" template="tsfmt" file="rsyslog2.out.log")
+}
+'
+. $srcdir/diag.sh startup
+kill -STOP $(cat rsyslog.pid)
+./udp_segment_sender -p13514 -m200 -s10 > rsyslog.sendtime
+RC=$?
+./msleep 2000
+kill -CONT $(cat rsyslog.pid)
+if [ $RC -eq 77 ]; then
+  echo "UDP_SEGMENT not supported, skipping test"
+  . $srcdir/diag.sh shutdown-when-empty
+  . $srcdir/diag.sh wait-shutdown
+  exit 77
+elif [ $RC -ne 0 ]; then
+  echo "udp_segment_sender failed"
+  . $srcdir/diag.sh error-exit 1
+fi
+. $srcdir/diag.sh wait-queueempty
+. $srcdir/diag.sh wait-for-stats-flush 'rsyslog.out.stats.log'
+. $srcdir/diag.sh shutdown-when-empty
+. $srcdir/diag.sh wait-shutdown
+# if the datagrams were not split, only the first message of each is seen
+. $srcdir/diag.sh seq-check 0 199
+if [ "$(wc -l < rsyslog2.out.log)" -ne 200 ]; then
+  echo "expected 200 timestamps, got $(wc -l < rsyslog2.out.log)"
+  exit 1
+fi
+# all messages must carry a timestamp from within the send window (we
+# permit 100ms of slack for clock granularity), not the processing time
+BAD=$(awk -v win="$(cat rsyslog.sendtime)" 'BEGIN { split(win, w, " ") }
+	$1 < w[1] - 0.1 || $1 > w[2] + 0.1 { ++bad } END { print bad+0 }' rsyslog2.out.log)
+if [ "$BAD" -ne 0 ]; then
+  echo "$BAD messages have a timegenerated outside of the send window $(cat rsyslog.sendtime):"
+  sort -u rsyslog2.out.log | head -5
+  exit 1
+fi
+NGRO=$(sed -n -E 's/^.*imudp\(w[0-9]+\):.* gro\.datagrams=([0-9]+).*$/\1/p' rsyslog.out.stats.log |
+       sort -n | tail -1)
+if [ "${NGRO:-0}" -eq 0 ]; then
+  echo "the kernel did not coalesce datagrams, GRO splitting was not tested - skipping"
+  exit 77
+fi
+rm -f rsyslog.sendtime
+. $srcdir/diag.sh exit
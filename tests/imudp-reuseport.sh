@@ -0,0 +1,39 @@
+#!/bin/bash
+# check imudp with one SO_REUSEPORT socket per worker thread. The kernel
+# distributes datagrams by source address and port, so we send from many
+# sockets (one per tcpflood run) and check via the per-worker stats that
+# more than one worker received messages.
+# released under ASL 2.0
+. $srcdir/diag.sh init
+. $srcdir/diag.sh generate-conf
+. $srcdir/diag.sh add-conf '
+module(load="../plugins/imudp/.libs/imudp" threads="4" reuseport="on")
+input(type="imudp" address="127.0.0.1" port="13514")
+module(load="../plugins/impstats/.libs/impstats" interval="1" severity="7"
+       ruleset="stats" bracketing="on")
+ruleset(name="stats") {
+	action(type="omfile" file="rsyslog.out.stats.log")
+}
+
+template(name="outfmt" type="string" string="%msg:F,58:2%\n")
+:msg, contains, "msgnum:" action(type="omfile" template="outfmt"
+			         file="rsyslog.out.log")
+'
+. $srcdir/diag.sh startup
+for i in $(seq 0 15); do
+	. $srcdir/diag.sh tcpflood -t127.0.0.1 -Tudp -m50 -i$((i * 50))
+done
+. $srcdir/diag.sh wait-queueempty
+. $srcdir/diag.sh wait-for-stats-flush 'rsyslog.out.stats.log'
+. $srcdir/diag.sh shutdown-when-empty
+. $srcdir/diag.sh wait-shutdown
+. $srcdir/diag.sh seq-check 0 799
+# counters are cumulative, so we use the highest value seen per worker
+NWRKRS=$(sed -n -E 's/^.*imudp\(w([0-9]+)\):.* msgs\.received=([0-9]+).*$/\1 \2/p' rsyslog.out.stats.log |
+	 awk '{ if($2 > max[$1]) max[$1] = $2 } END { for(w in max) if(max[w] > 0) n++; print n+0 }')
+if [ "$NWRKRS" -lt 2 ]; then
+  echo "expected messages to be spread over workers, but only $NWRKRS worker(s) received any:"
+  grep 'imudp(w' rsyslog.out.stats.log | tail -4
+  exit 1
+fi
+. $srcdir/diag.sh exit
@@ -0,0 +1,47 @@
+#!/bin/bash
+# check imuxsock with multiple receive threads and recvmmsg() batching.
+# Three sockets are spread over the receive loops. All messages must be
+# received and messages from a single socket must stay in sequence.
+# released under ASL 2.0
+echo \[imuxsock_threads.sh\]: test imuxsock with multiple receive threads
+./syslog_caller -fsyslog_inject-l -m0 > /dev/null 2>&1
+no_liblogging_stdlog=$?
+if [ $no_liblogging_stdlog -ne 0 ];then
+  echo "liblogging-stdlog not available - skipping test"
+  exit 77
+fi
+. $srcdir/diag.sh init
+. $srcdir/diag.sh generate-conf
+. $srcdir/diag.sh add-conf '
+module(load="../plugins/imuxsock/.libs/imuxsock" sysSock.use="off"
+	threads="3" batchSize="16")
+input(type="imuxsock" socket="testbench_socket1" hostname="s1" rcvbufSize="1m")
+input(type="imuxsock" socket="testbench_socket2" hostname="s2")
+input(type="imuxsock" socket="testbench_socket3" hostname="s3")
+
+template(name="outfmt" type="string" string="%hostname% %msg%\n")
+local1.*	action(type="omfile" template="outfmt" file="rsyslog.out.log")
+'
+. $srcdir/diag.sh startup
+for i in 1 2 3; do
+	./syslog_caller -m5000 -C "uxsock:testbench_socket$i" &
+done
+wait
+. $srcdir/diag.sh shutdown-when-empty
+. $srcdir/diag.sh wait-shutdown
+for i in 1 2 3; do
+	count=$(grep -c "^s$i .*test message nbr" rsyslog.out.log)
+	if [ "x$count" != "x5000" ]; then
+		echo "FAIL: expected 5000 messages from socket $i, got $count"
+		. $srcdir/diag.sh error-exit 1
+	fi
+done
+awk '{ match($0, /nbr [0-9]+/); n = substr($0, RSTART + 4, RLENGTH - 4) + 0
+       if(($1 in last) && n <= last[$1]) { print "out of order: " $0; err = 1 }
+       last[$1] = n }
+     END { exit err }' rsyslog.out.log
+if [ $? -ne 0 ]; then
+	echo "FAIL: messages from a single socket were reordered"
+	. $srcdir/diag.sh error-exit 1
+fi
+. $srcdir/diag.sh exit
@@ -0,0 +1,28 @@
+#!/bin/bash
+# check the shared memory ring output. The ring is deliberately small,
+# so that rsyslog needs to block on it.
+# released under ASL 2.0
+. $srcdir/diag.sh init
+rm -f rsyslog.ring
+. $srcdir/diag.sh generate-conf
+. $srcdir/diag.sh add-conf '
+module(load="../plugins/omshmring/.libs/omshmring")
+
+template(name="outfmt" type="string" string="%msg:F,58:2%\n")
+:msg, contains, "msgnum:" action(type="omshmring" ring="rsyslog.ring" size="16k"
+				 full="block" template="outfmt")
+'
+. $srcdir/diag.sh startup
+./shmring_reader -r rsyslog.ring -m 10000 > rsyslog.out.log &
+READER=$!
+. $srcdir/diag.sh injectmsg 0 10000
+wait $READER
+if [ "$?" -ne "0" ]; then
+  echo "shmring_reader failed"
+  . $srcdir/diag.sh error-exit 1
+fi
+. $srcdir/diag.sh shutdown-when-empty
+. $srcdir/diag.sh wait-shutdown
+. $srcdir/diag.sh seq-check 0 9999
+rm -f rsyslog.ring
+. $srcdir/diag.sh exit
@@ -0,0 +1,35 @@
+#!/bin/bash
+# check the adaptive parser memo. Two inputs receive different formats
+# from the same sender; each message must still be processed by the
+# right parser. We use a low revalidation interval so that this code
+# path is exercised as well.
+# released under ASL 2.0
+. $srcdir/diag.sh init
+. $srcdir/diag.sh generate-conf
+. $srcdir/diag.sh add-conf '
+global(parser.adaptive="on" parser.adaptive.revalidate="100")
+module(load="../plugins/imtcp/.libs/imtcp")
+input(type="imtcp" port="13514" name="in3164")
+input(type="imtcp" port="13515" name="in5424")
+
+template(name="outfmt" type="string" string="%msg:F,58:2%\n")
+template(name="appfmt" type="string" string="%inputname% %app-name%\n")
+:msg, contains, "msgnum:" {
+	action(type="omfile" template="outfmt" file="rsyslog.out.log")
+	action(type="omfile" template="appfmt" file="rsyslog2.out.log")
+}
+'
+. $srcdir/diag.sh startup
+. $srcdir/diag.sh tcpflood -p13514 -m5000 -i0
+. $srcdir/diag.sh tcpflood -p13515 -m5000 -i5000 -y
+. $srcdir/diag.sh tcpflood -p13514 -m5000 -i10000
+. $srcdir/diag.sh shutdown-when-empty
+. $srcdir/diag.sh wait-shutdown
+. $srcdir/diag.sh seq-check 0 14999
+if [ "$(grep -c '^in3164 tag$' rsyslog2.out.log)" != "10000" ] ||
+   [ "$(grep -c '^in5424 tcpflood$' rsyslog2.out.log)" != "5000" ]; then
+  echo "messages were processed by the wrong parser, rsyslog2.out.log is:"
+  sort rsyslog2.out.log | uniq -c
+  . $srcdir/diag.sh error-exit 1
+fi
+. $srcdir/diag.sh exit
@@ -0,0 +1,17 @@
+#!/bin/bash
+# check that sampled pipeline tracing records all processing stages
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[pipelinetrace.sh\]: test sampled pipeline tracing
+. $srcdir/diag.sh init
+. $srcdir/diag.sh startup pipelinetrace.conf
+. $srcdir/diag.sh injectmsg  0 1000
+echo doing shutdown
+. $srcdir/diag.sh shutdown-when-empty
+echo wait on shutdown
+. $srcdir/diag.sh wait-shutdown 
+. $srcdir/diag.sh seq-check  0 999
+. $srcdir/diag.sh custom-content-check '"input":"imdiag"' 'rsyslog.out.trace.log'
+. $srcdir/diag.sh custom-content-check '"evt":"done"' 'rsyslog.out.trace.log'
+. $srcdir/diag.sh assert-first-column-sum-greater-than 's/^.*"exec.end":\([0-9]\+\).*$/1/g' 'imdiag' 'rsyslog.out.trace.log' 90
+. $srcdir/diag.sh exit
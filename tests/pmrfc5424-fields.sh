@@ -0,0 +1,35 @@
+#!/bin/bash
+# check that the RFC5424 header fields, including structured data
+# with escaped brackets and multiple SD elements, are tokenized
+# correctly.
+# released under ASL 2.0
+. $srcdir/diag.sh init
+. $srcdir/diag.sh generate-conf
+. $srcdir/diag.sh add-conf '
+module(load="../plugins/imtcp/.libs/imtcp")
+input(type="imtcp" port="13514")
+
+template(name="outfmt" type="string"
+	 string="%hostname%|%app-name%|%procid%|%msgid%|%structured-data%|%msg%\n")
+:msg, contains, "msgnum:" action(type="omfile" template="outfmt"
+			         file="rsyslog.out.log")
+'
+
+. $srcdir/diag.sh startup
+echo '<165>1 2003-08-24T05:14:15.000003-07:00 host.example.com app 8710 ID47 [a@1 x="1\]"][b@2 y="a b"] msgnum:0000000 one
+<165>1 2003-08-24T05:14:15.000003-07:00 host2 - - - - msgnum:0000001 two
+<165>1 2003-08-24T05:14:15.000003-07:00 host3 app2 12 ID1 [c@3] msgnum:0000002 three' >tmp.in
+. $srcdir/diag.sh tcpflood -I tmp.in
+rm tmp.in
+. $srcdir/diag.sh shutdown-when-empty
+. $srcdir/diag.sh wait-shutdown
+echo 'host.example.com|app|8710|ID47|[a@1 x="1\]"][b@2 y="a b"]|msgnum:0000000 one
+host2|-|-|-|-|msgnum:0000001 two
+host3|app2|12|ID1|[c@3]|msgnum:0000002 three' | cmp rsyslog.out.log
+if [ ! $? -eq 0 ]; then
+  echo "invalid message recorded, rsyslog.out.log is:"
+  cat rsyslog.out.log
+  exit 1
+fi;
+
+. $srcdir/diag.sh exit
@@ -0,0 +1,34 @@
+#!/bin/bash
+# check that interned HOSTNAME, TAG and APP-NAME properties are correctly
+# handled, including duplication into and restore from a disk queue.
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[prop-intern.sh\]: test interned hostname, tag and app-name properties
+. $srcdir/diag.sh init
+. $srcdir/diag.sh generate-conf
+. $srcdir/diag.sh add-conf '
+global(workDirectory="test-spool")
+module(load="../plugins/imtcp/.libs/imtcp")
+input(type="imtcp" port="13514")
+
+template(name="outfmt" type="string" string="%msg:F,58:2%\n")
+template(name="propfmt" type="string" string="%hostname% %syslogtag% %app-name%\n")
+:msg, contains, "msgnum:" {
+	action(type="omfile" template="outfmt" file="rsyslog.out.log")
+	action(type="omfile" template="propfmt" file="rsyslog2.out.log"
+	       queue.type="disk" queue.filename="intern")
+}
+'
+. $srcdir/diag.sh startup
+. $srcdir/diag.sh tcpflood -m1000
+. $srcdir/diag.sh tcpflood -y -i1000 -m1000
+. $srcdir/diag.sh shutdown-when-empty
+. $srcdir/diag.sh wait-shutdown
+. $srcdir/diag.sh seq-check 0 1999
+if [ $(grep -c '^172\.20\.245\.8 tag tag$' rsyslog2.out.log) != 1000 ] ||
+   [ $(grep -c '^mymachine\.example\.com tcpflood tcpflood$' rsyslog2.out.log) != 1000 ]; then
+  echo "unexpected property values, file content:"
+  sort rsyslog2.out.log | uniq -c
+  exit 1
+fi;
+. $srcdir/diag.sh exit
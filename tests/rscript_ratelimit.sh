@@ -0,0 +1,14 @@
+#!/bin/bash
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[rscript_ratelimit.sh\]: testing rainerscript keyed ratelimit\(\) function
+. $srcdir/diag.sh init
+. $srcdir/diag.sh startup rscript_ratelimit.conf
+. $srcdir/diag.sh injectmsg  0 1000
+echo doing shutdown
+. $srcdir/diag.sh shutdown-when-empty
+echo wait on shutdown
+. $srcdir/diag.sh wait-shutdown 
+# 10 keys with a burst of 5 each, so only msgnum 0..49 must pass
+. $srcdir/diag.sh seq-check  0 49
+. $srcdir/diag.sh exit
@@ -0,0 +1,48 @@
+#!/bin/bash
+# benchmark (and check) control character sanitation on reception. Most
+# messages of the corpus are clean, every tenth one carries control
+# characters in different positions, so both the clean fast path and
+# the escaping path are exercised.
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[sanitize-bench.sh\]: benchmark control character sanitation
+. $srcdir/diag.sh init
+. $srcdir/diag.sh generate-conf
+. $srcdir/diag.sh add-conf '
+module(load="../plugins/imtcp/.libs/imtcp")
+input(type="imtcp" port="13514")
+
+template(name="outfmt" type="string" string="%msg:F,58:2%\n")
+template(name="msgfmt" type="string" string="%msg%\n")
+:msg, contains, "msgnum:" {
+	action(type="omfile" template="outfmt" file="rsyslog.out.log")
+	action(type="omfile" template="msgfmt" file="rsyslog2.out.log")
+}
+'
+# generate the corpus: clean messages of varying length plus some with
+# BEL, ESC and TAB characters in them
+awk 'BEGIN {
+	pad = "abcdefghijklmnopqrstuvwxyz0123456789 ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+	for(i = 0 ; i < 50000 ; ++i) {
+		txt = substr(pad pad pad pad, 1, 10 + (i * 7) % 200)
+		if(i % 10 == 0)
+			txt = substr(txt, 1, i % 37) "\007" substr(txt, (i % 37) + 1) "\033x\ty"
+		printf("<13>Mar  1 01:00:00 host tag: msgnum:%8.8d: %s\n", i, txt)
+	}
+}' > rsyslog.input
+. $srcdir/diag.sh startup
+START=$(date +%s%N)
+. $srcdir/diag.sh tcpflood -I rsyslog.input
+. $srcdir/diag.sh shutdown-when-empty
+. $srcdir/diag.sh wait-shutdown
+END=$(date +%s%N)
+echo "50000 messages took $(( (END - START) / 1000000 )) ms"
+. $srcdir/diag.sh seq-check 0 49999
+if [ $(grep -c '#007.*#033x#011y$' rsyslog2.out.log) != 5000 ] ||
+   [ $(grep -c '#' rsyslog2.out.log) != 5000 ]; then
+  echo "unexpected sanitation result, sample of file content:"
+  grep '#' rsyslog2.out.log | head -10
+  exit 1
+fi;
+rm -f rsyslog.input
+. $srcdir/diag.sh exit
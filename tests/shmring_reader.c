@@ -0,0 +1,109 @@
+/* A testing tool that reads records from a shared memory ring
+ * (as written by omshmring) and writes them to stdout.
+ *
+ * Options
+ *
+ * -r name of ring file (required)
+ * -m number of records to read before terminating (default 500)
+ * -t timeout in seconds: give up if the ring does not exist or no
+ *    data arrives for that long (default 60)
+ *
+ * Records are written as-is, so the template should contain the
+ * line terminator.
+ *
+ * Part of the testbench for rsyslog.
+ *
+ * This file is part of rsyslog.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <string.h>
+#include <unistd.h>
+#include "libshmring.h"
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: shmring_reader -r ring [-m num-records] [-t timeout]\n");
+	exit(1);
+}
+
+
+int main(int argc, char *argv[])
+{
+	shmring_t *pRing;
+	const void *data;
+	size_t len;
+	char *ring = NULL;
+	int recs = 500;
+	int timeout = 60;
+	int nRead = 0;
+	int waited = 0;
+	int opt;
+	int r;
+
+	while((opt = getopt(argc, argv, "r:m:t:")) != -1) {
+		switch (opt) {
+		case 'r':	ring = optarg;
+				break;
+		case 'm':	recs = atoi(optarg);
+				break;
+		case 't':	timeout = atoi(optarg);
+				break;
+		default:	usage();
+				break;
+		}
+	}
+	if(ring == NULL)
+		usage();
+
+	/* the ring is created by rsyslog on first use */
+	while((r = shmringOpen(&pRing, ring)) != SHMRING_OK) {
+		if(++waited > timeout * 10) {
+			fprintf(stderr, "shmring_reader: could not open ring '%s', error %d\n", ring, r);
+			exit(1);
+		}
+		usleep(100000);
+	}
+
+	waited = 0;
+	while(nRead < recs) {
+		while(nRead < recs && (r = shmringPeek(pRing, &data, &len)) == 1) {
+			fwrite(data, len, 1, stdout);
+			shmringAdvance(pRing);
+			++nRead;
+		}
+		shmringRelease(pRing);
+		if(r < 0) {
+			fprintf(stderr, "shmring_reader: ring '%s' is corrupt\n", ring);
+			exit(1);
+		}
+		if(nRead < recs && !shmringWait(pRing, 1000)) {
+			if(++waited > timeout) {
+				fprintf(stderr, "shmring_reader: timeout, only %d records read\n", nRead);
+				exit(1);
+			}
+		} else {
+			waited = 0;
+		}
+	}
+	fprintf(stderr, "shmring_reader: %d records read, %llu dropped\n", nRead,
+		(unsigned long long) shmringGetDrops(pRing));
+	shmringClose(pRing);
+	return 0;
+}
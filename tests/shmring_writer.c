@@ -0,0 +1,123 @@
+/* A testing tool that writes a number of messages into a
+ * shared memory ring (as created by imshmring).
+ *
+ * Options
+ *
+ * -r name of ring file (required)
+ * -m number of messages to generate (default 500)
+ * -t number of writer threads sharing the ring (default 1)
+ * -d drop messages if the ring is full (default: retry)
+ *
+ * Messages are numbered "msgnum:%08d:", with each thread writing an
+ * interleaved share of the numbers, so the usual seq-check works.
+ *
+ * Part of the testbench for rsyslog.
+ *
+ * This file is part of rsyslog.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "libshmring.h"
+
+static shmring_t *pRing;
+static int msgs = 500;
+static int nThrds = 1;
+static int bDrop = 0;
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: shmring_writer -r ring [-m num-messages] [-t threads] [-d]\n");
+	exit(1);
+}
+
+
+static void *
+writer(void *arg)
+{
+	const int thrd = (int) (long) arg;
+	char buf[128];
+	int len;
+	int r;
+	int i;
+
+	for(i = thrd ; i < msgs ; i += nThrds) {
+		len = snprintf(buf, sizeof(buf), "<167>Mar  1 01:00:00 172.20.245.8 tag msgnum:%8.8d:", i);
+		while((r = shmringWrite(pRing, buf, len)) == SHMRING_ERR_FULL && !bDrop)
+			usleep(1000);
+		if(r == SHMRING_ERR_FULL) {
+			shmringAddDrops(pRing, 1);
+		} else if(r != SHMRING_OK) {
+			fprintf(stderr, "shmring_writer: error %d writing record\n", r);
+			exit(1);
+		}
+	}
+	return NULL;
+}
+
+
+int main(int argc, char *argv[])
+{
+	pthread_t *thrds;
+	char *ring = NULL;
+	int opt;
+	int r;
+	int i;
+
+	while((opt = getopt(argc, argv, "r:m:t:d")) != -1) {
+		switch (opt) {
+		case 'r':	ring = optarg;
+				break;
+		case 'm':	msgs = atoi(optarg);
+				break;
+		case 't':	nThrds = atoi(optarg);
+				break;
+		case 'd':	bDrop = 1;
+				break;
+		default:	usage();
+				break;
+		}
+	}
+	if(ring == NULL || nThrds < 1)
+		usage();
+
+	if((r = shmringOpen(&pRing, ring)) != SHMRING_OK) {
+		fprintf(stderr, "shmring_writer: could not open ring '%s', error %d\n", ring, r);
+		exit(1);
+	}
+	if((thrds = calloc(nThrds, sizeof(pthread_t))) == NULL) {
+		perror("calloc");
+		exit(1);
+	}
+	for(i = 0 ; i < nThrds ; ++i) {
+		if(pthread_create(&thrds[i], NULL, writer, (void*) (long) i) != 0) {
+			perror("pthread_create");
+			exit(1);
+		}
+	}
+	for(i = 0 ; i < nThrds ; ++i)
+		pthread_join(thrds[i], NULL);
+	if(bDrop)
+		printf("%llu messages dropped\n", (unsigned long long) shmringGetDrops(pRing));
+	shmringClose(pRing);
+	free(thrds);
+	return 0;
+}
@@ -0,0 +1,25 @@
+#!/bin/bash
+# check that messages handed over from the TCP session receive chunks
+# (instead of being copied) keep their content intact, with a mix of
+# small (copied) and large (chunk-based) messages
+# released under ASL 2.0
+. $srcdir/diag.sh init
+. $srcdir/diag.sh generate-conf
+. $srcdir/diag.sh add-conf '
+global(maxMessageSize="4k")
+module(load="../plugins/imptcp/.libs/imptcp")
+module(load="../plugins/imtcp/.libs/imtcp")
+input(type="imptcp" port="13514")
+input(type="imtcp" port="13515")
+
+template(name="outfmt" type="string" string="%msg:F,58:2%,%msg:F,58:3%,%msg:F,58:4%\n")
+:msg, contains, "msgnum:" action(type="omfile" template="outfmt"
+			         file="rsyslog.out.log")
+'
+. $srcdir/diag.sh startup
+. $srcdir/diag.sh tcpflood -p13514 -c5 -m10000 -r -d3000
+. $srcdir/diag.sh tcpflood -p13515 -c5 -m10000 -i10000 -r -d3000
+. $srcdir/diag.sh shutdown-when-empty
+. $srcdir/diag.sh wait-shutdown
+. $srcdir/diag.sh seq-check 0 19999 -E
+. $srcdir/diag.sh exit
@@ -664,6 +664,16 @@ int sendMessages(struct instdata *inst)
 			}
 		}
 		if(inst->numSent % batchsize == 0) {
+			if(transport == TP_TLS && offsSendBuf != 0 && waittime > 0) {
+				/* the batch must be on the wire before we go idle */
+				lenSend = sendTLS(socknum, sendBuf, offsSendBuf);
+				if(lenSend != offsSendBuf) {
+					fprintf(stderr, "tcpflood: error in send function causes potential data loss "
+					"lenSend %d, offsSendBuf %d\n",
+					lenSend, offsSendBuf);
+				}
+				offsSendBuf = 0;
+			}
 			usleep(waittime);
 		}
 		++msgNum;
@@ -0,0 +1,56 @@
+#!/bin/bash
+# check the timestamp formatters, which use a per-thread cache: within
+# the same second only the fractional seconds are patched into the cached
+# string. We vary the fractional seconds, their precision, the timezone
+# offset and (every 500 messages) the second, and compare all results
+# against the expected values.
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[timestamp-format-cache.sh\]: check cached timestamp formatting
+. $srcdir/diag.sh init
+# mode 0: 6 digit secfrac, +02:00; mode 1: 3 digit secfrac, Z; mode 2: no secfrac, -05:30
+awk 'BEGIN {
+	for(i = 0 ; i < 10000 ; ++i) {
+		sec = int(i / 500) % 60;
+		mode = i % 3;
+		if(mode == 0) {
+			frac = sprintf("%06d", (i * 7919) % 1000000); sf = "." frac; tz = "+02:00";
+			ut = 1046480400 - 7200 + sec;
+		} else if(mode == 1) {
+			frac = sprintf("%03d", i % 1000); sf = "." frac; tz = "Z";
+			ut = 1046480400 + sec;
+		} else {
+			frac = "0"; sf = ""; tz = "-05:30";
+			ut = 1046480400 + 19800 + sec;
+		}
+		ts = sprintf("2003-03-01T01:00:%02d%s%s", sec, sf, tz);
+		printf("<165>1 %s host app - - - msgnum:%08d:\n", ts, i) > "rsyslog.input";
+		printf("%08d %s|Mar  1 01:00:%02d|%d|%s\n", i, ts, sec, ut, frac) > "rsyslog.expected";
+	}
+}'
+. $srcdir/diag.sh generate-conf
+. $srcdir/diag.sh add-conf '
+module(load="../plugins/imtcp/.libs/imtcp")
+input(type="imtcp" port="13514")
+
+template(name="outfmt" type="string" string="%msg:F,58:2%\n")
+template(name="tsfmt" type="string"
+	 string="%msg:F,58:2% %timereported:::date-rfc3339%|%timereported:::date-rfc3164%|%timereported:::date-unixtimestamp%|%timereported:::date-subseconds%\n")
+:msg, contains, "msgnum:" {
+	action(type="omfile" template="outfmt" file="rsyslog.out.log")
+	action(type="omfile" template="tsfmt" file="rsyslog2.out.log")
+}
+'
+. $srcdir/diag.sh startup
+. $srcdir/diag.sh tcpflood -I rsyslog.input
+. $srcdir/diag.sh shutdown-when-empty
+. $srcdir/diag.sh wait-shutdown
+. $srcdir/diag.sh seq-check 0 9999
+sort rsyslog2.out.log > rsyslog2.out.sorted
+if ! cmp -s rsyslog.expected rsyslog2.out.sorted; then
+  echo "unexpected timestamp values, first differences:"
+  diff rsyslog.expected rsyslog2.out.sorted | head -20
+  exit 1
+fi;
+rm -f rsyslog.input rsyslog.expected rsyslog2.out.sorted
+. $srcdir/diag.sh exit
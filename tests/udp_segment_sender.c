@@ -0,0 +1,136 @@
+/* A testing tool that sends syslog messages via UDP with generic
+ * segmentation offload (UDP_SEGMENT): each sendmsg() call passes a number
+ * of equally sized messages, which the kernel hands to a receiver with
+ * UDP_GRO enabled as a single coalesced datagram.
+ *
+ * Options
+ *
+ * -t target address (default 127.0.0.1)
+ * -p target port (default 13514)
+ * -m number of messages to send (default 200)
+ * -s number of messages (segments) per datagram (default 10)
+ *
+ * Messages are numbered "msgnum:%08d:", so the usual seq-check works.
+ * The time window in which all messages were sent is written to stdout
+ * as "<start> <end>", both in seconds since the epoch with microseconds.
+ * Exits with 77 (test skipped) if UDP_SEGMENT is not supported.
+ *
+ * Part of the testbench for rsyslog.
+ *
+ * This file is part of rsyslog.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <arpa/inet.h>
+
+#define MSG_LEN 54	/* all segments but the last one must have the same size */
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: udp_segment_sender [-t target] [-p port] [-m num-messages] "
+		"[-s segments-per-datagram]\n");
+	exit(1);
+}
+
+
+int main(int argc, char *argv[])
+{
+#ifdef UDP_SEGMENT
+	struct sockaddr_in rcvr;
+	struct timeval tvStart, tvEnd;
+	char *target = "127.0.0.1";
+	char *buf;
+	char msg[MSG_LEN + 1];
+	int port = 13514;
+	int msgs = 200;
+	int nSegs = 10;
+	int gsoSize = MSG_LEN;
+	int sock;
+	int opt;
+	int n;
+	int i;
+
+	while((opt = getopt(argc, argv, "t:p:m:s:")) != -1) {
+		switch (opt) {
+		case 't':	target = optarg;
+				break;
+		case 'p':	port = atoi(optarg);
+				break;
+		case 'm':	msgs = atoi(optarg);
+				break;
+		case 's':	nSegs = atoi(optarg);
+				break;
+		default:	usage();
+				break;
+		}
+	}
+	if(nSegs < 1 || nSegs > 64)
+		usage();
+
+	memset(&rcvr, 0, sizeof(rcvr));
+	rcvr.sin_family = AF_INET;
+	rcvr.sin_port = htons(port);
+	if(inet_aton(target, &rcvr.sin_addr) == 0) {
+		fprintf(stderr, "udp_segment_sender: invalid target address '%s'\n", target);
+		exit(1);
+	}
+	if((sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) == -1) {
+		perror("socket");
+		exit(1);
+	}
+	if(setsockopt(sock, IPPROTO_UDP, UDP_SEGMENT, &gsoSize, sizeof(gsoSize)) != 0) {
+		fprintf(stderr, "udp_segment_sender: UDP_SEGMENT not supported: %s\n", strerror(errno));
+		exit(77);
+	}
+	if((buf = malloc(nSegs * MSG_LEN)) == NULL) {
+		perror("malloc");
+		exit(1);
+	}
+
+	gettimeofday(&tvStart, NULL);
+	for(i = 0 ; i < msgs ; ) {
+		for(n = 0 ; n < nSegs && i < msgs ; ++n, ++i) {
+			snprintf(msg, sizeof(msg), "<167>Mar  1 01:00:00 172.20.245.8 tag msgnum:%8.8d:", i);
+			memcpy(buf + n * MSG_LEN, msg, MSG_LEN);
+		}
+		if(sendto(sock, buf, n * MSG_LEN, 0, (struct sockaddr*) &rcvr, sizeof(rcvr))
+		   != n * MSG_LEN) {
+			perror("sendto");
+			exit(1);
+		}
+	}
+	gettimeofday(&tvEnd, NULL);
+	printf("%ld.%6.6ld %ld.%6.6ld\n", (long) tvStart.tv_sec, (long) tvStart.tv_usec,
+		(long) tvEnd.tv_sec, (long) tvEnd.tv_usec);
+
+	free(buf);
+	close(sock);
+	return 0;
+#else
+	fprintf(stderr, "udp_segment_sender: UDP_SEGMENT not available on this platform\n");
+	exit(77);
+#endif
+}
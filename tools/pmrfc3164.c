@@ -156,9 +156,8 @@ ENDfreeParserInst
 BEGINparse2
 	uchar *p2parse;
 	int lenMsg;
+	uchar *pTAG;
 	int i;	/* general index for parsing */
-	uchar bufParseTAG[CONF_TAG_MAXSIZE];
-	uchar bufParseHOSTNAME[CONF_HOSTNAME_MAXSIZE];
 CODESTARTparse
 	DBGPRINTF("Message will now be parsed by the legacy syslog parser (one size fits all... ;)).\n");
 	assert(pMsg != NULL);
@@ -232,7 +231,6 @@ CODESTARTparse
 			if(pInst->bPermitSquareBracketsInHostname) {
 				if(i < lenMsg && p2parse[i] == '[') {
 					bHadSBracket = 1;
-					bufParseHOSTNAME[0] = '[';
 					++i;
 				}
 			}
@@ -241,7 +239,6 @@ CODESTARTparse
 					|| p2parse[i] == '_' || p2parse[i] == '-'
 					|| (p2parse[i] == ']' && bHadSBracket) )
 				&& i < (CONF_HOSTNAME_MAXSIZE - 1)) {
-				bufParseHOSTNAME[i] = p2parse[i];
 				++i;
 				if(p2parse[i] == ']')
 					break;	/* must be closing bracket */
@@ -251,16 +248,14 @@ CODESTARTparse
 				/* we have a message that is empty immediately after the hostname,
 				* but the hostname thus is valid! -- rgerhards, 2010-02-22
 				*/
+				MsgSetHOSTNAME(pMsg, p2parse, i);
 				p2parse += i;
 				lenMsg -= i;
-				bufParseHOSTNAME[i] = '\0';
-				MsgSetHOSTNAME(pMsg, bufParseHOSTNAME, i);
 			} else {
 				int isHostName = 0;
 				if(i > 0) {
 					if(bHadSBracket) {
 						if(p2parse[i] == ']') {
-							bufParseHOSTNAME[i] = ']';
 							++i;
 							isHostName = 1;
 						}
@@ -274,11 +269,12 @@ CODESTARTparse
 				}
 
 				if(isHostName) {
-					/* we got a hostname! */
+					/* we got a hostname! Note that the hostname is taken
+					 * directly from the raw message, no copy is needed.
+					 */
+					MsgSetHOSTNAME(pMsg, p2parse, i);
 					p2parse += i + 1; /* "eat" it (including SP delimiter) */
 					lenMsg -= i + 1;
-					bufParseHOSTNAME[i] = '\0';
-					MsgSetHOSTNAME(pMsg, bufParseHOSTNAME, i);
 				}
 			}
 		}
@@ -296,22 +292,23 @@ CODESTARTparse
 		 * in RFC3164...). We now receive the full size, but will modify the
 		 * outputs so that only 32 characters max are used by default.
 		 */
+		pTAG = p2parse;
 		i = 0;
 		while(lenMsg > 0 && *p2parse != ':' && *p2parse != ' ' && i < CONF_TAG_MAXSIZE - 2) {
-			bufParseTAG[i++] = *p2parse++;
+			++p2parse;
+			++i;
 			--lenMsg;
 		}
 		if(lenMsg > 0 && *p2parse == ':') {
 			++p2parse; 
 			--lenMsg;
-			bufParseTAG[i++] = ':';
+			++i;
 		}
 
 		/* no TAG can only be detected if the message immediatly ends, in which case an empty TAG
 		 * is considered OK. So we do not need to check for empty TAG. -- rgerhards, 2009-06-23
 		 */
-		bufParseTAG[i] = '\0';	/* terminate string */
-		MsgSetTAG(pMsg, bufParseTAG, i);
+		MsgSetTAG(pMsg, pTAG, i);
 	} else {/* we enter this code area when the user has instructed rsyslog NOT
 		 * to parse HOSTNAME and TAG - rgerhards, 2006-03-13
 		 */
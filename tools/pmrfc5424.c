@@ -68,40 +68,42 @@ ENDisCompatibleWithFeature
 
 
 /* Helper to parseRFCSyslogMsg. This function parses a field up to
- * (and including) the SP character after it. The field contents is
- * returned in a caller-provided buffer. The parsepointer is advanced
- * to after the terminating SP. The caller must ensure that the 
- * provided buffer is large enough to hold the to be extracted value.
+ * (and including) the SP character after it. The field is NOT copied.
+ * Instead, a pointer to its start inside the message and its length
+ * are returned, so the caller can hand it directly to the msg setters.
+ * The parsepointer is advanced to after the terminating SP.
  * Returns 0 if everything is fine or 1 if either the field is not
  * SP-terminated or any other error occurs. -- rger, 2005-11-24
  * The function now receives the size of the string and makes sure
  * that it does not process more than that. The *pLenStr counter is
  * updated on exit. -- rgerhards, 2009-09-23
+ * The SP is now searched via memchr(), which libc implements with
+ * wide (SIMD) compares.
  */
-static int parseRFCField(uchar **pp2parse, uchar *pResult, int *pLenStr)
+static int parseRFCField(uchar **pp2parse, uchar **ppField, int *pLenField, int *pLenStr)
 {
 	uchar *p2parse;
+	uchar *pSP;
 	int iRet = 0;
 
 	assert(pp2parse != NULL);
 	assert(*pp2parse != NULL);
-	assert(pResult != NULL);
+	assert(ppField != NULL);
 
 	p2parse = *pp2parse;
+	*ppField = p2parse;
 
-	/* this is the actual parsing loop */
-	while(*pLenStr > 0  && *p2parse != ' ') {
-		*pResult++ = *p2parse++;
-		--(*pLenStr);
-	}
-
-	if(*pLenStr > 0 && *p2parse == ' ') {
-		++p2parse; /* eat SP, but only if not at end of string */
-		--(*pLenStr);
-	} else {
+	pSP = (*pLenStr > 0) ? memchr(p2parse, ' ', *pLenStr) : NULL;
+	if(pSP == NULL) {
 		iRet = 1; /* there MUST be an SP! */
+		*pLenField = *pLenStr;
+		*pLenStr = 0;
+		p2parse += *pLenField;
+	} else {
+		*pLenField = pSP - p2parse;
+		*pLenStr -= *pLenField + 1; /* also eat SP */
+		p2parse = pSP + 1;
 	}
-	*pResult = '\0';
 
 	/* set the new parse pointer */
 	*pp2parse = p2parse;
@@ -112,84 +114,89 @@ static int parseRFCField(uchar **pp2parse, uchar *pResult, int *pLenStr)
 /* Helper to parseRFCSyslogMsg. This function parses the structured
  * data field of a message. It does NOT parse inside structured data,
  * just gets the field as whole. Parsing the single entities is left
- * to other functions. The parsepointer is advanced
- * to after the terminating SP. The caller must ensure that the 
- * provided buffer is large enough to hold the to be extracted value.
+ * to other functions. As with parseRFCField(), the field is not copied
+ * but returned as pointer and length into the message. The parsepointer
+ * is advanced to after the terminating SP.
  * Returns 0 if everything is fine or 1 if either the field is not
  * SP-terminated or any other error occurs. -- rger, 2005-11-24
  * The function now receives the size of the string and makes sure
  * that it does not process more than that. The *pLenStr counter is
  * updated on exit. -- rgerhards, 2009-09-23
  */
-static int parseRFCStructuredData(uchar **pp2parse, uchar *pResult, int *pLenStr)
+static int parseRFCStructuredData(uchar **pp2parse, uchar **ppField, int *pLenField, int *pLenStr)
 {
 	uchar *p2parse;
-	int bCont = 1;
+	uchar *pEnd;
+	uchar *pBracket;
 	int iRet = 0;
-	int lenStr;
 
 	assert(pp2parse != NULL);
 	assert(*pp2parse != NULL);
-	assert(pResult != NULL);
+	assert(ppField != NULL);
 
 	p2parse = *pp2parse;
-	lenStr = *pLenStr;
+	pEnd = p2parse + *pLenStr;
+	*ppField = p2parse;
 
-	/* this is the actual parsing loop
-	 * Remeber: structured data starts with [ and includes any characters
+	/* Remeber: structured data starts with [ and includes any characters
 	 * until the first ] followed by a SP. There may be spaces inside
 	 * structured data. There may also be \] inside the structured data, which
-	 * do NOT terminate an element.
+	 * do NOT terminate an element. We only need to look at the ] chars, so
+	 * we hop from one to the next via memchr().
 	 */
-	if(lenStr == 0 || (*p2parse != '[' && *p2parse != '-'))
+	if(*pLenStr == 0 || (*p2parse != '[' && *p2parse != '-')) {
+		*pLenField = 0;
 		return 1; /* this is NOT structured data! */
+	}
 
 	if(*p2parse == '-') { /* empty structured data? */
-		*pResult++ = '-';
+		*pLenField = 1;
 		++p2parse;
-		--lenStr;
 	} else {
-		while(bCont) {
-			if(lenStr < 2) {
-				/* we now need to check if we have only structured data */
-				if(lenStr > 0 && *p2parse == ']') {
-					*pResult++ = *p2parse;
-					p2parse++;
-					lenStr--;
-					bCont = 0;
+		pBracket = p2parse;
+		while(1) {
+			pBracket = memchr(pBracket + 1, ']', pEnd - (pBracket + 1));
+			if(pBracket == NULL) {
+				/* no end found. As with the old char-by-char loop, the last
+				 * char is not part of the SD, except if it completes an
+				 * escape sequence.
+				 */
+				iRet = 1; /* this is not valid! */
+				if(pEnd[-1] == ']') {
+					*pLenField = pEnd - p2parse;
+					p2parse = pEnd;
 				} else {
-					iRet = 1; /* this is not valid! */
-					bCont = 0;
+					*pLenField = pEnd - 1 - p2parse;
+					p2parse = pEnd - 1;
 				}
-			} else if(*p2parse == '\\' && *(p2parse+1) == ']') {
-				/* this is escaped, need to copy both */
-				*pResult++ = *p2parse++;
-				*pResult++ = *p2parse++;
-				lenStr -= 2;
-			} else if(*p2parse == ']' && *(p2parse+1) == ' ') {
-				/* found end, just need to copy the ] and eat the SP */
-				*pResult++ = *p2parse;
-				p2parse += 2;
-				lenStr -= 2;
-				bCont = 0;
-			} else {
-				*pResult++ = *p2parse++;
-				--lenStr;
+				break;
+			}
+			if(pBracket[-1] == '\\')
+				continue; /* escaped */
+			if(pBracket + 1 == pEnd) {
+				/* we have only structured data */
+				*pLenField = pEnd - p2parse;
+				p2parse = pEnd;
+				break;
+			}
+			if(pBracket[1] == ' ') {
+				/* found end, need to eat the SP */
+				*pLenField = pBracket + 1 - p2parse;
+				p2parse = pBracket + 2;
+				break;
 			}
 		}
 	}
 
-	if(lenStr > 0 && *p2parse == ' ') {
+	if(p2parse < pEnd && *p2parse == ' ') {
 		++p2parse; /* eat SP, but only if not at end of string */
-		--lenStr;
 	} else {
 		iRet = 1; /* there MUST be an SP! */
 	}
-	*pResult = '\0';
 
 	/* set the new parse pointer */
+	*pLenStr = pEnd - p2parse;
 	*pp2parse = p2parse;
-	*pLenStr = lenStr;
 	return iRet;
 }
 
@@ -212,7 +219,8 @@ static int parseRFCStructuredData(uchar **pp2parse, uchar *pResult, int *pLenStr
  */
 BEGINparse
 	uchar *p2parse;
-	uchar *pBuf = NULL;
+	uchar *pField;
+	int lenField;
 	int lenMsg;
 	int bContParse = 1;
 CODESTARTparse
@@ -230,13 +238,11 @@ CODESTARTparse
 	p2parse += 2;
 	lenMsg -= 2;
 
-	/* Now get us some memory we can use as a work buffer while parsing.
-	 * We simply allocated a buffer sufficiently large to hold all of the
-	 * message, so we can not run into any troubles. I think this is
-	 * wiser than to use individual buffers.
+	/* Note: there is no work buffer. All header fields are passed to the
+	 * msg setters directly from the raw message, which means each field
+	 * is scanned exactly once and copied at most once.
 	 */
-	CHKmalloc(pBuf = MALLOC(lenMsg + 1));
-		
+
 	/* IMPORTANT NOTE:
 	 * Validation is not actually done below nor are any errors handled. I have
 	 * NOT included this for the current proof of concept. However, it is strongly
@@ -261,40 +267,38 @@ CODESTARTparse
 
 	/* HOSTNAME */
 	if(bContParse) {
-		parseRFCField(&p2parse, pBuf, &lenMsg);
-		MsgSetHOSTNAME(pMsg, pBuf, ustrlen(pBuf));
+		parseRFCField(&p2parse, &pField, &lenField, &lenMsg);
+		MsgSetHOSTNAME(pMsg, pField, lenField);
 	}
 
 	/* APP-NAME */
 	if(bContParse) {
-		parseRFCField(&p2parse, pBuf, &lenMsg);
-		MsgSetAPPNAME(pMsg, (char*)pBuf);
+		parseRFCField(&p2parse, &pField, &lenField, &lenMsg);
+		MsgSetAPPNAMEWithLen(pMsg, pField, lenField);
 	}
 
 	/* PROCID */
 	if(bContParse) {
-		parseRFCField(&p2parse, pBuf, &lenMsg);
-		MsgSetPROCID(pMsg, (char*)pBuf);
+		parseRFCField(&p2parse, &pField, &lenField, &lenMsg);
+		MsgSetPROCIDWithLen(pMsg, pField, lenField);
 	}
 
 	/* MSGID */
 	if(bContParse) {
-		parseRFCField(&p2parse, pBuf, &lenMsg);
-		MsgSetMSGID(pMsg, (char*)pBuf);
+		parseRFCField(&p2parse, &pField, &lenField, &lenMsg);
+		MsgSetMSGIDWithLen(pMsg, pField, lenField);
 	}
 
 	/* STRUCTURED-DATA */
 	if(bContParse) {
-		parseRFCStructuredData(&p2parse, pBuf, &lenMsg);
-		MsgSetStructuredData(pMsg, (char*)pBuf);
+		parseRFCStructuredData(&p2parse, &pField, &lenField, &lenMsg);
+		MsgSetStructuredDataWithLen(pMsg, pField, lenField);
 	}
 
 	/* MSG */
 	MsgSetMSGoffs(pMsg, p2parse - pMsg->pszRawMsg);
 
 finalize_it:
-	if(pBuf != NULL)
-		free(pBuf);
 ENDparse
 
 
@@ -58,6 +58,7 @@
 #include "datetime.h"
 #include "dirty.h"
 #include "janitor.h"
+#include "msgtrace.h"
 
 DEFobjCurrIf(obj)
 DEFobjCurrIf(prop)
@@ -498,6 +499,7 @@ rsyslogd_InitGlobalClasses(void)
 	CHKiRet(objUse(net, LM_NET_FILENAME));
 
 	dnscacheInit();
+	msgtraceInit();
 	initRainerscript();
 	ratelimitModInit();
 
@@ -840,6 +842,7 @@ submitMsg2(msg_t *pMsg)
 		FINALIZE;
 	}
 
+	msgtraceSample(pMsg);
 	qqueueEnqMsg(pQueue, pMsg->flowCtlType, pMsg);
 
 finalize_it:
@@ -871,6 +874,7 @@ multiSubmitMsg2(multi_submit_t *pMultiSub)
 		FINALIZE;
 	}
 
+	msgtraceSampleBatch(pMultiSub->ppMsgs, pMultiSub->nElem);
 	iRet = pQueue->MultiEnq(pQueue, pMultiSub);
 	pMultiSub->nElem = 0;
 
@@ -1621,6 +1625,7 @@ deinitAll(void)
 	rsconfClassExit();
 	strExit();
 	ratelimitModExit();
+	msgtraceExit();
 	dnscacheDeinit();
 	thrdExit();
 	objRelease(net, LM_NET_FILENAME);